@@ -14,6 +14,13 @@ ISRS_GEN_C=$1
 ISRS_GEN_ASM=$2
 
 ISRS_WITH_ERROR_CODE="8 10 11 12 13 14 17 21"
+ISRS_USER_CALLABLE="128"
+
+# PIC lines get their own entry stubs, see IRQ_FAST in isr_asm.asm
+IRQ_BASE=32
+IRQ_COUNT=16
+# Same stub without the EOI, for timing it, see IRQ_TEST
+IRQ_TEST_VECTOR=130
 
 
 #
@@ -33,7 +40,12 @@ echo "void i686_ISR_InitializeGates()" >> $ISRS_GEN_C
 echo "{" >> $ISRS_GEN_C
 
 for i in $(seq 0 255); do
-    echo "    i686_IDT_SetGate(${i}, i686_ISR${i}, i686_GDT_CODE_SEGMENT, IDT_FLAG_RING0 | IDT_FLAG_GATE_32BIT_INT);" >> $ISRS_GEN_C
+    if echo "$ISRS_USER_CALLABLE" | grep -q "\b${i}\b"; then
+        RING=IDT_FLAG_RING3
+    else
+        RING=IDT_FLAG_RING0
+    fi
+    echo "    i686_IDT_SetGate(${i}, i686_ISR${i}, i686_GDT_CODE_SEGMENT, ${RING} | IDT_FLAG_GATE_32BIT_INT);" >> $ISRS_GEN_C
 done
 
 
@@ -45,7 +57,11 @@ echo "}" >> $ISRS_GEN_C
 echo "; !!! THIS FILE IS AUTOGENERATED !!!" > $ISRS_GEN_ASM
 
 for i in $(seq 0 255); do
-    if echo "$ISRS_WITH_ERROR_CODE" | grep -q "\b${i}\b"; then
+    if [ $i -ge $IRQ_BASE ] && [ $i -lt $((IRQ_BASE + IRQ_COUNT)) ]; then
+        echo "IRQ_FAST ${i} $((i - IRQ_BASE))" >> $ISRS_GEN_ASM
+    elif [ $i -eq $IRQ_TEST_VECTOR ]; then
+        echo "IRQ_TEST ${i}" >> $ISRS_GEN_ASM
+    elif echo "$ISRS_WITH_ERROR_CODE" | grep -q "\b${i}\b"; then
         echo "ISR_ERRORCODE ${i}" >> $ISRS_GEN_ASM
     else
         echo "ISR_NOERRORCODE ${i}" >> $ISRS_GEN_ASM
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ACPI_MAX_CPUS           16
+#define ACPI_MAX_IOAPICS        4
+#define ACPI_ISA_IRQS           16
+
+// Polarity and trigger of an interrupt source override (MPS INTI flags)
+#define ACPI_IRQ_POLARITY_MASK  0x3
+#define ACPI_IRQ_ACTIVE_LOW     0x3
+#define ACPI_IRQ_TRIGGER_MASK   0xC
+#define ACPI_IRQ_LEVEL          0xC
+
+typedef struct {
+    char Signature[4];
+    uint32_t Length;                    // including this header
+    uint8_t Revision;
+    uint8_t Checksum;
+    char OemId[6];
+    char OemTableId[8];
+    uint32_t OemRevision;
+    uint32_t CreatorId;
+    uint32_t CreatorRevision;
+} __attribute__((packed)) AcpiTableHeader;
+
+typedef struct {
+    uint8_t Id;
+    uint32_t Address;
+    uint32_t GsiBase;                   // first global system interrupt it handles
+} AcpiIoApic;
+
+// What the MADT says about the interrupt controllers
+typedef struct {
+    uint32_t LocalApicAddress;
+    bool LegacyPics;                    // the 8259s are wired up as well
+    uint32_t CpuCount;
+    uint8_t CpuApicIds[ACPI_MAX_CPUS];  // enabled processors, in table order
+    uint32_t IoApicCount;
+    AcpiIoApic IoApics[ACPI_MAX_IOAPICS];
+    uint32_t IsaGsi[ACPI_ISA_IRQS];     // where each ISA IRQ arrives, after overrides
+    uint16_t IsaFlags[ACPI_ISA_IRQS];   // ACPI_IRQ_* of it, 0 for the ISA default (edge, high)
+} AcpiMadt;
+
+// Finds the root table, false when the firmware has no ACPI. Tables are read
+// through the identity map, so ones above PMM_MAX_MEMORY are left out.
+bool acpi_init(void);
+const AcpiTableHeader* acpi_find_table(const char* signature);
+const AcpiMadt* acpi_get_madt(void);    // NULL without a MADT
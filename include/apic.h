@@ -0,0 +1,19 @@
+#pragma once
+
+#include <pic.h>
+
+// Local APIC with the I/O APICs found in the MADT, probes false without ACPI
+const PICDriver* apic_GetDriver();
+
+// Whether the driver was chosen, the rest needs it
+bool apic_IsActive();
+uint8_t apic_GetLocalId();
+// Enables the calling CPU's local APIC, the boot CPU's is done by the driver
+void apic_InitializeCpu();
+// For interrupts that come through the ISR table (IPIs), the IRQ stubs send their own
+void apic_EndOfInterrupt();
+
+void apic_SendIpi(uint8_t apicId, uint8_t vector);
+// The INIT, then startup at a page aligned address below 1MB, that starts an AP
+void apic_SendInit(uint8_t apicId);
+void apic_SendStartup(uint8_t apicId, uint32_t address);
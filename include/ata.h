@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Legacy PIIX IDE channels
+#define ATA_PRIMARY_IO          0x1F0
+#define ATA_PRIMARY_CONTROL     0x3F6
+#define ATA_SECONDARY_IO        0x170
+#define ATA_SECONDARY_CONTROL   0x376
+
+#define ATA_IRQ_PRIMARY         14
+#define ATA_IRQ_SECONDARY       15
+
+#define ATA_MAX_DRIVES          4
+#define ATA_SECTOR_SIZE         512
+#define ATA_DMA_MAX_SECTORS     2048            // per DMA command (1MB)
+
+typedef struct {
+    bool Present;
+    uint8_t Channel;                // 0 = primary, 1 = secondary
+    uint8_t Slave;                  // 0 = master, 1 = slave
+    uint16_t IoBase;
+    uint16_t ControlBase;
+    bool Lba48;
+    uint16_t MultipleSectors;       // sectors per DRQ block (1 when READ/WRITE MULTIPLE is unavailable)
+    uint64_t SectorCount;
+    bool DmaCapable;                // drive and controller support bus-master DMA
+    bool UseDma;                    // transfer mode used by ata_read/write_sectors
+    char Model[41];
+} ATADrive;
+
+// Called from the IRQ 14/15 handler when a DMA command finishes
+typedef void (*ATACompletion)(ATADrive* drive, bool success, void* context);
+
+// One piece of a scatter-gather transfer, the pieces cover consecutive sectors
+typedef struct {
+    void* Buffer;
+    uint32_t Count;
+} ATASegment;
+
+// Public functions
+void ata_init(void);
+int ata_get_drive_count(void);
+ATADrive* ata_get_drive(int index);
+
+bool ata_read_sectors(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer);
+bool ata_write_sectors(ATADrive* drive, uint64_t lba, uint32_t count, const void* buffer);
+bool ata_flush(ATADrive* drive);
+
+// Starts a DMA transfer and returns without waiting. The buffer must be word aligned and
+// physically contiguous, count at most ATA_DMA_MAX_SECTORS. Fails if the channel is busy.
+bool ata_submit(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write,
+                ATACompletion completion, void* context);
+bool ata_submit_sg(ATADrive* drive, uint64_t lba, const ATASegment* segments, int segmentCount,
+                   bool write, ATACompletion completion, void* context);
+bool ata_channel_busy(ATADrive* drive);
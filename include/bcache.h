@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <blockdev.h>
+#include <blkq.h>
+
+#define BCACHE_BLOCK_SIZE       512
+#define BCACHE_BUFFER_COUNT     1024        // 512KB of cached blocks
+#define BCACHE_WRITEBACK_MS     5000        // dirty blocks older than this are written back
+
+// Buffer flags
+#define BUFFER_VALID            0x01
+#define BUFFER_DIRTY            0x02
+#define BUFFER_READAHEAD        0x04        // loaded by read-ahead, not requested yet
+#define BUFFER_IO               0x08        // request in flight, wait on Request before use
+
+typedef struct Buffer {
+    BlockDev* Device;
+    uint64_t Lba;
+    uint8_t* Data;
+    uint32_t Flags;
+    uint32_t RefCount;
+    uint64_t DirtySince;                    // tick when the block was first dirtied
+    struct Buffer* HashNext;
+    struct Buffer* LruPrev;                 // most recently used at the head
+    struct Buffer* LruNext;
+    BlockRequest Request;
+} Buffer;
+
+typedef struct {
+    uint32_t Lookups;
+    uint32_t Hits;
+    uint32_t Misses;
+    uint32_t Evictions;
+    uint32_t DirtyEvictions;                // evicted blocks that had to be written first
+    uint32_t Flushes;                       // write-back passes that wrote something
+    uint32_t BlocksWritten;
+    uint32_t ReadAheadBlocks;
+    uint32_t ReadAheadHits;
+    uint32_t DirtyBlocks;
+    uint32_t CachedBlocks;                  // including blocks still being read
+} BCacheStats;
+
+void bcache_init(void);
+
+// Returns the block with a reference held, reading it from the device if needed
+Buffer* bcache_get(BlockDev* dev, uint64_t lba);
+void bcache_release(Buffer* buffer);
+void bcache_mark_dirty(Buffer* buffer);
+
+// Byte granular helpers on top of bcache_get
+bool bcache_read(BlockDev* dev, uint64_t lba, uint32_t offset, void* data, uint32_t size);
+bool bcache_write(BlockDev* dev, uint64_t lba, uint32_t offset, const void* data, uint32_t size);
+
+bool bcache_sync(BlockDev* dev);            // writes back every dirty block (dev == NULL for all)
+void bcache_invalidate(BlockDev* dev);      // drops clean, unreferenced blocks of dev
+void bcache_periodic_flush(void);           // called from the idle loop
+
+void bcache_get_stats(BCacheStats* stats);
+void bcache_reset_stats(void);
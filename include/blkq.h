@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <blockdev.h>
+
+#define BLKQ_MAX_SEGMENTS       64          // requests merged into one device command
+#define BLKQ_READ_EXPIRE_MS     500         // deadline before a read jumps the elevator
+#define BLKQ_WRITE_EXPIRE_MS    5000
+
+typedef struct BlockRequest BlockRequest;
+
+// Runs in IRQ context for interrupt driven devices
+typedef void (*BlockRequestDone)(BlockRequest* request, bool success);
+
+struct BlockRequest {
+    uint64_t Lba;
+    uint32_t Count;
+    void* Buffer;
+    bool Write;
+    BlockRequestDone Done;                  // optional
+    void* Context;
+    volatile bool Completed;
+    bool Success;
+
+    // Owned by the queue while the request is pending
+    BlockDev* Device;
+    uint64_t Deadline;
+    uint32_t TotalCount;                    // sectors including merged requests
+    uint32_t Segments;
+    BlockRequest* Next;                     // pending list, sorted by LBA
+    BlockRequest* MergeNext;                // requests merged behind this one, in LBA order
+};
+
+typedef struct {
+    uint32_t Submitted;
+    uint32_t BackMerges;
+    uint32_t FrontMerges;
+    uint32_t Dispatched;                    // device commands issued
+    uint32_t Completed;
+    uint32_t Errors;
+    uint32_t Expired;                       // dispatched out of elevator order by their deadline
+    uint32_t Depth;                         // requests waiting right now
+    uint32_t MaxDepth;
+    uint64_t DepthSum;                      // Depth sampled at every submit
+} BlockQueueStats;
+
+void blkq_init_device(BlockDev* dev);
+
+// Queues the request and returns, completion is reported through request->Done/Completed
+bool blkq_submit(BlockDev* dev, BlockRequest* request);
+
+// Called by drivers when the command started by BlockDev::Submit finishes
+void blkq_complete(BlockDev* dev, bool success);
+
+// While plugged, requests are only queued (and merged), unplugging dispatches them
+void blkq_plug(BlockDev* dev);
+void blkq_unplug(BlockDev* dev);
+
+// Returns only once the request completed. With interrupts off (syscalls, page faults)
+// the device is polled instead of waiting for its interrupt.
+bool blkq_wait(BlockRequest* request);
+bool blkq_read(BlockDev* dev, uint64_t lba, uint32_t count, void* buffer);
+bool blkq_write(BlockDev* dev, uint64_t lba, uint32_t count, const void* buffer);
+
+bool blkq_get_stats(BlockDev* dev, BlockQueueStats* stats);
+void blkq_reset_stats(BlockDev* dev);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BLOCKDEV_MAX_DEVICES    8
+
+struct BlockRequest;
+struct BlockQueue;
+
+// Kernel side block device, filled in by the disk drivers
+typedef struct BlockDev {
+    const char* Name;
+    uint32_t BlockSize;
+    uint64_t BlockCount;
+    uint32_t MaxSectors;            // largest merged request the device accepts
+    void* Data;                     // driver private
+    bool (*Read)(struct BlockDev* dev, uint64_t lba, uint32_t count, void* buffer);
+    bool (*Write)(struct BlockDev* dev, uint64_t lba, uint32_t count, const void* buffer);
+    bool (*Flush)(struct BlockDev* dev);
+
+    // Optional. Starts a (possibly merged) request and reports the result with blkq_complete(),
+    // devices without it are driven synchronously through Read/Write.
+    bool (*Submit)(struct BlockDev* dev, struct BlockRequest* request);
+    // Required with Submit when completions come from an interrupt. Called with interrupts off,
+    // finishes (or times out) the started command if the device is done with it, as its IRQ would.
+    void (*Poll)(struct BlockDev* dev);
+
+    struct BlockQueue* Queue;       // set up by blockdev_register
+} BlockDev;
+
+bool blockdev_register(BlockDev* dev);
+int blockdev_get_count(void);
+BlockDev* blockdev_get(int index);
+BlockDev* blockdev_find(const char* name);
@@ -1,6 +1,12 @@
 #include <stdio.h>
 
+// The fast boot profile only keeps errors; anything below the minimum level
+// is compiled out, so the format arguments are never evaluated.
+#ifdef FASTBOOT
+#define MIN_LOG_LEVEL LVL_ERROR
+#else
 #define MIN_LOG_LEVEL LVL_DEBUG
+#endif
 
 typedef enum {
     LVL_DEBUG = 0,
@@ -11,8 +17,9 @@ typedef enum {
 } DebugLevel;
 
 void logf(const char* module, DebugLevel level, const char* fmt, ...);
-#define log_debug(module, ...) logf(module, LVL_DEBUG, __VA_ARGS__)
-#define log_info(module, ...) logf(module, LVL_INFO, __VA_ARGS__)
-#define log_warn(module, ...) logf(module, LVL_WARN, __VA_ARGS__)
-#define log_err(module, ...) logf(module, LVL_ERROR, __VA_ARGS__)
-#define log_crit(module, ...) logf(module, LVL_CRITICAL, __VA_ARGS__)
\ No newline at end of file
+#define log_at(module, level, ...) do { if ((level) >= MIN_LOG_LEVEL) logf(module, level, __VA_ARGS__); } while (0)
+#define log_debug(module, ...) log_at(module, LVL_DEBUG, __VA_ARGS__)
+#define log_info(module, ...) log_at(module, LVL_INFO, __VA_ARGS__)
+#define log_warn(module, ...) log_at(module, LVL_WARN, __VA_ARGS__)
+#define log_err(module, ...) log_at(module, LVL_ERROR, __VA_ARGS__)
+#define log_crit(module, ...) log_at(module, LVL_CRITICAL, __VA_ARGS__)
\ No newline at end of file
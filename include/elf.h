@@ -106,5 +106,11 @@ enum ELFProgramType {
     ELF_PROGRAM_TYPE_HIPROC         = 0x7FFFFFFF,
 };
 
+enum ELFProgramFlags {
+    ELF_PROGRAM_FLAG_EXECUTE        = 1,
+    ELF_PROGRAM_FLAG_WRITE          = 2,
+    ELF_PROGRAM_FLAG_READ           = 4,
+};
+
 
 bool ELF_Read(Partition* part, const char* path, void** entryPoint);
\ No newline at end of file
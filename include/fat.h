@@ -21,16 +21,19 @@ typedef struct
 typedef struct 
 {
     uint8_t Order;
-    int16_t Chars1[5];
+    uint16_t Chars1[5];
     uint8_t Attribute;
     uint8_t LongEntryType;
     uint8_t Checksum;
-    int16_t Chars2[6];
+    uint16_t Chars2[6];
     uint16_t _AlwaysZero;
-    int16_t Chars3[2];
+    uint16_t Chars3[2];
 } __attribute__((packed)) FAT_LongFileEntry;
 
 #define FAT_LFN_LAST            0x40
+#define FAT_LFN_ORDER_MASK      0x1F
+#define FAT_LFN_CHARS           13          // UTF-16 characters per LFN entry
+#define FAT_LFN_MAX_ENTRIES     20          // 255 characters
                                     
 typedef struct 
 {
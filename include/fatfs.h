@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <blockdev.h>
+#include <vfs.h>
+
+#define FATFS_MAX_VOLUMES       4
+#define FATFS_MAX_OPEN_FILES    32
+#define FATFS_MAX_NAME          255         // long names, non ASCII characters read as '?'
+
+typedef struct FatVolume FatVolume;
+typedef struct FatFile FatFile;
+
+typedef struct {
+    char Name[FATFS_MAX_NAME + 1];
+    uint32_t Size;
+    bool IsDirectory;
+} FatDirInfo;
+
+// Finds a FAT12/16/32 file system on dev, either on the whole device or in its first
+// FAT partition, and mounts it
+FatVolume* fat_mount(BlockDev* dev);
+bool fat_unmount(FatVolume* volume);        // fails while files are open
+bool fat_sync(FatVolume* volume);           // volume == NULL for all volumes
+uint8_t fat_get_type(FatVolume* volume);    // 12, 16 or 32
+
+// Paths are relative to the volume root. Results are SYSCALL_* codes.
+int fat_open(FatVolume* volume, const char* path, uint32_t flags, FatFile** file);
+void fat_close(FatFile* file);
+int32_t fat_read(FatFile* file, void* buffer, uint32_t count);
+int32_t fat_write(FatFile* file, const void* buffer, uint32_t count);
+int fat_truncate(FatFile* file, uint32_t size);
+int fat_unlink(FatVolume* volume, const char* path);
+
+bool fat_seek(FatFile* file, uint32_t position);
+uint32_t fat_tell(FatFile* file);
+uint32_t fat_get_size(FatFile* file);
+bool fat_is_directory(FatFile* file);
+
+// Returns the next entry of an open directory, false at its end
+bool fat_readdir(FatFile* dir, FatDirInfo* info);
+
+extern VfsFileSystem g_FatFileSystem;
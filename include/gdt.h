@@ -1,6 +1,16 @@
 #pragma once
+#include <stdint.h>
 
 #define i686_GDT_CODE_SEGMENT 0x08
 #define i686_GDT_DATA_SEGMENT 0x10
+#define i686_GDT_USER_CODE_SEGMENT 0x1B   // RPL 3
+#define i686_GDT_USER_DATA_SEGMENT 0x23
+#define i686_GDT_TSS_SEGMENT 0x28
+#define i686_GDT_PERCPU_SEGMENT 0x30        // based at the CPU's own Cpu, kept in gs
 
-void i686_GDT_Initialize();
\ No newline at end of file
+void i686_GDT_Initialize();
+// Gives the calling CPU its own GDT and TSS and points gs at perCpu
+void i686_GDT_InitializeCpu(uint32_t cpu, void* perCpu);
+
+// Stack the CPU switches to when ring 3 is interrupted
+void __attribute__((cdecl)) i686_TSS_SetKernelStack(uint32_t esp0);
\ No newline at end of file
@@ -1,15 +1,42 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 
 void __attribute__((cdecl)) i686_outb(uint16_t port, uint8_t value);
 uint8_t __attribute__((cdecl)) i686_inb(uint16_t port);
 uint8_t __attribute__((cdecl)) i686_EnableInterrupts();
 uint8_t __attribute__((cdecl)) i686_DisableInterrupts();
 
+static inline bool i686_InterruptsEnabled(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+}
+
+// Disables interrupts and returns the previous EFLAGS for i686_RestoreInterrupts
+static inline uint32_t i686_SaveInterrupts(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void i686_RestoreInterrupts(uint32_t flags) {
+    if (flags & 0x200)
+        __asm__ volatile ("sti" : : : "memory");
+}
+
 void __attribute__((cdecl)) i686_hlt(void);
 
 void outb(uint16_t port, uint8_t val);
 uint8_t inb(uint16_t port);
+void outw(uint16_t port, uint16_t val);
+uint16_t inw(uint16_t port);
+void outl(uint16_t port, uint32_t val);
+uint32_t inl(uint16_t port);
+
+// String I/O, count is in words
+void insw(uint16_t port, void* buffer, uint32_t count);
+void outsw(uint16_t port, const void* buffer, uint32_t count);
 
 void i686_iowait();
 void __attribute__((cdecl)) i686_Panic();
\ No newline at end of file
@@ -3,5 +3,11 @@
 
 typedef void (*IRQHandler)(Registers* regs);
 
+// Has the IRQ entry stub without a PIC or APIC line behind it, no EOI is sent
+#define IRQ_TEST_VECTOR     0x82
+
 void i686_IRQ_Initialize();
 void i686_IRQ_RegisterHandler(int irq, IRQHandler handler);
+void i686_IRQ_Mask(int irq);
+void i686_IRQ_Unmask(int irq);
+void i686_IRQ_RegisterTestHandler(IRQHandler handler);    // for int IRQ_TEST_VECTOR, NULL to reset
@@ -14,3 +14,5 @@ typedef void (*ISRHandler)(Registers* regs);
 
 void i686_ISR_Initialize();
 void i686_ISR_RegisterHandler(int interrupt, ISRHandler handler);
+// Exceptions raised in ring 3 that have no handler of their own
+void i686_ISR_RegisterUserFaultHandler(ISRHandler handler);
@@ -19,9 +19,14 @@
 // 0x00020000 - 0x00030000 - stage2
 
 // 0x00030000 - 0x00080000 - free
+// 0x00070000 - 0x00070FFF - AP startup trampoline, once the kernel runs (SMP_TRAMPOLINE_BASE)
 
 // 0x00080000 - 0x0009FFFF - Extended BIOS data area
 // 0x000A0000 - 0x000C7FFF - Video
 // 0x000C8000 - 0x000FFFFF - BIOS
 
-#define MEMORY_KERNEL_ADDR  ((void*)0x100000)
\ No newline at end of file
+#define MEMORY_KERNEL_ADDR  ((void*)0x100000)
+
+// 0x00400000 - 0x004FFFFF - kernel heap (syscall malloc/free)
+#define MEMORY_KERNEL_HEAP_ADDR     0x00400000
+#define MEMORY_KERNEL_HEAP_SIZE     0x00100000
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Configuration space registers
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_COMMAND             0x04
+#define PCI_STATUS              0x06
+#define PCI_PROG_IF             0x09
+#define PCI_SUBCLASS            0x0A
+#define PCI_CLASS               0x0B
+#define PCI_HEADER_TYPE         0x0E
+#define PCI_BAR0                0x10
+#define PCI_BAR4                0x20
+#define PCI_INTERRUPT_LINE      0x3C
+
+// Command register bits
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_MASTER      0x0004
+
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_IDE        0x01
+
+typedef struct {
+    uint8_t Bus;
+    uint8_t Device;
+    uint8_t Function;
+} PCIAddress;
+
+uint32_t pci_read32(PCIAddress addr, uint8_t offset);
+uint16_t pci_read16(PCIAddress addr, uint8_t offset);
+uint8_t pci_read8(PCIAddress addr, uint8_t offset);
+void pci_write32(PCIAddress addr, uint8_t offset, uint32_t value);
+void pci_write16(PCIAddress addr, uint8_t offset, uint16_t value);
+
+// Finds the first function with the given class/subclass
+bool pci_find_class(uint8_t classCode, uint8_t subclass, PCIAddress* out);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <boot/bootparams.h>
+
+#define PMM_FRAME_SIZE          4096
+#define PMM_MAX_MEMORY          0x40000000      // frames above 1GB are ignored
+
+// Physical frame allocator. Frames are handed out as physical addresses,
+// which the kernel can use directly since memory is identity mapped.
+void pmm_init(BootParams* bootParams);
+
+uint32_t pmm_alloc_frames(uint32_t count);     // contiguous, returns 0 when out of memory
+uint32_t pmm_alloc_frame(void);
+void pmm_free_frames(uint32_t address, uint32_t count);
+void pmm_free_frame(uint32_t address);
+void pmm_reserve_region(uint32_t address, uint32_t length);
+
+// Frames mapped in several address spaces. An allocated frame has one reference,
+// pmm_unref_frame frees it when the last one goes. False when the count is full.
+bool pmm_ref_frame(uint32_t address);
+void pmm_unref_frame(uint32_t address);
+uint32_t pmm_get_frame_refs(uint32_t address);
+
+uint32_t pmm_get_total_frames(void);
+uint32_t pmm_get_free_frames(void);
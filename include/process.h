@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <vfs.h>
+#include <vmm.h>
+#include <isr.h>
+
+#define PROCESS_MAX             16
+#define PROCESS_MAX_REGIONS     16
+#define PROCESS_NAME_MAX        32
+
+// The kernel shell, parent of every program it starts
+#define PROCESS_KERNEL_PID      1
+
+#define PROCESS_STACK_SIZE      0x10000         // zero filled on demand like the rest
+#define PROCESS_STACK_TOP       VMM_USER_TOP
+// Anonymous mappings go top down from here, the heap grows up from the end of the executable
+#define PROCESS_MMAP_TOP        (PROCESS_STACK_TOP - PROCESS_STACK_SIZE - VMM_PAGE_SIZE)
+
+// Exit code of a killed program, 128 + SIGKILL like a shell reports it
+#define PROCESS_KILLED_EXIT     137
+
+typedef enum {
+    PROCESS_FREE,
+    PROCESS_RUNNING,
+    PROCESS_WAITING,                // started a program that has not finished yet
+    PROCESS_ZOMBIE,                 // exited, until its parent waits for it
+} ProcessState;
+
+#define PROCESS_REGION_WRITE    0x01
+#define PROCESS_REGION_HEAP     0x02        // moved by sbrk, may be empty
+#define PROCESS_REGION_ANON     0x04        // from mmap, removed by munmap
+
+// Part of the address space filled in on the first access. Pages come from
+// the executable up to FileSize and are zero after it.
+typedef struct {
+    uint32_t Start;                 // page aligned
+    uint32_t End;
+    uint32_t Flags;                 // PROCESS_REGION_*
+    uint32_t FileOffset;            // of Start
+    uint32_t FileSize;
+} ProcessRegion;
+
+typedef struct Process {
+    int Pid;
+    int ParentPid;
+    ProcessState State;
+    int ExitCode;
+    bool Killed;                    // exits as soon as it runs again
+    char Name[PROCESS_NAME_MAX];
+
+    uint32_t AddressSpace;
+    uint32_t Entry;
+    VfsContext Files;               // its descriptors and current directory
+    VfsFile* File;                  // the executable, open while it runs and out of reach of Files
+    ProcessRegion Regions[PROCESS_MAX_REGIONS];
+    uint32_t RegionCount;
+    uint32_t Break;                 // end of the heap, its region ends on the page after
+    uint32_t MinorFaults;           // pages zero filled or mapped to the zero page
+    uint32_t MajorFaults;           // pages read from the executable
+} Process;
+
+void process_init(void);
+
+// Loads an ELF32 executable and runs it until it exits. The caller waits
+// meanwhile. Returns the new pid, its exit code is collected with process_wait.
+int process_exec(const char* path);
+// Copy of the current process on a copy on write address space, resuming from
+// the syscall frame with 0 in eax. It runs first, the parent gets its pid after.
+int process_fork(const Registers* frame);
+
+// Address space of the current process. Nothing is backed until it is touched.
+// Both return the old break or the mapping through *address.
+int process_sbrk(int32_t increment, uint32_t* address);
+int process_mmap(uint32_t length, uint32_t flags, uint32_t* address);
+int process_munmap(uint32_t address);
+// Reaps an exited child of the caller, any child for pid -1. Returns its pid.
+int process_wait(int pid, int* exitCode);
+int process_kill(int pid);
+
+int process_get_pid(void);
+Process* process_current(void);                 // NULL in the kernel
+const Process* process_get(int index);          // table slot, for listing
+const Process* process_get_by_pid(int pid);     // zombies included, NULL when there is none
@@ -26,6 +26,11 @@ int cmd_cpuinfo(int argc, char* argv[]);
 int cmd_cpuid(int argc, char* argv[]);
 int cmd_lsmod(int argc, char* argv[]);
 int cmd_dmesg(int argc, char* argv[]);
+int cmd_bcache(int argc, char* argv[]);
+int cmd_iostat(int argc, char* argv[]);
+int cmd_irqstat(int argc, char* argv[]);
+int cmd_cpus(int argc, char* argv[]);
+int cmd_lockstat(int argc, char* argv[]);
 
 // File System
 int cmd_ls(int argc, char* argv[]);
@@ -35,6 +40,9 @@ int cmd_rm(int argc, char* argv[]);
 int cmd_find(int argc, char* argv[]);
 int cmd_grep(int argc, char* argv[]);
 int cmd_wc(int argc, char* argv[]);
+int cmd_mount(int argc, char* argv[]);
+int cmd_umount(int argc, char* argv[]);
+int cmd_df(int argc, char* argv[]);
 int cmd_create_file(int argc, char* argv[]);
 int cmd_edit(int argc, char* argv[]);
 
@@ -46,6 +54,7 @@ int cmd_hexdump(int argc, char* argv[]);
 int cmd_keytest(int argc, char* argv[]);
 int cmd_benchmark(int argc, char* argv[]);
 int cmd_registers(int argc, char* argv[]);
+int cmd_ata(int argc, char* argv[]);
 
 // System Calls
 int cmd_syscall_test(int argc, char* argv[]);
@@ -53,6 +62,9 @@ int cmd_syscall_info(int argc, char* argv[]);
 int cmd_malloc_test(int argc, char* argv[]);
 int cmd_heap_info(int argc, char* argv[]);
 int cmd_sleep_test(int argc, char* argv[]);
+int cmd_exec(int argc, char* argv[]);
+int cmd_ps(int argc, char* argv[]);
+int cmd_kill(int argc, char* argv[]);
 
 // System Control
 int cmd_reboot(int argc, char* argv[]);
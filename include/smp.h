@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <acpi.h>
+#include <sync.h>
+
+#define SMP_MAX_CPUS            ACPI_MAX_CPUS
+
+// Real mode code the application processors start in, a page in free low memory
+#define SMP_TRAMPOLINE_BASE     0x70000
+#define SMP_AP_STACK_FRAMES     4               // 16KB kernel stack per AP
+
+#define SMP_IPI_WAKE            0xF0            // work was queued for a halted CPU
+
+struct Process;
+
+// Something to run on whichever CPU gets to it first. Done is set once Function returned.
+typedef struct SmpWork {
+    void (*Function)(void* data);
+    void* Data;
+    volatile bool Done;
+    struct SmpWork* Next;
+} SmpWork;
+
+// One per CPU, reached through gs. The kernel segment loads keep gs on it.
+typedef struct Cpu {
+    struct Cpu* Self;                   // gs:0
+    uint32_t Index;                     // 0 for the boot CPU
+    uint8_t ApicId;
+    volatile bool Online;
+    struct Process* Process;            // running in ring 3 (or waiting on a child), NULL for the kernel
+
+    Spinlock QueueLock;                 // taken with interrupts off
+    SmpWork* QueueHead;
+    SmpWork* QueueTail;
+    volatile uint32_t QueueLength;
+
+    uint64_t OnlineTsc;
+    uint64_t BusyCycles;                // running queued work
+    uint32_t WorkDone;
+    uint32_t WorkStolen;                // taken from another CPU's queue
+    uint32_t IpisReceived;
+} Cpu;
+
+static inline Cpu* cpu_current(void)
+{
+    Cpu* cpu;
+    __asm__ volatile ("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// The boot CPU's entry is usable before smp_init, the GDT points gs at it
+Cpu* smp_get_cpu(uint32_t index);
+uint32_t smp_cpu_count(void);                   // online CPUs
+
+// Starts every other CPU in the MADT. Needs the APIC, paging and a calibrated TSC.
+void smp_init(void);
+void smp_send_ipi(uint32_t cpu, uint8_t vector);
+
+// Queues work on the CPU with the shortest queue, CPUs that run out take from the longest.
+// Only for self contained kernel work: processes, syscalls and the file systems stay on CPU 0.
+void smp_submit(SmpWork* work);
+void smp_submit_to(SmpWork* work, uint32_t cpu);
+// Helps with queued work until work is done
+void smp_wait(SmpWork* work);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <isr.h>
+
+// Deferred interrupt work. IRQ handlers (top halves) only capture what the
+// hardware has to give and raise a softirq; its handler runs right after the
+// IRQ is acknowledged, with interrupts enabled again.
+typedef enum {
+    SOFTIRQ_KEYBOARD,
+    SOFTIRQ_TASKLET,                // runs the scheduled tasklets
+
+    SOFTIRQ_COUNT
+} SoftirqVector;
+
+typedef void (*SoftirqHandler)(void);
+
+void softirq_register(SoftirqVector vector, SoftirqHandler handler);
+void softirq_raise(SoftirqVector vector);      // from an IRQ handler or with interrupts enabled
+void softirq_run(void);                         // pending work, if not already running
+
+// One off work for code that has no vector of its own. Scheduling a tasklet
+// that is already pending does nothing, it still runs once.
+typedef struct Tasklet {
+    void (*Function)(void* data);
+    void* Data;
+    bool Scheduled;
+    struct Tasklet* Next;
+} Tasklet;
+
+void tasklet_schedule(Tasklet* tasklet);
+
+// Called by the IRQ entry stubs once the PIC is acknowledged, entry is the
+// TSC when the stub started
+void __attribute__((cdecl)) softirq_irq_exit(Registers* regs, uint32_t irq, uint64_t entry);
+
+// Durations bucketed by the power of two of their TSC cycles
+#define SOFTIRQ_HISTOGRAM_BUCKETS   32
+
+typedef struct {
+    uint32_t Buckets[SOFTIRQ_HISTOGRAM_BUCKETS];
+    uint32_t Count;
+    uint32_t MaxCycles;
+} IrqHistogram;
+
+typedef struct {
+    uint32_t IrqCount[16];
+    IrqHistogram IrqOff;            // IRQ entry to EOI, interrupts disabled throughout
+    IrqHistogram Softirq;           // each pass over the pending softirqs
+} IrqStats;
+
+const IrqStats* softirq_get_stats(void);
+void softirq_reset_stats(void);
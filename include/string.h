@@ -1,10 +1,11 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 
 const char* strchr(const char* str, char chr);
 char* strcpy(char* dst, const char* src);
 unsigned strlen(const char* str);
 int strcmp(const char* a, const char* b);
 
-wchar_t* utf16_to_codepoint(wchar_t* string, int* codepoint);
+const uint16_t* utf16_to_codepoint(const uint16_t* string, int* codepoint);
 char* codepoint_to_utf8(int codepoint, char* stringOutput);
\ No newline at end of file
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct Cpu;
+
+typedef enum {
+    LOCK_SPIN,
+    LOCK_MUTEX,
+    LOCK_RW,
+    LOCK_SEQ,
+} LockType;
+
+// Contention counters of one named lock, listed by lockstat once it was first taken.
+// Reader side counts of a RwLock are added without holding it and may miss a few.
+typedef struct LockStats {
+    const char* Name;                   // NULL keeps the lock out of lockstat
+    LockType Type;
+    volatile uint32_t Registered;
+    uint32_t Acquired;
+    uint32_t Contended;                 // had to wait
+    uint64_t WaitCycles;                // spent waiting, over every contended acquisition
+    uint32_t MaxWaitCycles;
+    struct LockStats* Next;
+} LockStats;
+
+// Ticket spinlock, served in the order callers arrived. Zeroed memory is an unlocked, unnamed lock.
+typedef struct {
+    volatile uint16_t Next;             // ticket of the next caller
+    volatile uint16_t Owner;            // ticket being served
+    LockStats Stats;
+} Spinlock;
+
+#define SPINLOCK_INIT(name)     { .Stats = { .Name = (name), .Type = LOCK_SPIN } }
+
+void spinlock_init(Spinlock* lock, const char* name);
+void spin_lock(Spinlock* lock);
+void spin_unlock(Spinlock* lock);
+bool spin_trylock(Spinlock* lock);
+// With interrupts off on this CPU, for data an interrupt handler takes too. Returns the old eflags.
+uint32_t spin_lock_irqsave(Spinlock* lock);
+void spin_unlock_irqrestore(Spinlock* lock, uint32_t flags);
+
+// A CPU waiting on a WaitQueue, on its own stack
+typedef struct WaitQueueEntry {
+    struct Cpu* Cpu;
+    volatile bool Woken;
+    struct WaitQueueEntry* Next;
+} WaitQueueEntry;
+
+typedef struct {
+    Spinlock Lock;
+    WaitQueueEntry* Head;
+    WaitQueueEntry* Tail;
+} WaitQueue;
+
+// Sleeping lock. Without threads a waiter halts its CPU until the owner hands the
+// mutex over and wakes it with an IPI. Not for interrupt handlers, and taking it
+// twice on one CPU is a bug that panics.
+typedef struct {
+    bool Locked;                        // under Waiters.Lock
+    struct Cpu* Owner;
+    WaitQueue Waiters;
+    LockStats Stats;
+} Mutex;
+
+#define MUTEX_INIT(name)        { .Stats = { .Name = (name), .Type = LOCK_MUTEX } }
+
+void mutex_init(Mutex* mutex, const char* name);
+void mutex_lock(Mutex* mutex);
+bool mutex_trylock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+
+// Many readers or one writer, spinning. A waiting writer holds off new readers.
+typedef struct {
+    volatile int32_t Count;             // readers, -1 while a writer holds it
+    volatile uint32_t WritersWaiting;
+    LockStats Stats;
+} RwLock;
+
+#define RWLOCK_INIT(name)       { .Stats = { .Name = (name), .Type = LOCK_RW } }
+
+void rwlock_init(RwLock* lock, const char* name);
+void rwlock_read_lock(RwLock* lock);
+void rwlock_read_unlock(RwLock* lock);
+void rwlock_write_lock(RwLock* lock);
+void rwlock_write_unlock(RwLock* lock);
+
+// For small read mostly data. Readers never wait on the writer, they retry
+// when it changed the data under them.
+typedef struct {
+    volatile uint32_t Sequence;         // odd while a write is in progress
+    Spinlock Lock;                      // between writers
+} SeqLock;
+
+#define SEQLOCK_INIT(name)      { .Lock = { .Stats = { .Name = (name), .Type = LOCK_SEQ } } }
+
+void seqlock_init(SeqLock* lock, const char* name);
+void seqlock_write_begin(SeqLock* lock);
+void seqlock_write_end(SeqLock* lock);
+
+static inline uint32_t seqlock_read_begin(const SeqLock* lock)
+{
+    uint32_t sequence;
+    while ((sequence = lock->Sequence) & 1)
+        __asm__ volatile ("pause");
+    __asm__ volatile ("" : : : "memory");
+    return sequence;
+}
+
+// True when the data read since seqlock_read_begin has to be read again
+static inline bool seqlock_read_retry(const SeqLock* lock, uint32_t sequence)
+{
+    __asm__ volatile ("" : : : "memory");
+    return lock->Sequence != sequence;
+}
+
+// Every named lock taken so far, newest first
+LockStats* lockstat_first(void);
+void lockstat_reset(void);
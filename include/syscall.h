@@ -35,8 +35,16 @@ typedef enum {
     SYSCALL_UNLINK = 24,
     SYSCALL_MOUNT = 25,
     SYSCALL_UMOUNT = 26,
+    SYSCALL_PREAD = 27,
+    SYSCALL_PWRITE = 28,
+    SYSCALL_READV = 29,
+    SYSCALL_WRITEV = 30,
+    SYSCALL_RING_SETUP = 31,
+    SYSCALL_RING_ENTER = 32,
+    SYSCALL_RING_DESTROY = 33,
+    SYSCALL_SBRK = 34,
     
-    SYSCALL_COUNT = 27  // Total number of syscalls
+    SYSCALL_COUNT = 35  // Total number of syscalls
 } syscall_number_t;
 
 // Error codes
@@ -56,6 +64,9 @@ typedef enum {
     SYSCALL_NOT_EMPTY = -12
 } syscall_error_t;
 
+// For syscalls returning addresses, user ones are above 2GB and so negative as int32_t
+#define SYSCALL_FAILED(result)  ((int32_t)(result) < 0 && (int32_t)(result) >= -4095)
+
 // Structure for file information
 typedef struct {
     uint32_t size;
@@ -65,6 +76,14 @@ typedef struct {
     uint32_t modified_time;
 } stat_info_t;
 
+// Buffer for readv/writev, laid out like the kernel's VfsIoVec
+typedef struct {
+    void* base;
+    uint32_t length;
+} iovec_t;
+
+#define IOV_MAX         64      // buffers per readv/writev call
+
 // Flags for open
 #define OPEN_READ       0x01
 #define OPEN_WRITE      0x02
@@ -72,12 +91,45 @@ typedef struct {
 #define OPEN_TRUNCATE   0x08
 #define OPEN_APPEND     0x10
 
+// Origins for seek
+#define SEEK_SET        0
+#define SEEK_CUR        1
+#define SEEK_END        2
+
 //Flags for mmap
 #define MMAP_READ       0x01
 #define MMAP_WRITE      0x02
 #define MMAP_EXECUTE    0x04
 #define MMAP_PRIVATE    0x08
 #define MMAP_SHARED     0x10
+#define MMAP_ANONYMOUS  0x20        // zero filled memory, fd is ignored (programs only)
+
+// Submission/completion rings: the caller queues syscalls in sq and the kernel
+// posts their results to cq, so one trap (or none, with polling) runs many of them
+#define SYSCALL_RING_MAX_ENTRIES    256     // per ring, a power of two
+#define SYSCALL_RING_POLL           0x01    // the kernel idle loop drains sq without a trap
+
+typedef struct {
+    uint32_t opcode;            // any registered syscall except the ring ones
+    uint32_t args[4];
+    uint32_t user_data;         // handed back in the completion
+} sq_entry_t;
+
+typedef struct {
+    int32_t result;
+    uint32_t user_data;
+} cq_entry_t;
+
+typedef struct {
+    volatile uint32_t sq_head;  // advanced by the kernel
+    volatile uint32_t sq_tail;  // advanced by the caller
+    volatile uint32_t cq_head;  // advanced by the caller
+    volatile uint32_t cq_tail;  // advanced by the kernel
+    uint32_t entries;           // size of both rings
+    uint32_t flags;
+    sq_entry_t* sq;
+    cq_entry_t* cq;
+} syscall_ring_t;
 
 // Function type for syscall handlers
 typedef int32_t (*syscall_handler_t)(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
@@ -87,6 +139,10 @@ void syscall_initialize(void);
 void syscall_register_handler(syscall_number_t num, syscall_handler_t handler);
 int32_t syscall_dispatch(uint32_t syscall_num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
 
+// Drains the rings created with SYSCALL_RING_POLL, called from the kernel idle loop
+void syscall_ring_poll(void);
+void syscall_ring_initialize(void);
+
 // Utility functions for making syscalls from kernel code
 int32_t syscall_invoke(syscall_number_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
 
@@ -146,6 +202,27 @@ int32_t syscall_invoke(syscall_number_t num, uint32_t arg1, uint32_t arg2, uint3
     result; \
 })
 
+// Same calls through SYSENTER, which returns through ecx and edx. So arg2 and arg3
+// go in edi and esi and arg4 is pushed for the kernel to read at the caller's esp.
+#define SYSENTER4(num, arg1, arg2, arg3, arg4) ({ \
+    int32_t result; \
+    uint32_t stacked = (uint32_t)(arg4); \
+    __asm__ volatile( \
+        "pushfl\n\t" \
+        "pushl %%edx\n\t" \
+        "movl %%esp, %%ecx\n\t" \
+        "movl $1f, %%edx\n\t" \
+        "sysenter\n" \
+        "1:\n\t" \
+        "addl $4, %%esp\n\t" \
+        "popfl" \
+        : "=a"(result), "+d"(stacked) \
+        : "a"(num), "b"(arg1), "D"(arg2), "S"(arg3) \
+        : "ecx", "memory", "cc" \
+    ); \
+    result; \
+})
+
 // Wrapper functions for syscalls (for userland)
 static inline int32_t sys_exit(int32_t code) {
     return SYSCALL1(SYSCALL_EXIT, code);
@@ -183,6 +260,25 @@ static inline int32_t sys_getpid(void) {
     return SYSCALL0(SYSCALL_GETPID);
 }
 
+// 0 in the child, which runs until it exits before the parent continues with its pid
+static inline int32_t sys_fork(void) {
+    return SYSCALL0(SYSCALL_FORK);
+}
+
+// Runs an ELF executable to completion, returns its pid
+static inline int32_t sys_exec(const char* path) {
+    return SYSCALL1(SYSCALL_EXEC, (uint32_t)path);
+}
+
+// Collects the exit code of a finished child, any child for pid -1. Returns its pid.
+static inline int32_t sys_wait(int32_t pid, int32_t* status) {
+    return SYSCALL2(SYSCALL_WAIT, pid, (uint32_t)status);
+}
+
+static inline int32_t sys_kill(int32_t pid) {
+    return SYSCALL1(SYSCALL_KILL, pid);
+}
+
 static inline uint32_t sys_time(void) {
     return SYSCALL0(SYSCALL_TIME);
 }
@@ -193,4 +289,123 @@ static inline int32_t sys_sleep(uint32_t milliseconds) {
 
 static inline int32_t sys_yield(void) {
     return SYSCALL0(SYSCALL_YIELD);
-}
\ No newline at end of file
+}
+
+static inline int32_t sys_unlink(const char* path) {
+    return SYSCALL1(SYSCALL_UNLINK, (uint32_t)path);
+}
+
+static inline int32_t sys_mount(const char* device, const char* path) {
+    return SYSCALL2(SYSCALL_MOUNT, (uint32_t)device, (uint32_t)path);
+}
+
+static inline int32_t sys_umount(const char* path) {
+    return SYSCALL1(SYSCALL_UMOUNT, (uint32_t)path);
+}
+
+// Returns the new position
+static inline int32_t sys_seek(int32_t fd, int32_t offset, int32_t whence) {
+    return SYSCALL3(SYSCALL_SEEK, fd, offset, whence);
+}
+
+static inline int32_t sys_stat(const char* path, stat_info_t* info) {
+    return SYSCALL2(SYSCALL_STAT, (uint32_t)path, (uint32_t)info);
+}
+
+// Vectored I/O, all buffers in one trap
+static inline int32_t sys_readv(int32_t fd, const iovec_t* iov, uint32_t count) {
+    return SYSCALL3(SYSCALL_READV, fd, (uint32_t)iov, count);
+}
+
+static inline int32_t sys_writev(int32_t fd, const iovec_t* iov, uint32_t count) {
+    return SYSCALL3(SYSCALL_WRITEV, fd, (uint32_t)iov, count);
+}
+
+// Positional I/O, the descriptor's position is not used or moved
+static inline int32_t sys_pread(int32_t fd, void* buffer, size_t count, uint32_t offset) {
+    return SYSCALL4(SYSCALL_PREAD, fd, (uint32_t)buffer, count, offset);
+}
+
+static inline int32_t sys_pwrite(int32_t fd, const void* buffer, size_t count, uint32_t offset) {
+    return SYSCALL4(SYSCALL_PWRITE, fd, (uint32_t)buffer, count, offset);
+}
+
+static inline int32_t sys_chdir(const char* path) {
+    return SYSCALL1(SYSCALL_CHDIR, (uint32_t)path);
+}
+
+static inline int32_t sys_getcwd(char* buffer, size_t size) {
+    return SYSCALL2(SYSCALL_GETCWD, (uint32_t)buffer, size);
+}
+
+static inline int32_t sys_mkdir(const char* path) {
+    return SYSCALL1(SYSCALL_MKDIR, (uint32_t)path);
+}
+
+static inline int32_t sys_rmdir(const char* path) {
+    return SYSCALL1(SYSCALL_RMDIR, (uint32_t)path);
+}
+
+// Returns the address of the mapping, or a negative error code
+static inline int32_t sys_mmap(int32_t fd, size_t length, uint32_t offset, uint32_t flags) {
+    return SYSCALL4(SYSCALL_MMAP, fd, length, offset, flags);
+}
+
+static inline int32_t sys_munmap(void* address) {
+    return SYSCALL1(SYSCALL_MUNMAP, (uint32_t)address);
+}
+
+// Moves the end of a program's heap, returns the old one (check with SYSCALL_FAILED)
+static inline int32_t sys_sbrk(int32_t increment) {
+    return SYSCALL1(SYSCALL_SBRK, (uint32_t)increment);
+}
+
+// Returns the ring, or a negative error code
+static inline int32_t sys_ring_setup(uint32_t entries, uint32_t flags) {
+    return SYSCALL2(SYSCALL_RING_SETUP, entries, flags);
+}
+
+// Runs every queued entry, returns how many were completed
+static inline int32_t sys_ring_enter(syscall_ring_t* ring) {
+    return SYSCALL1(SYSCALL_RING_ENTER, (uint32_t)ring);
+}
+
+static inline int32_t sys_ring_destroy(syscall_ring_t* ring) {
+    return SYSCALL1(SYSCALL_RING_DESTROY, (uint32_t)ring);
+}
+
+// Queues a syscall without trapping, false when sq is full
+static inline int syscall_ring_push(syscall_ring_t* ring, uint32_t opcode, uint32_t arg1, uint32_t arg2,
+                                    uint32_t arg3, uint32_t arg4, uint32_t user_data) {
+    uint32_t tail = ring->sq_tail;
+    if (tail - ring->sq_head == ring->entries) return 0;
+    
+    sq_entry_t* entry = &ring->sq[tail & (ring->entries - 1)];
+    entry->opcode = opcode;
+    entry->args[0] = arg1;
+    entry->args[1] = arg2;
+    entry->args[2] = arg3;
+    entry->args[3] = arg4;
+    entry->user_data = user_data;
+    
+    // The entry must be complete before the kernel can see it
+    __asm__ volatile("" ::: "memory");
+    ring->sq_tail = tail + 1;
+    return 1;
+}
+
+// Takes the oldest completion, false when cq is empty
+static inline int syscall_ring_pop(syscall_ring_t* ring, cq_entry_t* completion) {
+    uint32_t head = ring->cq_head;
+    if (head == ring->cq_tail) return 0;
+    
+    __asm__ volatile("" ::: "memory");
+    *completion = ring->cq[head & (ring->entries - 1)];
+    ring->cq_head = head + 1;
+    return 1;
+}
+
+// Any syscall through the SYSENTER entry. Only valid once i686_Sysenter_Available() is true.
+static inline int32_t sys_fast_syscall(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    return SYSENTER4(num, arg1, arg2, arg3, arg4);
+}
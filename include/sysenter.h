@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Points the SYSENTER MSRs at the fast syscall entry, false when the CPU has no SYSENTER
+bool i686_Sysenter_Initialize();
+bool i686_Sysenter_Available();
+// Where SYSENTER switches to, 0 for the kernel's own stack
+void i686_Sysenter_SetKernelStack(uint32_t esp);
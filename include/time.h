@@ -1,7 +1,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <x86.h>
 
 void time_init(void);
 uint64_t time_get_ticks(void);
-uint32_t sys_time(void);
\ No newline at end of file
+uint32_t sys_time(void);
+
+// Calibrates x86_ReadTsc against the PIT once interrupts are running
+void time_calibrate_tsc(void);
+uint32_t time_get_tsc_khz(void);
+uint64_t time_tsc_to_us(uint64_t cycles);
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <vfs.h>
+
+#define TMPFS_MAX_NAME          63
+
+typedef struct TmpfsNode TmpfsNode;
+
+typedef struct {
+    uint32_t Nodes;
+    uint32_t Directories;
+    uint32_t DataPages;                 // file data
+    uint32_t IndexPages;                // radix tree and hash bucket pages
+    uint32_t SlabPages;                 // node storage
+} TmpfsStats;
+
+// Memory backed file system. Directories are hash tables, file data lives in 4KB frames
+// indexed by a radix tree, so files grow without copying.
+void tmpfs_init(void);
+TmpfsNode* tmpfs_get_root(void);
+
+// Results are SYSCALL_* codes
+TmpfsNode* tmpfs_lookup(TmpfsNode* dir, const char* name, uint32_t length);
+int tmpfs_create(TmpfsNode* dir, const char* name, uint32_t length, bool isDirectory, TmpfsNode** node);
+int tmpfs_remove(TmpfsNode* dir, const char* name, uint32_t length);     // directories must be empty
+
+// Resolves an absolute path or one relative to cwd, "." and ".." included
+int tmpfs_resolve(TmpfsNode* cwd, const char* path, TmpfsNode** node);
+
+int32_t tmpfs_read(TmpfsNode* node, uint32_t offset, void* buffer, uint32_t count);
+int32_t tmpfs_write(TmpfsNode* node, uint32_t offset, const void* buffer, uint32_t count);
+int tmpfs_truncate(TmpfsNode* node, uint32_t size);
+
+const char* tmpfs_get_name(TmpfsNode* node);
+TmpfsNode* tmpfs_get_parent(TmpfsNode* node);       // the root is its own parent
+uint32_t tmpfs_get_size(TmpfsNode* node);           // bytes, or entries of a directory
+uint32_t tmpfs_get_created(TmpfsNode* node);        // ticks
+bool tmpfs_is_directory(TmpfsNode* node);
+
+// Children in creation order
+TmpfsNode* tmpfs_first_child(TmpfsNode* dir);
+TmpfsNode* tmpfs_next_sibling(TmpfsNode* node);
+TmpfsNode* tmpfs_child_at(TmpfsNode* dir, uint32_t index);
+
+void tmpfs_get_stats(TmpfsStats* stats);
+
+extern VfsFileSystem g_TmpfsFileSystem;
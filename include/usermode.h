@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <isr.h>
+
+// Exit code of a program killed by an exception is this plus the vector
+#define USERMODE_FAULT_EXIT     128
+
+void usermode_init(void);
+
+// Runs ring 3 code at entry in the address space until it exits or faults and
+// returns its exit code. A running program may start another from a syscall,
+// it resumes once that one is done.
+int usermode_run(uint32_t directory, uint32_t entry, uint32_t stack);
+// Same, continuing from a full set of ring 3 registers
+int usermode_resume(uint32_t directory, const Registers* frame);
+bool usermode_active(void);
+
+// Registers an interrupt from the running program left on top of its kernel
+// stack, NULL while no program runs. Only meaningful while handling that interrupt.
+Registers* usermode_get_trap_frame(void);
+
+// Both go back to usermode_run, from a syscall or an exception in ring 3
+void usermode_exit(int code);
+void usermode_fault(Registers* regs);
+
+// Syscall arguments. While no program runs the caller is the kernel and
+// any address is accepted; otherwise it must be inside the user part.
+bool user_range_ok(const void* ptr, uint32_t size);
+// Also checks every page is mapped for user (and writable), for buffers handed straight to drivers
+bool user_buffer_ok(const void* ptr, uint32_t size, bool write);
+
+// A fault on the user side makes these fail instead of crashing the kernel.
+// SYSCALL_OK or SYSCALL_INVALID_PARAMS.
+int copy_from_user(void* dst, const void* src, uint32_t size);
+int copy_to_user(void* dst, const void* src, uint32_t size);
+// Length of the string, size when it does not fit (dst is then not terminated), or SYSCALL_INVALID_PARAMS
+int32_t strncpy_from_user(char* dst, const char* src, uint32_t size);
+
+// Where a fault at eip inside the copy routines resumes, 0 for any other eip
+uint32_t uaccess_fixup(uint32_t eip);
@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <blockdev.h>
 
 typedef int fd_t;
 
@@ -9,4 +11,136 @@ typedef int fd_t;
 #define VFS_FD_STDERR   2
 #define VFS_FD_DEBUG    3
 
-int VFS_Write(fd_t file, uint8_t* data, size_t size);
\ No newline at end of file
+#define VFS_MAX_PATH        256
+#define VFS_MAX_NAME        255
+#define VFS_MAX_MOUNTS      8
+#define VFS_MAX_INODES      64
+#define VFS_MAX_FILES       64          // open file objects
+#define VFS_MAX_FDS         64
+#define VFS_MAX_MAPPINGS    32
+
+typedef struct VfsMount VfsMount;
+typedef struct VfsInode VfsInode;
+typedef struct VfsFile VfsFile;
+
+typedef struct {
+    uint32_t Size;
+    bool IsDirectory;
+    uint32_t Created;                   // ticks, 0 when unknown
+} VfsStat;
+
+// One buffer of a vectored read or write
+typedef struct {
+    void* Base;
+    uint32_t Length;
+} VfsIoVec;
+
+typedef struct {
+    char Name[VFS_MAX_NAME + 1];
+    uint32_t Size;
+    bool IsDirectory;
+} VfsDirEntry;
+
+// Operations on an open inode. Results are byte counts or SYSCALL_* codes.
+typedef struct {
+    int32_t (*Read)(VfsInode* inode, uint32_t offset, void* buffer, uint32_t count);
+    int32_t (*Write)(VfsInode* inode, uint32_t offset, const void* buffer, uint32_t count);
+    int (*Truncate)(VfsInode* inode, uint32_t size);
+    int (*Stat)(VfsInode* inode, VfsStat* stat);
+    // Returns the entry at *cookie and advances it, false at the end of the directory
+    bool (*ReadDir)(VfsInode* dir, uint32_t* cookie, VfsDirEntry* entry);
+    void (*Release)(VfsInode* inode);   // last reference dropped, or a duplicate Open
+    // Frame caching page index of the file, 0 for a hole. Without it mappings get a copy.
+    uint32_t (*GetPage)(VfsInode* inode, uint32_t index);
+    void (*Flush)(VfsInode* inode);     // after a write call, however many buffers it had
+} VfsInodeOps;
+
+// A file system type. Paths handed to it are relative to the mount, "" for its root.
+typedef struct VfsFileSystem {
+    const char* Name;
+    int (*Mount)(BlockDev* device, void** data);
+    int (*Unmount)(void* data);
+    bool (*Sync)(void* data);
+    // Fills in the inode's Ops, Data and IsDirectory
+    int (*Open)(VfsMount* mount, const char* path, uint32_t flags, VfsInode* inode);
+    int (*Unlink)(VfsMount* mount, const char* path);
+    int (*Mkdir)(VfsMount* mount, const char* path);
+    struct VfsFileSystem* Next;
+} VfsFileSystem;
+
+struct VfsMount {
+    char Path[VFS_MAX_PATH];
+    VfsFileSystem* FileSystem;
+    void* Data;                         // file system private
+    bool InUse;
+};
+
+// Opening the same file twice shares the inode if the file system hands out the same Data,
+// the second Open is then released straight away
+struct VfsInode {
+    VfsMount* Mount;
+    const VfsInodeOps* Ops;
+    void* Data;
+    bool IsDirectory;
+    uint32_t RefCount;
+    uint32_t MapCount;                  // mappings, which also hold a reference
+};
+
+// Descriptor table and current directory. The kernel has one, every process its own.
+typedef struct {
+    VfsFile* Fds[VFS_MAX_FDS];
+    char Cwd[VFS_MAX_PATH];
+} VfsContext;
+
+void vfs_init(void);
+void vfs_register_filesystem(VfsFileSystem* fs);
+
+// A copy of the current context sharing its open files, like the descriptors of a fork
+void vfs_context_init(VfsContext* context);
+void vfs_context_release(VfsContext* context);          // closes every descriptor
+// Descriptors and relative paths go through context from now on, NULL for the kernel's.
+// Returns the previous one.
+VfsContext* vfs_set_context(VfsContext* context);
+
+int vfs_mount(const char* path, const char* fsName, BlockDev* device);
+int vfs_umount(const char* path);
+void vfs_sync(void);
+bool vfs_is_busy(VfsMount* mount, void* data);          // an inode with this Data is open
+
+// Relative paths start at the current directory
+int vfs_resolve_path(const char* path, char* out, uint32_t size);
+int vfs_chdir(const char* path);
+const char* vfs_getcwd(void);
+
+// An open file outside every descriptor table, for references the kernel keeps itself
+// (a program's executable), so nothing the program does with its descriptors reaches it
+int vfs_open_file(const char* path, uint32_t flags, VfsFile** file);
+void vfs_get_file_ref(VfsFile* file);
+void vfs_put_file(VfsFile* file);                       // closes it with the last reference
+int32_t vfs_file_pread(VfsFile* file, void* buffer, uint32_t count, uint32_t offset);
+
+// Results are file descriptors, byte counts or SYSCALL_* codes
+fd_t vfs_open(const char* path, uint32_t flags);
+int vfs_close(fd_t fd);
+fd_t vfs_dup(fd_t fd);                                  // shares the position and flags of fd
+int32_t vfs_read(fd_t fd, void* buffer, uint32_t count);
+int32_t vfs_write(fd_t fd, const void* buffer, uint32_t count);
+// Every buffer in one call, stopping at the first short transfer. Returns the total.
+int32_t vfs_readv(fd_t fd, const VfsIoVec* iov, uint32_t count);
+int32_t vfs_writev(fd_t fd, const VfsIoVec* iov, uint32_t count);
+int32_t vfs_seek(fd_t fd, int32_t offset, int whence);            // returns the new position
+// At offset, the descriptor's position is left alone and OPEN_APPEND does not apply
+int32_t vfs_pread(fd_t fd, void* buffer, uint32_t count, uint32_t offset);
+int32_t vfs_pwrite(fd_t fd, const void* buffer, uint32_t count, uint32_t offset);
+int vfs_fstat(fd_t fd, VfsStat* stat);
+int vfs_readdir(fd_t fd, VfsDirEntry* entry);           // 1 for an entry, 0 at the end
+int vfs_stat(const char* path, VfsStat* stat);
+int vfs_unlink(const char* path);
+int vfs_mkdir(const char* path);
+int vfs_rmdir(const char* path);
+
+// Maps length bytes of the file from a page aligned offset, read only, into the mapping window
+int vfs_mmap(fd_t fd, uint32_t length, uint32_t offset, uint32_t flags, void** address);
+int vfs_munmap(void* address);
+
+int VFS_Write(fd_t file, uint8_t* data, size_t size);
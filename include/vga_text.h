@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 extern const unsigned SCREEN_WIDTH;
 extern const unsigned SCREEN_HEIGHT;
@@ -8,6 +9,8 @@ extern int g_ScreenX, g_ScreenY;
 
 void VGA_clrscr();
 void VGA_putc(char c);
+// Leaves the hardware cursor behind, VGA_setcursor(g_ScreenX, g_ScreenY) catches it up
+void VGA_write(const char* data, size_t size);
 void VGA_setcursor(int x, int y);
 void VGA_putchr(int x, int y, char c);
 
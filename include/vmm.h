@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pmm.h>
+
+#define VMM_PAGE_SIZE           PMM_FRAME_SIZE
+
+#define VMM_PAGE_PRESENT        0x001
+#define VMM_PAGE_WRITE          0x002
+#define VMM_PAGE_USER           0x004
+#define VMM_PAGE_WRITE_THROUGH  0x008
+#define VMM_PAGE_NO_CACHE       0x010
+#define VMM_PAGE_LARGE          0x080       // 4MB page directory entry
+#define VMM_PAGE_COW            0x200       // read only until written, then copied (an available bit)
+
+// Physical memory up to PMM_MAX_MEMORY stays identity mapped with 4MB pages.
+// Page mappings (mmap) are placed in a window right above it.
+#define VMM_MAP_BASE            PMM_MAX_MEMORY
+#define VMM_MAP_SIZE            0x10000000      // 256MB
+
+// Ring 3 code and data, the only part that differs between address spaces
+#define VMM_USER_BASE           0x80000000
+#define VMM_USER_TOP            0xC0000000
+
+// Builds the kernel page directory and turns paging on. Needs pmm_init.
+void vmm_init(void);
+
+// In the current address space. Results are false or 0 when out of memory.
+bool vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
+void vmm_unmap_page(uint32_t virt);
+uint32_t vmm_get_physical(uint32_t virt);      // 0 when not mapped
+bool vmm_is_mapped(uint32_t virt);
+uint32_t vmm_get_flags(uint32_t virt);         // VMM_PAGE_* of the mapping, 0 when not mapped
+
+// Address spaces are page directories sharing every kernel mapping.
+// Destroying one frees the frames mapped in its user part.
+uint32_t vmm_create_address_space(void);
+void vmm_destroy_address_space(uint32_t directory);
+void vmm_switch_address_space(uint32_t directory);
+uint32_t vmm_get_address_space(void);
+uint32_t vmm_get_kernel_address_space(void);
+bool vmm_map_user_page(uint32_t directory, uint32_t virt, uint32_t phys, uint32_t flags);
+// Drops every page in [start, end), releasing their frames
+void vmm_unmap_user_range(uint32_t directory, uint32_t start, uint32_t end);
+
+// A new address space sharing the user frames of directory. Writable pages turn
+// copy on write in both, the first write to one takes a private copy.
+uint32_t vmm_clone_address_space(uint32_t directory);
+
+typedef struct {
+    uint32_t SharedPages;               // by vmm_clone_address_space
+    uint32_t CopiedPages;               // written while still shared
+    uint32_t ReclaimedPages;            // written after the other users went away, no copy
+} VmmCowStats;
+
+void vmm_get_cow_stats(VmmCowStats* stats);
+
+// Fills in a user page of the current address space that is missing (or read
+// only, for a write) instead of failing the access. True when it did.
+typedef bool (*VmmFaultHandler)(uint32_t address, bool write);
+void vmm_set_fault_handler(VmmFaultHandler handler);
+bool vmm_handle_fault(uint32_t address, bool write);
+
+// Identity maps device registers, uncached, into the kernel part of every address
+// space created from now on. Can be called before vmm_init. False inside RAM or user space.
+bool vmm_map_device(uint32_t phys, uint32_t size);
+
+// Page aligned ranges of the mapping window
+uint32_t vmm_alloc_range(uint32_t pages);
+void vmm_free_range(uint32_t address, uint32_t pages);
+
+// A zeroed frame shared by every read only mapping of a hole
+uint32_t vmm_get_zero_page(void);
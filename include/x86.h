@@ -40,4 +40,11 @@ enum E820MemoryBlockType
     E820_BAD_MEMORY = 5,
 };
 
-int ASMCALL x86_E820GetNextBlock(E820MemoryBlock* block, uint32_t* continuationId);
\ No newline at end of file
+int ASMCALL x86_E820GetNextBlock(E820MemoryBlock* block, uint32_t* continuationId);
+
+static inline uint64_t x86_ReadTsc()
+{
+    uint64_t tsc;
+    __asm__ volatile ("rdtsc" : "=A"(tsc));
+    return tsc;
+}
\ No newline at end of file
@@ -77,11 +77,6 @@ typedef struct
 
 } FAT_FileData;
 
-typedef struct {
-    uint8_t Order;
-    int16_t Chars[13];
-} FAT_LFNBlock;
-
 typedef struct
 {
     union
@@ -97,8 +92,10 @@ typedef struct
     uint8_t FatCache[FAT_CACHE_SIZE * SECTOR_SIZE];
     uint32_t FatCachePosition;
 
-    FAT_LFNBlock LFNBlocks[FAT_LFN_LAST];
-    int LFNCount;
+    // LFN entries precede their short entry in reverse order, so a name is assembled in one pass
+    uint16_t LFNChars[FAT_LFN_MAX_ENTRIES * FAT_LFN_CHARS + 1];
+    uint8_t LFNChecksum;
+    int LFNNext;                // order of the next expected LFN entry, 0 once complete, -1 when none is pending
 
 } FAT_Data;
 
@@ -110,13 +107,6 @@ static uint32_t g_SectorsPerFat;
 
 uint32_t FAT_ClusterToLba(uint32_t cluster);
 
-int FAT_CompareLFNBlocks(const void* blockA, const void* blockB)
-{
-    FAT_LFNBlock* a = (FAT_LFNBlock*)blockA;
-    FAT_LFNBlock* b = (FAT_LFNBlock*)blockB;
-    return ((int)a->Order) - ((int)b->Order);
-}
-
 bool FAT_ReadBootSector(Partition* disk)
 {
     return Partition_ReadSectors(disk, 0, 1, g_Data->BS.BootSectorBytes);
@@ -199,7 +189,7 @@ bool FAT_Initialize(Partition* disk)
     // reset opened files
     for (int i = 0; i < MAX_FILE_HANDLES; i++)
         g_Data->OpenedFiles[i].Opened = false;
-    g_Data->LFNCount = 0;
+    g_Data->LFNNext = -1;
 
     return true;
 }
@@ -404,47 +394,98 @@ void FAT_GetShortName(const char* name, char shortName[12])
     }
 }
 
+uint8_t FAT_ShortNameChecksum(const uint8_t* shortName)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + shortName[i];
+    return sum;
+}
+
+// Adds an LFN entry to the pending long name, dropping the name if the entry is out of sequence
+void FAT_CollectLFN(const FAT_LongFileEntry* lfn)
+{
+    int order = lfn->Order & FAT_LFN_ORDER_MASK;
+
+    if ((lfn->Order & FAT_LFN_LAST) != 0)
+    {
+        // first entry on disk, holds the end of the name
+        if (order == 0 || order > FAT_LFN_MAX_ENTRIES)
+        {
+            g_Data->LFNNext = -1;
+            return;
+        }
+        g_Data->LFNChecksum = lfn->Checksum;
+        g_Data->LFNChars[order * FAT_LFN_CHARS] = 0;
+    }
+    else if (order == 0 || order != g_Data->LFNNext || lfn->Checksum != g_Data->LFNChecksum)
+    {
+        g_Data->LFNNext = -1;
+        return;
+    }
+
+    uint16_t* chars = g_Data->LFNChars + (order - 1) * FAT_LFN_CHARS;
+    memcpy(chars, lfn->Chars1, sizeof(lfn->Chars1));
+    memcpy(chars + 5, lfn->Chars2, sizeof(lfn->Chars2));
+    memcpy(chars + 11, lfn->Chars3, sizeof(lfn->Chars3));
+    g_Data->LFNNext = order - 1;
+}
+
+// Compares the pending long name with name, ignoring ASCII case
+bool FAT_MatchLFN(const char* name)
+{
+    char longName[MAX_PATH_SIZE * 2];
+    char* namePos = longName;
+    const uint16_t* chars = g_Data->LFNChars;
+
+    // the name ends at a NUL, or fills its last entry exactly
+    while (*chars != 0 && *chars != 0xFFFF && namePos < longName + sizeof(longName) - 4)
+    {
+        int codepoint;
+        chars = utf16_to_codepoint(chars, &codepoint);
+        namePos = codepoint_to_utf8(codepoint, namePos);
+    }
+    *namePos = 0;
+
+    for (namePos = longName; *namePos && *name; namePos++, name++)
+    {
+        if (toupper(*namePos) != toupper(*name))
+            return false;
+    }
+    return *namePos == *name;
+}
+
 bool FAT_FindFile(Partition* disk, FAT_File* file, const char* name, FAT_DirectoryEntry* entryOut)
 {
     char shortName[12];
-    //char longName[256];
     FAT_DirectoryEntry entry;
 
     FAT_GetShortName(name, shortName);
+    g_Data->LFNNext = -1;
 
     while (FAT_ReadEntry(disk, file, &entry))
     {
-        /*if (entry.Attributes == FAT_ATTRIBUTE_LFN) {
-            FAT_LongFileEntry* lfn = (FAT_LongFileEntry*)&entry;
-
-            int idx = g_Data->LFNCount++;
-            g_Data->LFNBlocks[idx].Order = lfn->Order & (FAT_LFN_LAST - 1);
-            memcpy(g_Data->LFNBlocks[idx].Chars, lfn->Chars1, sizeof(lfn->Chars1));
-            memcpy(g_Data->LFNBlocks[idx].Chars + 5, lfn->Chars2, sizeof(lfn->Chars2));
-            memcpy(g_Data->LFNBlocks[idx].Chars + 11, lfn->Chars1, sizeof(lfn->Chars3));
-
-            // is this the last LFN block
-            if ((lfn->Order & FAT_LFN_LAST) != 0) {
-                qsort(g_Data->LFNBlocks, g_Data->LFNCount, sizeof(FAT_LFNBlock), FAT_CompareLFNBlocks);
-                char* namePos = longName;
-                for (int i = 0; i < g_Data->LFNCount; i++)
-                {
-                    int16_t* chars = g_Data->LFNBlocks[i].Chars;
-                    int16_t* charsLimit = chars + 13;
-
-                    while (chars < charsLimit && *chars != 0)
-                    {
-                        int codepoint;
-                        chars = utf16_to_codepoint(chars, &codepoint);
-                        namePos = codepoint_to_utf8(codepoint, namePos);
-                    }
-                }
-                *namePos = 0;
-                printf("LFN: %s\n", longName);
-            }
-        }*/
+        if (entry.Name[0] == 0)
+            break;
+
+        if (entry.Name[0] == 0xE5)
+        {
+            // deleted, along with any long name pending for it
+            g_Data->LFNNext = -1;
+            continue;
+        }
+
+        if (entry.Attributes == FAT_ATTRIBUTE_LFN)
+        {
+            FAT_CollectLFN((const FAT_LongFileEntry*)&entry);
+            continue;
+        }
+
+        // a long name belongs to the short entry right after its last LFN entry
+        bool hasLongName = g_Data->LFNNext == 0 && g_Data->LFNChecksum == FAT_ShortNameChecksum(entry.Name);
+        g_Data->LFNNext = -1;
 
-        if (memcmp(shortName, entry.Name, 11) == 0)
+        if (memcmp(shortName, entry.Name, 11) == 0 || (hasLongName && FAT_MatchLFN(name)))
         {
             *entryOut = entry;
             return true;
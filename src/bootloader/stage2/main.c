@@ -11,6 +11,7 @@
 #include <elf.h>
 #include <memdetect.h>
 #include <boot/bootparams.h>
+#include <boot/bootprofile.h>
 
 uint8_t* KernelLoadBuffer = (uint8_t*)MEMORY_LOAD_KERNEL;
 uint8_t* Kernel = (uint8_t*)MEMORY_KERNEL_ADDR;
@@ -23,8 +24,10 @@ void __attribute__((cdecl)) start(uint16_t bootDrive, void* partition)
 {
     static int boot_count = 0;
     boot_count++;
+
+    g_BootParams.LoaderStartTsc = x86_ReadTsc();
     
-    printf("=== BOOTLOADER START (execution #%d) ===\n", boot_count);
+    boot_trace("=== BOOTLOADER START (execution #%d) ===\n", boot_count);
     
     if (boot_count > 1) {
         printf("WARNING: Bootloader restarted! Previous kernel execution failed.\n");
@@ -35,7 +38,7 @@ void __attribute__((cdecl)) start(uint16_t bootDrive, void* partition)
     
     clrscr();
 
-    printf("Step 1: Initializing disk...\n");
+    boot_trace("Step 1: Initializing disk...\n");
     DISK disk;
     if (!DISK_Initialize(&disk, bootDrive))
     {
@@ -43,25 +46,25 @@ void __attribute__((cdecl)) start(uint16_t bootDrive, void* partition)
         goto end;
     }
 
-    printf("Step 2: Detecting partition...\n");
+    boot_trace("Step 2: Detecting partition...\n");
     Partition part;
     MBR_DetectPartition(&part, &disk, partition);
 
-    printf("Step 3: Initializing FAT...\n");
+    boot_trace("Step 3: Initializing FAT...\n");
     if (!FAT_Initialize(&part))
     {
         printf("FAT init error\r\n");
         goto end;
     }
 
-    printf("Step 4: Preparing boot params...\n");
+    boot_trace("Step 4: Preparing boot params...\n");
     g_BootParams.BootDevice = bootDrive;
     
-    printf("Step 5: Detecting memory...\n");
+    boot_trace("Step 5: Detecting memory...\n");
     Memory_Detect(&g_BootParams.Memory);
-    printf("Memory detection completed.\n");
+    boot_trace("Memory detection completed.\n");
 
-    printf("Step 6: Loading kernel ELF...\n");
+    boot_trace("Step 6: Loading kernel ELF...\n");
     KernelStart kernelEntry;
     if (!ELF_Read(&part, "/boot/kernel.elf", (void**)&kernelEntry))
     {
@@ -69,20 +72,22 @@ void __attribute__((cdecl)) start(uint16_t bootDrive, void* partition)
         goto end;
     }
 
-    printf("Step 7: Kernel loaded at address: 0x%x\n", (uint32_t)kernelEntry);
+    boot_trace("Step 7: Kernel loaded at address: 0x%x\n", (uint32_t)kernelEntry);
     
     if ((uint32_t)kernelEntry < 0x100000) {
         printf("WARNING: Kernel address 0x%x seems too low! Expected >= 0x100000\n", (uint32_t)kernelEntry);
     }
 
-    printf("Checking kernel memory at 0x%x:\n", (uint32_t)kernelEntry);
     uint32_t* kernelPtr = (uint32_t*)kernelEntry;
-    
-    printf("  First 16 bytes: ");
-    for (int i = 0; i < 4; i++) {
-        printf("0x%x ", kernelPtr[i]);
+
+    if (BOOT_VERBOSE) {
+        printf("Checking kernel memory at 0x%x:\n", (uint32_t)kernelEntry);
+        printf("  First 16 bytes: ");
+        for (int i = 0; i < 4; i++) {
+            printf("0x%x ", kernelPtr[i]);
+        }
+        printf("\n");
     }
-    printf("\n");
     
     bool allZeros = true;
     for (int i = 0; i < 16; i++) {
@@ -101,9 +106,9 @@ void __attribute__((cdecl)) start(uint16_t bootDrive, void* partition)
         goto end;
     }
     
-    printf("Step 8: Kernel data looks valid, proceeding...\n");
+    boot_trace("Step 8: Kernel data looks valid, proceeding...\n");
     
-    printf("Step 9: Executing kernel NOW!\n");
+    boot_trace("Step 9: Executing kernel NOW!\n");
     kernelEntry(&g_BootParams);
     
     printf("ERROR: Kernel returned to bootloader! This should not happen.\n");
@@ -1,6 +1,7 @@
 #include <x86.h>
 #include <stdio.h>
 #include <boot/bootparams.h>
+#include <boot/bootprofile.h>
 
 #define MAX_REGIONS 256
 
@@ -14,13 +15,13 @@ void Memory_Detect(MemoryInfo* memoryInfo)
 {
     // SI YA SE EJECUTÓ, NO HACER NADA MÁS
     if (memory_detection_done) {
-        printf("Memory_Detect: Already executed, returning cached results\n");
+        boot_trace("Memory_Detect: Already executed, returning cached results\n");
         memoryInfo->RegionCount = g_MemRegionCount;
         memoryInfo->Regions = g_MemRegions;
         return;
     }
     
-    printf("Memory_Detect: First execution, detecting memory...\n");
+    boot_trace("Memory_Detect: First execution, detecting memory...\n");
     
     E820MemoryBlock block;
     uint32_t continuation = 0;
@@ -46,14 +47,14 @@ void Memory_Detect(MemoryInfo* memoryInfo)
 
             // Solo mostrar las primeras veces para reducir spam
             if (g_MemRegionCount < 10) {
-                printf("E820: base=0x%llx length=0x%llx type=0x%x\n", 
-                       block.Base, block.Length, block.Type);
+                boot_trace("E820: base=0x%llx length=0x%llx type=0x%x\n", 
+                           block.Base, block.Length, block.Type);
             }
         }
         
     } while (ret > 0 && continuation != 0);
 
-    printf("Memory detection completed: %d regions found\n", g_MemRegionCount);
+    boot_trace("Memory detection completed: %d regions found\n", g_MemRegionCount);
     
     // Marcar como completado
     memory_detection_done = 1;
@@ -62,5 +63,5 @@ void Memory_Detect(MemoryInfo* memoryInfo)
     memoryInfo->RegionCount = g_MemRegionCount;
     memoryInfo->Regions = g_MemRegions;
     
-    printf("Memory_Detect: Function completed, continuing boot...\n");
+    boot_trace("Memory_Detect: Function completed, continuing boot...\n");
 }
\ No newline at end of file
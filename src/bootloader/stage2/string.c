@@ -66,7 +66,7 @@ int strcmp(const char* a, const char* b)
     return (*a) - (*b);
 }
 
-wchar_t* utf16_to_codepoint(wchar_t* string, int* codepoint)
+const uint16_t* utf16_to_codepoint(const uint16_t* string, int* codepoint)
 {
     int c1 = *string;
     ++string;
@@ -76,7 +76,9 @@ wchar_t* utf16_to_codepoint(wchar_t* string, int* codepoint)
         ++string;
         *codepoint = ((c1 & 0x3ff) << 10) + (c2 & 0x3ff) + 0x10000;
     }
-    *codepoint = c1;
+    else {
+        *codepoint = c1;
+    }
 
     return string;
 }
@@ -113,7 +115,7 @@ wchar_t* utf16_to_codepoint(wchar_t* string, int* codepoint)
 char* codepoint_to_utf8(int codepoint, char* stringOutput)
 {
     if (codepoint <= 0x7F) {
-        *stringOutput = (char)codepoint;
+        *stringOutput++ = (char)codepoint;
     }
     else if (codepoint <= 0x7FF) {
         *stringOutput++ = 0xC0 | ((codepoint >> 6) & 0x1F);
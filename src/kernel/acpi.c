@@ -0,0 +1,226 @@
+#include <acpi.h>
+#include <pmm.h>
+#include <memory.h>
+#include <debug.h>
+
+#define MODULE "ACPI"
+
+// The RSDP sits on a 16 byte boundary in the first KB of the EBDA or in the BIOS area
+#define ACPI_EBDA_SEGMENT       0x40E
+#define ACPI_BIOS_START         0xE0000
+#define ACPI_BIOS_END           0x100000
+#define ACPI_RSDP_V1_LENGTH     20
+
+#define MADT_LOCAL_APIC                 0
+#define MADT_IO_APIC                    1
+#define MADT_SOURCE_OVERRIDE            2
+#define MADT_LOCAL_APIC_ADDRESS         5
+
+#define MADT_PCAT_COMPAT                0x1
+#define MADT_LOCAL_APIC_ENABLED         0x1
+
+typedef struct {
+    char Signature[8];
+    uint8_t Checksum;
+    char OemId[6];
+    uint8_t Revision;                   // 0 for ACPI 1.0, which ends after RsdtAddress
+    uint32_t RsdtAddress;
+    uint32_t Length;
+    uint64_t XsdtAddress;
+    uint8_t ExtendedChecksum;
+    uint8_t Reserved[3];
+} __attribute__((packed)) AcpiRsdp;
+
+typedef struct {
+    AcpiTableHeader Header;
+    uint32_t LocalApicAddress;
+    uint32_t Flags;
+} __attribute__((packed)) AcpiMadtHeader;
+
+typedef struct {
+    uint8_t Type;
+    uint8_t Length;
+} __attribute__((packed)) AcpiMadtEntry;
+
+typedef struct {
+    AcpiMadtEntry Entry;
+    uint8_t ProcessorId;
+    uint8_t ApicId;
+    uint32_t Flags;
+} __attribute__((packed)) AcpiMadtLocalApic;
+
+typedef struct {
+    AcpiMadtEntry Entry;
+    uint8_t Id;
+    uint8_t Reserved;
+    uint32_t Address;
+    uint32_t GsiBase;
+} __attribute__((packed)) AcpiMadtIoApic;
+
+typedef struct {
+    AcpiMadtEntry Entry;
+    uint8_t Bus;                        // always 0, ISA
+    uint8_t Source;
+    uint32_t Gsi;
+    uint16_t Flags;
+} __attribute__((packed)) AcpiMadtOverride;
+
+typedef struct {
+    AcpiMadtEntry Entry;
+    uint16_t Reserved;
+    uint64_t Address;
+} __attribute__((packed)) AcpiMadtLocalApicAddress;
+
+static bool g_Initialized = false;
+static const AcpiTableHeader* g_Root = NULL;   // RSDT or XSDT
+static bool g_RootIsXsdt = false;
+static AcpiMadt g_Madt;
+static bool g_HaveMadt = false;
+
+static bool acpi_checksum(const void* data, uint32_t length)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++)
+        sum += ((const uint8_t*)data)[i];
+    return sum == 0;
+}
+
+static bool acpi_reachable(uint64_t address, uint32_t length)
+{
+    return address != 0 && address + length <= PMM_MAX_MEMORY;
+}
+
+static const AcpiRsdp* acpi_scan(uint32_t start, uint32_t end)
+{
+    for (uint32_t address = start & ~0xF; address + sizeof(AcpiRsdp) <= end; address += 16) {
+        const AcpiRsdp* rsdp = (const AcpiRsdp*)address;
+        if (memcmp(rsdp->Signature, "RSD PTR ", 8) == 0 && acpi_checksum(rsdp, ACPI_RSDP_V1_LENGTH))
+            return rsdp;
+    }
+    return NULL;
+}
+
+static const AcpiTableHeader* acpi_map_table(uint64_t address)
+{
+    if (!acpi_reachable(address, sizeof(AcpiTableHeader)))
+        return NULL;
+
+    const AcpiTableHeader* table = (const AcpiTableHeader*)(uint32_t)address;
+    if (table->Length < sizeof(AcpiTableHeader) || !acpi_reachable(address, table->Length))
+        return NULL;
+    return acpi_checksum(table, table->Length) ? table : NULL;
+}
+
+static void acpi_parse_madt(const AcpiMadtHeader* madt)
+{
+    memset(&g_Madt, 0, sizeof(g_Madt));
+    g_Madt.LocalApicAddress = madt->LocalApicAddress;
+    g_Madt.LegacyPics = (madt->Flags & MADT_PCAT_COMPAT) != 0;
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++)
+        g_Madt.IsaGsi[irq] = irq;
+
+    const uint8_t* entry = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->Header.Length;
+    while (entry + sizeof(AcpiMadtEntry) <= end) {
+        const AcpiMadtEntry* header = (const AcpiMadtEntry*)entry;
+        if (header->Length < sizeof(AcpiMadtEntry) || entry + header->Length > end)
+            break;
+
+        switch (header->Type) {
+        case MADT_LOCAL_APIC: {
+            const AcpiMadtLocalApic* cpu = (const AcpiMadtLocalApic*)entry;
+            if ((cpu->Flags & MADT_LOCAL_APIC_ENABLED) && g_Madt.CpuCount < ACPI_MAX_CPUS)
+                g_Madt.CpuApicIds[g_Madt.CpuCount++] = cpu->ApicId;
+            break;
+        }
+        case MADT_IO_APIC: {
+            const AcpiMadtIoApic* ioapic = (const AcpiMadtIoApic*)entry;
+            if (g_Madt.IoApicCount < ACPI_MAX_IOAPICS) {
+                AcpiIoApic* out = &g_Madt.IoApics[g_Madt.IoApicCount++];
+                out->Id = ioapic->Id;
+                out->Address = ioapic->Address;
+                out->GsiBase = ioapic->GsiBase;
+            }
+            break;
+        }
+        case MADT_SOURCE_OVERRIDE: {
+            const AcpiMadtOverride* override = (const AcpiMadtOverride*)entry;
+            if (override->Bus == 0 && override->Source < ACPI_ISA_IRQS) {
+                g_Madt.IsaGsi[override->Source] = override->Gsi;
+                g_Madt.IsaFlags[override->Source] = override->Flags;
+            }
+            break;
+        }
+        case MADT_LOCAL_APIC_ADDRESS: {
+            const AcpiMadtLocalApicAddress* address = (const AcpiMadtLocalApicAddress*)entry;
+            if (address->Address < 0x100000000ULL)
+                g_Madt.LocalApicAddress = (uint32_t)address->Address;
+            break;
+        }
+        }
+        entry += header->Length;
+    }
+
+    g_HaveMadt = true;
+    log_info(MODULE, "MADT: %u CPUs, %u I/O APICs, local APIC at 0x%x",
+             g_Madt.CpuCount, g_Madt.IoApicCount, g_Madt.LocalApicAddress);
+}
+
+bool acpi_init(void)
+{
+    if (g_Initialized)
+        return g_Root != NULL;
+    g_Initialized = true;
+
+    uint32_t ebda = (uint32_t)*(volatile uint16_t*)ACPI_EBDA_SEGMENT << 4;
+    const AcpiRsdp* rsdp = ebda != 0 ? acpi_scan(ebda, ebda + 1024) : NULL;
+    if (rsdp == NULL)
+        rsdp = acpi_scan(ACPI_BIOS_START, ACPI_BIOS_END);
+    if (rsdp == NULL) {
+        log_warn(MODULE, "No RSDP found");
+        return false;
+    }
+
+    // The XSDT supersedes the RSDT when both are there
+    if (rsdp->Revision >= 2 && acpi_checksum(rsdp, rsdp->Length))
+        g_Root = acpi_map_table(rsdp->XsdtAddress);
+    g_RootIsXsdt = g_Root != NULL;
+    if (g_Root == NULL)
+        g_Root = acpi_map_table(rsdp->RsdtAddress);
+    if (g_Root == NULL) {
+        log_warn(MODULE, "Root table at 0x%x is unreadable", rsdp->RsdtAddress);
+        return false;
+    }
+
+    log_info(MODULE, "ACPI %s at 0x%x", g_RootIsXsdt ? "XSDT" : "RSDT", (uint32_t)g_Root);
+
+    const AcpiTableHeader* madt = acpi_find_table("APIC");
+    if (madt != NULL && madt->Length >= sizeof(AcpiMadtHeader))
+        acpi_parse_madt((const AcpiMadtHeader*)madt);
+    return true;
+}
+
+const AcpiTableHeader* acpi_find_table(const char* signature)
+{
+    if (g_Root == NULL)
+        return NULL;
+
+    uint32_t size = g_RootIsXsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+    uint32_t count = (g_Root->Length - sizeof(AcpiTableHeader)) / size;
+    const uint8_t* entries = (const uint8_t*)(g_Root + 1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t address = 0;
+        memcpy(&address, entries + i * size, size);
+
+        const AcpiTableHeader* table = acpi_map_table(address);
+        if (table != NULL && memcmp(table->Signature, signature, 4) == 0)
+            return table;
+    }
+    return NULL;
+}
+
+const AcpiMadt* acpi_get_madt(void)
+{
+    return g_HaveMadt ? &g_Madt : NULL;
+}
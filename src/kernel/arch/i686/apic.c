@@ -0,0 +1,294 @@
+#include <apic.h>
+#include <acpi.h>
+#include <i8259.h>
+#include <isr.h>
+#include <vmm.h>
+#include <debug.h>
+#include <stddef.h>
+
+#define MODULE "APIC"
+
+#define CPUID_FEATURE_APIC          0x200
+#define MSR_APIC_BASE               0x1B
+#define MSR_APIC_BASE_ENABLE        0x800
+
+// Local APIC registers, byte offsets from its base
+#define LAPIC_ID                    0x020
+#define LAPIC_VERSION               0x030
+#define LAPIC_TPR                   0x080
+#define LAPIC_EOI                   0x0B0
+#define LAPIC_SVR                   0x0F0
+#define LAPIC_ICR_LOW               0x300
+#define LAPIC_ICR_HIGH              0x310
+#define LAPIC_LVT_LINT0             0x350
+
+#define LAPIC_SVR_ENABLE            0x100
+#define LAPIC_LVT_MASKED            0x10000
+#define APIC_SPURIOUS_VECTOR        0xFF
+
+#define ICR_FIXED                   0x00000
+#define ICR_INIT                    0x00500
+#define ICR_STARTUP                 0x00600
+#define ICR_DELIVERY_PENDING        0x01000
+#define ICR_LEVEL_ASSERT            0x04000
+#define ICR_TRIGGER_LEVEL           0x08000
+
+// I/O APIC registers are reached through an index and a data window
+#define IOAPIC_REGSEL               0x00
+#define IOAPIC_WINDOW               0x10
+#define IOAPIC_REG_VERSION          0x01
+#define IOAPIC_REG_REDIRECTION      0x10        // two per pin, low then high
+
+#define IOAPIC_MASKED               0x10000
+#define IOAPIC_LEVEL                0x08000
+#define IOAPIC_ACTIVE_LOW           0x02000
+
+#define APIC_NO_PIN                 0xFFFFFFFF
+
+typedef struct {
+    volatile uint32_t* Base;
+    uint32_t GsiBase;
+    uint32_t Pins;
+} IoApic;
+
+static const AcpiMadt* g_Madt = NULL;
+static volatile uint32_t* g_LocalApic = NULL;
+static IoApic g_IoApics[ACPI_MAX_IOAPICS];
+static uint32_t g_IoApicCount = 0;
+static uint32_t g_IrqGsi[ACPI_ISA_IRQS];       // APIC_NO_PIN when another IRQ took its pin
+
+// Written by the IRQ_FAST entry stubs in place of the 8259 EOI, NULL while the 8259 is in use
+volatile uint32_t* g_LapicEoi = NULL;
+
+static inline uint32_t lapic_Read(uint32_t reg)
+{
+    return g_LocalApic[reg / 4];
+}
+
+static inline void lapic_Write(uint32_t reg, uint32_t value)
+{
+    g_LocalApic[reg / 4] = value;
+}
+
+static uint32_t ioapic_Read(IoApic* ioapic, uint32_t reg)
+{
+    ioapic->Base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic->Base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_Write(IoApic* ioapic, uint32_t reg, uint32_t value)
+{
+    ioapic->Base[IOAPIC_REGSEL / 4] = reg;
+    ioapic->Base[IOAPIC_WINDOW / 4] = value;
+}
+
+// The I/O APIC handling gsi, its pin through *pin
+static IoApic* ioapic_ForGsi(uint32_t gsi, uint32_t* pin)
+{
+    for (uint32_t i = 0; i < g_IoApicCount; i++) {
+        if (gsi >= g_IoApics[i].GsiBase && gsi < g_IoApics[i].GsiBase + g_IoApics[i].Pins) {
+            *pin = gsi - g_IoApics[i].GsiBase;
+            return &g_IoApics[i];
+        }
+    }
+    return NULL;
+}
+
+static void ioapic_SetMasked(int irq, bool masked)
+{
+    if (irq < 0 || irq >= ACPI_ISA_IRQS || g_IrqGsi[irq] == APIC_NO_PIN)
+        return;
+
+    uint32_t pin;
+    IoApic* ioapic = ioapic_ForGsi(g_IrqGsi[irq], &pin);
+    if (ioapic == NULL)
+        return;
+
+    uint32_t reg = IOAPIC_REG_REDIRECTION + pin * 2;
+    uint32_t low = ioapic_Read(ioapic, reg);
+    ioapic_Write(ioapic, reg, masked ? (low | IOAPIC_MASKED) : (low & ~IOAPIC_MASKED));
+}
+
+static void apic_Spurious(Registers* regs)
+{
+    // Nothing is in service, so no EOI either
+}
+
+static void lapic_EnableCpu()
+{
+    uint32_t low, high;
+    __asm__ volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(MSR_APIC_BASE));
+    __asm__ volatile ("wrmsr" : : "c"(MSR_APIC_BASE), "a"(low | MSR_APIC_BASE_ENABLE), "d"(high));
+
+    // Accept every priority, nothing raises the TPR since all IRQs go to the boot CPU anyway.
+    // ISA interrupts come through the I/O APIC rather than LINT0.
+    lapic_Write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_Write(LAPIC_TPR, 0);
+    lapic_Write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+}
+
+static void lapic_SendCommand(uint8_t apicId, uint32_t command)
+{
+    lapic_Write(LAPIC_ICR_HIGH, (uint32_t)apicId << 24);
+    lapic_Write(LAPIC_ICR_LOW, command);
+    while (lapic_Read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING)
+        __asm__ volatile ("pause");
+}
+
+bool apic_Probe()
+{
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_FEATURE_APIC) || !acpi_init())
+        return false;
+
+    g_Madt = acpi_get_madt();
+    return g_Madt != NULL && g_Madt->IoApicCount > 0;
+}
+
+void apic_Disable()
+{
+    for (uint32_t i = 0; i < g_IoApicCount; i++) {
+        for (uint32_t pin = 0; pin < g_IoApics[i].Pins; pin++)
+            ioapic_Write(&g_IoApics[i], IOAPIC_REG_REDIRECTION + pin * 2, IOAPIC_MASKED);
+    }
+}
+
+// autoEoi is the 8259's AEOI mode. The local APIC has no equivalent, every
+// interrupt it delivers waits for the write the IRQ stubs do to its EOI register.
+void apic_Initialize(uint8_t offsetPic1, uint8_t offsetPic2, bool autoEoi)
+{
+    if (autoEoi)
+        log_warn(MODULE, "No automatic EOI, interrupts are acknowledged by the IRQ stubs");
+
+    // Remapped away from the exceptions, in case one still raises a spurious IRQ
+    if (g_Madt->LegacyPics) {
+        const PICDriver* legacy = i8259_GetDriver();
+        legacy->Initialize(offsetPic1, offsetPic2, false);
+        legacy->Disable();
+    }
+
+    if (!vmm_map_device(g_Madt->LocalApicAddress, VMM_PAGE_SIZE))
+        log_warn(MODULE, "Could not map the local APIC at 0x%x", g_Madt->LocalApicAddress);
+    g_LocalApic = (volatile uint32_t*)g_Madt->LocalApicAddress;
+
+    i686_ISR_RegisterHandler(APIC_SPURIOUS_VECTOR, apic_Spurious);
+    lapic_EnableCpu();
+    uint32_t apicId = apic_GetLocalId();
+
+    g_IoApicCount = 0;
+    for (uint32_t i = 0; i < g_Madt->IoApicCount; i++) {
+        const AcpiIoApic* found = &g_Madt->IoApics[i];
+        if (!vmm_map_device(found->Address, VMM_PAGE_SIZE)) {
+            log_warn(MODULE, "Could not map the I/O APIC at 0x%x", found->Address);
+            continue;
+        }
+
+        IoApic* ioapic = &g_IoApics[g_IoApicCount++];
+        ioapic->Base = (volatile uint32_t*)found->Address;
+        ioapic->GsiBase = found->GsiBase;
+        ioapic->Pins = ((ioapic_Read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+    }
+    apic_Disable();
+
+    // An IRQ moved onto another one's pin (IRQ0 to GSI 2 usually) leaves the latter without one
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        g_IrqGsi[irq] = g_Madt->IsaGsi[irq];
+        for (uint32_t other = 0; other < ACPI_ISA_IRQS; other++) {
+            if (other != irq && g_Madt->IsaGsi[other] == irq && g_Madt->IsaGsi[irq] == irq)
+                g_IrqGsi[irq] = APIC_NO_PIN;
+        }
+    }
+
+    // Same vectors as the 8259 would use, so the IRQ entry stubs serve both.
+    // Everything goes to this CPU with fixed delivery, masked until a driver unmasks it:
+    // drivers, the block cache and the file systems only run on the boot CPU and take no
+    // locks against the others, so lowest priority delivery (and a TPR to steer it) would
+    // run their handlers where they are not safe.
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        uint32_t pin;
+        IoApic* ioapic = g_IrqGsi[irq] != APIC_NO_PIN ? ioapic_ForGsi(g_IrqGsi[irq], &pin) : NULL;
+        if (ioapic == NULL)
+            continue;
+
+        uint32_t vector = (irq < 8 ? offsetPic1 : offsetPic2 - 8) + irq;
+        uint32_t entry = IOAPIC_MASKED | vector;
+        if ((g_Madt->IsaFlags[irq] & ACPI_IRQ_POLARITY_MASK) == ACPI_IRQ_ACTIVE_LOW)
+            entry |= IOAPIC_ACTIVE_LOW;
+        if ((g_Madt->IsaFlags[irq] & ACPI_IRQ_TRIGGER_MASK) == ACPI_IRQ_LEVEL)
+            entry |= IOAPIC_LEVEL;
+
+        ioapic_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2 + 1, apicId << 24);
+        ioapic_Write(ioapic, IOAPIC_REG_REDIRECTION + pin * 2, entry);
+    }
+
+    g_LapicEoi = &g_LocalApic[LAPIC_EOI / 4];
+    log_info(MODULE, "Local APIC %u (version 0x%x), %u I/O APICs", apicId,
+             lapic_Read(LAPIC_VERSION) & 0xFF, g_IoApicCount);
+}
+
+void apic_SendEndOfInterrupt(int irq)
+{
+    lapic_Write(LAPIC_EOI, 0);
+}
+
+void apic_Mask(int irq)
+{
+    ioapic_SetMasked(irq, true);
+}
+
+void apic_Unmask(int irq)
+{
+    ioapic_SetMasked(irq, false);
+}
+
+static const PICDriver g_ApicDriver = {
+    .Name = "Local APIC + I/O APIC",
+    .Probe = &apic_Probe,
+    .Initialize = &apic_Initialize,
+    .Disable = &apic_Disable,
+    .SendEndOfInterrupt = &apic_SendEndOfInterrupt,
+    .Mask = &apic_Mask,
+    .Unmask = &apic_Unmask,
+};
+
+const PICDriver* apic_GetDriver()
+{
+    return &g_ApicDriver;
+}
+
+bool apic_IsActive()
+{
+    return g_LapicEoi != NULL;
+}
+
+uint8_t apic_GetLocalId()
+{
+    return lapic_Read(LAPIC_ID) >> 24;
+}
+
+void apic_InitializeCpu()
+{
+    lapic_EnableCpu();
+}
+
+void apic_EndOfInterrupt()
+{
+    lapic_Write(LAPIC_EOI, 0);
+}
+
+void apic_SendIpi(uint8_t apicId, uint8_t vector)
+{
+    lapic_SendCommand(apicId, ICR_FIXED | vector);
+}
+
+void apic_SendInit(uint8_t apicId)
+{
+    lapic_SendCommand(apicId, ICR_INIT | ICR_TRIGGER_LEVEL | ICR_LEVEL_ASSERT);
+    lapic_SendCommand(apicId, ICR_INIT | ICR_TRIGGER_LEVEL);
+}
+
+void apic_SendStartup(uint8_t apicId, uint32_t address)
+{
+    lapic_SendCommand(apicId, ICR_STARTUP | (address >> 12));
+}
@@ -1,4 +1,6 @@
 #include <gdt.h>
+#include <smp.h>
+#include <memory.h>
 #include <stdint.h>
 
 typedef struct
@@ -30,6 +32,7 @@ typedef enum
     GDT_ACCESS_CODE_SEGMENT                 = 0x18,
 
     GDT_ACCESS_DESCRIPTOR_TSS               = 0x00,
+    GDT_ACCESS_TSS_32BIT_AVAILABLE          = 0x09,
 
     GDT_ACCESS_RING0                        = 0x00,
     GDT_ACCESS_RING1                        = 0x20,
@@ -50,6 +53,21 @@ typedef enum
     GDT_FLAG_GRANULARITY_4K                 = 0x80,
 } GDT_FLAGS;
 
+// Only the ring 0 stack is used, there is no hardware task switching
+typedef struct
+{
+    uint32_t PrevTss;
+    uint32_t Esp0;
+    uint32_t Ss0;
+    uint32_t Esp1, Ss1, Esp2, Ss2;
+    uint32_t Cr3, Eip, Eflags;
+    uint32_t Eax, Ecx, Edx, Ebx, Esp, Ebp, Esi, Edi;
+    uint32_t Es, Cs, Ss, Ds, Fs, Gs;
+    uint32_t Ldt;
+    uint16_t Trap;
+    uint16_t IoMapBase;
+} __attribute__((packed)) TSSEntry;
+
 // Helper macros
 #define GDT_LIMIT_LOW(limit)                (limit & 0xFFFF)
 #define GDT_BASE_LOW(base)                  (base & 0xFFFF)
@@ -82,13 +100,69 @@ GDTEntry g_GDT[] = {
               GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_DATA_SEGMENT | GDT_ACCESS_DATA_WRITEABLE,
               GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_4K),
 
+    // User 32-bit code segment, SYSEXIT expects it right after the kernel ones
+    GDT_ENTRY(0,
+              0xFFFFF,
+              GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_CODE_SEGMENT | GDT_ACCESS_CODE_READABLE,
+              GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_4K),
+
+    // User 32-bit data segment
+    GDT_ENTRY(0,
+              0xFFFFF,
+              GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_DATA_SEGMENT | GDT_ACCESS_DATA_WRITEABLE,
+              GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_4K),
+
+    // TSS, its base is only known at run time
+    GDT_ENTRY(0, 0, 0, 0),
+
+    // Per CPU data, based at each CPU's Cpu
+    GDT_ENTRY(0, 0, 0, 0),
+
 };
 
-GDTDescriptor g_GDTDescriptor = { sizeof(g_GDT) - 1, g_GDT};
+// Every CPU runs on its own copy of g_GDT, with its TSS and per CPU data filled in
+static GDTEntry g_CpuGDT[SMP_MAX_CPUS][sizeof(g_GDT) / sizeof(GDTEntry)];
+static GDTDescriptor g_CpuGDTDescriptor[SMP_MAX_CPUS];
+static TSSEntry g_TSS[SMP_MAX_CPUS];
 
 void __attribute__((cdecl)) i686_GDT_Load(GDTDescriptor* descriptor, uint16_t codeSegment, uint16_t dataSegment);
 
 void i686_GDT_Initialize()
 {
-    i686_GDT_Load(&g_GDTDescriptor, i686_GDT_CODE_SEGMENT, i686_GDT_DATA_SEGMENT);
+    i686_GDT_InitializeCpu(0, smp_get_cpu(0));
+}
+
+void i686_GDT_InitializeCpu(uint32_t cpu, void* perCpu)
+{
+    GDTEntry* gdt = g_CpuGDT[cpu];
+    TSSEntry* tssEntry = &g_TSS[cpu];
+    memcpy(gdt, g_GDT, sizeof(g_GDT));
+
+    // Interrupts from ring 3 switch to Ss0:Esp0. No I/O bitmap, so ring 3 can't touch ports.
+    memset(tssEntry, 0, sizeof(TSSEntry));
+    tssEntry->Ss0 = i686_GDT_DATA_SEGMENT;
+    tssEntry->IoMapBase = sizeof(TSSEntry);
+
+    GDTEntry tss = GDT_ENTRY((uint32_t)tssEntry,
+                             sizeof(TSSEntry) - 1,
+                             GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_DESCRIPTOR_TSS | GDT_ACCESS_TSS_32BIT_AVAILABLE,
+                             0);
+    gdt[i686_GDT_TSS_SEGMENT / sizeof(GDTEntry)] = tss;
+
+    GDTEntry data = GDT_ENTRY((uint32_t)perCpu,
+                              0xFFFFF,
+                              GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_DATA_SEGMENT | GDT_ACCESS_DATA_WRITEABLE,
+                              GDT_FLAG_32BIT | GDT_FLAG_GRANULARITY_4K);
+    gdt[i686_GDT_PERCPU_SEGMENT / sizeof(GDTEntry)] = data;
+
+    g_CpuGDTDescriptor[cpu].Limit = sizeof(g_GDT) - 1;
+    g_CpuGDTDescriptor[cpu].Ptr = gdt;
+    i686_GDT_Load(&g_CpuGDTDescriptor[cpu], i686_GDT_CODE_SEGMENT, i686_GDT_DATA_SEGMENT);
+    __asm__ volatile ("ltr %w0" : : "r"(i686_GDT_TSS_SEGMENT));
+    __asm__ volatile ("mov %w0, %%gs" : : "r"(i686_GDT_PERCPU_SEGMENT));
+}
+
+void i686_TSS_SetKernelStack(uint32_t esp0)
+{
+    g_TSS[cpu_current()->Index].Esp0 = esp0;
 }
\ No newline at end of file
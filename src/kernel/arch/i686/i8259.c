@@ -126,7 +126,13 @@ void i8259_Mask(int irq)
 
 void i8259_Unmask(int irq)
 {
-    i8259_SetMask(g_PicMask & ~(1 << irq));
+    uint16_t mask = g_PicMask & ~(1 << irq);
+
+    // IRQs on the slave PIC only get through if the cascade line is open
+    if (irq >= 8)
+        mask &= ~(1 << 2);
+
+    i8259_SetMask(mask);
 }
 
 uint16_t i8259_ReadIrqRequestRegister()
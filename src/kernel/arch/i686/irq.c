@@ -1,40 +1,57 @@
 #include <irq.h>
 #include <pic.h>
 #include <i8259.h>
+#include <apic.h>
 #include <io.h>
 #include <stddef.h>
 #include <arrays.h>
 #include <stdio.h>
 #include <debug.h>
+#include <softirq.h>
 
 #define PIC_REMAP_OFFSET        0x20
 #define MODULE                  "PIC"
 
+// Called straight from the IRQ_FAST entry stubs, which also send the EOI
+// (port writes to the 8259, or the local APIC's EOI register when it is in use).
+// Never NULL, lines without a driver point at i686_IRQ_Unhandled.
 IRQHandler g_IRQHandlers[16];
 static const PICDriver* g_Driver = NULL;
 
-void i686_IRQ_Handler(Registers* regs)
+// Logging is slow (E9 and the log buffer), so the IRQ only notes the line
+static volatile uint16_t g_UnhandledIRQs = 0;
+
+static void i686_IRQ_LogUnhandled(void* data)
 {
-    int irq = regs->interrupt - PIC_REMAP_OFFSET;
-    
-    if (g_IRQHandlers[irq] != NULL)
-    {
-        // handle IRQ
-        g_IRQHandlers[irq](regs);
-    }
-    else
-    {
-        log_warn(MODULE, "Unhandled IRQ %d...", irq);
+    for (int irq = 0; irq < 16; irq++) {
+        if (g_UnhandledIRQs & (1 << irq)) {
+            g_UnhandledIRQs &= ~(1 << irq);
+            log_warn(MODULE, "Unhandled IRQ %d...", irq);
+        }
     }
+}
+
+static Tasklet g_UnhandledTasklet = { .Function = i686_IRQ_LogUnhandled };
 
-    // send EOI
-    g_Driver->SendEndOfInterrupt(irq);
+static void i686_IRQ_Unhandled(Registers* regs)
+{
+    g_UnhandledIRQs |= 1 << (regs->interrupt - PIC_REMAP_OFFSET);
+    tasklet_schedule(&g_UnhandledTasklet);
 }
 
+static void i686_IRQ_TestIgnored(Registers* regs)
+{
+}
+
+// Called from the IRQ_TEST stub of IRQ_TEST_VECTOR, never NULL either
+IRQHandler g_IRQTestHandler = i686_IRQ_TestIgnored;
+
 void i686_IRQ_Initialize()
 {
+    // The last one found wins, so the APIC is preferred over the 8259s
     const PICDriver* drivers[] = {
         i8259_GetDriver(),
+        apic_GetDriver(),
     };
 
     for (int i = 0; i < SIZE(drivers); i++) {
@@ -48,12 +65,14 @@ void i686_IRQ_Initialize()
         return;
     }
 
-    log_info(MODULE, "Found %s PIC.", g_Driver->Name);
+    log_info(MODULE, "Using %s.", g_Driver->Name);
     g_Driver->Initialize(PIC_REMAP_OFFSET, PIC_REMAP_OFFSET + 8, false);
 
-    // register ISR handlers for each of the 16 irq lines
-    for (int i = 0; i < 16; i++)
-        i686_ISR_RegisterHandler(PIC_REMAP_OFFSET + i, i686_IRQ_Handler);
+    // the entry stubs call these directly, without going through the ISR table
+    for (int i = 0; i < 16; i++) {
+        if (g_IRQHandlers[i] == NULL)
+            g_IRQHandlers[i] = i686_IRQ_Unhandled;
+    }
 
     // enable interrupts
     i686_EnableInterrupts();
@@ -64,5 +83,22 @@ void i686_IRQ_Initialize()
 
 void i686_IRQ_RegisterHandler(int irq, IRQHandler handler)
 {
-    g_IRQHandlers[irq] = handler;
+    g_IRQHandlers[irq] = handler != NULL ? handler : i686_IRQ_Unhandled;
+}
+
+void i686_IRQ_RegisterTestHandler(IRQHandler handler)
+{
+    g_IRQTestHandler = handler != NULL ? handler : i686_IRQ_TestIgnored;
+}
+
+void i686_IRQ_Mask(int irq)
+{
+    if (g_Driver != NULL)
+        g_Driver->Mask(irq);
+}
+
+void i686_IRQ_Unmask(int irq)
+{
+    if (g_Driver != NULL)
+        g_Driver->Unmask(irq);
 }
\ No newline at end of file
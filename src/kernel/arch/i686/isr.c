@@ -9,6 +9,7 @@
 #define MODULE          "ISR"
 
 ISRHandler g_ISRHandlers[256];
+static ISRHandler g_UserFaultHandler = NULL;
 
 static const char* const g_Exceptions[] = {
     "Divide by zero error",
@@ -63,6 +64,10 @@ void __attribute__((cdecl)) i686_ISR_Handler(Registers* regs)
 
     else if (regs->interrupt >= 32)
         log_err(MODULE, "Unhandled interrupt %d!", regs->interrupt);
+
+    // An exception in ring 3 only takes down the program
+    else if ((regs->cs & 3) && g_UserFaultHandler != NULL)
+        g_UserFaultHandler(regs);
     
     else 
     {
@@ -87,4 +92,9 @@ void i686_ISR_RegisterHandler(int interrupt, ISRHandler handler)
 {
     g_ISRHandlers[interrupt] = handler;
     i686_IDT_EnableGate(interrupt);
+}
+
+void i686_ISR_RegisterUserFaultHandler(ISRHandler handler)
+{
+    g_UserFaultHandler = handler;
 }
\ No newline at end of file
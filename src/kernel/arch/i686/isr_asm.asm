@@ -23,6 +23,133 @@ i686_ISR%1:
 
 %endmacro
 
+; Hardware interrupts skip isr_common and i686_ISR_Handler: the stub calls
+; the registered IRQ handler itself and acknowledges the 8259 inline.
+; The frame is the same Registers, so handlers see no difference.
+; Deferred work then runs from softirq_irq_exit with interrupts enabled.
+
+extern g_IRQHandlers
+extern softirq_irq_exit
+extern g_LapicEoi
+
+PIC1_COMMAND    equ 0x20
+PIC2_COMMAND    equ 0xA0
+PIC_EOI         equ 0x20
+REGS_CS         equ 48          ; offset in Registers
+KERNEL_DATA     equ 0x10
+KERNEL_PERCPU   equ 0x30        ; gs in the kernel, i686_GDT_PERCPU_SEGMENT
+
+%macro IRQ_FAST 2
+global i686_ISR%1:
+i686_ISR%1:
+    push 0              ; push dummy error code
+    push %1             ; push interrupt number
+    pusha
+
+    xor eax, eax        ; push ds
+    mov ax, ds
+    push eax
+
+    ; kernel segments are already loaded unless ring 3 was interrupted
+    test byte [esp + REGS_CS], 3
+    jz %%kernel_entry
+    mov ax, KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, KERNEL_PERCPU
+    mov gs, ax
+%%kernel_entry:
+
+    rdtsc               ; entry time, for the interrupts off histogram
+    push edx
+    push eax
+
+    lea eax, [esp + 8]
+    push eax            ; Registers*
+    call [g_IRQHandlers + 4 * %2]
+    add esp, 4
+
+    mov eax, [g_LapicEoi]
+    test eax, eax
+    jz %%pic_eoi
+    mov dword [eax], 0  ; local APIC, one uncached write
+    jmp %%eoi_done
+%%pic_eoi:
+    mov al, PIC_EOI
+%if %2 >= 8
+    out PIC2_COMMAND, al
+%endif
+    out PIC1_COMMAND, al
+%%eoi_done:
+
+    lea eax, [esp + 8]
+    push %2
+    push eax
+    call softirq_irq_exit
+    add esp, 16         ; arguments and entry time
+
+    pop eax
+    test byte [esp + REGS_CS - 4], 3
+    jz %%kernel_exit
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+%%kernel_exit:
+
+    popa
+    add esp, 8          ; remove error code and interrupt number
+    iret
+
+%endmacro
+
+; The IRQ_FAST entry and exit without EOI, entry time and softirq pass, on a
+; vector no device or PIC line uses. Only raised by int, to time the stub
+; itself without acknowledging an interrupt nobody sent.
+
+extern g_IRQTestHandler
+
+%macro IRQ_TEST 1
+global i686_ISR%1:
+i686_ISR%1:
+    push 0              ; push dummy error code
+    push %1             ; push interrupt number
+    pusha
+
+    xor eax, eax        ; push ds
+    mov ax, ds
+    push eax
+
+    test byte [esp + REGS_CS], 3
+    jz %%kernel_entry
+    mov ax, KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, KERNEL_PERCPU
+    mov gs, ax
+%%kernel_entry:
+
+    push esp            ; Registers*
+    call [g_IRQTestHandler]
+    add esp, 4
+
+    pop eax
+    test byte [esp + REGS_CS - 4], 3
+    jz %%kernel_exit
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+%%kernel_exit:
+
+    popa
+    add esp, 8          ; remove error code and interrupt number
+    iret
+
+%endmacro
+
 %include "arch/i686/isrs_gen.inc"
 
 isr_common:
@@ -32,10 +159,11 @@ isr_common:
     mov ax, ds
     push eax
 
-    mov ax, 0x10        ; use kernel data segment
+    mov ax, KERNEL_DATA ; use kernel data segment
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, KERNEL_PERCPU
     mov gs, ax
     
     push esp            ; pass pointer to stack to C, so we can access all the pushed information
@@ -46,7 +174,10 @@ isr_common:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    test byte [esp + REGS_CS - 4], 3
+    jz .kernel_exit     ; the kernel keeps gs on its per CPU data
     mov gs, ax
+.kernel_exit:
 
     popa                ; pop what we pushed with pusha
     add esp, 8          ; remove error code and interrupt number
@@ -0,0 +1,75 @@
+SMP_TRAMPOLINE_BASE     equ 0x70000         ; smp.h
+KERNEL_CODE             equ 0x08
+KERNEL_DATA             equ 0x10
+
+; Linear address of a label once the trampoline was copied into place
+%define TRAMPOLINE(label) (SMP_TRAMPOLINE_BASE + (label) - i686_SmpTrampoline)
+
+section .text
+
+; Copied to SMP_TRAMPOLINE_BASE by smp_init, where a startup IPI starts an AP in
+; real mode with cs = SMP_TRAMPOLINE_BASE >> 4. Turns on protected mode and paging
+; the way the boot CPU has them, then calls entry(cpu) on the given stack.
+global i686_SmpTrampoline
+global i686_SmpTrampolineParams
+global i686_SmpTrampolineEnd
+
+[bits 16]
+i686_SmpTrampoline:
+    cli
+    cld
+    mov ax, cs
+    mov ds, ax
+    lgdt [trampoline_gdtr - i686_SmpTrampoline]
+
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    jmp dword KERNEL_CODE:TRAMPOLINE(trampoline_protected)
+
+[bits 32]
+trampoline_protected:
+    mov ax, KERNEL_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; cr3 before cr0 turns paging on
+    mov eax, [TRAMPOLINE(trampoline_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(trampoline_cr3)]
+    mov cr3, eax
+    mov eax, [TRAMPOLINE(trampoline_cr0)]
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE(trampoline_stack)]
+    push dword [TRAMPOLINE(trampoline_cpu)]
+    call [TRAMPOLINE(trampoline_entry)]
+
+trampoline_halt:
+    cli
+    hlt
+    jmp trampoline_halt
+
+; Flat code and data, only until the entry loads the CPU's own GDT
+align 8
+trampoline_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+trampoline_gdtr:
+    dw trampoline_gdtr - trampoline_gdt - 1
+    dd TRAMPOLINE(trampoline_gdt)
+
+; Filled in by smp_init for each AP, SmpTrampolineParams in smp.c
+align 4
+i686_SmpTrampolineParams:
+trampoline_cr0:     dd 0
+trampoline_cr3:     dd 0
+trampoline_cr4:     dd 0
+trampoline_stack:   dd 0
+trampoline_cpu:     dd 0
+trampoline_entry:   dd 0
+i686_SmpTrampolineEnd:
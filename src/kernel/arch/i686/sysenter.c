@@ -0,0 +1,60 @@
+#include <sysenter.h>
+#include <gdt.h>
+#include <stdint.h>
+#include <debug.h>
+
+#define MODULE              "SYSENTER"
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+#define CPUID_FEATURE_SEP   0x800
+
+#define SYSENTER_STACK_SIZE 16384
+
+void __attribute__((cdecl)) i686_Sysenter();
+
+// Handlers run here while no program runs, the caller's esp only comes back through ecx
+static uint8_t g_SysenterStack[SYSENTER_STACK_SIZE] __attribute__((aligned(16)));
+static bool g_SysenterAvailable = false;
+
+static inline void i686_WriteMsr(uint32_t msr, uint32_t value)
+{
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+bool i686_Sysenter_Initialize()
+{
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+
+    // The first Pentium Pro steppings report SEP without implementing it
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    if (!(edx & CPUID_FEATURE_SEP) || (family == 6 && model < 3 && stepping < 3)) {
+        log_warn(MODULE, "Not supported, syscalls only go through int 0x80");
+        return false;
+    }
+
+    // SYSEXIT takes the user segments from the two entries after SYSENTER_CS
+    i686_WriteMsr(MSR_SYSENTER_CS, i686_GDT_CODE_SEGMENT);
+    i686_WriteMsr(MSR_SYSENTER_ESP, (uint32_t)(g_SysenterStack + SYSENTER_STACK_SIZE));
+    i686_WriteMsr(MSR_SYSENTER_EIP, (uint32_t)i686_Sysenter);
+
+    g_SysenterAvailable = true;
+    log_info(MODULE, "Fast syscall entry at 0x%x", (uint32_t)i686_Sysenter);
+    return true;
+}
+
+bool i686_Sysenter_Available()
+{
+    return g_SysenterAvailable;
+}
+
+void i686_Sysenter_SetKernelStack(uint32_t esp)
+{
+    if (g_SysenterAvailable)
+        i686_WriteMsr(MSR_SYSENTER_ESP, esp != 0 ? esp : (uint32_t)(g_SysenterStack + SYSENTER_STACK_SIZE));
+}
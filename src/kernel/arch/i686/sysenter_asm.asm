@@ -0,0 +1,62 @@
+[bits 32]
+
+extern syscall_dispatch
+
+SYSCALL_INVALID_PARAMS  equ -3
+USER_BASE               equ 0x80000000      ; VMM_USER_BASE
+USER_TOP                equ 0xC0000000      ; VMM_USER_TOP
+KERNEL_PERCPU           equ 0x30            ; i686_GDT_PERCPU_SEGMENT
+
+; Entered by SYSENTER with cs, ss and esp from the MSRs and interrupts off.
+; eax = syscall number, ebx, edi, esi = arg1..arg3, ecx = caller esp with arg4 on top,
+; edx = return address. Segments are flat, so ds is left as the caller had it,
+; only gs is switched to the per CPU data and back.
+; No local labels, the global fault labels in between would break them.
+global i686_Sysenter
+global i686_SysenterArgFault
+global i686_SysenterArgFixup
+i686_Sysenter:
+    push ds                 ; its RPL tells which ring called
+    push gs
+    push ecx
+    push edx
+    mov dx, KERNEL_PERCPU
+    mov gs, dx
+
+    ; Ring 3 may only point at its own stack
+    test dword [esp + 12], 3
+    jz i686_SysenterArgFault
+    cmp ecx, USER_BASE
+    jb sysenter_bad_stack
+    cmp ecx, USER_TOP - 4
+    ja sysenter_bad_stack
+
+i686_SysenterArgFault:
+    push dword [ecx]        ; arg4
+    push esi
+    push edi
+    push ebx
+    push eax
+    call syscall_dispatch   ; same checks as int 0x80, cdecl keeps ebx, esi, edi and ebp
+    add esp, 20
+    jmp sysenter_return
+
+i686_SysenterArgFixup:
+sysenter_bad_stack:
+    mov eax, SYSCALL_INVALID_PARAMS
+
+sysenter_return:
+    pop edx
+    pop ecx
+    pop gs
+    test dword [esp], 3
+    lea esp, [esp + 4]      ; leaves the flags alone
+    jnz sysenter_user
+
+    ; Kernel callers stay in ring 0, SYSEXIT would drop them to ring 3
+    mov esp, ecx
+    jmp edx
+
+sysenter_user:
+    sti                     ; takes effect after SYSEXIT
+    sysexit
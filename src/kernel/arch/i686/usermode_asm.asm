@@ -0,0 +1,142 @@
+[bits 32]
+
+extern usermode_set_kernel_stack
+
+; Offsets into Registers (isr.h)
+REGS_EDI        equ 4
+REGS_ESI        equ 8
+REGS_EBP        equ 12
+REGS_EBX        equ 20
+REGS_EDX        equ 24
+REGS_ECX        equ 28
+REGS_EAX        equ 32
+REGS_EIP        equ 44
+REGS_EFLAGS     equ 52
+REGS_ESP        equ 56
+
+; int __attribute__((cdecl)) i686_EnterUserMode(uint32_t* kernelEsp, const Registers* frame);
+; Loads the general registers, eip, eflags and esp of frame in ring 3.
+; Returns when i686_LeaveUserMode is called with the saved kernelEsp.
+global i686_EnterUserMode
+i686_EnterUserMode:
+    pushfd
+    push ebp
+    push ebx
+    push esi
+    push edi
+
+    mov eax, [esp + 24]
+    mov [eax], esp
+    mov esi, [esp + 28]
+
+    ; Interrupts and SYSENTER from ring 3 land right below the saved registers
+    mov eax, esp
+    push esi
+    push eax
+    call usermode_set_kernel_stack
+    add esp, 4
+    pop esi
+
+    push 0x23           ; ss
+    push dword [esi + REGS_ESP]
+    push dword [esi + REGS_EFLAGS]
+    push 0x1B           ; cs
+    push dword [esi + REGS_EIP]
+
+    ; in pusha order
+    push dword [esi + REGS_EAX]
+    push dword [esi + REGS_ECX]
+    push dword [esi + REGS_EDX]
+    push dword [esi + REGS_EBX]
+    push 0              ; esp, skipped by popa
+    push dword [esi + REGS_EBP]
+    push dword [esi + REGS_ESI]
+    push dword [esi + REGS_EDI]
+
+    cli                 ; no interrupt between here and iret, iret enables them again
+    mov ax, 0x23        ; user data segment, RPL 3
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    popa
+    iret
+
+; void __attribute__((cdecl)) i686_LeaveUserMode(uint32_t kernelEsp, int code);
+global i686_LeaveUserMode
+i686_LeaveUserMode:
+    mov eax, [esp + 8]
+    mov esp, [esp + 4]
+
+    mov cx, 0x10
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    mov cx, 0x30        ; per CPU data
+    mov gs, cx
+
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    popfd
+    ret
+
+; uint32_t __attribute__((cdecl)) i686_UserCopy(void* dst, const void* src, uint32_t size);
+; Returns the bytes left, 0 when everything was copied. A fault on the
+; copy resumes at the fixup with ecx still counting what was left.
+global i686_UserCopy
+global i686_UserCopyFault
+global i686_UserCopyFixup
+i686_UserCopy:
+    push esi
+    push edi
+    mov edi, [esp + 12]
+    mov esi, [esp + 16]
+    mov ecx, [esp + 20]
+    cld
+i686_UserCopyFault:
+    rep movsb
+i686_UserCopyFixup:
+    mov eax, ecx
+    pop edi
+    pop esi
+    ret
+
+; int32_t __attribute__((cdecl)) i686_UserStrCopy(char* dst, const char* src, uint32_t size);
+; Returns the length, size when no terminator was found, -1 after a fault
+global i686_UserStrCopy
+global i686_UserStrCopyFault
+global i686_UserStrCopyFixup
+i686_UserStrCopy:
+    push esi
+    push edi
+    mov edi, [esp + 12]
+    mov esi, [esp + 16]
+    mov ecx, [esp + 20]
+    xor edx, edx
+
+; no local labels here, the fault label in between would break them
+user_strcopy_next:
+    cmp edx, ecx
+    je user_strcopy_done
+i686_UserStrCopyFault:
+    mov al, [esi + edx]
+    mov [edi + edx], al
+    inc edx
+    test al, al
+    jnz user_strcopy_next
+    dec edx
+
+user_strcopy_done:
+    mov eax, edx
+    pop edi
+    pop esi
+    ret
+
+i686_UserStrCopyFixup:
+    mov eax, -1
+    pop edi
+    pop esi
+    ret
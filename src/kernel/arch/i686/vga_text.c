@@ -82,7 +82,8 @@ void VGA_scrollback(int lines)
     g_ScreenY -= lines;
 }
 
-void VGA_putc(char c)
+// Puts a character without moving the hardware cursor, which takes four port writes
+static void VGA_emit(char c)
 {
     switch (c)
     {
@@ -93,7 +94,7 @@ void VGA_putc(char c)
     
         case '\t':
             for (int i = 0; i < 4 - (g_ScreenX % 4); i++)
-                VGA_putc(' ');
+                VGA_emit(' ');
             break;
 
         case '\r':
@@ -113,6 +114,16 @@ void VGA_putc(char c)
     }
     if (g_ScreenY >= SCREEN_HEIGHT)
         VGA_scrollback(1);
+}
 
+void VGA_putc(char c)
+{
+    VGA_emit(c);
     VGA_setcursor(g_ScreenX, g_ScreenY);
+}
+
+void VGA_write(const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        VGA_emit(data[i]);
 }
\ No newline at end of file
@@ -0,0 +1,563 @@
+#include <bcache.h>
+#include <pmm.h>
+#include <time.h>
+#include <memory.h>
+#include <debug.h>
+#include <stddef.h>
+
+#define MODULE "BCache"
+
+#define BCACHE_HASH_BUCKETS     512
+#define BCACHE_READAHEAD_MIN    4
+#define BCACHE_READAHEAD_MAX    64          // also the longest run written back at once
+#define BCACHE_FLUSH_INTERVAL   1000        // ms between periodic write-back checks
+
+// Sequential access detection, one entry per device
+typedef struct {
+    BlockDev* Device;
+    uint64_t LastLba;
+    uint32_t Window;
+} ReadAheadState;
+
+static Buffer g_Buffers[BCACHE_BUFFER_COUNT];
+static Buffer* g_Hash[BCACHE_HASH_BUCKETS];
+static Buffer* g_LruHead = NULL;
+static Buffer* g_LruTail = NULL;
+static ReadAheadState g_ReadAhead[BLOCKDEV_MAX_DEVICES];
+static BCacheStats g_Stats;
+static uint64_t g_NextFlushTick = 0;
+static bool g_Initialized = false;
+
+static inline uint32_t bcache_hash(BlockDev* dev, uint64_t lba)
+{
+    return (((uint32_t)lba * 2654435761u) ^ ((uint32_t)dev >> 4)) % BCACHE_HASH_BUCKETS;
+}
+
+static Buffer* bcache_lookup(BlockDev* dev, uint64_t lba)
+{
+    for (Buffer* b = g_Hash[bcache_hash(dev, lba)]; b != NULL; b = b->HashNext) {
+        if (b->Device == dev && b->Lba == lba)
+            return b;
+    }
+    return NULL;
+}
+
+static void bcache_hash_insert(Buffer* b)
+{
+    uint32_t bucket = bcache_hash(b->Device, b->Lba);
+    b->HashNext = g_Hash[bucket];
+    g_Hash[bucket] = b;
+}
+
+static void bcache_hash_remove(Buffer* b)
+{
+    Buffer** link = &g_Hash[bcache_hash(b->Device, b->Lba)];
+    while (*link != NULL) {
+        if (*link == b) {
+            *link = b->HashNext;
+            break;
+        }
+        link = &(*link)->HashNext;
+    }
+    b->HashNext = NULL;
+}
+
+static void bcache_lru_unlink(Buffer* b)
+{
+    if (b->LruPrev) b->LruPrev->LruNext = b->LruNext;
+    else g_LruHead = b->LruNext;
+
+    if (b->LruNext) b->LruNext->LruPrev = b->LruPrev;
+    else g_LruTail = b->LruPrev;
+
+    b->LruPrev = b->LruNext = NULL;
+}
+
+static void bcache_lru_push_front(Buffer* b)
+{
+    b->LruPrev = NULL;
+    b->LruNext = g_LruHead;
+    if (g_LruHead) g_LruHead->LruPrev = b;
+    else g_LruTail = b;
+    g_LruHead = b;
+}
+
+static void bcache_touch(Buffer* b)
+{
+    if (g_LruHead != b) {
+        bcache_lru_unlink(b);
+        bcache_lru_push_front(b);
+    }
+}
+
+static void bcache_io_done(BlockRequest* request, bool success)
+{
+    Buffer* b = (Buffer*)request->Context;
+    if (success && !request->Write)
+        b->Flags |= BUFFER_VALID;
+    b->Flags &= ~BUFFER_IO;
+}
+
+// Queues a single block transfer, the queue merges neighbouring blocks into one command
+static bool bcache_submit(Buffer* b, bool write)
+{
+    BlockRequest* r = &b->Request;
+    r->Lba = b->Lba;
+    r->Count = 1;
+    r->Buffer = b->Data;
+    r->Write = write;
+    r->Done = bcache_io_done;
+    r->Context = b;
+
+    b->Flags |= BUFFER_IO;
+    if (!blkq_submit(b->Device, r)) {
+        b->Flags &= ~BUFFER_IO;
+        r->Completed = true;
+        r->Success = false;
+        return false;
+    }
+    return true;
+}
+
+// Takes b out of the cache, it is reused before any other buffer
+static void bcache_forget(Buffer* b)
+{
+    if (b->Device != NULL) {
+        bcache_hash_remove(b);
+        g_Stats.CachedBlocks--;
+    }
+
+    b->Flags = 0;
+    b->Device = NULL;
+
+    bcache_lru_unlink(b);
+    if (g_LruTail) {
+        g_LruTail->LruNext = b;
+        b->LruPrev = g_LruTail;
+        g_LruTail = b;
+    }
+    else {
+        g_LruHead = g_LruTail = b;
+    }
+}
+
+static ReadAheadState* bcache_readahead_state(BlockDev* dev)
+{
+    ReadAheadState* free = NULL;
+    for (int i = 0; i < BLOCKDEV_MAX_DEVICES; i++) {
+        if (g_ReadAhead[i].Device == dev)
+            return &g_ReadAhead[i];
+        if (g_ReadAhead[i].Device == NULL && free == NULL)
+            free = &g_ReadAhead[i];
+    }
+
+    if (free != NULL) {
+        free->Device = dev;
+        free->LastLba = (uint64_t)-2;
+        free->Window = BCACHE_READAHEAD_MIN;
+    }
+    return free;
+}
+
+static void bcache_clear_dirty(Buffer* b)
+{
+    if (b->Flags & BUFFER_DIRTY) {
+        b->Flags &= ~BUFFER_DIRTY;
+        g_Stats.DirtyBlocks--;
+    }
+}
+
+// Writes the dirty run starting at b, the queue coalesces it into one request
+static bool bcache_write_run(Buffer* b)
+{
+    Buffer* run[BCACHE_READAHEAD_MAX];
+    uint32_t count = 0;
+
+    run[count++] = b;
+    while (count < BCACHE_READAHEAD_MAX) {
+        Buffer* next = bcache_lookup(b->Device, b->Lba + count);
+        if (next == NULL || !(next->Flags & BUFFER_DIRTY))
+            break;
+        run[count++] = next;
+    }
+
+    blkq_plug(b->Device);
+    for (uint32_t i = 0; i < count; i++)
+        bcache_submit(run[i], true);
+    blkq_unplug(b->Device);
+
+    bool ok = true;
+    for (uint32_t i = 0; i < count; i++)
+        ok &= blkq_wait(&run[i]->Request);
+
+    if (!ok) {
+        log_err(MODULE, "Write back of %s LBA %llu (%u blocks) failed", b->Device->Name, b->Lba, count);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        bcache_clear_dirty(run[i]);
+
+    g_Stats.BlocksWritten += count;
+    return true;
+}
+
+static inline bool bcache_needs_writeback(Buffer* b, BlockDev* dev, uint64_t olderThan)
+{
+    return (b->Flags & BUFFER_DIRTY) && b->Device == dev && b->DirtySince <= olderThan;
+}
+
+// Queues every qualifying dirty block of dev at once and lets the elevator sort and merge them
+static bool bcache_writeback_device(BlockDev* dev, uint64_t olderThan, bool* wrote)
+{
+    blkq_plug(dev);
+    for (int i = 0; i < BCACHE_BUFFER_COUNT; i++) {
+        if (bcache_needs_writeback(&g_Buffers[i], dev, olderThan))
+            bcache_submit(&g_Buffers[i], true);
+    }
+    blkq_unplug(dev);
+
+    bool ok = true;
+    for (int i = 0; i < BCACHE_BUFFER_COUNT; i++) {
+        Buffer* b = &g_Buffers[i];
+        if (!bcache_needs_writeback(b, dev, olderThan))
+            continue;
+
+        *wrote = true;
+        if (blkq_wait(&b->Request)) {
+            bcache_clear_dirty(b);
+            g_Stats.BlocksWritten++;
+        }
+        else {
+            ok = false;
+        }
+    }
+
+    if (!ok)
+        log_err(MODULE, "Write back to %s failed", dev->Name);
+    return ok;
+}
+
+// Writes back dirty blocks of dev (NULL = all devices) dirtied at or before 'olderThan'
+static bool bcache_writeback(BlockDev* dev, uint64_t olderThan)
+{
+    bool ok = true;
+    bool wrote = false;
+
+    for (int i = 0; i < blockdev_get_count(); i++) {
+        BlockDev* d = blockdev_get(i);
+        if (dev == NULL || d == dev)
+            ok &= bcache_writeback_device(d, olderThan, &wrote);
+    }
+
+    if (wrote)
+        g_Stats.Flushes++;
+
+    return ok;
+}
+
+// Finds a buffer to reuse, least recently used first. Dirty victims are written back
+// first, unless 'cleanOnly' is set because the device queue is plugged.
+static Buffer* bcache_evict(bool cleanOnly)
+{
+    for (Buffer* b = g_LruTail; b != NULL; b = b->LruPrev) {
+        if (b->RefCount > 0 || (b->Flags & BUFFER_IO) || (cleanOnly && (b->Flags & BUFFER_DIRTY)))
+            continue;
+
+        if (b->Flags & BUFFER_DIRTY) {
+            if (!bcache_write_run(b))
+                continue;
+            g_Stats.DirtyEvictions++;
+        }
+
+        if (b->Device != NULL) {
+            bcache_hash_remove(b);
+            g_Stats.Evictions++;
+            g_Stats.CachedBlocks--;
+        }
+
+        b->Flags = 0;
+        b->Device = NULL;
+        return b;
+    }
+
+    if (!cleanOnly)
+        log_err(MODULE, "All buffers are in use");
+    return NULL;
+}
+
+static Buffer* bcache_assign(BlockDev* dev, uint64_t lba, bool cleanOnly)
+{
+    Buffer* b = bcache_evict(cleanOnly);
+    if (b == NULL)
+        return NULL;
+
+    b->Device = dev;
+    b->Lba = lba;
+    bcache_hash_insert(b);
+    bcache_touch(b);
+    g_Stats.CachedBlocks++;
+    return b;
+}
+
+// Reads lba and, on sequential access, queues the following window of uncached blocks behind it.
+// Only the requested block is waited for, the read-ahead blocks complete in the background.
+static bool bcache_fill(Buffer* b, ReadAheadState* ra)
+{
+    BlockDev* dev = b->Device;
+    uint32_t count = 1;
+
+    if (ra != NULL && b->Lba == ra->LastLba + 1) {
+        count = ra->Window;
+        if (ra->Window < BCACHE_READAHEAD_MAX)
+            ra->Window *= 2;
+    }
+    else if (ra != NULL) {
+        ra->Window = BCACHE_READAHEAD_MIN;
+    }
+
+    if (b->Lba + count > dev->BlockCount)
+        count = dev->BlockCount - b->Lba;
+
+    // Stop at the first block that is already cached
+    uint32_t limit = 1;
+    while (limit < count && bcache_lookup(dev, b->Lba + limit) == NULL)
+        limit++;
+    count = limit;
+
+    // Keep the requested block referenced so eviction can't pick it for the read-ahead blocks
+    b->RefCount++;
+    blkq_plug(dev);
+
+    bool submitted = bcache_submit(b, false);
+    for (uint32_t i = 1; submitted && i < count; i++) {
+        Buffer* ahead = bcache_assign(dev, b->Lba + i, true);
+        if (ahead == NULL)
+            break;
+
+        ahead->Flags = BUFFER_READAHEAD;
+        if (!bcache_submit(ahead, false)) {
+            bcache_forget(ahead);
+            break;
+        }
+        g_Stats.ReadAheadBlocks++;
+    }
+
+    blkq_unplug(dev);
+    b->RefCount--;
+
+    // The requested block is the one that must survive the longest
+    bcache_touch(b);
+    return submitted && blkq_wait(&b->Request);
+}
+
+static Buffer* bcache_get_block(BlockDev* dev, uint64_t lba, bool read)
+{
+    if (!g_Initialized || dev == NULL || dev->BlockSize != BCACHE_BLOCK_SIZE || lba >= dev->BlockCount)
+        return NULL;
+
+    g_Stats.Lookups++;
+    ReadAheadState* ra = bcache_readahead_state(dev);
+
+    Buffer* b = bcache_lookup(dev, lba);
+    if (b != NULL) {
+        g_Stats.Hits++;
+        // A read-ahead block may still be on its way
+        if (b->Flags & BUFFER_IO)
+            blkq_wait(&b->Request);
+
+        if (b->Flags & BUFFER_READAHEAD) {
+            b->Flags &= ~BUFFER_READAHEAD;
+            g_Stats.ReadAheadHits++;
+        }
+
+        if (!(b->Flags & BUFFER_VALID)) {
+            // Its read-ahead failed, try once more on its own
+            if (!read) {
+                b->Flags |= BUFFER_VALID;
+            }
+            else if (!bcache_submit(b, false) || !blkq_wait(&b->Request)) {
+                bcache_forget(b);
+                return NULL;
+            }
+        }
+    }
+    else {
+        g_Stats.Misses++;
+
+        b = bcache_assign(dev, lba, false);
+        if (b == NULL)
+            return NULL;
+
+        if (read) {
+            if (!bcache_fill(b, ra)) {
+                bcache_forget(b);
+                return NULL;
+            }
+        }
+        else {
+            // The caller overwrites the whole block, no need to read it
+            b->Flags |= BUFFER_VALID;
+        }
+    }
+
+    if (ra != NULL)
+        ra->LastLba = lba;
+
+    bcache_touch(b);
+    b->RefCount++;
+    return b;
+}
+
+void bcache_init(void)
+{
+    uint32_t frames = BCACHE_BUFFER_COUNT * BCACHE_BLOCK_SIZE / PMM_FRAME_SIZE;
+
+    uint32_t data = pmm_alloc_frames(frames);
+    if (data == 0) {
+        log_err(MODULE, "Not enough memory for the buffer cache");
+        return;
+    }
+
+    for (int i = 0; i < BCACHE_BUFFER_COUNT; i++) {
+        Buffer* b = &g_Buffers[i];
+        memset(b, 0, sizeof(Buffer));
+        b->Data = (uint8_t*)(data + i * BCACHE_BLOCK_SIZE);
+        bcache_lru_push_front(b);
+    }
+
+    memset(&g_Stats, 0, sizeof(g_Stats));
+    g_NextFlushTick = time_get_ticks() + BCACHE_FLUSH_INTERVAL;
+    g_Initialized = true;
+
+    log_info(MODULE, "%u buffers of %u bytes", BCACHE_BUFFER_COUNT, BCACHE_BLOCK_SIZE);
+}
+
+Buffer* bcache_get(BlockDev* dev, uint64_t lba)
+{
+    return bcache_get_block(dev, lba, true);
+}
+
+void bcache_release(Buffer* buffer)
+{
+    if (buffer != NULL && buffer->RefCount > 0)
+        buffer->RefCount--;
+}
+
+void bcache_mark_dirty(Buffer* buffer)
+{
+    if (!(buffer->Flags & BUFFER_DIRTY)) {
+        buffer->Flags |= BUFFER_DIRTY;
+        buffer->DirtySince = time_get_ticks();
+        g_Stats.DirtyBlocks++;
+    }
+}
+
+bool bcache_read(BlockDev* dev, uint64_t lba, uint32_t offset, void* data, uint32_t size)
+{
+    uint8_t* out = (uint8_t*)data;
+
+    while (size > 0) {
+        lba += offset / BCACHE_BLOCK_SIZE;
+        offset %= BCACHE_BLOCK_SIZE;
+
+        Buffer* b = bcache_get(dev, lba);
+        if (b == NULL)
+            return false;
+
+        uint32_t chunk = BCACHE_BLOCK_SIZE - offset;
+        if (chunk > size)
+            chunk = size;
+
+        memcpy(out, b->Data + offset, chunk);
+        bcache_release(b);
+
+        out += chunk;
+        size -= chunk;
+        offset += chunk;
+    }
+
+    return true;
+}
+
+bool bcache_write(BlockDev* dev, uint64_t lba, uint32_t offset, const void* data, uint32_t size)
+{
+    const uint8_t* in = (const uint8_t*)data;
+
+    while (size > 0) {
+        lba += offset / BCACHE_BLOCK_SIZE;
+        offset %= BCACHE_BLOCK_SIZE;
+
+        uint32_t chunk = BCACHE_BLOCK_SIZE - offset;
+        if (chunk > size)
+            chunk = size;
+
+        // Whole block writes skip reading the old contents
+        Buffer* b = bcache_get_block(dev, lba, chunk != BCACHE_BLOCK_SIZE);
+        if (b == NULL)
+            return false;
+
+        memcpy(b->Data + offset, in, chunk);
+        bcache_mark_dirty(b);
+        bcache_release(b);
+
+        in += chunk;
+        size -= chunk;
+        offset += chunk;
+    }
+
+    return true;
+}
+
+bool bcache_sync(BlockDev* dev)
+{
+    if (!g_Initialized)
+        return true;
+
+    bool ok = bcache_writeback(dev, (uint64_t)-1);
+
+    for (int i = 0; i < blockdev_get_count(); i++) {
+        BlockDev* d = blockdev_get(i);
+        if ((dev == NULL || d == dev) && d->Flush != NULL)
+            ok &= d->Flush(d);
+    }
+
+    return ok;
+}
+
+void bcache_invalidate(BlockDev* dev)
+{
+    for (int i = 0; i < BCACHE_BUFFER_COUNT; i++) {
+        Buffer* b = &g_Buffers[i];
+        if (b->Device != dev || b->RefCount > 0 || (b->Flags & (BUFFER_DIRTY | BUFFER_IO)))
+            continue;
+
+        bcache_forget(b);
+    }
+}
+
+void bcache_periodic_flush(void)
+{
+    uint64_t now = time_get_ticks();
+    if (!g_Initialized || now < g_NextFlushTick)
+        return;
+
+    g_NextFlushTick = now + BCACHE_FLUSH_INTERVAL;
+    if (g_Stats.DirtyBlocks > 0 && now >= BCACHE_WRITEBACK_MS)
+        bcache_writeback(NULL, now - BCACHE_WRITEBACK_MS);
+}
+
+void bcache_get_stats(BCacheStats* stats)
+{
+    *stats = g_Stats;
+}
+
+void bcache_reset_stats(void)
+{
+    uint32_t dirty = g_Stats.DirtyBlocks;
+    uint32_t cached = g_Stats.CachedBlocks;
+
+    memset(&g_Stats, 0, sizeof(g_Stats));
+    g_Stats.DirtyBlocks = dirty;
+    g_Stats.CachedBlocks = cached;
+}
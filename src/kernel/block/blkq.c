@@ -0,0 +1,320 @@
+#include <blkq.h>
+#include <io.h>
+#include <time.h>
+#include <memory.h>
+#include <debug.h>
+#include <stddef.h>
+
+#define MODULE "BlkQ"
+
+#define BLKQ_DEFAULT_MAX_SECTORS    256
+
+typedef struct BlockQueue {
+    BlockDev* Device;
+    BlockRequest* Pending;              // sorted by LBA
+    BlockRequest* InFlight;
+    uint64_t HeadLba;                   // where the last dispatched request ended
+    int Plugged;
+    bool Dispatching;
+    BlockQueueStats Stats;
+} BlockQueue;
+
+static BlockQueue g_Queues[BLOCKDEV_MAX_DEVICES];
+static int g_QueueCount = 0;
+
+void blkq_init_device(BlockDev* dev)
+{
+    if (g_QueueCount >= BLOCKDEV_MAX_DEVICES)
+        return;
+
+    BlockQueue* q = &g_Queues[g_QueueCount++];
+    memset(q, 0, sizeof(BlockQueue));
+    q->Device = dev;
+    dev->Queue = q;
+
+    if (dev->MaxSectors == 0)
+        dev->MaxSectors = BLKQ_DEFAULT_MAX_SECTORS;
+}
+
+static bool blkq_try_merge(BlockQueue* q, BlockRequest* request)
+{
+    for (BlockRequest** link = &q->Pending; *link != NULL; link = &(*link)->Next) {
+        BlockRequest* r = *link;
+
+        if (r->Write != request->Write || r->Segments >= BLKQ_MAX_SEGMENTS ||
+            r->TotalCount + request->Count > q->Device->MaxSectors)
+            continue;
+
+        // Back merge, the new request continues where r's chain ends
+        if (r->Lba + r->TotalCount == request->Lba) {
+            BlockRequest* tail = r;
+            while (tail->MergeNext != NULL)
+                tail = tail->MergeNext;
+
+            tail->MergeNext = request;
+            r->TotalCount += request->Count;
+            r->Segments++;
+            if (request->Deadline < r->Deadline)
+                r->Deadline = request->Deadline;
+
+            q->Stats.BackMerges++;
+            return true;
+        }
+
+        // Front merge, the new request becomes the head of r's chain
+        if (request->Lba + request->Count == r->Lba) {
+            request->MergeNext = r;
+            request->TotalCount = r->TotalCount + request->Count;
+            request->Segments = r->Segments + 1;
+            if (r->Deadline < request->Deadline)
+                request->Deadline = r->Deadline;
+
+            request->Next = r->Next;
+            *link = request;
+
+            q->Stats.FrontMerges++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void blkq_insert_sorted(BlockQueue* q, BlockRequest* request)
+{
+    BlockRequest** link = &q->Pending;
+    while (*link != NULL && (*link)->Lba < request->Lba)
+        link = &(*link)->Next;
+
+    request->Next = *link;
+    *link = request;
+}
+
+// Deadline first, otherwise C-LOOK: the next request above the head, wrapping to the lowest LBA
+static BlockRequest* blkq_pick(BlockQueue* q)
+{
+    uint64_t now = time_get_ticks();
+    BlockRequest* expired = NULL;
+    BlockRequest* ahead = NULL;
+
+    for (BlockRequest* r = q->Pending; r != NULL; r = r->Next) {
+        if (r->Deadline <= now && (expired == NULL || r->Deadline < expired->Deadline))
+            expired = r;
+        if (ahead == NULL && r->Lba >= q->HeadLba)
+            ahead = r;
+    }
+
+    if (expired != NULL && expired != ahead) {
+        q->Stats.Expired++;
+        return expired;
+    }
+
+    return ahead != NULL ? ahead : q->Pending;
+}
+
+static void blkq_unlink(BlockQueue* q, BlockRequest* request)
+{
+    BlockRequest** link = &q->Pending;
+    while (*link != request)
+        link = &(*link)->Next;
+
+    *link = request->Next;
+    request->Next = NULL;
+}
+
+// Runs synchronous devices' requests one after another
+static bool blkq_run_sync(BlockDev* dev, BlockRequest* request)
+{
+    for (BlockRequest* r = request; r != NULL; r = r->MergeNext) {
+        bool ok = r->Write ? dev->Write(dev, r->Lba, r->Count, r->Buffer)
+                           : dev->Read(dev, r->Lba, r->Count, r->Buffer);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+static void blkq_dispatch(BlockQueue* q)
+{
+    for (;;) {
+        uint32_t flags = i686_SaveInterrupts();
+
+        // Completions re-enter here from the IRQ, the outer loop picks up their work
+        if (q->Dispatching || q->InFlight != NULL || q->Pending == NULL || q->Plugged > 0) {
+            i686_RestoreInterrupts(flags);
+            return;
+        }
+
+        BlockRequest* request = blkq_pick(q);
+        blkq_unlink(q, request);
+        q->InFlight = request;
+        q->HeadLba = request->Lba + request->TotalCount;
+        q->Dispatching = true;
+        q->Stats.Depth -= request->Segments;
+        q->Stats.Dispatched++;
+        i686_RestoreInterrupts(flags);
+
+        BlockDev* dev = q->Device;
+        if (dev->Submit != NULL) {
+            if (!dev->Submit(dev, request))
+                blkq_complete(dev, false);
+        }
+        else {
+            blkq_complete(dev, blkq_run_sync(dev, request));
+        }
+
+        flags = i686_SaveInterrupts();
+        q->Dispatching = false;
+        i686_RestoreInterrupts(flags);
+    }
+}
+
+bool blkq_submit(BlockDev* dev, BlockRequest* request)
+{
+    BlockQueue* q = dev->Queue;
+    if (q == NULL || request->Count == 0 || request->Lba + request->Count > dev->BlockCount)
+        return false;
+
+    request->Completed = false;
+    request->Success = false;
+    request->Device = dev;
+    request->TotalCount = request->Count;
+    request->Segments = 1;
+    request->Next = NULL;
+    request->MergeNext = NULL;
+    request->Deadline = time_get_ticks() + (request->Write ? BLKQ_WRITE_EXPIRE_MS : BLKQ_READ_EXPIRE_MS);
+
+    uint32_t flags = i686_SaveInterrupts();
+    q->Stats.Submitted++;
+    if (!blkq_try_merge(q, request))
+        blkq_insert_sorted(q, request);
+
+    q->Stats.Depth++;
+    q->Stats.DepthSum += q->Stats.Depth;
+    if (q->Stats.Depth > q->Stats.MaxDepth)
+        q->Stats.MaxDepth = q->Stats.Depth;
+    i686_RestoreInterrupts(flags);
+
+    blkq_dispatch(q);
+    return true;
+}
+
+void blkq_complete(BlockDev* dev, bool success)
+{
+    BlockQueue* q = dev->Queue;
+
+    uint32_t flags = i686_SaveInterrupts();
+    BlockRequest* request = q->InFlight;
+    q->InFlight = NULL;
+    if (request != NULL) {
+        q->Stats.Completed++;
+        if (!success)
+            q->Stats.Errors++;
+    }
+    i686_RestoreInterrupts(flags);
+
+    if (request == NULL)
+        return;
+
+    if (!success)
+        log_err(MODULE, "%s: %s of LBA %llu (%u sectors) failed", dev->Name,
+                request->Write ? "Write" : "Read", request->Lba, request->TotalCount);
+
+    // Done may resubmit its request, so nothing is touched after calling it
+    while (request != NULL) {
+        BlockRequest* next = request->MergeNext;
+        request->Success = success;
+        request->Completed = true;
+        if (request->Done != NULL)
+            request->Done(request, success);
+        request = next;
+    }
+
+    blkq_dispatch(q);
+}
+
+void blkq_plug(BlockDev* dev)
+{
+    uint32_t flags = i686_SaveInterrupts();
+    dev->Queue->Plugged++;
+    i686_RestoreInterrupts(flags);
+}
+
+void blkq_unplug(BlockDev* dev)
+{
+    uint32_t flags = i686_SaveInterrupts();
+    if (dev->Queue->Plugged > 0)
+        dev->Queue->Plugged--;
+    i686_RestoreInterrupts(flags);
+
+    blkq_dispatch(dev->Queue);
+}
+
+bool blkq_wait(BlockRequest* request)
+{
+    // The request (and its buffer) belongs to the queue until Completed, returning
+    // any earlier would let the caller reuse them under the device
+    while (!request->Completed) {
+        BlockDev* dev = request->Device;
+        uint32_t flags = i686_SaveInterrupts();
+        if (dev->Poll != NULL)
+            dev->Poll(dev);
+
+        // Halting needs the completion or the timer tick to wake up, without interrupts just poll again
+        if (request->Completed || !(flags & 0x200))
+            __asm__ volatile ("pause");
+        else
+            __asm__ volatile ("sti; hlt" : : : "memory");
+        i686_RestoreInterrupts(flags);
+    }
+
+    return request->Success;
+}
+
+static bool blkq_transfer(BlockDev* dev, uint64_t lba, uint32_t count, void* buffer, bool write)
+{
+    BlockRequest request;
+    memset(&request, 0, sizeof(request));
+    request.Lba = lba;
+    request.Count = count;
+    request.Buffer = buffer;
+    request.Write = write;
+
+    if (!blkq_submit(dev, &request))
+        return false;
+
+    return blkq_wait(&request);
+}
+
+bool blkq_read(BlockDev* dev, uint64_t lba, uint32_t count, void* buffer)
+{
+    return blkq_transfer(dev, lba, count, buffer, false);
+}
+
+bool blkq_write(BlockDev* dev, uint64_t lba, uint32_t count, const void* buffer)
+{
+    return blkq_transfer(dev, lba, count, (void*)buffer, true);
+}
+
+bool blkq_get_stats(BlockDev* dev, BlockQueueStats* stats)
+{
+    if (dev->Queue == NULL)
+        return false;
+
+    uint32_t flags = i686_SaveInterrupts();
+    *stats = dev->Queue->Stats;
+    i686_RestoreInterrupts(flags);
+    return true;
+}
+
+void blkq_reset_stats(BlockDev* dev)
+{
+    if (dev->Queue == NULL)
+        return;
+
+    uint32_t flags = i686_SaveInterrupts();
+    uint32_t depth = dev->Queue->Stats.Depth;
+    memset(&dev->Queue->Stats, 0, sizeof(BlockQueueStats));
+    dev->Queue->Stats.Depth = depth;
+    i686_RestoreInterrupts(flags);
+}
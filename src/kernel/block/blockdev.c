@@ -0,0 +1,46 @@
+#include <blockdev.h>
+#include <blkq.h>
+#include <string.h>
+#include <stddef.h>
+#include <debug.h>
+
+#define MODULE "Block"
+
+static BlockDev* g_BlockDevices[BLOCKDEV_MAX_DEVICES];
+static int g_BlockDeviceCount = 0;
+
+bool blockdev_register(BlockDev* dev)
+{
+    if (g_BlockDeviceCount >= BLOCKDEV_MAX_DEVICES) {
+        log_err(MODULE, "Too many block devices, %s not registered", dev->Name);
+        return false;
+    }
+
+    g_BlockDevices[g_BlockDeviceCount++] = dev;
+    blkq_init_device(dev);
+    log_debug(MODULE, "Registered %s (%llu blocks of %u bytes)", dev->Name, dev->BlockCount, dev->BlockSize);
+    return true;
+}
+
+int blockdev_get_count(void)
+{
+    return g_BlockDeviceCount;
+}
+
+BlockDev* blockdev_get(int index)
+{
+    if (index < 0 || index >= g_BlockDeviceCount)
+        return NULL;
+
+    return g_BlockDevices[index];
+}
+
+BlockDev* blockdev_find(const char* name)
+{
+    for (int i = 0; i < g_BlockDeviceCount; i++) {
+        if (strcmp(g_BlockDevices[i]->Name, name) == 0)
+            return g_BlockDevices[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,823 @@
+#include <ata.h>
+#include <blockdev.h>
+#include <blkq.h>
+#include <io.h>
+#include <irq.h>
+#include <pci.h>
+#include <time.h>
+#include <debug.h>
+#include <stddef.h>
+
+#define MODULE "ATA"
+
+// Task file registers (offset from IoBase)
+#define ATA_REG_DATA            0x00
+#define ATA_REG_ERROR           0x01
+#define ATA_REG_FEATURES        0x01
+#define ATA_REG_SECCOUNT        0x02
+#define ATA_REG_LBA0            0x03
+#define ATA_REG_LBA1            0x04
+#define ATA_REG_LBA2            0x05
+#define ATA_REG_DRIVE           0x06
+#define ATA_REG_STATUS          0x07
+#define ATA_REG_COMMAND         0x07
+
+// Control block register (ControlBase)
+#define ATA_REG_ALTSTATUS       0x00
+#define ATA_REG_DEVCONTROL      0x00
+
+// Status bits
+#define ATA_SR_ERR              0x01
+#define ATA_SR_DRQ              0x08
+#define ATA_SR_DF               0x20
+#define ATA_SR_DRDY             0x40
+#define ATA_SR_BSY              0x80
+
+// Device control bits
+#define ATA_DC_NIEN             0x02
+#define ATA_DC_SRST             0x04
+
+// Commands
+#define ATA_CMD_READ_SECTORS        0x20
+#define ATA_CMD_READ_SECTORS_EXT    0x24
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_READ_MULTIPLE_EXT   0x29
+#define ATA_CMD_WRITE_SECTORS       0x30
+#define ATA_CMD_WRITE_SECTORS_EXT   0x34
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT  0x39
+#define ATA_CMD_READ_MULTIPLE       0xC4
+#define ATA_CMD_WRITE_MULTIPLE      0xC5
+#define ATA_CMD_SET_MULTIPLE        0xC6
+#define ATA_CMD_READ_DMA            0xC8
+#define ATA_CMD_WRITE_DMA           0xCA
+#define ATA_CMD_FLUSH_CACHE         0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT     0xEA
+#define ATA_CMD_IDENTIFY            0xEC
+
+// IDENTIFY DEVICE words
+#define ATA_IDENT_MODEL             27
+#define ATA_IDENT_MAX_MULTIPLE      47
+#define ATA_IDENT_CAPABILITIES      49
+#define ATA_IDENT_LBA28_SECTORS     60
+#define ATA_IDENT_COMMAND_SETS      83
+#define ATA_IDENT_LBA48_SECTORS     100
+
+#define ATA_LBA28_LIMIT             0x10000000ULL
+#define ATA_LBA28_MAX_TRANSFER      256
+#define ATA_LBA48_MAX_TRANSFER      65536
+#define ATA_POLL_TIMEOUT            1000000
+#define ATA_DMA_TIMEOUT_MS          5000
+
+// Bus master IDE registers (offset from the channel's BusMasterBase)
+#define BM_REG_COMMAND              0x00
+#define BM_REG_STATUS               0x02
+#define BM_REG_PRDT                 0x04
+
+#define BM_CMD_START                0x01
+#define BM_CMD_READ                 0x08        // device to memory
+#define BM_SR_ACTIVE                0x01
+#define BM_SR_ERROR                 0x02
+#define BM_SR_IRQ                   0x04
+
+// A PRD region may not cross a 64K boundary, 1MB needs at most 17 of them plus one
+// per extra scatter-gather segment
+#define ATA_PRD_ENTRIES             128
+#define ATA_PRD_BOUNDARY            0x10000
+#define ATA_PRD_EOT                 0x8000
+
+typedef struct {
+    uint32_t Address;
+    uint16_t ByteCount;                 // 0 means 64K
+    uint16_t Flags;
+} __attribute__((packed)) ATAPrd;
+
+typedef struct {
+    uint16_t IoBase;
+    uint16_t BusMasterBase;             // 0 when the channel has no DMA
+    volatile bool Busy;
+    volatile bool Dma;                  // Busy with a DMA command, which the IRQ or a poll finishes
+    uint64_t Deadline;                  // TSC after which the DMA command is given up
+    ATADrive* Drive;
+    ATACompletion Completion;
+    void* Context;
+
+    // Queued request of the other drive, started when the channel is released
+    BlockDev* DeferredDevice;
+    BlockRequest* DeferredRequest;
+} ATAChannel;
+
+// Completion of a synchronous DMA command, on the waiter's stack
+typedef struct {
+    volatile bool Done;
+    bool Success;
+} ATAWait;
+
+static ATADrive g_Drives[ATA_MAX_DRIVES];
+static int g_DriveCount = 0;
+static int8_t g_SelectedDrive[2] = { -1, -1 };
+
+static ATAChannel g_Channels[2];
+static BlockDev g_BlockDevs[ATA_MAX_DRIVES];
+static const char* const g_DriveNames[ATA_MAX_DRIVES] = { "ata0", "ata1", "ata2", "ata3" };
+// The table itself must not cross a 64K boundary either
+static ATAPrd g_Prdt[2][ATA_PRD_ENTRIES] __attribute__((aligned(sizeof(ATAPrd) * ATA_PRD_ENTRIES)));
+
+static bool ata_pio_transfer(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write);
+
+static inline uint8_t ata_status(ATADrive* drive)
+{
+    return inb(drive->IoBase + ATA_REG_STATUS);
+}
+
+// Reading the alternate status register takes ~100ns and doesn't clear a pending interrupt
+static void ata_delay400(ATADrive* drive)
+{
+    for (int i = 0; i < 4; i++)
+        inb(drive->ControlBase + ATA_REG_ALTSTATUS);
+}
+
+static bool ata_wait_not_busy(ATADrive* drive)
+{
+    for (int i = 0; i < ATA_POLL_TIMEOUT; i++) {
+        if (!(ata_status(drive) & ATA_SR_BSY))
+            return true;
+    }
+    return false;
+}
+
+// Waits until the drive is ready to transfer a DRQ block, fails on error or device fault
+static bool ata_wait_drq(ATADrive* drive)
+{
+    for (int i = 0; i < ATA_POLL_TIMEOUT; i++) {
+        uint8_t status = ata_status(drive);
+        if (status & ATA_SR_BSY)
+            continue;
+        if (status & (ATA_SR_ERR | ATA_SR_DF))
+            return false;
+        if (status & ATA_SR_DRQ)
+            return true;
+    }
+    return false;
+}
+
+static void ata_select(ATADrive* drive, uint8_t lbaHigh)
+{
+    int index = drive->Channel * 2 + drive->Slave;
+
+    outb(drive->IoBase + ATA_REG_DRIVE, 0xE0 | (drive->Slave << 4) | (lbaHigh & 0x0F));
+
+    // Switching between master and slave needs the full 400ns settle time
+    if (g_SelectedDrive[drive->Channel] != index) {
+        ata_delay400(drive);
+        g_SelectedDrive[drive->Channel] = index;
+    }
+}
+
+static void ata_setup_lba(ATADrive* drive, uint64_t lba, uint32_t count, bool lba48)
+{
+    if (lba48) {
+        ata_select(drive, 0);
+        // High order bytes go first, the registers are two-deep FIFOs
+        outb(drive->IoBase + ATA_REG_SECCOUNT, (count >> 8) & 0xFF);
+        outb(drive->IoBase + ATA_REG_LBA0, (lba >> 24) & 0xFF);
+        outb(drive->IoBase + ATA_REG_LBA1, (lba >> 32) & 0xFF);
+        outb(drive->IoBase + ATA_REG_LBA2, (lba >> 40) & 0xFF);
+    }
+    else {
+        ata_select(drive, (lba >> 24) & 0x0F);
+    }
+
+    outb(drive->IoBase + ATA_REG_SECCOUNT, count & 0xFF);
+    outb(drive->IoBase + ATA_REG_LBA0, lba & 0xFF);
+    outb(drive->IoBase + ATA_REG_LBA1, (lba >> 8) & 0xFF);
+    outb(drive->IoBase + ATA_REG_LBA2, (lba >> 16) & 0xFF);
+}
+
+static void ata_read_model(ATADrive* drive, const uint16_t* identify)
+{
+    // Model string is stored as big endian words, padded with spaces
+    for (int i = 0; i < 20; i++) {
+        uint16_t word = identify[ATA_IDENT_MODEL + i];
+        drive->Model[i * 2] = word >> 8;
+        drive->Model[i * 2 + 1] = word & 0xFF;
+    }
+
+    int len = 40;
+    while (len > 0 && drive->Model[len - 1] == ' ')
+        len--;
+    drive->Model[len] = '\0';
+}
+
+static bool ata_identify(ATADrive* drive)
+{
+    uint16_t identify[256];
+
+    ata_select(drive, 0);
+    outb(drive->IoBase + ATA_REG_SECCOUNT, 0);
+    outb(drive->IoBase + ATA_REG_LBA0, 0);
+    outb(drive->IoBase + ATA_REG_LBA1, 0);
+    outb(drive->IoBase + ATA_REG_LBA2, 0);
+    outb(drive->IoBase + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay400(drive);
+
+    // Floating bus or no device
+    uint8_t status = ata_status(drive);
+    if (status == 0 || status == 0xFF)
+        return false;
+
+    if (!ata_wait_not_busy(drive))
+        return false;
+
+    // ATAPI and SATA devices abort IDENTIFY and leave a signature in LBA1/LBA2
+    if (inb(drive->IoBase + ATA_REG_LBA1) != 0 || inb(drive->IoBase + ATA_REG_LBA2) != 0)
+        return false;
+
+    if (!ata_wait_drq(drive))
+        return false;
+
+    insw(drive->IoBase + ATA_REG_DATA, identify, 256);
+
+    drive->Lba48 = (identify[ATA_IDENT_COMMAND_SETS] & (1 << 10)) != 0;
+    if (drive->Lba48) {
+        drive->SectorCount = (uint64_t)identify[ATA_IDENT_LBA48_SECTORS]
+                           | ((uint64_t)identify[ATA_IDENT_LBA48_SECTORS + 1] << 16)
+                           | ((uint64_t)identify[ATA_IDENT_LBA48_SECTORS + 2] << 32)
+                           | ((uint64_t)identify[ATA_IDENT_LBA48_SECTORS + 3] << 48);
+    }
+    else {
+        drive->SectorCount = (uint32_t)identify[ATA_IDENT_LBA28_SECTORS]
+                           | ((uint32_t)identify[ATA_IDENT_LBA28_SECTORS + 1] << 16);
+    }
+
+    // Low byte of word 47 is the largest block READ/WRITE MULTIPLE supports
+    drive->MultipleSectors = identify[ATA_IDENT_MAX_MULTIPLE] & 0xFF;
+    drive->DmaCapable = (identify[ATA_IDENT_CAPABILITIES] & (1 << 8)) != 0;
+    ata_read_model(drive, identify);
+    return true;
+}
+
+static void ata_set_multiple(ATADrive* drive)
+{
+    if (drive->MultipleSectors > 1) {
+        ata_select(drive, 0);
+        outb(drive->IoBase + ATA_REG_SECCOUNT, drive->MultipleSectors);
+        outb(drive->IoBase + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+        ata_delay400(drive);
+
+        if (ata_wait_not_busy(drive) && !(ata_status(drive) & (ATA_SR_ERR | ATA_SR_DF)))
+            return;
+
+        log_warn(MODULE, "%s: SET MULTIPLE %u rejected, using single sector blocks",
+                 drive->Model, drive->MultipleSectors);
+    }
+
+    drive->MultipleSectors = 1;
+}
+
+static void ata_probe_channel(uint8_t channel, uint16_t ioBase, uint16_t controlBase)
+{
+    g_Channels[channel].IoBase = ioBase;
+
+    // A floating bus reads back 0xFF, nothing is attached to this channel
+    if (inb(ioBase + ATA_REG_STATUS) == 0xFF)
+        return;
+
+    // Polled operation, the IRQ is left masked
+    outb(controlBase + ATA_REG_DEVCONTROL, ATA_DC_NIEN);
+
+    for (uint8_t slave = 0; slave < 2; slave++) {
+        ATADrive* drive = &g_Drives[channel * 2 + slave];
+        drive->Channel = channel;
+        drive->Slave = slave;
+        drive->IoBase = ioBase;
+        drive->ControlBase = controlBase;
+
+        if (!ata_identify(drive))
+            continue;
+
+        ata_set_multiple(drive);
+        drive->Present = true;
+        g_DriveCount++;
+    }
+}
+
+//
+// Bus master DMA
+//
+
+static bool ata_blockdev_start(BlockDev* dev, BlockRequest* request);
+
+// Gives up the channel, the other drive's deferred request (if any) takes it over
+static void ata_channel_release(ATAChannel* ch)
+{
+    uint32_t flags = i686_SaveInterrupts();
+    BlockDev* dev = ch->DeferredDevice;
+    BlockRequest* request = ch->DeferredRequest;
+    ch->DeferredDevice = NULL;
+    ch->DeferredRequest = NULL;
+    ch->Busy = false;
+    i686_RestoreInterrupts(flags);
+
+    if (dev != NULL && !ata_blockdev_start(dev, request))
+        blkq_complete(dev, false);
+}
+
+// Stops the bus master and hands the result of the channel's DMA command to its owner.
+// Runs with interrupts off, from the IRQ or from a poll.
+static void ata_dma_finish(uint8_t channel, bool timedOut)
+{
+    ATAChannel* ch = &g_Channels[channel];
+    uint16_t bm = ch->BusMasterBase;
+
+    uint8_t bmStatus = inb(bm + BM_REG_STATUS);
+    outb(bm + BM_REG_COMMAND, 0);
+
+    // Reading the status register acknowledges the drive's interrupt
+    uint8_t status = inb(ch->IoBase + ATA_REG_STATUS);
+    outb(bm + BM_REG_STATUS, (bmStatus & 0x60) | BM_SR_ERROR | BM_SR_IRQ);
+
+    bool success = !timedOut && !(bmStatus & BM_SR_ERROR) && !(status & (ATA_SR_ERR | ATA_SR_DF));
+    if (timedOut)
+        log_err(MODULE, "DMA transfer timed out (status=0x%x bm=0x%x)", status, bmStatus);
+    else if (!success)
+        log_err(MODULE, "DMA transfer failed (status=0x%x bm=0x%x)", status, bmStatus);
+
+    // Release the channel before the callback so it can submit the next command
+    ATADrive* drive = ch->Drive;
+    ATACompletion completion = ch->Completion;
+    void* context = ch->Context;
+    ch->Dma = false;
+    ata_channel_release(ch);
+
+    if (completion != NULL)
+        completion(drive, success, context);
+}
+
+static void ata_irq(uint8_t channel)
+{
+    ATAChannel* ch = &g_Channels[channel];
+
+    // The bus master's interrupt bit follows the drive's INTRQ, so it is set for PIO commands too
+    if (!ch->Dma || !(inb(ch->BusMasterBase + BM_REG_STATUS) & BM_SR_IRQ)) {
+        // PIO command or spurious interrupt, just acknowledge it
+        inb(ch->IoBase + ATA_REG_STATUS);
+        return;
+    }
+
+    ata_dma_finish(channel, false);
+}
+
+// What the IRQ would do, for callers that wait with interrupts off. Also the only place
+// a DMA command that never completes is given up, the IRQ path has no timer.
+static void ata_poll(uint8_t channel)
+{
+    ATAChannel* ch = &g_Channels[channel];
+    if (!ch->Dma)
+        return;
+
+    if (inb(ch->BusMasterBase + BM_REG_STATUS) & BM_SR_IRQ)
+        ata_dma_finish(channel, false);
+    else if (x86_ReadTsc() > ch->Deadline)
+        ata_dma_finish(channel, true);
+}
+
+// One step of waiting for the channel: polls it, then sleeps until the next interrupt if
+// interrupts are on. The completion interrupt may fire between the check and hlt, sti delays
+// it until hlt.
+static void ata_wait_step(uint8_t channel)
+{
+    uint32_t flags = i686_SaveInterrupts();
+    ata_poll(channel);
+    if (!(flags & 0x200))
+        __asm__ volatile ("pause");
+    else if (g_Channels[channel].Busy)
+        __asm__ volatile ("sti; hlt" : : : "memory");
+    i686_RestoreInterrupts(flags);
+}
+
+static void ata_irq_primary(Registers* regs)
+{
+    ata_irq(0);
+}
+
+static void ata_irq_secondary(Registers* regs)
+{
+    ata_irq(1);
+}
+
+static bool ata_init_dma(void)
+{
+    PCIAddress addr;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &addr)) {
+        log_info(MODULE, "No PCI IDE controller, using PIO only");
+        return false;
+    }
+
+    // Prog IF bit 7 tells whether the controller can do bus mastering, BAR4 holds its I/O ports
+    uint32_t bar4 = pci_read32(addr, PCI_BAR4);
+    if (!(pci_read8(addr, PCI_PROG_IF) & 0x80) || !(bar4 & 1)) {
+        log_info(MODULE, "IDE controller has no bus master support, using PIO only");
+        return false;
+    }
+
+    uint16_t base = bar4 & 0xFFFC;
+    pci_write16(addr, PCI_COMMAND, pci_read16(addr, PCI_COMMAND) | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    for (uint8_t channel = 0; channel < 2; channel++) {
+        bool used = false;
+        for (int slave = 0; slave < 2; slave++) {
+            ATADrive* drive = &g_Drives[channel * 2 + slave];
+            drive->DmaCapable = drive->Present && drive->DmaCapable;
+            drive->UseDma = drive->DmaCapable;
+            used |= drive->DmaCapable;
+        }
+
+        if (!used)
+            continue;
+
+        ATAChannel* ch = &g_Channels[channel];
+        ch->BusMasterBase = base + channel * 8;
+        outb(ch->BusMasterBase + BM_REG_COMMAND, 0);
+        outl(ch->BusMasterBase + BM_REG_PRDT, (uint32_t)g_Prdt[channel]);
+
+        int irq = channel == 0 ? ATA_IRQ_PRIMARY : ATA_IRQ_SECONDARY;
+        i686_IRQ_RegisterHandler(irq, channel == 0 ? ata_irq_primary : ata_irq_secondary);
+
+        // Completions are interrupt driven from now on
+        outb((channel == 0 ? ATA_PRIMARY_CONTROL : ATA_SECONDARY_CONTROL) + ATA_REG_DEVCONTROL, 0);
+        i686_IRQ_Unmask(irq);
+    }
+
+    return true;
+}
+
+// Physical address == virtual address, so a segment is only split where a region would cross 64K
+static bool ata_build_prdt(uint8_t channel, const ATASegment* segments, int segmentCount)
+{
+    int entry = 0;
+
+    for (int i = 0; i < segmentCount; i++) {
+        uint32_t address = (uint32_t)segments[i].Buffer;
+        uint32_t size = segments[i].Count * ATA_SECTOR_SIZE;
+
+        while (size > 0) {
+            if (entry == ATA_PRD_ENTRIES)
+                return false;
+
+            uint32_t chunk = ATA_PRD_BOUNDARY - (address & (ATA_PRD_BOUNDARY - 1));
+            if (chunk > size)
+                chunk = size;
+
+            g_Prdt[channel][entry].Address = address;
+            g_Prdt[channel][entry].ByteCount = chunk & 0xFFFF;
+            g_Prdt[channel][entry].Flags = 0;
+
+            address += chunk;
+            size -= chunk;
+            entry++;
+        }
+    }
+
+    g_Prdt[channel][entry - 1].Flags = ATA_PRD_EOT;
+    return true;
+}
+
+bool ata_submit(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write,
+                ATACompletion completion, void* context)
+{
+    ATASegment segment = { buffer, count };
+    return ata_submit_sg(drive, lba, &segment, 1, write, completion, context);
+}
+
+bool ata_submit_sg(ATADrive* drive, uint64_t lba, const ATASegment* segments, int segmentCount,
+                   bool write, ATACompletion completion, void* context)
+{
+    if (drive == NULL || !drive->Present || !drive->DmaCapable || segmentCount <= 0)
+        return false;
+
+    uint32_t count = 0;
+    for (int i = 0; i < segmentCount; i++) {
+        if (segments[i].Count == 0 || ((uint32_t)segments[i].Buffer & 1))
+            return false;
+        count += segments[i].Count;
+    }
+
+    if (count > ATA_DMA_MAX_SECTORS || (!drive->Lba48 && count > ATA_LBA28_MAX_TRANSFER) ||
+        lba + count > drive->SectorCount)
+        return false;
+
+    ATAChannel* ch = &g_Channels[drive->Channel];
+    if (ch->Busy || !ata_wait_not_busy(drive))
+        return false;
+
+    if (!ata_build_prdt(drive->Channel, segments, segmentCount))
+        return false;
+
+    ch->Busy = true;
+    ch->Dma = true;
+    ch->Deadline = x86_ReadTsc() + (uint64_t)time_get_tsc_khz() * ATA_DMA_TIMEOUT_MS;
+    ch->Drive = drive;
+    ch->Completion = completion;
+    ch->Context = context;
+
+    uint16_t bm = ch->BusMasterBase;
+    uint8_t direction = write ? 0 : BM_CMD_READ;
+    outb(bm + BM_REG_COMMAND, direction);
+    outb(bm + BM_REG_STATUS, (inb(bm + BM_REG_STATUS) & 0x60) | BM_SR_ERROR | BM_SR_IRQ);
+
+    bool lba48 = lba + count > ATA_LBA28_LIMIT || count > ATA_LBA28_MAX_TRANSFER;
+    ata_setup_lba(drive, lba, count, lba48);
+    if (write)
+        outb(drive->IoBase + ATA_REG_COMMAND, lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA);
+    else
+        outb(drive->IoBase + ATA_REG_COMMAND, lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+
+    outb(bm + BM_REG_COMMAND, direction | BM_CMD_START);
+    return true;
+}
+
+bool ata_channel_busy(ATADrive* drive)
+{
+    return g_Channels[drive->Channel].Busy;
+}
+
+static bool ata_blockdev_read(BlockDev* dev, uint64_t lba, uint32_t count, void* buffer)
+{
+    return ata_read_sectors((ATADrive*)dev->Data, lba, count, buffer);
+}
+
+static bool ata_blockdev_write(BlockDev* dev, uint64_t lba, uint32_t count, const void* buffer)
+{
+    return ata_write_sectors((ATADrive*)dev->Data, lba, count, buffer);
+}
+
+static bool ata_blockdev_flush(BlockDev* dev)
+{
+    return ata_flush((ATADrive*)dev->Data);
+}
+
+static void ata_blockdev_complete(ATADrive* drive, bool success, void* context)
+{
+    blkq_complete((BlockDev*)context, success);
+}
+
+static void ata_blockdev_poll(BlockDev* dev)
+{
+    ata_poll(((ATADrive*)dev->Data)->Channel);
+}
+
+// Starts a queued request, merged requests become one scatter-gather DMA command.
+// Without DMA the request runs as PIO right away and is completed before returning.
+// May run in IRQ context, DMA started there completes once the handler returns. DMA is
+// used with interrupts off too, whoever waits for the request polls it (ata_blockdev_poll).
+static bool ata_blockdev_start(BlockDev* dev, BlockRequest* request)
+{
+    ATADrive* drive = (ATADrive*)dev->Data;
+    ATAChannel* ch = &g_Channels[drive->Channel];
+
+    ATASegment segments[BLKQ_MAX_SEGMENTS];
+    int segmentCount = 0;
+    bool aligned = true;
+    for (BlockRequest* r = request; r != NULL && segmentCount < BLKQ_MAX_SEGMENTS; r = r->MergeNext) {
+        segments[segmentCount].Buffer = r->Buffer;
+        segments[segmentCount].Count = r->Count;
+        aligned = aligned && !((uint32_t)r->Buffer & 1);
+        segmentCount++;
+    }
+
+    uint32_t flags = i686_SaveInterrupts();
+    bool dma = drive->UseDma && drive->DmaCapable && aligned;
+
+    if (ch->Busy) {
+        // The other drive owns the channel, ata_channel_release starts this request
+        ch->DeferredDevice = dev;
+        ch->DeferredRequest = request;
+        i686_RestoreInterrupts(flags);
+        return true;
+    }
+
+    if (dma) {
+        bool ok = ata_submit_sg(drive, request->Lba, segments, segmentCount, request->Write,
+                                ata_blockdev_complete, dev);
+        i686_RestoreInterrupts(flags);
+        return ok;
+    }
+
+    // Hold the channel for the PIO command so the other drive's requests get deferred
+    ch->Busy = true;
+    ch->Drive = drive;
+    ch->Completion = NULL;
+    i686_RestoreInterrupts(flags);
+
+    uint64_t lba = request->Lba;
+    bool ok = true;
+    for (int i = 0; i < segmentCount && ok; i++) {
+        ok = ata_pio_transfer(drive, lba, segments[i].Count, segments[i].Buffer, request->Write);
+        lba += segments[i].Count;
+    }
+
+    ata_channel_release(ch);
+    blkq_complete(dev, ok);
+    return true;
+}
+
+
+static void ata_register_blockdev(int index)
+{
+    BlockDev* dev = &g_BlockDevs[index];
+    dev->Name = g_DriveNames[index];
+    dev->BlockSize = ATA_SECTOR_SIZE;
+    dev->BlockCount = g_Drives[index].SectorCount;
+    dev->Data = &g_Drives[index];
+    dev->Read = ata_blockdev_read;
+    dev->Write = ata_blockdev_write;
+    dev->Flush = ata_blockdev_flush;
+    dev->Submit = ata_blockdev_start;
+    dev->Poll = ata_blockdev_poll;
+    dev->MaxSectors = g_Drives[index].Lba48 ? ATA_DMA_MAX_SECTORS : ATA_LBA28_MAX_TRANSFER;
+    blockdev_register(dev);
+}
+
+void ata_init(void)
+{
+    g_DriveCount = 0;
+    ata_probe_channel(0, ATA_PRIMARY_IO, ATA_PRIMARY_CONTROL);
+    ata_probe_channel(1, ATA_SECONDARY_IO, ATA_SECONDARY_CONTROL);
+
+    if (g_DriveCount == 0) {
+        log_warn(MODULE, "No ATA drives found");
+        return;
+    }
+
+    bool dma = ata_init_dma();
+
+    for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+        ATADrive* drive = &g_Drives[i];
+        if (!drive->Present)
+            continue;
+
+        if (!dma)
+            drive->DmaCapable = false;
+
+        log_info(MODULE, "ata%d: %s, %llu sectors, LBA%d, %u sectors per block, %s",
+                 i, drive->Model, drive->SectorCount, drive->Lba48 ? 48 : 28,
+                 drive->MultipleSectors, drive->DmaCapable ? "DMA" : "PIO");
+        ata_register_blockdev(i);
+    }
+}
+
+int ata_get_drive_count(void)
+{
+    return g_DriveCount;
+}
+
+ATADrive* ata_get_drive(int index)
+{
+    if (index < 0 || index >= ATA_MAX_DRIVES || !g_Drives[index].Present)
+        return NULL;
+
+    return &g_Drives[index];
+}
+
+// Runs a single PIO command of at most one command's worth of sectors
+static bool ata_pio_transfer(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write)
+{
+    bool lba48 = lba + count > ATA_LBA28_LIMIT || count > ATA_LBA28_MAX_TRANSFER;
+    bool multiple = drive->MultipleSectors > 1;
+    uint8_t command;
+
+    if (write) {
+        if (multiple)
+            command = lba48 ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+        else
+            command = lba48 ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_WRITE_SECTORS;
+    }
+    else {
+        if (multiple)
+            command = lba48 ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+        else
+            command = lba48 ? ATA_CMD_READ_SECTORS_EXT : ATA_CMD_READ_SECTORS;
+    }
+
+    if (!ata_wait_not_busy(drive))
+        return false;
+
+    // A count of 0 means 256 (LBA28) or 65536 (LBA48) sectors
+    ata_setup_lba(drive, lba, count, lba48);
+    outb(drive->IoBase + ATA_REG_COMMAND, command);
+
+    uint16_t* words = (uint16_t*)buffer;
+    while (count > 0) {
+        uint32_t block = count < drive->MultipleSectors ? count : drive->MultipleSectors;
+
+        ata_delay400(drive);
+        if (!ata_wait_drq(drive)) {
+            log_err(MODULE, "%s failed at LBA %llu (status=0x%x error=0x%x)",
+                    write ? "Write" : "Read", lba, ata_status(drive),
+                    inb(drive->IoBase + ATA_REG_ERROR));
+            return false;
+        }
+
+        // One DRQ block per interrupt/poll instead of one per sector
+        if (write)
+            outsw(drive->IoBase + ATA_REG_DATA, words, block * (ATA_SECTOR_SIZE / 2));
+        else
+            insw(drive->IoBase + ATA_REG_DATA, words, block * (ATA_SECTOR_SIZE / 2));
+
+        words += block * (ATA_SECTOR_SIZE / 2);
+        lba += block;
+        count -= block;
+    }
+
+    if (write) {
+        if (!ata_wait_not_busy(drive) || (ata_status(drive) & (ATA_SR_ERR | ATA_SR_DF)))
+            return false;
+    }
+
+    return true;
+}
+
+static void ata_wait_complete(ATADrive* drive, bool success, void* context)
+{
+    ATAWait* wait = (ATAWait*)context;
+    wait->Success = success;
+    wait->Done = true;
+}
+
+static bool ata_dma_transfer(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write)
+{
+    ATAWait wait = { false, false };
+    if (!ata_submit(drive, lba, count, buffer, write, ata_wait_complete, &wait))
+        return false;
+
+    // wait is on this stack, so this can't return before the command finished or timed out
+    while (!wait.Done)
+        ata_wait_step(drive->Channel);
+    return wait.Success;
+}
+
+static bool ata_transfer(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer, bool write)
+{
+    if (drive == NULL || !drive->Present)
+        return false;
+
+    if (lba + count > drive->SectorCount) {
+        log_err(MODULE, "Access beyond end of %s (LBA %llu + %u)", drive->Model, lba, count);
+        return false;
+    }
+
+    ATAChannel* ch = &g_Channels[drive->Channel];
+    bool dma = drive->UseDma && drive->DmaCapable && !((uint32_t)buffer & 1);
+
+    // Let an asynchronous command on the same channel (and any it starts) finish first
+    while (ch->Busy)
+        ata_wait_step(drive->Channel);
+
+    uint8_t* data = (uint8_t*)buffer;
+    while (count > 0) {
+        uint32_t limit = drive->Lba48 ? ATA_LBA48_MAX_TRANSFER : ATA_LBA28_MAX_TRANSFER;
+        if (dma && limit > ATA_DMA_MAX_SECTORS)
+            limit = ATA_DMA_MAX_SECTORS;
+        uint32_t chunk = count < limit ? count : limit;
+
+        bool ok = dma ? ata_dma_transfer(drive, lba, chunk, data, write)
+                      : ata_pio_transfer(drive, lba, chunk, data, write);
+        if (!ok)
+            return false;
+
+        data += chunk * ATA_SECTOR_SIZE;
+        lba += chunk;
+        count -= chunk;
+    }
+
+    return true;
+}
+
+bool ata_read_sectors(ATADrive* drive, uint64_t lba, uint32_t count, void* buffer)
+{
+    return ata_transfer(drive, lba, count, buffer, false);
+}
+
+bool ata_write_sectors(ATADrive* drive, uint64_t lba, uint32_t count, const void* buffer)
+{
+    return ata_transfer(drive, lba, count, (void*)buffer, true);
+}
+
+bool ata_flush(ATADrive* drive)
+{
+    if (drive == NULL || !drive->Present)
+        return false;
+
+    while (g_Channels[drive->Channel].Busy)
+        ata_wait_step(drive->Channel);
+
+    if (!ata_wait_not_busy(drive))
+        return false;
+
+    ata_select(drive, 0);
+    outb(drive->IoBase + ATA_REG_COMMAND, drive->Lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    ata_delay400(drive);
+
+    return ata_wait_not_busy(drive) && !(ata_status(drive) & (ATA_SR_ERR | ATA_SR_DF));
+}
@@ -6,6 +6,8 @@
 #include <stdbool.h>
 #include <vga_text.h>
 #include <memory.h>
+#include <softirq.h>
+#include <sync.h>
 
 /*
 ┌──────┐      ┌──────┬──────┬──────┬──────┐  ┌──────┬──────┬──────┬──────┐  ┌──────┬──────┬─────┬─────┐   ┌──────┐
@@ -104,10 +106,17 @@ static int caps_lock = 0;
 static int extended_key = 0;
 static uint8_t dead_key_state = DEAD_NONE;
 
-// Circular keyboard buffer
+// Circular keyboard buffer, filled by keyboard_softirq and drained by the shell
 static char key_buffer[KEYBOARD_BUFFER_SIZE];
 static int kb_head = 0;
 static int kb_tail = 0;
+static Spinlock kb_lock = SPINLOCK_INIT("keyboard buffer");
+
+// Raw scancodes from IRQ1, translated later by keyboard_softirq
+#define SCANCODE_QUEUE_SIZE 64
+static volatile uint8_t scancode_queue[SCANCODE_QUEUE_SIZE];
+static volatile uint32_t sc_head = 0;
+static volatile uint32_t sc_tail = 0;
 
 typedef struct {
     uint8_t scancode;
@@ -225,7 +234,10 @@ static const DeadKeyComposition dead_compositions[] = {
     {DEAD_CIRCUMFLEX, 'U', 0x96},  // Û
 };
 
+static void keyboard_softirq(void);
+
 void keyboard_init(void) {
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_softirq);
     i686_outb(0x21, i686_inb(0x21) & ~(1 << 1));
     while(i686_inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTPUT_BUFFER_FULL) {
         i686_inb(KEYBOARD_DATA_PORT);
@@ -281,18 +293,26 @@ static char apply_caps_lock(char ascii) {
 
 // Circular keyboard buffer
 bool keyboard_buffer_push(char c) {
+    uint32_t flags = spin_lock_irqsave(&kb_lock);
     int next = (kb_head + 1) % KEYBOARD_BUFFER_SIZE;
-    if (next == kb_tail) return false; // Full Buffer
-    key_buffer[kb_head] = c;
-    kb_head = next;
-    return true;
+    bool pushed = next != kb_tail; // Full Buffer otherwise
+    if (pushed) {
+        key_buffer[kb_head] = c;
+        kb_head = next;
+    }
+    spin_unlock_irqrestore(&kb_lock, flags);
+    return pushed;
 }
 
 bool keyboard_buffer_pop(char* c) {
-    if (kb_head == kb_tail) return false; // Empty
-    *c = key_buffer[kb_tail];
-    kb_tail = (kb_tail + 1) % KEYBOARD_BUFFER_SIZE;
-    return true;
+    uint32_t flags = spin_lock_irqsave(&kb_lock);
+    bool popped = kb_head != kb_tail; // Empty otherwise
+    if (popped) {
+        *c = key_buffer[kb_tail];
+        kb_tail = (kb_tail + 1) % KEYBOARD_BUFFER_SIZE;
+    }
+    spin_unlock_irqrestore(&kb_lock, flags);
+    return popped;
 }
 
 bool keyboard_buffer_empty(void) {
@@ -366,10 +386,20 @@ void insert_char_multiline(char ascii) {
     redraw_input_line();
 }
 
-// Process keyboard buffer (display text on screen)
+// IRQ1 top half: takes the byte off the controller and leaves the rest for later
 void keyboard_handler(Registers* regs) {
-    uint8_t scancode = keyboard_get_scancode();
+    uint8_t scancode = i686_inb(KEYBOARD_DATA_PORT);
 
+    // Dropped when full, like the controller would
+    if (sc_head - sc_tail < SCANCODE_QUEUE_SIZE) {
+        scancode_queue[sc_head % SCANCODE_QUEUE_SIZE] = scancode;
+        sc_head++;
+    }
+    softirq_raise(SOFTIRQ_KEYBOARD);
+}
+
+// Translate one scancode and display text on screen
+static void keyboard_process_scancode(uint8_t scancode) {
     if (scancode == 0xE0) {
         extended_key = 1;
         return;
@@ -462,14 +492,24 @@ void keyboard_handler(Registers* regs) {
     keyboard_buffer_push(ascii);
 }
 
+// Bottom half, with interrupts enabled
+static void keyboard_softirq(void) {
+    while (sc_tail != sc_head) {
+        keyboard_process_scancode(scancode_queue[sc_tail % SCANCODE_QUEUE_SIZE]);
+        sc_tail++;
+    }
+}
+
 void keyboard_reset_dead_state(void) {
     dead_key_state = DEAD_NONE;
 }
 
 // Clear the keyboard circular buffer (drop any pending characters)
 void keyboard_clear_buffer(void) {
+    uint32_t flags = spin_lock_irqsave(&kb_lock);
     kb_head = 0;
     kb_tail = 0;
+    spin_unlock_irqrestore(&kb_lock, flags);
     dead_key_state = DEAD_NONE;
 }
 
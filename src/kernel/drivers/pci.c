@@ -0,0 +1,69 @@
+#include <pci.h>
+#include <io.h>
+
+// Configuration mechanism #1
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+
+static void pci_select(PCIAddress addr, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, 0x80000000
+                           | ((uint32_t)addr.Bus << 16)
+                           | ((uint32_t)addr.Device << 11)
+                           | ((uint32_t)addr.Function << 8)
+                           | (offset & 0xFC));
+}
+
+uint32_t pci_read32(PCIAddress addr, uint8_t offset)
+{
+    pci_select(addr, offset);
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read16(PCIAddress addr, uint8_t offset)
+{
+    return (pci_read32(addr, offset) >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+uint8_t pci_read8(PCIAddress addr, uint8_t offset)
+{
+    return (pci_read32(addr, offset) >> ((offset & 3) * 8)) & 0xFF;
+}
+
+void pci_write32(PCIAddress addr, uint8_t offset, uint32_t value)
+{
+    pci_select(addr, offset);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_write16(PCIAddress addr, uint8_t offset, uint16_t value)
+{
+    pci_select(addr, offset);
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+bool pci_find_class(uint8_t classCode, uint8_t subclass, PCIAddress* out)
+{
+    for (uint16_t bus = 0; bus < 256; bus++) {
+        for (uint8_t device = 0; device < 32; device++) {
+            PCIAddress addr = { bus, device, 0 };
+            if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF)
+                continue;
+
+            // Only multi-function devices have functions 1-7
+            uint8_t functions = (pci_read8(addr, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (uint8_t function = 0; function < functions; function++) {
+                addr.Function = function;
+                if (pci_read16(addr, PCI_VENDOR_ID) == 0xFFFF)
+                    continue;
+
+                if (pci_read8(addr, PCI_CLASS) == classCode && pci_read8(addr, PCI_SUBCLASS) == subclass) {
+                    *out = addr;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
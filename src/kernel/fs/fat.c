@@ -0,0 +1,1639 @@
+#include <fatfs.h>
+#include <fat.h>
+#include <bcache.h>
+#include <syscall.h>
+#include <memory.h>
+#include <string.h>
+#include <debug.h>
+#include <stddef.h>
+
+#define MODULE "FAT"
+
+#define SECTOR_SIZE             512
+#define DIR_ENTRY_SIZE          sizeof(FAT_DirectoryEntry)
+#define DELETED_ENTRY           0xE5
+#define FAT_DEFAULT_DATE        0x0021      // 1980-01-01, there is no RTC driver yet
+
+#define FSINFO_LEAD_SIGNATURE   0x41615252
+#define FSINFO_STRUCT_SIGNATURE 0x61417272
+#define FSINFO_FREE_COUNT       488
+#define FSINFO_NEXT_FREE        492
+#define FSINFO_UNKNOWN          0xFFFFFFFF
+
+#define FAT_MAX_EXTENTS         32          // per open file, more fragmented chains are partly walked
+
+#define FAT_DENTRY_COUNT        256
+#define FAT_DENTRY_BUCKETS      128
+#define FAT_DENTRY_NAME         64          // longer names are looked up on disk every time
+
+typedef struct {
+    uint8_t DriveNumber;
+    uint8_t _Reserved;
+    uint8_t Signature;
+    uint32_t VolumeId;
+    uint8_t VolumeLabel[11];
+    uint8_t SystemId[8];
+} __attribute__((packed)) FAT_ExtendedBootRecord;
+
+typedef struct {
+    uint32_t SectorsPerFat;
+    uint16_t Flags;
+    uint16_t FatVersion;
+    uint32_t RootDirectoryCluster;
+    uint16_t FSInfoSector;
+    uint16_t BackupBootSector;
+    uint8_t _Reserved[12];
+    FAT_ExtendedBootRecord EBR;
+} __attribute__((packed)) FAT32_ExtendedBootRecord;
+
+typedef struct {
+    uint8_t BootJumpInstruction[3];
+    uint8_t OemIdentifier[8];
+    uint16_t BytesPerSector;
+    uint8_t SectorsPerCluster;
+    uint16_t ReservedSectors;
+    uint8_t FatCount;
+    uint16_t DirEntryCount;
+    uint16_t TotalSectors;
+    uint8_t MediaDescriptorType;
+    uint16_t SectorsPerFat;
+    uint16_t SectorsPerTrack;
+    uint16_t Heads;
+    uint32_t HiddenSectors;
+    uint32_t LargeSectorCount;
+
+    union {
+        FAT_ExtendedBootRecord EBR1216;
+        FAT32_ExtendedBootRecord EBR32;
+    };
+} __attribute__((packed)) FAT_BootSector;
+
+typedef struct {
+    uint8_t Status;
+    uint8_t ChsFirst[3];
+    uint8_t Type;
+    uint8_t ChsLast[3];
+    uint32_t LbaStart;
+    uint32_t Size;
+} __attribute__((packed)) MBR_PartitionEntry;
+
+struct FatVolume {
+    bool Mounted;
+    BlockDev* Device;
+    uint8_t Type;                       // 12, 16 or 32
+    uint32_t SectorsPerCluster;
+    uint32_t ClusterSize;
+    uint32_t ClusterCount;              // data clusters, numbered from 2
+    uint8_t FatCount;
+    uint32_t SectorsPerFat;
+    uint64_t FatLba;
+    uint64_t RootDirLba;                // FAT12/16 fixed root directory
+    uint32_t RootDirSize;
+    uint32_t RootCluster;               // FAT32
+    uint64_t DataLba;
+    uint64_t FsInfoLba;                 // 0 when the volume has no FSInfo sector
+    uint32_t FreeCount;                 // FSINFO_UNKNOWN until counted
+    uint32_t NextFree;                  // allocation hint
+    bool FsInfoDirty;
+    int OpenFiles;
+};
+
+// Location of a directory entry on disk
+typedef struct {
+    uint64_t Lba;
+    uint32_t Offset;
+} FatEntryPos;
+
+// Run of consecutive clusters in a file's chain
+typedef struct {
+    uint32_t FileCluster;               // index of the run's first cluster in the file
+    uint32_t Cluster;
+    uint32_t Length;
+} FatExtent;
+
+// A file's cluster chain as extents sorted by FileCluster, built on the first walk
+typedef struct {
+    bool Valid;
+    bool Complete;                      // false when the chain had more runs than fit
+    uint32_t Count;
+    uint32_t Clusters;                  // clusters covered by the extents
+    FatExtent Extents[FAT_MAX_EXTENTS];
+} FatExtentMap;
+
+// One per open directory entry, shared by every open of it so size, first cluster and
+// extents exist once
+struct FatFile {
+    bool InUse;
+    uint32_t RefCount;                  // fat_open calls not yet closed
+    FatVolume* Volume;
+    uint32_t Flags;                     // OPEN_READ/OPEN_WRITE of all opens, per open flags are the VFS's
+    bool IsDirectory;
+    bool FixedRoot;                     // FAT12/16 root directory, outside the data area
+    uint32_t FirstCluster;              // 0 for empty files
+    uint32_t Size;
+    uint32_t Position;                  // scratch for the call at hand, the VFS seeks before each one
+    uint32_t CurrentCluster;            // last cluster visited and its index in the chain,
+    uint32_t CurrentIndex;              // sequential access continues from here
+    FatExtentMap* Extents;              // NULL for the temporary directory handles used by lookups
+    bool HasEntry;                      // false for root directories
+    FatEntryPos Entry;
+};
+
+// Long name being assembled while a directory is scanned forwards. Its LFN entries come
+// right before the short entry, last part first, so no sorting is needed.
+typedef struct {
+    int Next;                           // order of the next expected entry, 0 once complete, -1 for none
+    uint8_t Checksum;
+    uint32_t FirstSlot;                 // directory position of the first LFN entry
+    char Name[FATFS_MAX_NAME + 1];      // empty when the short entry has no long name
+} FatLfnState;
+
+// Cached result of looking up Name in a directory, Negative when it does not exist
+typedef struct FatDentry {
+    FatVolume* Volume;
+    uint32_t Parent;                    // first cluster of the directory, 0 for a fixed root
+    uint32_t Hash;
+    char Name[FAT_DENTRY_NAME];         // upper case
+    bool Negative;
+    FatEntryPos Entry;
+    struct FatDentry* HashNext;
+    struct FatDentry* LruPrev;          // most recently used at the head
+    struct FatDentry* LruNext;
+} FatDentry;
+
+static FatVolume g_Volumes[FATFS_MAX_VOLUMES];
+static FatFile g_Files[FATFS_MAX_OPEN_FILES];
+static FatExtentMap g_ExtentMaps[FATFS_MAX_OPEN_FILES];
+static const uint8_t g_ZeroSector[SECTOR_SIZE];
+
+static FatDentry g_Dentries[FAT_DENTRY_COUNT];
+static FatDentry* g_DentryHash[FAT_DENTRY_BUCKETS];
+static FatDentry* g_DentryLruHead = NULL;
+static FatDentry* g_DentryLruTail = NULL;
+
+//
+// FAT table
+//
+
+static inline uint64_t fat_cluster_lba(FatVolume* v, uint32_t cluster)
+{
+    return v->DataLba + (uint64_t)(cluster - 2) * v->SectorsPerCluster;
+}
+
+static inline uint32_t fat_eoc(FatVolume* v)
+{
+    return v->Type == 12 ? 0xFFF : v->Type == 16 ? 0xFFFF : 0x0FFFFFFF;
+}
+
+static inline bool fat_is_eoc(FatVolume* v, uint32_t value)
+{
+    return value >= (fat_eoc(v) & ~7u);
+}
+
+static inline bool fat_is_valid_cluster(FatVolume* v, uint32_t cluster)
+{
+    return cluster >= 2 && cluster < v->ClusterCount + 2;
+}
+
+static bool fat_get(FatVolume* v, uint32_t cluster, uint32_t* value)
+{
+    if (v->Type == 12) {
+        uint16_t raw;
+        if (!bcache_read(v->Device, v->FatLba, cluster + cluster / 2, &raw, sizeof(raw)))
+            return false;
+        *value = (cluster & 1) ? raw >> 4 : raw & 0xFFF;
+    }
+    else if (v->Type == 16) {
+        uint16_t raw;
+        if (!bcache_read(v->Device, v->FatLba, cluster * 2, &raw, sizeof(raw)))
+            return false;
+        *value = raw;
+    }
+    else {
+        uint32_t raw;
+        if (!bcache_read(v->Device, v->FatLba, cluster * 4, &raw, sizeof(raw)))
+            return false;
+        *value = raw & 0x0FFFFFFF;
+    }
+    return true;
+}
+
+// Updates every copy of the FAT
+static bool fat_set(FatVolume* v, uint32_t cluster, uint32_t value)
+{
+    for (uint8_t i = 0; i < v->FatCount; i++) {
+        uint64_t lba = v->FatLba + (uint64_t)i * v->SectorsPerFat;
+        bool ok;
+
+        if (v->Type == 12) {
+            uint32_t offset = cluster + cluster / 2;
+            uint16_t raw;
+            if (!bcache_read(v->Device, lba, offset, &raw, sizeof(raw)))
+                return false;
+            if (cluster & 1)
+                raw = (raw & 0x000F) | (value << 4);
+            else
+                raw = (raw & 0xF000) | (value & 0xFFF);
+            ok = bcache_write(v->Device, lba, offset, &raw, sizeof(raw));
+        }
+        else if (v->Type == 16) {
+            uint16_t raw = value;
+            ok = bcache_write(v->Device, lba, cluster * 2, &raw, sizeof(raw));
+        }
+        else {
+            // The top 4 bits are reserved and must be preserved
+            uint32_t raw;
+            if (!bcache_read(v->Device, lba, cluster * 4, &raw, sizeof(raw)))
+                return false;
+            raw = (raw & 0xF0000000) | (value & 0x0FFFFFFF);
+            ok = bcache_write(v->Device, lba, cluster * 4, &raw, sizeof(raw));
+        }
+
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// Allocates a free cluster starting at the FSInfo hint, zeroes it and links it after 'prev' (0 = none)
+static uint32_t fat_alloc_cluster(FatVolume* v, uint32_t prev)
+{
+    uint32_t cluster = fat_is_valid_cluster(v, v->NextFree) ? v->NextFree : 2;
+
+    for (uint32_t i = 0; i < v->ClusterCount; i++, cluster++) {
+        if (cluster >= v->ClusterCount + 2)
+            cluster = 2;
+
+        uint32_t value;
+        if (!fat_get(v, cluster, &value))
+            return 0;
+        if (value != 0)
+            continue;
+
+        // A freed cluster keeps its old data, which would show up as stale entries in a
+        // directory or behind the end of a file. Whole sector writes don't read the disk.
+        for (uint32_t sector = 0; sector < v->SectorsPerCluster; sector++) {
+            if (!bcache_write(v->Device, fat_cluster_lba(v, cluster) + sector, 0, g_ZeroSector, SECTOR_SIZE))
+                return 0;
+        }
+
+        if (!fat_set(v, cluster, fat_eoc(v)))
+            return 0;
+        if (prev != 0 && !fat_set(v, prev, cluster)) {
+            fat_set(v, cluster, 0);
+            return 0;
+        }
+
+        v->NextFree = cluster + 1;
+        if (v->FreeCount != FSINFO_UNKNOWN)
+            v->FreeCount--;
+        v->FsInfoDirty = true;
+        return cluster;
+    }
+
+    log_warn(MODULE, "%s: No free clusters", v->Device->Name);
+    return 0;
+}
+
+static bool fat_free_chain(FatVolume* v, uint32_t cluster)
+{
+    while (fat_is_valid_cluster(v, cluster)) {
+        uint32_t next;
+        if (!fat_get(v, cluster, &next) || !fat_set(v, cluster, 0))
+            return false;
+
+        if (v->FreeCount != FSINFO_UNKNOWN)
+            v->FreeCount++;
+        if (cluster < v->NextFree)
+            v->NextFree = cluster;
+        v->FsInfoDirty = true;
+
+        if (fat_is_eoc(v, next))
+            break;
+        cluster = next;
+    }
+    return true;
+}
+
+//
+// File data
+//
+
+static void fat_file_init(FatFile* f, FatVolume* v, uint32_t firstCluster, uint32_t size, bool directory)
+{
+    memset(f, 0, sizeof(FatFile));
+    f->Volume = v;
+    f->IsDirectory = directory;
+    f->FirstCluster = firstCluster;
+    f->Size = directory ? 0 : size;
+}
+
+static void fat_open_root(FatVolume* v, FatFile* f)
+{
+    if (v->Type == 32) {
+        fat_file_init(f, v, v->RootCluster, 0, true);
+    }
+    else {
+        fat_file_init(f, v, 0, 0, true);
+        f->FixedRoot = true;
+    }
+}
+
+static void fat_open_entry(FatVolume* v, FatFile* f, const FAT_DirectoryEntry* entry, const FatEntryPos* pos)
+{
+    uint32_t cluster = ((uint32_t)entry->FirstClusterHigh << 16) | entry->FirstClusterLow;
+    bool directory = (entry->Attributes & FAT_ATTRIBUTE_DIRECTORY) != 0;
+
+    // ".." of a first level directory points at cluster 0
+    if (directory && cluster == 0) {
+        fat_open_root(v, f);
+        return;
+    }
+
+    fat_file_init(f, v, cluster, entry->Size, directory);
+    f->HasEntry = true;
+    f->Entry = *pos;
+}
+
+//
+// Extent cache
+//
+
+// Appends the cluster following the mapped part of the chain
+static bool fat_extent_add(FatExtentMap* map, uint32_t cluster)
+{
+    if (map->Count > 0) {
+        FatExtent* last = &map->Extents[map->Count - 1];
+        if (last->Cluster + last->Length == cluster) {
+            last->Length++;
+            map->Clusters++;
+            return true;
+        }
+    }
+
+    if (map->Count == FAT_MAX_EXTENTS)
+        return false;
+
+    FatExtent* extent = &map->Extents[map->Count++];
+    extent->FileCluster = map->Clusters;
+    extent->Cluster = cluster;
+    extent->Length = 1;
+    map->Clusters++;
+    return true;
+}
+
+static bool fat_build_extents(FatFile* f)
+{
+    FatVolume* v = f->Volume;
+    FatExtentMap* map = f->Extents;
+
+    map->Valid = true;
+    map->Complete = false;
+    map->Count = 0;
+    map->Clusters = 0;
+
+    uint32_t cluster = f->FirstCluster;
+    if (cluster == 0) {
+        map->Complete = true;
+        return true;
+    }
+
+    while (fat_extent_add(map, cluster)) {
+        uint32_t next;
+        if (!fat_get(v, cluster, &next)) {
+            map->Valid = false;
+            return false;
+        }
+
+        if (fat_is_eoc(v, next)) {
+            map->Complete = true;
+            break;
+        }
+
+        // A chain longer than the volume loops back on itself
+        if (!fat_is_valid_cluster(v, next) || map->Clusters > v->ClusterCount) {
+            log_err(MODULE, "%s: Broken cluster chain at %u", v->Device->Name, cluster);
+            map->Valid = false;
+            return false;
+        }
+        cluster = next;
+    }
+
+    return true;
+}
+
+// Binary search for the extent holding the file's index'th cluster, index < map->Clusters
+static uint32_t fat_extent_lookup(FatExtentMap* map, uint32_t index)
+{
+    uint32_t low = 0;
+    uint32_t high = map->Count - 1;
+
+    while (low < high) {
+        uint32_t middle = (low + high + 1) / 2;
+        if (map->Extents[middle].FileCluster <= index)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    FatExtent* extent = &map->Extents[low];
+    return extent->Cluster + (index - extent->FileCluster);
+}
+
+// Same directory entry, or the same chain reached another way (a directory through "..")
+static bool fat_same_chain(const FatFile* a, const FatFile* b)
+{
+    if (a->Volume != b->Volume)
+        return false;
+    if (a->HasEntry && b->HasEntry && a->Entry.Lba == b->Entry.Lba && a->Entry.Offset == b->Entry.Offset)
+        return true;
+    return a->FirstCluster != 0 && a->FirstCluster == b->FirstCluster;
+}
+
+// Other open handles on f's chain drop their extents and cursor, which may point at clusters
+// f just freed or miss clusters f just appended
+static void fat_invalidate_other_extents(FatFile* f)
+{
+    for (int i = 0; i < FATFS_MAX_OPEN_FILES; i++) {
+        FatFile* other = &g_Files[i];
+        if (other == f || !other->InUse || !fat_same_chain(other, f))
+            continue;
+
+        if (other->Extents != NULL)
+            other->Extents->Valid = false;
+        other->CurrentCluster = 0;
+        other->CurrentIndex = 0;
+    }
+}
+
+static void fat_invalidate_extents(FatFile* f)
+{
+    if (f->Extents != NULL)
+        f->Extents->Valid = false;
+    fat_invalidate_other_extents(f);
+}
+
+// Translates a file position to the cluster holding it: returns the cluster's LBA, the offset
+// inside it and the bytes left in it. With 'extend' set missing clusters are allocated.
+static bool fat_map(FatFile* f, uint32_t position, bool extend, uint64_t* lba, uint32_t* offset, uint32_t* avail)
+{
+    FatVolume* v = f->Volume;
+    FatExtentMap* map = f->Extents;
+
+    if (f->FixedRoot) {
+        if (position >= v->RootDirSize)
+            return false;
+        *lba = v->RootDirLba;
+        *offset = position;
+        *avail = v->RootDirSize - position;
+        return true;
+    }
+
+    if (f->FirstCluster == 0) {
+        if (!extend)
+            return false;
+
+        uint32_t cluster = fat_alloc_cluster(v, 0);
+        if (cluster == 0)
+            return false;
+        f->FirstCluster = cluster;
+        f->CurrentCluster = 0;
+        fat_invalidate_extents(f);
+    }
+
+    uint32_t index = position / v->ClusterSize;
+    if (map != NULL && !map->Valid && !fat_build_extents(f))
+        return false;
+
+    if (map != NULL && index < map->Clusters) {
+        f->CurrentCluster = fat_extent_lookup(map, index);
+        f->CurrentIndex = index;
+    }
+    else if (map != NULL && map->Complete && !extend) {
+        return false;
+    }
+    else {
+        // Past the mapped part: walk on from the furthest known cluster
+        if (f->CurrentCluster == 0 || index < f->CurrentIndex) {
+            f->CurrentCluster = f->FirstCluster;
+            f->CurrentIndex = 0;
+        }
+        if (map != NULL && map->Clusters > f->CurrentIndex + 1) {
+            f->CurrentIndex = map->Clusters - 1;
+            f->CurrentCluster = fat_extent_lookup(map, f->CurrentIndex);
+        }
+    }
+
+    while (f->CurrentIndex < index) {
+        uint32_t next;
+        if (!fat_get(v, f->CurrentCluster, &next))
+            return false;
+
+        if (fat_is_eoc(v, next)) {
+            if (!extend)
+                return false;
+            next = fat_alloc_cluster(v, f->CurrentCluster);
+            if (next == 0)
+                return false;
+
+            // Growing at the end of a fully mapped chain keeps the map up to date
+            if (map != NULL && map->Complete && f->CurrentIndex + 1 == map->Clusters && !fat_extent_add(map, next))
+                map->Complete = false;
+            fat_invalidate_other_extents(f);
+        }
+        else if (!fat_is_valid_cluster(v, next)) {
+            log_err(MODULE, "%s: Broken cluster chain at %u", v->Device->Name, f->CurrentCluster);
+            return false;
+        }
+
+        f->CurrentCluster = next;
+        f->CurrentIndex++;
+    }
+
+    *lba = fat_cluster_lba(v, f->CurrentCluster);
+    *offset = position % v->ClusterSize;
+    *avail = v->ClusterSize - *offset;
+    return true;
+}
+
+// Copies data (or zeros when data is NULL) to the file at its position, allocating clusters
+static uint32_t fat_write_data(FatFile* f, const uint8_t* data, uint32_t count)
+{
+    uint32_t written = 0;
+
+    while (written < count) {
+        uint64_t lba;
+        uint32_t offset, avail;
+        if (!fat_map(f, f->Position, true, &lba, &offset, &avail))
+            break;
+
+        uint32_t chunk = count - written < avail ? count - written : avail;
+        if (data == NULL && chunk > SECTOR_SIZE - offset % SECTOR_SIZE)
+            chunk = SECTOR_SIZE - offset % SECTOR_SIZE;
+
+        if (!bcache_write(f->Volume->Device, lba, offset, data ? data + written : g_ZeroSector, chunk))
+            break;
+
+        written += chunk;
+        f->Position += chunk;
+    }
+
+    if (f->Position > f->Size && !f->IsDirectory)
+        f->Size = f->Position;
+
+    return written;
+}
+
+// Writes size and first cluster back to the file's directory entry
+static bool fat_update_entry(FatFile* f)
+{
+    if (!f->HasEntry)
+        return true;
+
+    FAT_DirectoryEntry entry;
+    BlockDev* dev = f->Volume->Device;
+    if (!bcache_read(dev, f->Entry.Lba, f->Entry.Offset, &entry, DIR_ENTRY_SIZE))
+        return false;
+
+    entry.Size = f->IsDirectory ? 0 : f->Size;
+    entry.FirstClusterLow = f->FirstCluster & 0xFFFF;
+    entry.FirstClusterHigh = f->FirstCluster >> 16;
+    entry.ModifiedDate = FAT_DEFAULT_DATE;
+    entry.AccessedDate = FAT_DEFAULT_DATE;
+    entry.Attributes |= f->IsDirectory ? 0 : FAT_ATTRIBUTE_ARCHIVE;
+    return bcache_write(dev, f->Entry.Lba, f->Entry.Offset, &entry, DIR_ENTRY_SIZE);
+}
+
+//
+// Directories
+//
+
+static char fat_upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static bool fat_is_valid_char(char c)
+{
+    static const char invalid[] = "\"*+,./:;<=>?[\\]|";
+
+    if (c <= ' ')
+        return false;
+    for (int i = 0; invalid[i] != '\0'; i++) {
+        if (c == invalid[i])
+            return false;
+    }
+    return true;
+}
+
+// Converts a path component to its padded 8.3 form, false if it has no such form
+static bool fat_make_short_name(const char* name, uint32_t length, uint8_t shortName[11])
+{
+    memset(shortName, ' ', 11);
+
+    if ((length == 1 && name[0] == '.') || (length == 2 && name[0] == '.' && name[1] == '.')) {
+        memcpy(shortName, name, length);
+        return true;
+    }
+
+    uint32_t dot = length;
+    for (uint32_t i = 0; i < length; i++) {
+        if (name[i] == '.')
+            dot = i;
+    }
+
+    if (dot == 0 || dot > 8 || length - dot > 4 || (dot < length && dot == length - 1))
+        return false;
+
+    for (uint32_t i = 0; i < length; i++) {
+        char c = name[i];
+        if (i == dot)
+            continue;
+        if (!fat_is_valid_char(c))
+            return false;
+
+        if (i < dot)
+            shortName[i] = fat_upper(c);
+        else
+            shortName[8 + i - dot - 1] = fat_upper(c);
+    }
+
+    return true;
+}
+
+static void fat_short_name_to_string(const uint8_t shortName[11], char* out)
+{
+    int length = 0;
+    for (int i = 0; i < 8 && shortName[i] != ' '; i++)
+        out[length++] = shortName[i];
+
+    if (shortName[8] != ' ') {
+        out[length++] = '.';
+        for (int i = 8; i < 11 && shortName[i] != ' '; i++)
+            out[length++] = shortName[i];
+    }
+    out[length] = '\0';
+}
+
+// Case insensitive for ASCII, 'b' is not terminated
+static bool fat_name_equals(const char* a, const char* b, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        if (a[i] == '\0' || fat_upper(a[i]) != fat_upper(b[i]))
+            return false;
+    }
+    return a[length] == '\0';
+}
+
+// Reads the entry at the directory's position and moves past it, false at the end of its clusters
+static bool fat_dir_read(FatFile* dir, FAT_DirectoryEntry* entry, FatEntryPos* pos)
+{
+    uint64_t lba;
+    uint32_t offset, avail;
+    if (!fat_map(dir, dir->Position, false, &lba, &offset, &avail))
+        return false;
+
+    if (!bcache_read(dir->Volume->Device, lba, offset, entry, DIR_ENTRY_SIZE))
+        return false;
+
+    pos->Lba = lba + offset / SECTOR_SIZE;
+    pos->Offset = offset % SECTOR_SIZE;
+    dir->Position += DIR_ENTRY_SIZE;
+    return true;
+}
+
+//
+// Long file names
+//
+
+static uint8_t fat_lfn_checksum(const uint8_t shortName[11])
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + shortName[i];
+    return sum;
+}
+
+static void fat_lfn_collect(FatLfnState* lfn, const FAT_LongFileEntry* e, uint32_t position)
+{
+    int order = e->Order & FAT_LFN_ORDER_MASK;
+
+    if (e->Order & FAT_LFN_LAST) {
+        if (order == 0 || order > FAT_LFN_MAX_ENTRIES) {
+            lfn->Next = -1;
+            return;
+        }
+        lfn->Checksum = e->Checksum;
+        lfn->FirstSlot = position;
+        lfn->Name[order * FAT_LFN_CHARS < FATFS_MAX_NAME ? order * FAT_LFN_CHARS : FATFS_MAX_NAME] = '\0';
+    }
+    else if (order == 0 || order != lfn->Next || e->Checksum != lfn->Checksum) {
+        lfn->Next = -1;
+        return;
+    }
+
+    uint16_t chars[FAT_LFN_CHARS];
+    memcpy(chars, e->Chars1, sizeof(e->Chars1));
+    memcpy(chars + 5, e->Chars2, sizeof(e->Chars2));
+    memcpy(chars + 11, e->Chars3, sizeof(e->Chars3));
+
+    // The name ends at a NUL followed by 0xFFFF padding, or fills its last entry exactly
+    uint32_t start = (order - 1) * FAT_LFN_CHARS;
+    for (uint32_t i = 0; i < FAT_LFN_CHARS && start + i < FATFS_MAX_NAME; i++) {
+        uint16_t c = chars[i];
+        lfn->Name[start + i] = (c == 0 || c == 0xFFFF) ? '\0' : (c < 0x80 ? (char)c : '?');
+    }
+    lfn->Next = order - 1;
+}
+
+// Returns the next live short entry of dir, with lfn->Name set to its long name if it has a
+// valid one. LFN entries are collected on the way, so a directory takes a single forward pass.
+static bool fat_dir_next(FatFile* dir, FatLfnState* lfn, FAT_DirectoryEntry* entry, FatEntryPos* pos)
+{
+    lfn->Next = -1;
+    lfn->Name[0] = '\0';
+
+    while (fat_dir_read(dir, entry, pos)) {
+        if (entry->Name[0] == 0) {
+            // Stay on the end marker so further calls keep returning false
+            dir->Position -= DIR_ENTRY_SIZE;
+            return false;
+        }
+        if (entry->Name[0] == DELETED_ENTRY) {
+            lfn->Next = -1;
+            continue;
+        }
+        if (entry->Attributes == FAT_ATTRIBUTE_LFN) {
+            fat_lfn_collect(lfn, (const FAT_LongFileEntry*)entry, dir->Position - DIR_ENTRY_SIZE);
+            continue;
+        }
+        if (entry->Attributes & FAT_ATTRIBUTE_VOLUME_ID) {
+            lfn->Next = -1;
+            continue;
+        }
+
+        if (lfn->Next != 0 || lfn->Checksum != fat_lfn_checksum(entry->Name))
+            lfn->Name[0] = '\0';
+        lfn->Next = -1;
+        return true;
+    }
+
+    return false;
+}
+
+//
+// Dentry cache
+//
+
+static inline uint32_t fat_dir_key(FatFile* dir)
+{
+    return dir->FixedRoot ? 0 : dir->FirstCluster;
+}
+
+// Upper cases name into key, false when it is too long to be cached
+static bool fat_dentry_key(const char* name, uint32_t length, char key[FAT_DENTRY_NAME])
+{
+    if (length >= FAT_DENTRY_NAME)
+        return false;
+
+    for (uint32_t i = 0; i < length; i++)
+        key[i] = fat_upper(name[i]);
+    key[length] = '\0';
+    return true;
+}
+
+static uint32_t fat_dentry_hash(FatVolume* v, uint32_t parent, const char* key)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)v ^ (parent * 2654435761u);
+    for (; *key != '\0'; key++)
+        hash = (hash ^ (uint8_t)*key) * 16777619u;
+    return hash;
+}
+
+static void fat_dentry_lru_unlink(FatDentry* d)
+{
+    if (d->LruPrev) d->LruPrev->LruNext = d->LruNext;
+    else g_DentryLruHead = d->LruNext;
+
+    if (d->LruNext) d->LruNext->LruPrev = d->LruPrev;
+    else g_DentryLruTail = d->LruPrev;
+
+    d->LruPrev = d->LruNext = NULL;
+}
+
+static void fat_dentry_lru_push_front(FatDentry* d)
+{
+    d->LruPrev = NULL;
+    d->LruNext = g_DentryLruHead;
+    if (g_DentryLruHead) g_DentryLruHead->LruPrev = d;
+    else g_DentryLruTail = d;
+    g_DentryLruHead = d;
+}
+
+static void fat_dentry_hash_remove(FatDentry* d)
+{
+    FatDentry** link = &g_DentryHash[d->Hash % FAT_DENTRY_BUCKETS];
+    while (*link != NULL) {
+        if (*link == d) {
+            *link = d->HashNext;
+            break;
+        }
+        link = &(*link)->HashNext;
+    }
+    d->HashNext = NULL;
+    d->Volume = NULL;
+}
+
+static FatDentry* fat_dentry_find(FatVolume* v, uint32_t parent, const char* key)
+{
+    uint32_t hash = fat_dentry_hash(v, parent, key);
+    for (FatDentry* d = g_DentryHash[hash % FAT_DENTRY_BUCKETS]; d != NULL; d = d->HashNext) {
+        if (d->Hash == hash && d->Volume == v && d->Parent == parent && strcmp(d->Name, key) == 0) {
+            if (g_DentryLruHead != d) {
+                fat_dentry_lru_unlink(d);
+                fat_dentry_lru_push_front(d);
+            }
+            return d;
+        }
+    }
+    return NULL;
+}
+
+// Adds or updates the entry for key, pos == NULL records that the name does not exist
+static void fat_dentry_insert(FatVolume* v, uint32_t parent, const char* key, const FatEntryPos* pos)
+{
+    FatDentry* d = fat_dentry_find(v, parent, key);
+
+    if (d == NULL) {
+        if (g_DentryLruHead == NULL) {
+            for (int i = 0; i < FAT_DENTRY_COUNT; i++)
+                fat_dentry_lru_push_front(&g_Dentries[i]);
+        }
+
+        // Reuse the least recently used entry
+        d = g_DentryLruTail;
+        if (d->Volume != NULL)
+            fat_dentry_hash_remove(d);
+
+        d->Volume = v;
+        d->Parent = parent;
+        d->Hash = fat_dentry_hash(v, parent, key);
+        strcpy(d->Name, key);
+
+        FatDentry** bucket = &g_DentryHash[d->Hash % FAT_DENTRY_BUCKETS];
+        d->HashNext = *bucket;
+        *bucket = d;
+
+        fat_dentry_lru_unlink(d);
+        fat_dentry_lru_push_front(d);
+    }
+
+    d->Negative = pos == NULL;
+    if (pos != NULL)
+        d->Entry = *pos;
+}
+
+static void fat_dentry_purge(FatVolume* v)
+{
+    for (int i = 0; i < FAT_DENTRY_COUNT; i++) {
+        if (g_Dentries[i].Volume == v)
+            fat_dentry_hash_remove(&g_Dentries[i]);
+    }
+}
+
+// Scans dir for name, by its short or long name, caching every name it passes
+static bool fat_dir_search(FatFile* dir, const char* name, uint32_t length, FatLfnState* lfn,
+                           FAT_DirectoryEntry* entry, FatEntryPos* pos)
+{
+    FatVolume* v = dir->Volume;
+    uint32_t parent = fat_dir_key(dir);
+    uint8_t shortName[11];
+    bool hasShortName = fat_make_short_name(name, length, shortName);
+
+    dir->Position = 0;
+    while (fat_dir_next(dir, lfn, entry, pos)) {
+        char key[FAT_DENTRY_NAME];
+        fat_short_name_to_string(entry->Name, key);
+        fat_dentry_insert(v, parent, key, pos);
+
+        uint32_t longLength = strlen(lfn->Name);
+        if (longLength > 0 && fat_dentry_key(lfn->Name, longLength, key))
+            fat_dentry_insert(v, parent, key, pos);
+
+        if ((hasShortName && memcmp(entry->Name, shortName, 11) == 0) ||
+            (longLength > 0 && fat_name_equals(lfn->Name, name, length)))
+            return true;
+    }
+
+    return false;
+}
+
+// Looks name up in dir. A miss scans the directory once and caches every name it passes,
+// so later lookups in the same directory are answered from memory.
+static bool fat_lookup(FatFile* dir, const char* name, uint32_t length, FAT_DirectoryEntry* entry, FatEntryPos* pos)
+{
+    FatVolume* v = dir->Volume;
+    uint32_t parent = fat_dir_key(dir);
+    char key[FAT_DENTRY_NAME];
+    bool cacheable = fat_dentry_key(name, length, key);
+
+    if (cacheable) {
+        FatDentry* d = fat_dentry_find(v, parent, key);
+        if (d != NULL) {
+            if (d->Negative)
+                return false;
+
+            // The entry itself is re-read so size and first cluster are current
+            *pos = d->Entry;
+            return bcache_read(v->Device, pos->Lba, pos->Offset, entry, DIR_ENTRY_SIZE);
+        }
+    }
+
+    FatLfnState lfn;
+    if (fat_dir_search(dir, name, length, &lfn, entry, pos))
+        return true;
+
+    if (cacheable)
+        fat_dentry_insert(v, parent, key, NULL);
+    return false;
+}
+
+// Finds a free slot in dir, growing it by a zeroed cluster when it is full
+static bool fat_find_free_entry(FatFile* dir, FatEntryPos* pos)
+{
+    FAT_DirectoryEntry entry;
+
+    dir->Position = 0;
+    while (fat_dir_read(dir, &entry, pos)) {
+        if (entry.Name[0] == 0 || entry.Name[0] == DELETED_ENTRY)
+            return true;
+    }
+
+    if (dir->FixedRoot) {
+        log_warn(MODULE, "%s: Root directory is full", dir->Volume->Device->Name);
+        return false;
+    }
+
+    uint32_t position = dir->Position;
+    if (fat_write_data(dir, NULL, dir->Volume->ClusterSize) != dir->Volume->ClusterSize)
+        return false;
+
+    dir->Position = position;
+    return fat_dir_read(dir, &entry, pos);
+}
+
+static bool fat_create_entry(FatFile* dir, const uint8_t shortName[11], FAT_DirectoryEntry* entry, FatEntryPos* pos)
+{
+    if (!fat_find_free_entry(dir, pos))
+        return false;
+
+    memset(entry, 0, DIR_ENTRY_SIZE);
+    memcpy(entry->Name, shortName, 11);
+    entry->Attributes = FAT_ATTRIBUTE_ARCHIVE;
+    entry->CreatedDate = FAT_DEFAULT_DATE;
+    entry->ModifiedDate = FAT_DEFAULT_DATE;
+    entry->AccessedDate = FAT_DEFAULT_DATE;
+
+    return bcache_write(dir->Volume->Device, pos->Lba, pos->Offset, entry, DIR_ENTRY_SIZE);
+}
+
+// Walks every component but the last one. On success 'dir' is the parent directory and
+// 'last' the last component; an empty path leaves 'dir' on the root and 'last' NULL.
+static int fat_resolve_parent(FatVolume* v, const char* path, FatFile* dir, const char** last, uint32_t* lastLength)
+{
+    fat_open_root(v, dir);
+    *last = NULL;
+
+    while (*path == '/')
+        path++;
+
+    while (*path != '\0') {
+        const char* end = path;
+        while (*end != '\0' && *end != '/')
+            end++;
+
+        const char* next = end;
+        while (*next == '/')
+            next++;
+
+        if (*next == '\0') {
+            *last = path;
+            *lastLength = end - path;
+            return SYSCALL_OK;
+        }
+
+        FAT_DirectoryEntry entry;
+        FatEntryPos pos;
+        if (!fat_lookup(dir, path, end - path, &entry, &pos))
+            return SYSCALL_NOT_FOUND;
+        if (!(entry.Attributes & FAT_ATTRIBUTE_DIRECTORY))
+            return SYSCALL_NOT_DIRECTORY;
+
+        fat_open_entry(v, dir, &entry, &pos);
+        path = next;
+    }
+
+    return SYSCALL_OK;
+}
+
+//
+// Volumes
+//
+
+static bool fat_is_boot_sector(const FAT_BootSector* bs)
+{
+    uint8_t spc = bs->SectorsPerCluster;
+    return (bs->BootJumpInstruction[0] == 0xEB || bs->BootJumpInstruction[0] == 0xE9) &&
+           bs->BytesPerSector == SECTOR_SIZE && spc != 0 && (spc & (spc - 1)) == 0 &&
+           bs->FatCount != 0 && bs->ReservedSectors != 0;
+}
+
+// The image builder puts the file system in a partition, floppies have it on the whole device
+static bool fat_find_boot_sector(BlockDev* dev, uint8_t* sector, uint64_t* start)
+{
+    if (!bcache_read(dev, 0, 0, sector, SECTOR_SIZE))
+        return false;
+
+    *start = 0;
+    if (fat_is_boot_sector((FAT_BootSector*)sector))
+        return true;
+
+    if (sector[510] != 0x55 || sector[511] != 0xAA)
+        return false;
+
+    MBR_PartitionEntry partitions[4];
+    memcpy(partitions, sector + 0x1BE, sizeof(partitions));
+
+    for (int i = 0; i < 4; i++) {
+        if (partitions[i].Type == 0 || partitions[i].LbaStart == 0 || partitions[i].LbaStart >= dev->BlockCount)
+            continue;
+
+        if (!bcache_read(dev, partitions[i].LbaStart, 0, sector, SECTOR_SIZE))
+            return false;
+        if (fat_is_boot_sector((FAT_BootSector*)sector)) {
+            *start = partitions[i].LbaStart;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void fat_read_fsinfo(FatVolume* v)
+{
+    uint32_t lead, structSig, freeCount, nextFree;
+    if (!bcache_read(v->Device, v->FsInfoLba, 0, &lead, 4) ||
+        !bcache_read(v->Device, v->FsInfoLba, 484, &structSig, 4) ||
+        !bcache_read(v->Device, v->FsInfoLba, FSINFO_FREE_COUNT, &freeCount, 4) ||
+        !bcache_read(v->Device, v->FsInfoLba, FSINFO_NEXT_FREE, &nextFree, 4) ||
+        lead != FSINFO_LEAD_SIGNATURE || structSig != FSINFO_STRUCT_SIGNATURE) {
+        v->FsInfoLba = 0;
+        return;
+    }
+
+    // Both values are only hints, ignore ones that can't be right
+    v->FreeCount = freeCount <= v->ClusterCount ? freeCount : FSINFO_UNKNOWN;
+    v->NextFree = fat_is_valid_cluster(v, nextFree) ? nextFree : 2;
+}
+
+FatVolume* fat_mount(BlockDev* dev)
+{
+    FatVolume* v = NULL;
+    for (int i = 0; i < FATFS_MAX_VOLUMES; i++) {
+        if (g_Volumes[i].Mounted && g_Volumes[i].Device == dev) {
+            log_err(MODULE, "%s is already mounted", dev->Name);
+            return NULL;
+        }
+        if (!g_Volumes[i].Mounted && v == NULL)
+            v = &g_Volumes[i];
+    }
+
+    if (v == NULL || dev->BlockSize != SECTOR_SIZE)
+        return NULL;
+
+    uint8_t sector[SECTOR_SIZE];
+    uint64_t start;
+    if (!fat_find_boot_sector(dev, sector, &start)) {
+        log_warn(MODULE, "No FAT file system on %s", dev->Name);
+        return NULL;
+    }
+
+    FAT_BootSector* bs = (FAT_BootSector*)sector;
+    uint32_t totalSectors = bs->TotalSectors != 0 ? bs->TotalSectors : bs->LargeSectorCount;
+    uint32_t sectorsPerFat = bs->SectorsPerFat != 0 ? bs->SectorsPerFat : bs->EBR32.SectorsPerFat;
+    uint32_t rootDirSectors = (bs->DirEntryCount * DIR_ENTRY_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t metaSectors = bs->ReservedSectors + bs->FatCount * sectorsPerFat + rootDirSectors;
+
+    if (sectorsPerFat == 0 || totalSectors <= metaSectors || start + totalSectors > dev->BlockCount) {
+        log_err(MODULE, "%s: Invalid boot sector", dev->Name);
+        return NULL;
+    }
+
+    memset(v, 0, sizeof(FatVolume));
+    v->Device = dev;
+    v->SectorsPerCluster = bs->SectorsPerCluster;
+    v->ClusterSize = bs->SectorsPerCluster * SECTOR_SIZE;
+    v->ClusterCount = (totalSectors - metaSectors) / bs->SectorsPerCluster;
+    v->FatCount = bs->FatCount;
+    v->SectorsPerFat = sectorsPerFat;
+    v->FatLba = start + bs->ReservedSectors;
+    v->RootDirLba = v->FatLba + bs->FatCount * sectorsPerFat;
+    v->RootDirSize = bs->DirEntryCount * DIR_ENTRY_SIZE;
+    v->DataLba = v->RootDirLba + rootDirSectors;
+    v->FreeCount = FSINFO_UNKNOWN;
+    v->NextFree = 2;
+
+    // The cluster count alone decides the FAT type
+    if (v->ClusterCount < 4085)
+        v->Type = 12;
+    else if (v->ClusterCount < 65525)
+        v->Type = 16;
+    else
+        v->Type = 32;
+
+    if (v->Type == 32) {
+        v->RootCluster = bs->EBR32.RootDirectoryCluster;
+        if (bs->EBR32.FSInfoSector != 0 && bs->EBR32.FSInfoSector != 0xFFFF) {
+            v->FsInfoLba = start + bs->EBR32.FSInfoSector;
+            fat_read_fsinfo(v);
+        }
+    }
+
+    v->Mounted = true;
+    log_info(MODULE, "Mounted FAT%u on %s (%u clusters of %u bytes)", v->Type, dev->Name,
+             v->ClusterCount, v->ClusterSize);
+    return v;
+}
+
+bool fat_unmount(FatVolume* volume)
+{
+    if (volume->OpenFiles > 0) {
+        log_warn(MODULE, "%s has %d open files", volume->Device->Name, volume->OpenFiles);
+        return false;
+    }
+
+    bool ok = fat_sync(volume);
+    bcache_invalidate(volume->Device);
+    fat_dentry_purge(volume);
+    volume->Mounted = false;
+    return ok;
+}
+
+bool fat_sync(FatVolume* volume)
+{
+    if (volume == NULL) {
+        bool ok = true;
+        for (int i = 0; i < FATFS_MAX_VOLUMES; i++) {
+            if (g_Volumes[i].Mounted)
+                ok &= fat_sync(&g_Volumes[i]);
+        }
+        return ok;
+    }
+
+    if (volume->FsInfoDirty && volume->FsInfoLba != 0) {
+        bcache_write(volume->Device, volume->FsInfoLba, FSINFO_FREE_COUNT, &volume->FreeCount, 4);
+        bcache_write(volume->Device, volume->FsInfoLba, FSINFO_NEXT_FREE, &volume->NextFree, 4);
+    }
+    volume->FsInfoDirty = false;
+
+    return bcache_sync(volume->Device);
+}
+
+uint8_t fat_get_type(FatVolume* volume)
+{
+    return volume->Type;
+}
+
+//
+// Files
+//
+
+static FatFile* fat_alloc_file(void)
+{
+    for (int i = 0; i < FATFS_MAX_OPEN_FILES; i++) {
+        if (!g_Files[i].InUse)
+            return &g_Files[i];
+    }
+    return NULL;
+}
+
+static bool fat_is_open(FatVolume* v, const FatEntryPos* pos)
+{
+    for (int i = 0; i < FATFS_MAX_OPEN_FILES; i++) {
+        FatFile* f = &g_Files[i];
+        if (f->InUse && f->Volume == v && f->HasEntry &&
+            f->Entry.Lba == pos->Lba && f->Entry.Offset == pos->Offset)
+            return true;
+    }
+    return false;
+}
+
+static FatFile* fat_find_open(const FatFile* file)
+{
+    for (int i = 0; i < FATFS_MAX_OPEN_FILES; i++) {
+        FatFile* f = &g_Files[i];
+        if (f->InUse && (fat_same_chain(f, file) || (f->Volume == file->Volume && f->FixedRoot && file->FixedRoot)))
+            return f;
+    }
+    return NULL;
+}
+
+int fat_open(FatVolume* volume, const char* path, uint32_t flags, FatFile** file)
+{
+    FatFile dir;
+    const char* last;
+    uint32_t lastLength;
+    int result = fat_resolve_parent(volume, path, &dir, &last, &lastLength);
+    if (result != SYSCALL_OK)
+        return result;
+
+    FatFile opened;
+    if (last == NULL) {
+        // The root directory itself
+        opened = dir;
+    }
+    else {
+        FAT_DirectoryEntry entry;
+        FatEntryPos pos;
+
+        if (!fat_lookup(&dir, last, lastLength, &entry, &pos)) {
+            uint8_t shortName[11];
+            if (!(flags & OPEN_CREATE))
+                return SYSCALL_NOT_FOUND;
+            if (!fat_make_short_name(last, lastLength, shortName))
+                return SYSCALL_INVALID_PARAMS;
+            if (!fat_create_entry(&dir, shortName, &entry, &pos))
+                return SYSCALL_IO_ERROR;
+
+            char key[FAT_DENTRY_NAME];
+            if (fat_dentry_key(last, lastLength, key))
+                fat_dentry_insert(volume, fat_dir_key(&dir), key, &pos);
+        }
+        else if ((entry.Attributes & FAT_ATTRIBUTE_READ_ONLY) && (flags & (OPEN_WRITE | OPEN_TRUNCATE))) {
+            return SYSCALL_PERMISSION_DENIED;
+        }
+
+        fat_open_entry(volume, &opened, &entry, &pos);
+    }
+
+    if (opened.IsDirectory && (flags & (OPEN_WRITE | OPEN_TRUNCATE)))
+        return SYSCALL_IS_DIRECTORY;
+
+    FatFile* f = fat_find_open(&opened);
+    if (f == NULL) {
+        f = fat_alloc_file();
+        if (f == NULL)
+            return SYSCALL_OUT_OF_MEMORY;
+
+        *f = opened;
+        f->InUse = true;
+        f->RefCount = 0;
+        f->Flags = 0;
+        f->Extents = &g_ExtentMaps[f - g_Files];
+        f->Extents->Valid = false;
+        volume->OpenFiles++;
+    }
+    f->RefCount++;
+    f->Flags |= flags & (OPEN_READ | OPEN_WRITE);
+    f->Position = 0;
+
+    if ((flags & OPEN_TRUNCATE) && (flags & OPEN_WRITE) && f->Size > 0) {
+        result = fat_truncate(f, 0);
+        if (result != SYSCALL_OK) {
+            fat_close(f);
+            return result;
+        }
+    }
+
+    *file = f;
+    return SYSCALL_OK;
+}
+
+void fat_close(FatFile* file)
+{
+    if (file == NULL || !file->InUse || --file->RefCount > 0)
+        return;
+
+    file->InUse = false;
+    file->Volume->OpenFiles--;
+}
+
+int32_t fat_read(FatFile* file, void* buffer, uint32_t count)
+{
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t done = 0;
+
+    // Directories have no size, they end with their cluster chain
+    if (!file->IsDirectory) {
+        if (file->Position >= file->Size)
+            return 0;
+        if (count > file->Size - file->Position)
+            count = file->Size - file->Position;
+    }
+
+    while (done < count) {
+        uint64_t lba;
+        uint32_t offset, avail;
+        if (!fat_map(file, file->Position, false, &lba, &offset, &avail))
+            break;
+
+        uint32_t chunk = count - done < avail ? count - done : avail;
+        if (!bcache_read(file->Volume->Device, lba, offset, out + done, chunk))
+            return done > 0 ? (int32_t)done : SYSCALL_IO_ERROR;
+
+        done += chunk;
+        file->Position += chunk;
+    }
+
+    return done;
+}
+
+int32_t fat_write(FatFile* file, const void* buffer, uint32_t count)
+{
+    if (!(file->Flags & OPEN_WRITE))
+        return SYSCALL_PERMISSION_DENIED;
+    if (file->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+
+    if (count > 0xFFFFFFFF - file->Position)
+        count = 0xFFFFFFFF - file->Position;
+
+    // Writing past the end leaves a hole that must read back as zeros
+    if (file->Position > file->Size) {
+        uint32_t target = file->Position;
+        uint32_t gap = target - file->Size;
+        file->Position = file->Size;
+        if (fat_write_data(file, NULL, gap) != gap) {
+            fat_update_entry(file);
+            return SYSCALL_IO_ERROR;
+        }
+    }
+
+    uint32_t written = fat_write_data(file, (const uint8_t*)buffer, count);
+    if (!fat_update_entry(file) || (written == 0 && count > 0))
+        return SYSCALL_IO_ERROR;
+
+    return written;
+}
+
+int fat_truncate(FatFile* file, uint32_t size)
+{
+    if (!(file->Flags & OPEN_WRITE))
+        return SYSCALL_PERMISSION_DENIED;
+    if (file->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+
+    FatVolume* v = file->Volume;
+    uint32_t position = file->Position;
+
+    if (size > file->Size) {
+        uint32_t gap = size - file->Size;
+        file->Position = file->Size;
+        bool ok = fat_write_data(file, NULL, gap) == gap;
+        file->Position = position;
+        if (!ok) {
+            fat_update_entry(file);
+            return SYSCALL_IO_ERROR;
+        }
+    }
+    else if (size < file->Size) {
+        uint32_t keep = (size + v->ClusterSize - 1) / v->ClusterSize;
+
+        if (keep == 0) {
+            if (!fat_free_chain(v, file->FirstCluster))
+                return SYSCALL_IO_ERROR;
+            file->FirstCluster = 0;
+        }
+        else if (file->FirstCluster != 0) {
+            // Cut the chain after the last cluster still needed
+            uint64_t lba;
+            uint32_t offset, avail, next;
+            if (!fat_map(file, (keep - 1) * v->ClusterSize, false, &lba, &offset, &avail) ||
+                !fat_get(v, file->CurrentCluster, &next))
+                return SYSCALL_IO_ERROR;
+
+            if (!fat_is_eoc(v, next)) {
+                if (!fat_set(v, file->CurrentCluster, fat_eoc(v)) || !fat_free_chain(v, next))
+                    return SYSCALL_IO_ERROR;
+            }
+        }
+
+        file->CurrentCluster = 0;
+        file->CurrentIndex = 0;
+        file->Size = size;
+        fat_invalidate_extents(file);
+    }
+
+    return fat_update_entry(file) ? SYSCALL_OK : SYSCALL_IO_ERROR;
+}
+
+int fat_unlink(FatVolume* volume, const char* path)
+{
+    FatFile dir;
+    const char* last;
+    uint32_t lastLength;
+    int result = fat_resolve_parent(volume, path, &dir, &last, &lastLength);
+    if (result != SYSCALL_OK)
+        return result;
+    if (last == NULL)
+        return SYSCALL_IS_DIRECTORY;
+
+    // Scanned rather than looked up in the dcache, its LFN entries are deleted too
+    FAT_DirectoryEntry entry;
+    FatEntryPos pos;
+    FatLfnState lfn;
+    if (!fat_dir_search(&dir, last, lastLength, &lfn, &entry, &pos))
+        return SYSCALL_NOT_FOUND;
+    uint32_t entryPosition = dir.Position - DIR_ENTRY_SIZE;
+
+    if (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY)
+        return SYSCALL_IS_DIRECTORY;
+    if (entry.Attributes & FAT_ATTRIBUTE_READ_ONLY)
+        return SYSCALL_PERMISSION_DENIED;
+    if (fat_is_open(volume, &pos))
+        return SYSCALL_BUSY;
+
+    uint32_t cluster = ((uint32_t)entry.FirstClusterHigh << 16) | entry.FirstClusterLow;
+    if (cluster != 0 && !fat_free_chain(volume, cluster))
+        return SYSCALL_IO_ERROR;
+
+    uint8_t deleted = DELETED_ENTRY;
+    if (!bcache_write(volume->Device, pos.Lba, pos.Offset, &deleted, 1))
+        return SYSCALL_IO_ERROR;
+
+    if (lfn.Name[0] != '\0') {
+        FAT_DirectoryEntry slot;
+        FatEntryPos slotPos;
+        for (dir.Position = lfn.FirstSlot; dir.Position < entryPosition; ) {
+            if (!fat_dir_read(&dir, &slot, &slotPos) ||
+                !bcache_write(volume->Device, slotPos.Lba, slotPos.Offset, &deleted, 1))
+                return SYSCALL_IO_ERROR;
+        }
+    }
+
+    // Remember every name of the entry as missing
+    char key[FAT_DENTRY_NAME];
+    fat_short_name_to_string(entry.Name, key);
+    fat_dentry_insert(volume, fat_dir_key(&dir), key, NULL);
+    if (fat_dentry_key(lfn.Name, strlen(lfn.Name), key))
+        fat_dentry_insert(volume, fat_dir_key(&dir), key, NULL);
+    if (fat_dentry_key(last, lastLength, key))
+        fat_dentry_insert(volume, fat_dir_key(&dir), key, NULL);
+    return SYSCALL_OK;
+}
+
+bool fat_seek(FatFile* file, uint32_t position)
+{
+    if (file->IsDirectory && position % DIR_ENTRY_SIZE != 0)
+        return false;
+
+    file->Position = position;
+    return true;
+}
+
+uint32_t fat_tell(FatFile* file)
+{
+    return file->Position;
+}
+
+uint32_t fat_get_size(FatFile* file)
+{
+    return file->Size;
+}
+
+bool fat_is_directory(FatFile* file)
+{
+    return file->IsDirectory;
+}
+
+bool fat_readdir(FatFile* dir, FatDirInfo* info)
+{
+    if (!dir->IsDirectory)
+        return false;
+
+    FAT_DirectoryEntry entry;
+    FatEntryPos pos;
+    FatLfnState lfn;
+    if (!fat_dir_next(dir, &lfn, &entry, &pos))
+        return false;
+
+    if (lfn.Name[0] != '\0')
+        strcpy(info->Name, lfn.Name);
+    else
+        fat_short_name_to_string(entry.Name, info->Name);
+    info->Size = entry.Size;
+    info->IsDirectory = (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY) != 0;
+    return true;
+}
+
+//
+// VFS
+//
+
+static int32_t fat_vfs_read(VfsInode* inode, uint32_t offset, void* buffer, uint32_t count)
+{
+    FatFile* file = (FatFile*)inode->Data;
+    fat_seek(file, offset);
+    return fat_read(file, buffer, count);
+}
+
+static int32_t fat_vfs_write(VfsInode* inode, uint32_t offset, const void* buffer, uint32_t count)
+{
+    FatFile* file = (FatFile*)inode->Data;
+    fat_seek(file, offset);
+    return fat_write(file, buffer, count);
+}
+
+static int fat_vfs_truncate(VfsInode* inode, uint32_t size)
+{
+    return fat_truncate((FatFile*)inode->Data, size);
+}
+
+static int fat_vfs_stat(VfsInode* inode, VfsStat* stat)
+{
+    FatFile* file = (FatFile*)inode->Data;
+    stat->Size = file->Size;
+    stat->IsDirectory = file->IsDirectory;
+    stat->Created = 0;
+    return SYSCALL_OK;
+}
+
+static bool fat_vfs_readdir(VfsInode* dir, uint32_t* cookie, VfsDirEntry* entry)
+{
+    // The cookie is the byte offset of the next directory entry
+    FatFile* file = (FatFile*)dir->Data;
+    FatDirInfo info;
+    if (!fat_seek(file, *cookie) || !fat_readdir(file, &info))
+        return false;
+
+    strcpy(entry->Name, info.Name);
+    entry->Size = info.Size;
+    entry->IsDirectory = info.IsDirectory;
+    *cookie = fat_tell(file);
+    return true;
+}
+
+static void fat_vfs_release(VfsInode* inode)
+{
+    fat_close((FatFile*)inode->Data);
+}
+
+static const VfsInodeOps g_FatInodeOps = {
+    .Read = fat_vfs_read,
+    .Write = fat_vfs_write,
+    .Truncate = fat_vfs_truncate,
+    .Stat = fat_vfs_stat,
+    .ReadDir = fat_vfs_readdir,
+    .Release = fat_vfs_release,
+};
+
+static int fat_vfs_mount(BlockDev* device, void** data)
+{
+    if (device == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    FatVolume* volume = fat_mount(device);
+    if (volume == NULL)
+        return SYSCALL_ERROR;
+
+    *data = volume;
+    return SYSCALL_OK;
+}
+
+static int fat_vfs_unmount(void* data)
+{
+    return fat_unmount((FatVolume*)data) ? SYSCALL_OK : SYSCALL_BUSY;
+}
+
+static bool fat_vfs_sync(void* data)
+{
+    return fat_sync((FatVolume*)data);
+}
+
+static int fat_vfs_open(VfsMount* mount, const char* path, uint32_t flags, VfsInode* inode)
+{
+    // Truncating is left to the VFS, which knows whether the file is mapped
+    FatFile* file;
+    int result = fat_open((FatVolume*)mount->Data, path, flags & ~OPEN_TRUNCATE, &file);
+    if (result != SYSCALL_OK)
+        return result;
+
+    inode->Ops = &g_FatInodeOps;
+    inode->Data = file;
+    inode->IsDirectory = file->IsDirectory;
+    return SYSCALL_OK;
+}
+
+static int fat_vfs_unlink(VfsMount* mount, const char* path)
+{
+    return fat_unlink((FatVolume*)mount->Data, path);
+}
+
+VfsFileSystem g_FatFileSystem = {
+    .Name = "fat",
+    .Mount = fat_vfs_mount,
+    .Unmount = fat_vfs_unmount,
+    .Sync = fat_vfs_sync,
+    .Open = fat_vfs_open,
+    .Unlink = fat_vfs_unlink,
+};
@@ -0,0 +1,719 @@
+#include <tmpfs.h>
+#include <syscall.h>
+#include <pmm.h>
+#include <time.h>
+#include <memory.h>
+#include <string.h>
+#include <debug.h>
+#include <vfs.h>
+#include <sync.h>
+#include <stddef.h>
+
+#define MODULE "TmpFS"
+
+#define TMPFS_PAGE_SIZE         PMM_FRAME_SIZE
+#define TMPFS_PAGE_ENTRIES      (TMPFS_PAGE_SIZE / sizeof(uint32_t))    // 1024 per radix tree level
+#define TMPFS_PAGE_SHIFT        10          // three levels cover 4GB
+#define TMPFS_INLINE_BUCKETS    8           // small directories hash into the node itself
+
+struct TmpfsNode {
+    char Name[TMPFS_MAX_NAME + 1];
+    uint32_t Hash;
+    bool IsDirectory;
+    uint32_t Size;                          // bytes, or entries of a directory
+    uint32_t Created;
+    struct TmpfsNode* Parent;
+    struct TmpfsNode* HashNext;
+    struct TmpfsNode* Prev;                 // siblings in creation order
+    struct TmpfsNode* Next;
+
+    union {
+        // Height 1 makes Root the only data page, every level above adds a page of 1024 entries
+        struct {
+            uint32_t Root;
+            uint32_t Height;
+        } File;
+
+        struct {
+            struct TmpfsNode** Buckets;
+            uint32_t BucketCount;           // power of two
+            struct TmpfsNode* FirstChild;
+            struct TmpfsNode* LastChild;
+            struct TmpfsNode* Cursor;       // last child handed out by index
+            uint32_t CursorIndex;
+            struct TmpfsNode* Inline[TMPFS_INLINE_BUCKETS];
+        } Dir;
+    };
+};
+
+static TmpfsNode* g_Root = NULL;
+static TmpfsNode* g_FreeNodes = NULL;
+static TmpfsStats g_Stats;
+// Node tables, page trees and directory hashes. Taken by the VFS entry points only.
+static RwLock g_Lock = RWLOCK_INIT("tmpfs");
+
+//
+// Memory
+//
+
+static uint32_t tmpfs_alloc_page(uint32_t* counter)
+{
+    uint32_t page = pmm_alloc_frame();
+    if (page == 0)
+        return 0;
+
+    memset((void*)page, 0, TMPFS_PAGE_SIZE);
+    (*counter)++;
+    return page;
+}
+
+static void tmpfs_free_page(uint32_t page, uint32_t* counter)
+{
+    pmm_free_frame(page);
+    (*counter)--;
+}
+
+// Nodes are carved out of whole frames, which are kept for reuse once allocated
+static TmpfsNode* tmpfs_alloc_node(void)
+{
+    if (g_FreeNodes == NULL) {
+        uint32_t page = tmpfs_alloc_page(&g_Stats.SlabPages);
+        if (page == 0)
+            return NULL;
+
+        TmpfsNode* nodes = (TmpfsNode*)page;
+        for (uint32_t i = 0; i < TMPFS_PAGE_SIZE / sizeof(TmpfsNode); i++) {
+            nodes[i].Next = g_FreeNodes;
+            g_FreeNodes = &nodes[i];
+        }
+    }
+
+    TmpfsNode* node = g_FreeNodes;
+    g_FreeNodes = node->Next;
+    memset(node, 0, sizeof(TmpfsNode));
+    g_Stats.Nodes++;
+    return node;
+}
+
+static void tmpfs_free_node(TmpfsNode* node)
+{
+    node->Next = g_FreeNodes;
+    g_FreeNodes = node;
+    g_Stats.Nodes--;
+}
+
+//
+// File data
+//
+
+static uint32_t tmpfs_height_pages(uint32_t height)
+{
+    return height == 0 ? 0 : 1u << (TMPFS_PAGE_SHIFT * (height - 1));
+}
+
+// Returns the data page holding page index 'page', allocating the path to it when alloc is set.
+// 0 stands for a hole, which reads as zeros.
+static uint32_t tmpfs_get_page(TmpfsNode* node, uint32_t page, bool alloc)
+{
+    if (page >= tmpfs_height_pages(node->File.Height)) {
+        if (!alloc)
+            return 0;
+
+        // Grow the tree at the top, the old root becomes the first entry of the new one
+        while (page >= tmpfs_height_pages(node->File.Height)) {
+            if (node->File.Height == 0) {
+                node->File.Height = 1;
+                continue;
+            }
+            if (node->File.Root != 0) {
+                uint32_t root = tmpfs_alloc_page(&g_Stats.IndexPages);
+                if (root == 0)
+                    return 0;
+                ((uint32_t*)root)[0] = node->File.Root;
+                node->File.Root = root;
+            }
+            node->File.Height++;
+        }
+    }
+
+    uint32_t* slot = &node->File.Root;
+    for (uint32_t level = node->File.Height; level > 1; level--) {
+        if (*slot == 0) {
+            if (!alloc)
+                return 0;
+            *slot = tmpfs_alloc_page(&g_Stats.IndexPages);
+            if (*slot == 0)
+                return 0;
+        }
+
+        uint32_t index = (page >> (TMPFS_PAGE_SHIFT * (level - 2))) & (TMPFS_PAGE_ENTRIES - 1);
+        slot = &((uint32_t*)*slot)[index];
+    }
+
+    if (*slot == 0 && alloc)
+        *slot = tmpfs_alloc_page(&g_Stats.DataPages);
+    return *slot;
+}
+
+// Frees every page of the subtree at slot from page 'first' on, true when nothing is left of it
+static bool tmpfs_trim(uint32_t* slot, uint32_t level, uint32_t first)
+{
+    if (*slot == 0)
+        return true;
+
+    if (level == 1) {
+        if (first > 0)
+            return false;
+        tmpfs_free_page(*slot, &g_Stats.DataPages);
+        *slot = 0;
+        return true;
+    }
+
+    uint32_t span = tmpfs_height_pages(level - 1);
+    uint32_t* table = (uint32_t*)*slot;
+    bool empty = true;
+
+    for (uint32_t i = 0; i < TMPFS_PAGE_ENTRIES; i++) {
+        uint32_t start = i * span;
+        if (first >= start + span) {
+            empty &= table[i] == 0;
+            continue;
+        }
+        empty &= tmpfs_trim(&table[i], level - 1, first > start ? first - start : 0);
+    }
+
+    if (empty) {
+        tmpfs_free_page(*slot, &g_Stats.IndexPages);
+        *slot = 0;
+    }
+    return empty;
+}
+
+//
+// Directories
+//
+
+static uint32_t tmpfs_hash(const char* name, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++)
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    return hash;
+}
+
+static void tmpfs_hash_insert(TmpfsNode* dir, TmpfsNode* node)
+{
+    TmpfsNode** bucket = &dir->Dir.Buckets[node->Hash & (dir->Dir.BucketCount - 1)];
+    node->HashNext = *bucket;
+    *bucket = node;
+}
+
+static void tmpfs_hash_remove(TmpfsNode* dir, TmpfsNode* node)
+{
+    TmpfsNode** link = &dir->Dir.Buckets[node->Hash & (dir->Dir.BucketCount - 1)];
+    while (*link != node)
+        link = &(*link)->HashNext;
+    *link = node->HashNext;
+}
+
+// Doubles the bucket array once a directory holds more entries than buckets.
+// Failing to grow only makes the chains longer.
+static void tmpfs_grow_buckets(TmpfsNode* dir)
+{
+    uint32_t count = dir->Dir.BucketCount * 2;
+    uint32_t bytes = count * sizeof(TmpfsNode*);
+    uint32_t frames = (bytes + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+
+    uint32_t buckets = pmm_alloc_frames(frames);
+    if (buckets == 0)
+        return;
+    memset((void*)buckets, 0, frames * TMPFS_PAGE_SIZE);
+    g_Stats.IndexPages += frames;
+
+    if (dir->Dir.Buckets != dir->Dir.Inline) {
+        uint32_t oldFrames = dir->Dir.BucketCount * sizeof(TmpfsNode*) / TMPFS_PAGE_SIZE;
+        pmm_free_frames((uint32_t)dir->Dir.Buckets, oldFrames);
+        g_Stats.IndexPages -= oldFrames;
+    }
+
+    // A frame holds 1024 buckets, so the first step skips straight to that
+    dir->Dir.Buckets = (TmpfsNode**)buckets;
+    dir->Dir.BucketCount = frames * TMPFS_PAGE_SIZE / sizeof(TmpfsNode*);
+    for (TmpfsNode* child = dir->Dir.FirstChild; child != NULL; child = child->Next)
+        tmpfs_hash_insert(dir, child);
+}
+
+static void tmpfs_init_directory(TmpfsNode* node)
+{
+    node->IsDirectory = true;
+    node->Dir.Buckets = node->Dir.Inline;
+    node->Dir.BucketCount = TMPFS_INLINE_BUCKETS;
+    g_Stats.Directories++;
+}
+
+void tmpfs_init(void)
+{
+    if (g_Root != NULL)
+        return;
+
+    memset(&g_Stats, 0, sizeof(g_Stats));
+    g_Root = tmpfs_alloc_node();
+    if (g_Root == NULL) {
+        log_err(MODULE, "Not enough memory for the root directory");
+        return;
+    }
+
+    strcpy(g_Root->Name, "/");
+    g_Root->Parent = g_Root;
+    g_Root->Created = (uint32_t)time_get_ticks();
+    tmpfs_init_directory(g_Root);
+
+    log_info(MODULE, "Initialized, %u nodes per page", TMPFS_PAGE_SIZE / sizeof(TmpfsNode));
+}
+
+TmpfsNode* tmpfs_get_root(void)
+{
+    if (g_Root == NULL)
+        tmpfs_init();
+    return g_Root;
+}
+
+TmpfsNode* tmpfs_lookup(TmpfsNode* dir, const char* name, uint32_t length)
+{
+    if (!dir->IsDirectory || length > TMPFS_MAX_NAME)
+        return NULL;
+
+    uint32_t hash = tmpfs_hash(name, length);
+    for (TmpfsNode* node = dir->Dir.Buckets[hash & (dir->Dir.BucketCount - 1)]; node != NULL; node = node->HashNext) {
+        if (node->Hash == hash && memcmp(node->Name, name, length) == 0 && node->Name[length] == '\0')
+            return node;
+    }
+    return NULL;
+}
+
+int tmpfs_create(TmpfsNode* dir, const char* name, uint32_t length, bool isDirectory, TmpfsNode** node)
+{
+    if (!dir->IsDirectory)
+        return SYSCALL_NOT_DIRECTORY;
+    if (length == 0 || length > TMPFS_MAX_NAME)
+        return SYSCALL_INVALID_PARAMS;
+    for (uint32_t i = 0; i < length; i++) {
+        if (name[i] == '/' || name[i] == '\0')
+            return SYSCALL_INVALID_PARAMS;
+    }
+    if ((length == 1 && name[0] == '.') || (length == 2 && name[0] == '.' && name[1] == '.'))
+        return SYSCALL_EXISTS;
+    if (tmpfs_lookup(dir, name, length) != NULL)
+        return SYSCALL_EXISTS;
+
+    TmpfsNode* created = tmpfs_alloc_node();
+    if (created == NULL)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    memcpy(created->Name, name, length);
+    created->Name[length] = '\0';
+    created->Hash = tmpfs_hash(name, length);
+    created->Parent = dir;
+    created->Created = (uint32_t)time_get_ticks();
+    if (isDirectory)
+        tmpfs_init_directory(created);
+
+    created->Prev = dir->Dir.LastChild;
+    if (dir->Dir.LastChild != NULL)
+        dir->Dir.LastChild->Next = created;
+    else
+        dir->Dir.FirstChild = created;
+    dir->Dir.LastChild = created;
+
+    tmpfs_hash_insert(dir, created);
+    dir->Size++;
+    if (dir->Size > dir->Dir.BucketCount)
+        tmpfs_grow_buckets(dir);
+
+    if (node != NULL)
+        *node = created;
+    return SYSCALL_OK;
+}
+
+int tmpfs_remove(TmpfsNode* dir, const char* name, uint32_t length)
+{
+    TmpfsNode* node = tmpfs_lookup(dir, name, length);
+    if (node == NULL)
+        return SYSCALL_NOT_FOUND;
+
+    if (node->IsDirectory) {
+        if (node->Size > 0)
+            return SYSCALL_NOT_EMPTY;
+        if (node->Dir.Buckets != node->Dir.Inline) {
+            uint32_t frames = node->Dir.BucketCount * sizeof(TmpfsNode*) / TMPFS_PAGE_SIZE;
+            pmm_free_frames((uint32_t)node->Dir.Buckets, frames);
+            g_Stats.IndexPages -= frames;
+        }
+        g_Stats.Directories--;
+    }
+    else {
+        tmpfs_trim(&node->File.Root, node->File.Height, 0);
+    }
+
+    tmpfs_hash_remove(dir, node);
+    dir->Dir.Cursor = NULL;
+    if (node->Prev != NULL)
+        node->Prev->Next = node->Next;
+    else
+        dir->Dir.FirstChild = node->Next;
+    if (node->Next != NULL)
+        node->Next->Prev = node->Prev;
+    else
+        dir->Dir.LastChild = node->Prev;
+    dir->Size--;
+
+    tmpfs_free_node(node);
+    return SYSCALL_OK;
+}
+
+int tmpfs_resolve(TmpfsNode* cwd, const char* path, TmpfsNode** node)
+{
+    TmpfsNode* current = (path[0] == '/' || cwd == NULL) ? tmpfs_get_root() : cwd;
+
+    while (*path != '\0') {
+        while (*path == '/')
+            path++;
+        if (*path == '\0')
+            break;
+
+        const char* end = path;
+        while (*end != '\0' && *end != '/')
+            end++;
+        uint32_t length = end - path;
+
+        if (!current->IsDirectory)
+            return SYSCALL_NOT_DIRECTORY;
+
+        if (length == 1 && path[0] == '.') {
+            // Stays in place
+        }
+        else if (length == 2 && path[0] == '.' && path[1] == '.') {
+            current = current->Parent;
+        }
+        else {
+            current = tmpfs_lookup(current, path, length);
+            if (current == NULL)
+                return SYSCALL_NOT_FOUND;
+        }
+        path = end;
+    }
+
+    *node = current;
+    return SYSCALL_OK;
+}
+
+int32_t tmpfs_read(TmpfsNode* node, uint32_t offset, void* buffer, uint32_t count)
+{
+    if (node->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+    if (offset >= node->Size)
+        return 0;
+    if (count > node->Size - offset)
+        count = node->Size - offset;
+
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t position = offset + done;
+        uint32_t pageOffset = position % TMPFS_PAGE_SIZE;
+        uint32_t chunk = TMPFS_PAGE_SIZE - pageOffset;
+        if (chunk > count - done)
+            chunk = count - done;
+
+        uint32_t page = tmpfs_get_page(node, position / TMPFS_PAGE_SIZE, false);
+        if (page != 0)
+            memcpy(out + done, (uint8_t*)page + pageOffset, chunk);
+        else
+            memset(out + done, 0, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+int32_t tmpfs_write(TmpfsNode* node, uint32_t offset, const void* buffer, uint32_t count)
+{
+    if (node->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+    if (offset + count < offset)
+        return SYSCALL_INVALID_PARAMS;
+
+    const uint8_t* in = (const uint8_t*)buffer;
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t position = offset + done;
+        uint32_t pageOffset = position % TMPFS_PAGE_SIZE;
+        uint32_t chunk = TMPFS_PAGE_SIZE - pageOffset;
+        if (chunk > count - done)
+            chunk = count - done;
+
+        uint32_t page = tmpfs_get_page(node, position / TMPFS_PAGE_SIZE, true);
+        if (page == 0)
+            break;
+
+        memcpy((uint8_t*)page + pageOffset, in + done, chunk);
+        done += chunk;
+    }
+
+    if (offset + done > node->Size)
+        node->Size = offset + done;
+
+    if (done == 0 && count > 0)
+        return SYSCALL_OUT_OF_MEMORY;
+    return done;
+}
+
+int tmpfs_truncate(TmpfsNode* node, uint32_t size)
+{
+    if (node->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+
+    if (size < node->Size) {
+        uint32_t firstFree = (size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+        tmpfs_trim(&node->File.Root, node->File.Height, firstFree);
+        if (node->File.Root == 0)
+            node->File.Height = 0;
+
+        // The rest of the last page must read as zeros if the file grows again
+        uint32_t tail = size % TMPFS_PAGE_SIZE;
+        if (tail != 0) {
+            uint32_t page = tmpfs_get_page(node, size / TMPFS_PAGE_SIZE, false);
+            if (page != 0)
+                memset((uint8_t*)page + tail, 0, TMPFS_PAGE_SIZE - tail);
+        }
+    }
+
+    // Growing leaves a hole, no pages are allocated for it
+    node->Size = size;
+    return SYSCALL_OK;
+}
+
+const char* tmpfs_get_name(TmpfsNode* node)
+{
+    return node->Name;
+}
+
+TmpfsNode* tmpfs_get_parent(TmpfsNode* node)
+{
+    return node->Parent;
+}
+
+uint32_t tmpfs_get_size(TmpfsNode* node)
+{
+    return node->Size;
+}
+
+uint32_t tmpfs_get_created(TmpfsNode* node)
+{
+    return node->Created;
+}
+
+bool tmpfs_is_directory(TmpfsNode* node)
+{
+    return node->IsDirectory;
+}
+
+TmpfsNode* tmpfs_first_child(TmpfsNode* dir)
+{
+    return dir->IsDirectory ? dir->Dir.FirstChild : NULL;
+}
+
+TmpfsNode* tmpfs_next_sibling(TmpfsNode* node)
+{
+    return node == g_Root ? NULL : node->Next;
+}
+
+TmpfsNode* tmpfs_child_at(TmpfsNode* dir, uint32_t index)
+{
+    if (!dir->IsDirectory || index >= dir->Size)
+        return NULL;
+
+    // Directory listings ask for consecutive indices, carry on from the last one
+    TmpfsNode* node = dir->Dir.FirstChild;
+    uint32_t position = 0;
+    if (dir->Dir.Cursor != NULL && dir->Dir.CursorIndex <= index) {
+        node = dir->Dir.Cursor;
+        position = dir->Dir.CursorIndex;
+    }
+
+    while (position < index) {
+        node = node->Next;
+        position++;
+    }
+
+    dir->Dir.Cursor = node;
+    dir->Dir.CursorIndex = index;
+    return node;
+}
+
+void tmpfs_get_stats(TmpfsStats* stats)
+{
+    *stats = g_Stats;
+}
+
+//
+// VFS
+//
+
+static int32_t tmpfs_vfs_read(VfsInode* inode, uint32_t offset, void* buffer, uint32_t count)
+{
+    rwlock_read_lock(&g_Lock);
+    int32_t result = tmpfs_read((TmpfsNode*)inode->Data, offset, buffer, count);
+    rwlock_read_unlock(&g_Lock);
+    return result;
+}
+
+static int32_t tmpfs_vfs_write(VfsInode* inode, uint32_t offset, const void* buffer, uint32_t count)
+{
+    rwlock_write_lock(&g_Lock);
+    int32_t result = tmpfs_write((TmpfsNode*)inode->Data, offset, buffer, count);
+    rwlock_write_unlock(&g_Lock);
+    return result;
+}
+
+static int tmpfs_vfs_truncate(VfsInode* inode, uint32_t size)
+{
+    rwlock_write_lock(&g_Lock);
+    int result = tmpfs_truncate((TmpfsNode*)inode->Data, size);
+    rwlock_write_unlock(&g_Lock);
+    return result;
+}
+
+static int tmpfs_vfs_stat(VfsInode* inode, VfsStat* stat)
+{
+    TmpfsNode* node = (TmpfsNode*)inode->Data;
+    rwlock_read_lock(&g_Lock);
+    stat->Size = node->Size;
+    stat->IsDirectory = node->IsDirectory;
+    stat->Created = node->Created;
+    rwlock_read_unlock(&g_Lock);
+    return SYSCALL_OK;
+}
+
+static uint32_t tmpfs_vfs_get_page(VfsInode* inode, uint32_t index)
+{
+    // File pages are frames already, mappings share them
+    TmpfsNode* node = (TmpfsNode*)inode->Data;
+    uint32_t page = 0;
+    rwlock_read_lock(&g_Lock);
+    if (index < (node->Size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE)
+        page = tmpfs_get_page(node, index, false);
+    rwlock_read_unlock(&g_Lock);
+    return page;
+}
+
+static bool tmpfs_vfs_readdir(VfsInode* dir, uint32_t* cookie, VfsDirEntry* entry)
+{
+    rwlock_read_lock(&g_Lock);
+    TmpfsNode* node = tmpfs_child_at((TmpfsNode*)dir->Data, *cookie);
+    if (node != NULL) {
+        strcpy(entry->Name, node->Name);
+        entry->Size = node->Size;
+        entry->IsDirectory = node->IsDirectory;
+        (*cookie)++;
+    }
+    rwlock_read_unlock(&g_Lock);
+    return node != NULL;
+}
+
+static const VfsInodeOps g_TmpfsInodeOps = {
+    .Read = tmpfs_vfs_read,
+    .Write = tmpfs_vfs_write,
+    .Truncate = tmpfs_vfs_truncate,
+    .Stat = tmpfs_vfs_stat,
+    .ReadDir = tmpfs_vfs_readdir,
+    .GetPage = tmpfs_vfs_get_page,
+};
+
+// Splits path into its parent directory and last component
+static int tmpfs_vfs_parent(const char* path, TmpfsNode** dir, const char** name, uint32_t* length)
+{
+    uint32_t end = strlen(path);
+    while (end > 0 && path[end - 1] == '/')
+        end--;
+    uint32_t start = end;
+    while (start > 0 && path[start - 1] != '/')
+        start--;
+    if (start == end)
+        return SYSCALL_EXISTS;
+
+    char parent[VFS_MAX_PATH];
+    memcpy(parent, path, start);
+    parent[start] = '\0';
+
+    int result = tmpfs_resolve(NULL, parent, dir);
+    if (result != SYSCALL_OK)
+        return result;
+
+    *name = path + start;
+    *length = end - start;
+    return SYSCALL_OK;
+}
+
+static int tmpfs_vfs_open(VfsMount* mount, const char* path, uint32_t flags, VfsInode* inode)
+{
+    // Opening may create the file
+    rwlock_write_lock(&g_Lock);
+    TmpfsNode* node;
+    int result = tmpfs_resolve(NULL, path, &node);
+    if (result == SYSCALL_NOT_FOUND && (flags & OPEN_CREATE)) {
+        TmpfsNode* dir;
+        const char* name;
+        uint32_t length;
+        result = tmpfs_vfs_parent(path, &dir, &name, &length);
+        if (result == SYSCALL_OK)
+            result = tmpfs_create(dir, name, length, false, &node);
+    }
+    if (result == SYSCALL_OK) {
+        inode->Ops = &g_TmpfsInodeOps;
+        inode->Data = node;
+        inode->IsDirectory = node->IsDirectory;
+    }
+    rwlock_write_unlock(&g_Lock);
+    return result;
+}
+
+static int tmpfs_vfs_unlink(VfsMount* mount, const char* path)
+{
+    rwlock_write_lock(&g_Lock);
+    TmpfsNode* dir;
+    const char* name;
+    uint32_t length;
+    int result = tmpfs_vfs_parent(path, &dir, &name, &length);
+    if (result == SYSCALL_OK) {
+        TmpfsNode* node = tmpfs_lookup(dir, name, length);
+        if (node == NULL)
+            result = SYSCALL_NOT_FOUND;
+        else if (vfs_is_busy(mount, node))
+            result = SYSCALL_BUSY;
+        else
+            result = tmpfs_remove(dir, name, length);
+    }
+    rwlock_write_unlock(&g_Lock);
+    return result;
+}
+
+static int tmpfs_vfs_mkdir(VfsMount* mount, const char* path)
+{
+    rwlock_write_lock(&g_Lock);
+    TmpfsNode* dir;
+    const char* name;
+    uint32_t length;
+    int result = tmpfs_vfs_parent(path, &dir, &name, &length);
+    if (result == SYSCALL_OK)
+        result = tmpfs_create(dir, name, length, true, NULL);
+    rwlock_write_unlock(&g_Lock);
+    return result;
+}
+
+VfsFileSystem g_TmpfsFileSystem = {
+    .Name = "tmpfs",
+    .Open = tmpfs_vfs_open,
+    .Unlink = tmpfs_vfs_unlink,
+    .Mkdir = tmpfs_vfs_mkdir,
+};
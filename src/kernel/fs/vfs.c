@@ -0,0 +1,907 @@
+#include <vfs.h>
+#include <syscall.h>
+#include <vga_text.h>
+#include <e9.h>
+#include <tmpfs.h>
+#include <fatfs.h>
+#include <vmm.h>
+#include <memory.h>
+#include <string.h>
+#include <debug.h>
+
+#define MODULE "VFS"
+
+// An open file: the inode plus the state of this open, shared by every fd pointing at it
+struct VfsFile {
+    VfsInode* Inode;
+    uint32_t Position;                  // byte offset, or directory cookie
+    uint32_t Flags;
+    uint32_t RefCount;
+};
+
+// Pages of a file mapped into the mapping window
+typedef struct {
+    uint32_t Address;
+    uint32_t Pages;
+    VfsInode* Inode;
+    bool Private;                       // frames were filled by reading and belong to the mapping
+} VfsMapping;
+
+//
+// Console
+//
+
+static int32_t vfs_console_read(VfsInode* inode, uint32_t offset, void* buffer, uint32_t count)
+{
+    return 0;
+}
+
+static int32_t vfs_console_write(VfsInode* inode, uint32_t offset, const void* buffer, uint32_t count)
+{
+    const char* data = (const char*)buffer;
+    if (inode->Data == NULL) {
+        VGA_write(data, count);
+        return count;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        e9_putc(data[i]);
+    return count;
+}
+
+static void vfs_console_flush(VfsInode* inode)
+{
+    // The hardware cursor moves once per write call instead of once per character
+    if (inode->Data == NULL)
+        VGA_setcursor(g_ScreenX, g_ScreenY);
+}
+
+static const VfsInodeOps g_ConsoleOps = {
+    .Read = vfs_console_read,
+    .Write = vfs_console_write,
+    .Flush = vfs_console_flush,
+};
+
+// Data tells the debug port from the screen. Both exist before vfs_init so early logging works.
+static VfsInode g_ScreenInode = { .Ops = &g_ConsoleOps, .Data = NULL, .RefCount = 1 };
+static VfsInode g_DebugInode = { .Ops = &g_ConsoleOps, .Data = (void*)1, .RefCount = 1 };
+
+static VfsFile g_Files[VFS_MAX_FILES] = {
+    [VFS_FD_STDIN]  = { &g_ScreenInode, 0, OPEN_READ, 1 },
+    [VFS_FD_STDOUT] = { &g_ScreenInode, 0, OPEN_WRITE, 1 },
+    [VFS_FD_STDERR] = { &g_ScreenInode, 0, OPEN_WRITE, 1 },
+    [VFS_FD_DEBUG]  = { &g_DebugInode, 0, OPEN_WRITE, 1 },
+};
+
+// The shell's, kernel output always goes through it
+static VfsContext g_KernelContext = {
+    .Fds = { &g_Files[VFS_FD_STDIN], &g_Files[VFS_FD_STDOUT], &g_Files[VFS_FD_STDERR], &g_Files[VFS_FD_DEBUG] },
+    .Cwd = "/",
+};
+static VfsContext* g_Context = &g_KernelContext;
+
+static VfsInode g_Inodes[VFS_MAX_INODES];
+static VfsMapping g_Mappings[VFS_MAX_MAPPINGS];
+static VfsMount g_Mounts[VFS_MAX_MOUNTS];
+static VfsFileSystem* g_FileSystems = NULL;
+
+//
+// Paths
+//
+
+// Joins path to the current directory and folds "." and ".." into a canonical absolute path
+int vfs_resolve_path(const char* path, char* out, uint32_t size)
+{
+    if (path == NULL || size < 2)
+        return SYSCALL_INVALID_PARAMS;
+
+    uint32_t length = 0;
+    out[length++] = '/';
+
+    for (int pass = (path[0] == '/') ? 1 : 0; pass < 2; pass++) {
+        const char* p = (pass == 0) ? g_Context->Cwd : path;
+
+        while (*p != '\0') {
+            while (*p == '/')
+                p++;
+            if (*p == '\0')
+                break;
+
+            const char* end = p;
+            while (*end != '\0' && *end != '/')
+                end++;
+            uint32_t n = end - p;
+
+            if (n == 1 && p[0] == '.') {
+                // Stays in place
+            }
+            else if (n == 2 && p[0] == '.' && p[1] == '.') {
+                while (length > 1 && out[length - 1] != '/')
+                    length--;
+                if (length > 1)
+                    length--;
+            }
+            else {
+                if (length + n + 2 > size)
+                    return SYSCALL_INVALID_PARAMS;
+                if (length > 1)
+                    out[length++] = '/';
+                memcpy(out + length, p, n);
+                length += n;
+            }
+            p = end;
+        }
+    }
+
+    out[length] = '\0';
+    return SYSCALL_OK;
+}
+
+// Longest mount path that prefixes an absolute path, rest is what follows it
+static VfsMount* vfs_find_mount(const char* path, const char** rest)
+{
+    VfsMount* best = NULL;
+    uint32_t bestLength = 0;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VfsMount* m = &g_Mounts[i];
+        if (!m->InUse)
+            continue;
+
+        uint32_t length = strlen(m->Path);
+        if (length == 1) {
+            // The root mount prefixes everything
+            if (best == NULL) {
+                best = m;
+                bestLength = 0;
+            }
+            continue;
+        }
+
+        if (length > bestLength && memcmp(path, m->Path, length) == 0 &&
+            (path[length] == '\0' || path[length] == '/')) {
+            best = m;
+            bestLength = length;
+        }
+    }
+
+    if (best != NULL)
+        *rest = path + bestLength;
+    return best;
+}
+
+// Resolves path and finds its mount, the remaining path has no leading slash
+static int vfs_lookup_mount(const char* path, char* buffer, VfsMount** mount, const char** rest)
+{
+    int result = vfs_resolve_path(path, buffer, VFS_MAX_PATH);
+    if (result != SYSCALL_OK)
+        return result;
+
+    *mount = vfs_find_mount(buffer, rest);
+    if (*mount == NULL)
+        return SYSCALL_NOT_FOUND;
+
+    while (**rest == '/')
+        (*rest)++;
+    return SYSCALL_OK;
+}
+
+//
+// Inodes and files
+//
+
+bool vfs_is_busy(VfsMount* mount, void* data)
+{
+    for (int i = 0; i < VFS_MAX_INODES; i++) {
+        if (g_Inodes[i].RefCount > 0 && g_Inodes[i].Mount == mount && g_Inodes[i].Data == data)
+            return true;
+    }
+    return false;
+}
+
+static void vfs_put_inode(VfsInode* inode)
+{
+    if (--inode->RefCount > 0)
+        return;
+
+    if (inode->Ops->Release != NULL)
+        inode->Ops->Release(inode);
+    inode->Mount = NULL;
+    inode->Data = NULL;
+}
+
+// Opens path as an inode, sharing an already open one for the same file
+static int vfs_get_inode(const char* path, uint32_t flags, VfsInode** inode)
+{
+    char buffer[VFS_MAX_PATH];
+    VfsMount* mount;
+    const char* rest;
+    int result = vfs_lookup_mount(path, buffer, &mount, &rest);
+    if (result != SYSCALL_OK)
+        return result;
+
+    VfsInode* free = NULL;
+    for (int i = 0; i < VFS_MAX_INODES && free == NULL; i++) {
+        if (g_Inodes[i].RefCount == 0)
+            free = &g_Inodes[i];
+    }
+    if (free == NULL)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    VfsInode opened;
+    memset(&opened, 0, sizeof(opened));
+    opened.Mount = mount;
+    result = mount->FileSystem->Open(mount, rest, flags, &opened);
+    if (result != SYSCALL_OK)
+        return result;
+
+    for (int i = 0; i < VFS_MAX_INODES; i++) {
+        VfsInode* existing = &g_Inodes[i];
+        if (existing->RefCount > 0 && existing->Mount == mount && existing->Data == opened.Data) {
+            if (opened.Ops->Release != NULL)
+                opened.Ops->Release(&opened);
+            existing->RefCount++;
+            *inode = existing;
+            return SYSCALL_OK;
+        }
+    }
+
+    *free = opened;
+    free->RefCount = 1;
+    *inode = free;
+    return SYSCALL_OK;
+}
+
+static VfsFile* vfs_get_file(fd_t fd)
+{
+    if (fd < 0 || fd >= VFS_MAX_FDS)
+        return NULL;
+    return g_Context->Fds[fd];
+}
+
+int vfs_open_file(const char* path, uint32_t flags, VfsFile** opened)
+{
+    VfsFile* file = NULL;
+    for (int i = 0; i < VFS_MAX_FILES && file == NULL; i++) {
+        if (g_Files[i].RefCount == 0)
+            file = &g_Files[i];
+    }
+
+    if (file == NULL)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    VfsInode* inode;
+    int result = vfs_get_inode(path, flags, &inode);
+    if (result != SYSCALL_OK)
+        return result;
+
+    if (inode->IsDirectory && (flags & (OPEN_WRITE | OPEN_TRUNCATE))) {
+        vfs_put_inode(inode);
+        return SYSCALL_IS_DIRECTORY;
+    }
+
+    if ((flags & OPEN_TRUNCATE) && (flags & OPEN_WRITE) && inode->Ops->Truncate != NULL) {
+        // Mappings point at the file's pages, they must not be freed underneath them
+        result = inode->MapCount > 0 ? SYSCALL_BUSY : inode->Ops->Truncate(inode, 0);
+        if (result != SYSCALL_OK) {
+            vfs_put_inode(inode);
+            return result;
+        }
+    }
+
+    file->Inode = inode;
+    file->Position = 0;
+    file->Flags = flags;
+    file->RefCount = 1;
+    *opened = file;
+    return SYSCALL_OK;
+}
+
+fd_t vfs_open(const char* path, uint32_t flags)
+{
+    fd_t fd = -1;
+    for (int i = 0; i < VFS_MAX_FDS && fd < 0; i++) {
+        if (g_Context->Fds[i] == NULL)
+            fd = i;
+    }
+    if (fd < 0)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    VfsFile* file;
+    int result = vfs_open_file(path, flags, &file);
+    if (result != SYSCALL_OK)
+        return result;
+
+    g_Context->Fds[fd] = file;
+    return fd;
+}
+
+void vfs_put_file(VfsFile* file)
+{
+    if (--file->RefCount == 0 && file->Inode->Mount != NULL)
+        vfs_put_inode(file->Inode);
+}
+
+void vfs_get_file_ref(VfsFile* file)
+{
+    file->RefCount++;
+}
+
+int vfs_close(fd_t fd)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    g_Context->Fds[fd] = NULL;
+    vfs_put_file(file);
+    return SYSCALL_OK;
+}
+
+fd_t vfs_dup(fd_t fd)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    for (int i = 0; i < VFS_MAX_FDS; i++) {
+        if (g_Context->Fds[i] == NULL) {
+            file->RefCount++;
+            g_Context->Fds[i] = file;
+            return i;
+        }
+    }
+    return SYSCALL_OUT_OF_MEMORY;
+}
+
+void vfs_context_init(VfsContext* context)
+{
+    for (int i = 0; i < VFS_MAX_FDS; i++) {
+        context->Fds[i] = g_Context->Fds[i];
+        if (context->Fds[i] != NULL)
+            context->Fds[i]->RefCount++;
+    }
+    strcpy(context->Cwd, g_Context->Cwd);
+}
+
+void vfs_context_release(VfsContext* context)
+{
+    for (int i = 0; i < VFS_MAX_FDS; i++) {
+        if (context->Fds[i] != NULL)
+            vfs_put_file(context->Fds[i]);
+        context->Fds[i] = NULL;
+    }
+}
+
+VfsContext* vfs_set_context(VfsContext* context)
+{
+    VfsContext* previous = g_Context;
+    g_Context = context != NULL ? context : &g_KernelContext;
+    return previous;
+}
+
+static int32_t vfs_file_read(VfsFile* file, void* buffer, uint32_t count, uint32_t offset)
+{
+    if (file->Inode->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+    if (file->Inode->Ops->Read == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    return file->Inode->Ops->Read(file->Inode, offset, buffer, count);
+}
+
+static int32_t vfs_file_write(VfsFile* file, const void* buffer, uint32_t count, uint32_t offset)
+{
+    if (!(file->Flags & OPEN_WRITE) || file->Inode->Ops->Write == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    return file->Inode->Ops->Write(file->Inode, offset, buffer, count);
+}
+
+static int vfs_file_size(VfsFile* file, uint32_t* size)
+{
+    VfsInode* inode = file->Inode;
+    if (inode->Ops->Stat == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    VfsStat stat;
+    int result = inode->Ops->Stat(inode, &stat);
+    *size = stat.Size;
+    return result;
+}
+
+int32_t vfs_read(fd_t fd, void* buffer, uint32_t count)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || buffer == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    int32_t result = vfs_file_read(file, buffer, count, file->Position);
+    if (result > 0)
+        file->Position += result;
+    return result;
+}
+
+int32_t vfs_write(fd_t fd, const void* buffer, uint32_t count)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || buffer == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    if (file->Flags & OPEN_APPEND)
+        vfs_file_size(file, &file->Position);
+
+    int32_t result = vfs_file_write(file, buffer, count, file->Position);
+    if (result > 0)
+        file->Position += result;
+    if (file->Inode->Ops->Flush != NULL)
+        file->Inode->Ops->Flush(file->Inode);
+    return result;
+}
+
+int32_t vfs_readv(fd_t fd, const VfsIoVec* iov, uint32_t count)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || iov == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    int32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (iov[i].Length == 0)
+            continue;
+        if (iov[i].Base == NULL)
+            return total > 0 ? total : SYSCALL_INVALID_PARAMS;
+
+        int32_t result = vfs_file_read(file, iov[i].Base, iov[i].Length, file->Position);
+        if (result < 0)
+            return total > 0 ? total : result;
+
+        file->Position += result;
+        total += result;
+        if ((uint32_t)result < iov[i].Length)
+            break;
+    }
+    return total;
+}
+
+int32_t vfs_writev(fd_t fd, const VfsIoVec* iov, uint32_t count)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || iov == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    if (file->Flags & OPEN_APPEND)
+        vfs_file_size(file, &file->Position);
+
+    int32_t total = 0;
+    int32_t result = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (iov[i].Length == 0)
+            continue;
+        if (iov[i].Base == NULL) {
+            result = SYSCALL_INVALID_PARAMS;
+            break;
+        }
+
+        result = vfs_file_write(file, iov[i].Base, iov[i].Length, file->Position);
+        if (result < 0)
+            break;
+
+        file->Position += result;
+        total += result;
+        if ((uint32_t)result < iov[i].Length)
+            break;
+    }
+
+    // One flush for the whole batch, on the console that is a single cursor update
+    if (file->Inode->Ops->Flush != NULL)
+        file->Inode->Ops->Flush(file->Inode);
+    return (total > 0 || result >= 0) ? total : result;
+}
+
+int32_t vfs_pread(fd_t fd, void* buffer, uint32_t count, uint32_t offset)
+{
+    return vfs_file_pread(vfs_get_file(fd), buffer, count, offset);
+}
+
+int32_t vfs_file_pread(VfsFile* file, void* buffer, uint32_t count, uint32_t offset)
+{
+    if (file == NULL || buffer == NULL || file->Inode->Mount == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    return vfs_file_read(file, buffer, count, offset);
+}
+
+int32_t vfs_pwrite(fd_t fd, const void* buffer, uint32_t count, uint32_t offset)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || buffer == NULL || file->Inode->Mount == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    return vfs_file_write(file, buffer, count, offset);
+}
+
+int32_t vfs_seek(fd_t fd, int32_t offset, int whence)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || file->Inode->Mount == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    // A directory position is a file system cookie, it can only be rewound
+    if (file->Inode->IsDirectory) {
+        if (whence != SEEK_SET || offset != 0)
+            return SYSCALL_INVALID_PARAMS;
+        file->Position = 0;
+        return 0;
+    }
+
+    int64_t base;
+    uint32_t size;
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = file->Position;
+        break;
+    case SEEK_END:
+        if (vfs_file_size(file, &size) != SYSCALL_OK)
+            return SYSCALL_INVALID_PARAMS;
+        base = size;
+        break;
+    default:
+        return SYSCALL_INVALID_PARAMS;
+    }
+
+    // Positions past the end are fine, a later write leaves a hole
+    int64_t position = base + offset;
+    if (position < 0 || position > INT32_MAX)
+        return SYSCALL_INVALID_PARAMS;
+
+    file->Position = (uint32_t)position;
+    return (int32_t)position;
+}
+
+int vfs_fstat(fd_t fd, VfsStat* stat)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || stat == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    memset(stat, 0, sizeof(VfsStat));
+    stat->IsDirectory = file->Inode->IsDirectory;
+    if (file->Inode->Ops->Stat == NULL)
+        return SYSCALL_OK;
+    return file->Inode->Ops->Stat(file->Inode, stat);
+}
+
+int vfs_readdir(fd_t fd, VfsDirEntry* entry)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || entry == NULL)
+        return SYSCALL_INVALID_PARAMS;
+    if (!file->Inode->IsDirectory || file->Inode->Ops->ReadDir == NULL)
+        return SYSCALL_NOT_DIRECTORY;
+
+    return file->Inode->Ops->ReadDir(file->Inode, &file->Position, entry) ? 1 : 0;
+}
+
+int vfs_stat(const char* path, VfsStat* stat)
+{
+    fd_t fd = vfs_open(path, OPEN_READ);
+    if (fd < 0)
+        return fd;
+
+    int result = vfs_fstat(fd, stat);
+    vfs_close(fd);
+    return result;
+}
+
+int vfs_unlink(const char* path)
+{
+    char buffer[VFS_MAX_PATH];
+    VfsMount* mount;
+    const char* rest;
+    int result = vfs_lookup_mount(path, buffer, &mount, &rest);
+    if (result != SYSCALL_OK)
+        return result;
+    if (*rest == '\0')
+        return SYSCALL_BUSY;            // a mount point or the root
+    if (mount->FileSystem->Unlink == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    return mount->FileSystem->Unlink(mount, rest);
+}
+
+int vfs_mkdir(const char* path)
+{
+    char buffer[VFS_MAX_PATH];
+    VfsMount* mount;
+    const char* rest;
+    int result = vfs_lookup_mount(path, buffer, &mount, &rest);
+    if (result != SYSCALL_OK)
+        return result;
+    if (*rest == '\0')
+        return SYSCALL_EXISTS;
+    if (mount->FileSystem->Mkdir == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    return mount->FileSystem->Mkdir(mount, rest);
+}
+
+int vfs_rmdir(const char* path)
+{
+    VfsStat stat;
+    int result = vfs_stat(path, &stat);
+    if (result != SYSCALL_OK)
+        return result;
+    if (!stat.IsDirectory)
+        return SYSCALL_NOT_DIRECTORY;
+
+    return vfs_unlink(path);
+}
+
+// Unmaps the first count pages of a mapping and gives its range of the window back
+static void vfs_release_mapping(VfsMapping* mapping, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t virt = mapping->Address + i * VMM_PAGE_SIZE;
+        if (mapping->Private)
+            pmm_free_frame(vmm_get_physical(virt));
+        vmm_unmap_page(virt);
+    }
+
+    vmm_free_range(mapping->Address, mapping->Pages);
+    mapping->Inode = NULL;
+}
+
+int vfs_mmap(fd_t fd, uint32_t length, uint32_t offset, uint32_t flags, void** address)
+{
+    VfsFile* file = vfs_get_file(fd);
+    if (file == NULL || address == NULL || length == 0 || offset % VMM_PAGE_SIZE != 0)
+        return SYSCALL_INVALID_PARAMS;
+
+    VfsInode* inode = file->Inode;
+    if (inode->Mount == NULL)
+        return SYSCALL_INVALID_PARAMS;
+    if (inode->IsDirectory)
+        return SYSCALL_IS_DIRECTORY;
+    if ((flags & MMAP_WRITE) || !(file->Flags & OPEN_READ))
+        return SYSCALL_PERMISSION_DENIED;
+    if (inode->Ops->GetPage == NULL && inode->Ops->Read == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    VfsMapping* mapping = NULL;
+    for (int i = 0; i < VFS_MAX_MAPPINGS && mapping == NULL; i++) {
+        if (g_Mappings[i].Inode == NULL)
+            mapping = &g_Mappings[i];
+    }
+    if (mapping == NULL)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    uint32_t pages = (length + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    uint32_t zero = vmm_get_zero_page();
+    uint32_t base = vmm_alloc_range(pages);
+    if (base == 0 || zero == 0) {
+        if (base != 0)
+            vmm_free_range(base, pages);
+        return SYSCALL_OUT_OF_MEMORY;
+    }
+
+    mapping->Address = base;
+    mapping->Pages = pages;
+    mapping->Inode = inode;
+    mapping->Private = inode->Ops->GetPage == NULL;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t position = offset + i * VMM_PAGE_SIZE;
+        uint32_t frame;
+        if (!mapping->Private) {
+            // The file's own page, holes and the end of the file read as the zero page
+            frame = inode->Ops->GetPage(inode, position / VMM_PAGE_SIZE);
+            if (frame == 0)
+                frame = zero;
+        }
+        else {
+            // No page cache to share, the mapping gets its own copy
+            frame = pmm_alloc_frame();
+            if (frame == 0) {
+                vfs_release_mapping(mapping, i);
+                return SYSCALL_OUT_OF_MEMORY;
+            }
+            // Past the end of the file reads short and stays zero, an error fails the mmap
+            memset((void*)frame, 0, VMM_PAGE_SIZE);
+            int32_t read = inode->Ops->Read(inode, position, (void*)frame, VMM_PAGE_SIZE);
+            if (read < 0) {
+                pmm_free_frame(frame);
+                vfs_release_mapping(mapping, i);
+                return read;
+            }
+        }
+
+        if (!vmm_map_page(base + i * VMM_PAGE_SIZE, frame, VMM_PAGE_PRESENT)) {
+            if (mapping->Private)
+                pmm_free_frame(frame);
+            vfs_release_mapping(mapping, i);
+            return SYSCALL_OUT_OF_MEMORY;
+        }
+    }
+
+    // The mapping keeps the inode, and with it the file's pages, until it is unmapped
+    inode->RefCount++;
+    inode->MapCount++;
+    *address = (void*)base;
+    return SYSCALL_OK;
+}
+
+int vfs_munmap(void* address)
+{
+    for (int i = 0; i < VFS_MAX_MAPPINGS; i++) {
+        VfsMapping* mapping = &g_Mappings[i];
+        if (mapping->Inode == NULL || mapping->Address != (uint32_t)address)
+            continue;
+
+        VfsInode* inode = mapping->Inode;
+        vfs_release_mapping(mapping, mapping->Pages);
+        inode->MapCount--;
+        vfs_put_inode(inode);
+        return SYSCALL_OK;
+    }
+
+    return SYSCALL_INVALID_PARAMS;
+}
+
+int vfs_chdir(const char* path)
+{
+    char buffer[VFS_MAX_PATH];
+    int result = vfs_resolve_path(path, buffer, sizeof(buffer));
+    if (result != SYSCALL_OK)
+        return result;
+
+    VfsStat stat;
+    result = vfs_stat(buffer, &stat);
+    if (result != SYSCALL_OK)
+        return result;
+    if (!stat.IsDirectory)
+        return SYSCALL_NOT_DIRECTORY;
+
+    strcpy(g_Context->Cwd, buffer);
+    return SYSCALL_OK;
+}
+
+const char* vfs_getcwd(void)
+{
+    return g_Context->Cwd;
+}
+
+//
+// Mounts
+//
+
+void vfs_register_filesystem(VfsFileSystem* fs)
+{
+    fs->Next = g_FileSystems;
+    g_FileSystems = fs;
+}
+
+int vfs_mount(const char* path, const char* fsName, BlockDev* device)
+{
+    char buffer[VFS_MAX_PATH];
+    int result = vfs_resolve_path(path, buffer, sizeof(buffer));
+    if (result != SYSCALL_OK)
+        return result;
+
+    VfsFileSystem* fs = g_FileSystems;
+    while (fs != NULL && strcmp(fs->Name, fsName) != 0)
+        fs = fs->Next;
+    if (fs == NULL)
+        return SYSCALL_NOT_FOUND;
+
+    VfsMount* slot = NULL;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_Mounts[i].InUse && strcmp(g_Mounts[i].Path, buffer) == 0)
+            return SYSCALL_BUSY;
+        if (!g_Mounts[i].InUse && slot == NULL)
+            slot = &g_Mounts[i];
+    }
+    if (slot == NULL)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    // The mount point shows up as a directory of the file system it sits in
+    if (strcmp(buffer, "/") != 0) {
+        result = vfs_mkdir(buffer);
+        if (result != SYSCALL_OK && result != SYSCALL_EXISTS && result != SYSCALL_PERMISSION_DENIED)
+            return result;
+    }
+
+    void* data = NULL;
+    if (fs->Mount != NULL) {
+        result = fs->Mount(device, &data);
+        if (result != SYSCALL_OK)
+            return result;
+    }
+
+    strcpy(slot->Path, buffer);
+    slot->FileSystem = fs;
+    slot->Data = data;
+    slot->InUse = true;
+
+    log_info(MODULE, "Mounted %s on %s", fs->Name, buffer);
+    return SYSCALL_OK;
+}
+
+int vfs_umount(const char* path)
+{
+    char buffer[VFS_MAX_PATH];
+    int result = vfs_resolve_path(path, buffer, sizeof(buffer));
+    if (result != SYSCALL_OK)
+        return result;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VfsMount* m = &g_Mounts[i];
+        if (!m->InUse || strcmp(m->Path, buffer) != 0)
+            continue;
+
+        if (strcmp(buffer, "/") == 0)
+            return SYSCALL_BUSY;
+        for (int j = 0; j < VFS_MAX_INODES; j++) {
+            if (g_Inodes[j].RefCount > 0 && g_Inodes[j].Mount == m)
+                return SYSCALL_BUSY;
+        }
+
+        if (m->FileSystem->Unmount != NULL) {
+            result = m->FileSystem->Unmount(m->Data);
+            if (result != SYSCALL_OK)
+                return result;
+        }
+
+        m->InUse = false;
+        m->Data = NULL;
+        return SYSCALL_OK;
+    }
+
+    return SYSCALL_NOT_FOUND;
+}
+
+void vfs_sync(void)
+{
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_Mounts[i].InUse && g_Mounts[i].FileSystem->Sync != NULL)
+            g_Mounts[i].FileSystem->Sync(g_Mounts[i].Data);
+    }
+}
+
+static void vfs_create_file(const char* path, const char* text)
+{
+    fd_t fd = vfs_open(path, OPEN_WRITE | OPEN_CREATE | OPEN_TRUNCATE);
+    if (fd < 0)
+        return;
+    vfs_write(fd, text, strlen(text));
+    vfs_close(fd);
+}
+
+void vfs_init(void)
+{
+    vfs_register_filesystem(&g_TmpfsFileSystem);
+    vfs_register_filesystem(&g_FatFileSystem);
+
+    if (vfs_mount("/", "tmpfs", NULL) != SYSCALL_OK) {
+        log_err(MODULE, "Cannot mount the root file system");
+        return;
+    }
+
+    vfs_create_file("/welcome.txt", "Welcome to MiqOSoft!\nThis is a virtual file system.\n");
+    vfs_create_file("/info.txt", "System calls are working!\nYou can use the syscall interface.\n");
+}
+
+int VFS_Write(fd_t file, uint8_t* data, size_t size)
+{
+    if (file == VFS_FD_STDIN)
+        return 0;
+
+    // Kernel output, not the descriptors of whichever program is running
+    VfsContext* context = vfs_set_context(NULL);
+    int result = vfs_write(file, data, size);
+    vfs_set_context(context);
+    return result;
+}
@@ -6,12 +6,24 @@
 #include <io.h>
 #include <debug.h>
 #include <boot/bootparams.h>
+#include <boot/bootprofile.h>
 #include <keyboard.h>
 #include <vga_text.h>
 #include <shell.h>
 #include <syscall.h>
 #include <shell_commands.h>
 #include <time.h>
+#include <ata.h>
+#include <pmm.h>
+#include <bcache.h>
+#include <blockdev.h>
+#include <vmm.h>
+#include <usermode.h>
+#include <process.h>
+#include <tmpfs.h>
+#include <vfs.h>
+#include <smp.h>
+#include <sync.h>
 
 extern void _init();
 
@@ -19,7 +31,7 @@ extern void _init();
 // Improved Dmesg System
 //
 
-#define SIMPLE_MSG_COUNT 20  // Increased from 16 to 20
+#define SIMPLE_MSG_COUNT 48  // The boot path alone logs about 35, the boot time among the last
 #define SIMPLE_MSG_LEN 50    // Increased from 32 to 50 for longer messages
 
 // Ultra-simple structure
@@ -31,9 +43,18 @@ typedef struct {
 static ultra_simple_msg_t ultra_messages[SIMPLE_MSG_COUNT];
 static int ultra_msg_idx = 0;
 static int ultra_initialized = 0;
+static Spinlock ultra_lock = SPINLOCK_INIT("dmesg");         // the buffer and its index
+
+// Entry numbers and counts, at most two digits with SIMPLE_MSG_COUNT below 100
+static void dmesg_put_number(int value) {
+    if (value >= 10) {
+        putc('0' + value / 10);
+    }
+    putc('0' + value % 10);
+}
 
 // Improved function to create more complete messages
-void kernel_add_message(char level, const char* component, const char* message) {
+static void kernel_add_message_locked(char level, const char* component, const char* message) {
     if (!ultra_initialized) {
         // Initialize ultra-simple
         for (int i = 0; i < SIMPLE_MSG_COUNT; i++) {
@@ -101,6 +122,12 @@ void kernel_add_message(char level, const char* component, const char* message)
     ultra_msg_idx++;
 }
 
+void kernel_add_message(char level, const char* component, const char* message) {
+    uint32_t flags = spin_lock_irqsave(&ultra_lock);
+    kernel_add_message_locked(level, component, message);
+    spin_unlock_irqrestore(&ultra_lock, flags);
+}
+
 void display_kernel_messages(void) {
     if (!ultra_initialized) {
         puts("dmesg not initialized");
@@ -126,11 +153,8 @@ void display_kernel_messages(void) {
         // Display entry number with improved format
         if (i < 10) {
             putc('0');
-            putc('0' + i);
-        } else {
-            putc('1');
-            putc('0' + (i - 10));
         }
+        dmesg_put_number(i);
         
         putc(':');
         putc(' ');
@@ -152,17 +176,13 @@ void display_kernel_messages(void) {
     
     // Display summary
     puts("=== End Messages (");
-    if (ultra_msg_idx < 10) {
-        putc('0' + ultra_msg_idx);
-    } else {
-        putc('1');
-        putc('0' + (ultra_msg_idx - 10));
-    }
+    dmesg_put_number(ultra_msg_idx);
     puts(" shown) ===\n");
 }
 
 void dmesg_clear(void) {
     // Clear all messages
+    uint32_t flags = spin_lock_irqsave(&ultra_lock);
     for (int i = 0; i < SIMPLE_MSG_COUNT; i++) {
         ultra_messages[i].valid = 0;
         for (int j = 0; j < SIMPLE_MSG_LEN; j++) {
@@ -170,6 +190,7 @@ void dmesg_clear(void) {
         }
     }
     ultra_msg_idx = 0;
+    spin_unlock_irqrestore(&ultra_lock, flags);
     puts("dmesg: Message buffer cleared");
 }
 
@@ -182,31 +203,16 @@ void dmesg_stats(void) {
     puts("dmesg Statistics:");
     
     puts("  Buffer size: ");
-    if (SIMPLE_MSG_COUNT < 10) {
-        putc('0' + SIMPLE_MSG_COUNT);
-    } else {
-        putc('2');
-        putc('0');
-    }
+    dmesg_put_number(SIMPLE_MSG_COUNT);
     puts(" entries");
     
     puts("  Used entries: ");
-    if (ultra_msg_idx < 10) {
-        putc('0' + ultra_msg_idx);
-    } else {
-        putc('1');
-        putc('0' + (ultra_msg_idx - 10));
-    }
+    dmesg_put_number(ultra_msg_idx);
     putc('\n');
     
     int free_entries = SIMPLE_MSG_COUNT - ultra_msg_idx;
     puts("  Free entries: ");
-    if (free_entries < 10) {
-        putc('0' + free_entries);
-    } else {
-        putc('1');
-        putc('0' + (free_entries - 10));
-    }
+    dmesg_put_number(free_entries);
     putc('\n');
     
     // Verify integrity
@@ -218,21 +224,46 @@ void dmesg_stats(void) {
     }
     
     puts("  Valid entries: ");
-    if (valid_count < 10) {
-        putc('0' + valid_count);
-    } else {
-        putc('1');
-        putc('0' + (valid_count - 10));
-    }
+    dmesg_put_number(valid_count);
     putc('\n');
 }
 
+//
+// Boot Time
+//
+
+static uint64_t g_KernelStartTsc;
+static uint64_t g_LoaderToShellUs;
+static uint64_t g_KernelToShellUs;
+
+// Record how long it took to get from stage2 (and from the kernel entry) to the shell prompt
+static void kernel_record_boot_time(BootParams* bootParams) {
+    uint64_t now = x86_ReadTsc();
+    g_LoaderToShellUs = time_tsc_to_us(now - bootParams->LoaderStartTsc);
+    g_KernelToShellUs = time_tsc_to_us(now - g_KernelStartTsc);
+
+    char msg[40];
+    snprintf(msg, sizeof(msg), "Boot to shell %d ms", (int)(g_LoaderToShellUs / 1000));
+    kernel_add_message('I', "boot", msg);
+
+    // Always reported on the debug port so both profiles can be benchmarked
+    debugf("[Boot] profile=%s loader-to-shell=%llu us kernel-to-shell=%llu us\n",
+           BOOT_PROFILE, g_LoaderToShellUs, g_KernelToShellUs);
+}
+
+void kernel_get_boot_time(uint64_t* loaderToShellUs, uint64_t* kernelToShellUs) {
+    *loaderToShellUs = g_LoaderToShellUs;
+    *kernelToShellUs = g_KernelToShellUs;
+}
+
 //
 // Main Kernel Function
 //
 
 void start(BootParams* bootParams)
 {
+    g_KernelStartTsc = x86_ReadTsc();
+
     // Call global constructors
     _init();
 
@@ -264,18 +295,18 @@ void start(BootParams* bootParams)
     // STEP 5: Interrupts
     kernel_add_message('I', "pic", "Configuring interrupts");
     
-    // Declare external function
-    extern void i8259_Unmask(int irq);
-    
-    i8259_Unmask(0);
+    i686_IRQ_Unmask(0);
     kernel_add_message('D', "pic", "Timer IRQ unmasked");
     
-    i8259_Unmask(1);
+    i686_IRQ_Unmask(1);
     kernel_add_message('D', "pic", "Keyboard IRQ unmasked");
     
     kernel_add_message('I', "cpu", "Enabling interrupts");
     i686_EnableInterrupts();
     kernel_add_message('I', "cpu", "Interrupts enabled");
+
+    time_calibrate_tsc();
+    kernel_add_message('D', "timer", "TSC calibrated");
     
     // STEP 6: Boot information
     kernel_add_message('D', "boot", "Processing boot params");
@@ -292,13 +323,55 @@ void start(BootParams* bootParams)
     }
     kernel_add_message('I', "memory", "Memory scan complete");
 
-    // STEP 7: Logging system
-    log_info("Main", "This is an info msg!");
-    log_warn("Main", "This is a warning msg!");
-    log_err("Main", "This is an error msg!");
-    log_crit("Main", "This is a critical msg!");
-    
-    kernel_add_message('I', "demo", "Logging test complete");
+    pmm_init(bootParams);
+    kernel_add_message('I', "memory", "Frame allocator ready");
+
+    vmm_init();
+    usermode_init();
+    process_init();
+    kernel_add_message('I', "memory", "Paging enabled");
+
+    // Needs paging (the APs start with the kernel page directory) and the TSC for its delays
+    smp_init();
+    char smpMsg[32];
+    snprintf(smpMsg, sizeof(smpMsg), "CPUs online: %u", smp_cpu_count());
+    kernel_add_message('I', "smp", smpMsg);
+
+    tmpfs_init();
+    kernel_add_message('I', "tmpfs", "RAM file system ready");
+
+    vfs_init();
+    kernel_add_message('I', "vfs", "Root file system mounted");
+
+    // Needs the timer (DMA timeouts) and interrupts (DMA completion)
+    kernel_add_message('I', "ata", "Probing ATA drives");
+    ata_init();
+    char ataMsg[32];
+    snprintf(ataMsg, sizeof(ataMsg), "ATA drives found: %d", ata_get_drive_count());
+    kernel_add_message('I', "ata", ataMsg);
+
+    bcache_init();
+    kernel_add_message('I', "bcache", "Buffer cache ready");
+
+    // The boot disk's FAT partition becomes /disk
+    if (blockdev_get_count() > 0) {
+        const char* disk = blockdev_get(0)->Name;
+        if (syscall_invoke(SYSCALL_MOUNT, (uint32_t)disk, (uint32_t)"/disk", 0, 0) == SYSCALL_OK) {
+            char mountMsg[32];
+            snprintf(mountMsg, sizeof(mountMsg), "Mounted %s on /disk", disk);
+            kernel_add_message('I', "fat", mountMsg);
+        }
+    }
+
+    // STEP 7: Logging system (demo messages are diagnostics only)
+    if (BOOT_VERBOSE) {
+        log_info("Main", "This is an info msg!");
+        log_warn("Main", "This is a warning msg!");
+        log_err("Main", "This is an error msg!");
+        log_crit("Main", "This is a critical msg!");
+        
+        kernel_add_message('I', "demo", "Logging test complete");
+    }
     
     // STEP 8: User interface
     printf("Welcome to OS MiqOSosft v1.0\n");
@@ -311,6 +384,7 @@ void start(BootParams* bootParams)
     kernel_add_message('I', "shell", "Shell starting");
     shell_init();
     kernel_add_message('I', "shell", "Shell ready");
+    kernel_record_boot_time(bootParams);
     
     // STEP 10: Completion
     kernel_add_message('I', "boot", "Init complete");
@@ -319,5 +393,7 @@ void start(BootParams* bootParams)
     while(1)
     {
         shell_run();
+        bcache_periodic_flush();
+        syscall_ring_poll();
     }
 }
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include <pmm.h>
+#include <memdefs.h>
+#include <memory.h>
+#include <debug.h>
+
+#define MODULE "PMM"
+
+#define PMM_MAX_FRAMES          (PMM_MAX_MEMORY / PMM_FRAME_SIZE)
+#define PMM_LOW_MEMORY          0x100000        // BIOS, stage2 data and the kernel stack
+#define E820_USABLE             1
+
+// One bit per frame, set = used
+static uint32_t g_FrameBitmap[PMM_MAX_FRAMES / 32];
+static uint32_t g_TotalFrames = 0;
+static uint32_t g_FreeFrames = 0;
+static uint32_t g_SearchStart = 0;      // no free frame below this index
+static uint8_t* g_FrameRefs = NULL;     // per frame, up to the last usable one
+static uint32_t g_RefFrames = 0;
+
+extern uint8_t __end[];
+
+static inline bool pmm_test(uint32_t frame)
+{
+    return g_FrameBitmap[frame / 32] & (1u << (frame % 32));
+}
+
+static inline void pmm_set(uint32_t frame)
+{
+    g_FrameBitmap[frame / 32] |= 1u << (frame % 32);
+}
+
+static inline void pmm_clear(uint32_t frame)
+{
+    g_FrameBitmap[frame / 32] &= ~(1u << (frame % 32));
+}
+
+static inline void pmm_set_refs(uint32_t first, uint32_t count, uint8_t refs)
+{
+    for (uint32_t frame = first; frame < first + count && frame < g_RefFrames; frame++)
+        g_FrameRefs[frame] = refs;
+}
+
+static void pmm_free_region(uint64_t begin, uint64_t length)
+{
+    uint64_t end = begin + length;
+    if (end > PMM_MAX_MEMORY)
+        end = PMM_MAX_MEMORY;
+
+    // Only whole frames inside the region are usable
+    uint32_t first = (begin + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32_t last = end / PMM_FRAME_SIZE;
+
+    for (uint32_t frame = first; frame < last; frame++) {
+        if (pmm_test(frame)) {
+            pmm_clear(frame);
+            g_FreeFrames++;
+            g_TotalFrames++;
+        }
+    }
+}
+
+void pmm_reserve_region(uint32_t address, uint32_t length)
+{
+    uint32_t first = address / PMM_FRAME_SIZE;
+    uint32_t last = (address + length + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (last > PMM_MAX_FRAMES)
+        last = PMM_MAX_FRAMES;
+
+    for (uint32_t frame = first; frame < last; frame++) {
+        if (!pmm_test(frame)) {
+            pmm_set(frame);
+            g_FreeFrames--;
+        }
+    }
+}
+
+void pmm_init(BootParams* bootParams)
+{
+    memset(g_FrameBitmap, 0xFF, sizeof(g_FrameBitmap));
+    g_TotalFrames = 0;
+    g_FreeFrames = 0;
+
+    for (int i = 0; i < bootParams->Memory.RegionCount; i++) {
+        MemoryRegion* region = &bootParams->Memory.Regions[i];
+        if (region->Type == E820_USABLE && region->Begin < PMM_MAX_MEMORY)
+            pmm_free_region(region->Begin, region->Length);
+    }
+
+    pmm_reserve_region(0, PMM_LOW_MEMORY);
+    pmm_reserve_region((uint32_t)MEMORY_KERNEL_ADDR, (uint32_t)__end - (uint32_t)MEMORY_KERNEL_ADDR);
+    pmm_reserve_region(MEMORY_KERNEL_HEAP_ADDR, MEMORY_KERNEL_HEAP_SIZE);
+    g_SearchStart = PMM_LOW_MEMORY / PMM_FRAME_SIZE;
+
+    // A byte per frame, taken from the frames it counts
+    uint32_t last = PMM_MAX_FRAMES;
+    while (last > 0 && pmm_test(last - 1))
+        last--;
+    uint32_t refsAddress = pmm_alloc_frames((last + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+    if (refsAddress != 0) {
+        g_FrameRefs = (uint8_t*)refsAddress;
+        g_RefFrames = last;
+        memset(g_FrameRefs, 0, last);
+        pmm_set_refs(refsAddress / PMM_FRAME_SIZE, (last + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE, 1);
+    }
+
+    log_info(MODULE, "%u KB usable, %u KB free", g_TotalFrames * 4, g_FreeFrames * 4);
+}
+
+uint32_t pmm_alloc_frames(uint32_t count)
+{
+    if (count == 0 || count > g_FreeFrames)
+        return 0;
+
+    // First fit over the bitmap, whole words at a time when they are full
+    uint32_t run = 0;
+    for (uint32_t frame = g_SearchStart; frame < PMM_MAX_FRAMES; frame++) {
+        if (frame % 32 == 0 && run == 0 && g_FrameBitmap[frame / 32] == 0xFFFFFFFF) {
+            frame += 31;
+            continue;
+        }
+
+        if (pmm_test(frame)) {
+            run = 0;
+            continue;
+        }
+
+        if (++run == count) {
+            uint32_t first = frame + 1 - count;
+            for (uint32_t i = first; i <= frame; i++)
+                pmm_set(i);
+
+            g_FreeFrames -= count;
+            if (first == g_SearchStart)
+                g_SearchStart = frame + 1;
+
+            pmm_set_refs(first, count, 1);
+
+            return first * PMM_FRAME_SIZE;
+        }
+    }
+
+    log_warn(MODULE, "Out of memory allocating %u contiguous frames", count);
+    return 0;
+}
+
+uint32_t pmm_alloc_frame(void)
+{
+    return pmm_alloc_frames(1);
+}
+
+void pmm_free_frames(uint32_t address, uint32_t count)
+{
+    uint32_t first = address / PMM_FRAME_SIZE;
+
+    for (uint32_t frame = first; frame < first + count && frame < PMM_MAX_FRAMES; frame++) {
+        if (!pmm_test(frame)) {
+            log_err(MODULE, "Double free of frame 0x%x", frame * PMM_FRAME_SIZE);
+            continue;
+        }
+
+        pmm_clear(frame);
+        pmm_set_refs(frame, 1, 0);
+        g_FreeFrames++;
+    }
+
+    if (first < g_SearchStart)
+        g_SearchStart = first;
+}
+
+void pmm_free_frame(uint32_t address)
+{
+    pmm_free_frames(address, 1);
+}
+
+bool pmm_ref_frame(uint32_t address)
+{
+    uint32_t frame = address / PMM_FRAME_SIZE;
+    if (frame >= g_RefFrames || g_FrameRefs[frame] == 0 || g_FrameRefs[frame] == UINT8_MAX)
+        return false;
+
+    g_FrameRefs[frame]++;
+    return true;
+}
+
+void pmm_unref_frame(uint32_t address)
+{
+    uint32_t frame = address / PMM_FRAME_SIZE;
+    if (frame < g_RefFrames && g_FrameRefs[frame] > 1) {
+        g_FrameRefs[frame]--;
+        return;
+    }
+    pmm_free_frame(address);
+}
+
+uint32_t pmm_get_frame_refs(uint32_t address)
+{
+    uint32_t frame = address / PMM_FRAME_SIZE;
+    return frame < g_RefFrames ? g_FrameRefs[frame] : 0;
+}
+
+uint32_t pmm_get_total_frames(void)
+{
+    return g_TotalFrames;
+}
+
+uint32_t pmm_get_free_frames(void)
+{
+    return g_FreeFrames;
+}
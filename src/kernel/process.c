@@ -0,0 +1,470 @@
+#include <process.h>
+#include <usermode.h>
+#include <syscall.h>
+#include <elf.h>
+#include <pmm.h>
+#include <memory.h>
+#include <string.h>
+#include <minmax.h>
+#include <debug.h>
+#include <smp.h>
+
+#define MODULE "Process"
+
+static Process g_Processes[PROCESS_MAX];
+static int g_NextPid = PROCESS_KERNEL_PID + 1;
+
+static Process* process_alloc(void)
+{
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        Process* process = &g_Processes[i];
+        if (process->State != PROCESS_FREE)
+            continue;
+
+        memset(process, 0, sizeof(Process));
+        process->Pid = g_NextPid++;
+        return process;
+    }
+    return NULL;
+}
+
+static void process_free(Process* process)
+{
+    process->State = PROCESS_FREE;
+}
+
+static Process* process_find(int pid)
+{
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        if (g_Processes[i].State != PROCESS_FREE && g_Processes[i].Pid == pid)
+            return &g_Processes[i];
+    }
+    return NULL;
+}
+
+static ProcessRegion* process_find_region(Process* process, uint32_t address)
+{
+    for (uint32_t i = 0; i < process->RegionCount; i++) {
+        ProcessRegion* region = &process->Regions[i];
+        if (address >= region->Start && address < region->End)
+            return region;
+    }
+    return NULL;
+}
+
+static int process_add_region(Process* process, uint32_t start, uint32_t end, uint32_t flags,
+                              uint32_t fileOffset, uint32_t fileSize)
+{
+    // Only the heap starts out empty
+    if (start < VMM_USER_BASE || end > VMM_USER_TOP || start > end || (start == end && !(flags & PROCESS_REGION_HEAP)))
+        return SYSCALL_INVALID_PARAMS;
+    if (process->RegionCount == PROCESS_MAX_REGIONS)
+        return SYSCALL_OUT_OF_MEMORY;
+
+    for (uint32_t i = 0; i < process->RegionCount; i++) {
+        if (start < process->Regions[i].End && process->Regions[i].Start < end)
+            return SYSCALL_INVALID_PARAMS;
+    }
+
+    ProcessRegion* region = &process->Regions[process->RegionCount++];
+    region->Start = start;
+    region->End = end;
+    region->Flags = flags;
+    region->FileOffset = fileOffset;
+    region->FileSize = fileSize;
+    return SYSCALL_OK;
+}
+
+// Turns the PT_LOAD segments into regions, nothing is read past the headers yet
+static int process_load_elf(Process* process)
+{
+    uint32_t imageEnd = VMM_USER_BASE;
+    ELFHeader header;
+    if (vfs_file_pread(process->File, &header, sizeof(header), 0) != (int32_t)sizeof(header))
+        return SYSCALL_IO_ERROR;
+
+    if (memcmp(header.Magic, ELF_MAGIC, 4) != 0 ||
+        header.Bitness != ELF_BITNESS_32BIT ||
+        header.Endianness != ELF_ENDIANNESS_LITTLE ||
+        header.Type != ELF_TYPE_EXECUTABLE ||
+        header.InstructionSet != ELF_INSTRUCTION_SET_X86 ||
+        header.ProgramHeaderTableEntrySize < sizeof(ELFProgramHeader))
+        return SYSCALL_INVALID_PARAMS;
+
+    for (uint32_t i = 0; i < header.ProgramHeaderTableEntryCount; i++) {
+        ELFProgramHeader segment;
+        uint32_t position = header.ProgramHeaderTablePosition + i * header.ProgramHeaderTableEntrySize;
+        if (vfs_file_pread(process->File, &segment, sizeof(segment), position) != (int32_t)sizeof(segment))
+            return SYSCALL_IO_ERROR;
+
+        if (segment.Type != ELF_PROGRAM_TYPE_LOAD || segment.MemorySize == 0)
+            continue;
+
+        // Pages are read straight from the file, so file and memory must share the page offset
+        uint32_t start = segment.VirtualAddress & ~(VMM_PAGE_SIZE - 1);
+        uint32_t skip = segment.VirtualAddress - start;
+        uint32_t end = (segment.VirtualAddress + segment.MemorySize + VMM_PAGE_SIZE - 1) & ~(VMM_PAGE_SIZE - 1);
+        if (segment.FileSize > segment.MemorySize || segment.Offset % VMM_PAGE_SIZE != skip ||
+            end < segment.VirtualAddress || end > PROCESS_STACK_TOP - PROCESS_STACK_SIZE)
+            return SYSCALL_INVALID_PARAMS;
+
+        uint32_t flags = (segment.Flags & ELF_PROGRAM_FLAG_WRITE) ? PROCESS_REGION_WRITE : 0;
+        int result = process_add_region(process, start, end, flags, segment.Offset - skip, segment.FileSize + skip);
+        if (result != SYSCALL_OK)
+            return result;
+        imageEnd = max(imageEnd, end);
+    }
+
+    if (process_find_region(process, header.ProgramEntryPosition) == NULL)
+        return SYSCALL_INVALID_PARAMS;
+
+    process->Entry = header.ProgramEntryPosition;
+    process->Break = imageEnd;
+    return process_add_region(process, imageEnd, imageEnd, PROCESS_REGION_HEAP | PROCESS_REGION_WRITE, 0, 0);
+}
+
+static ProcessRegion* process_find_flags(Process* process, uint32_t flags)
+{
+    for (uint32_t i = 0; i < process->RegionCount; i++) {
+        if (process->Regions[i].Flags & flags)
+            return &process->Regions[i];
+    }
+    return NULL;
+}
+
+static void process_remove_region(Process* process, ProcessRegion* region)
+{
+    vmm_unmap_user_range(process->AddressSpace, region->Start, region->End);
+    *region = process->Regions[--process->RegionCount];
+}
+
+// Brings in the page of a region on its first access
+static bool process_fault(uint32_t address, bool write)
+{
+    Process* process = cpu_current()->Process;
+    uint32_t page = address & ~(VMM_PAGE_SIZE - 1);
+    if (process == NULL || vmm_is_mapped(page))
+        return false;
+
+    ProcessRegion* region = process_find_region(process, page);
+    if (region == NULL || (write && !(region->Flags & PROCESS_REGION_WRITE)))
+        return false;
+
+    // Reading a page past the file costs no memory, it gets a frame once written
+    uint32_t offset = page - region->Start;
+    if (!write && offset >= region->FileSize) {
+        uint32_t zero = vmm_get_zero_page();
+        uint32_t zeroFlags = (region->Flags & PROCESS_REGION_WRITE) ? VMM_PAGE_COW : 0;
+        if (zero == 0 || !vmm_map_user_page(process->AddressSpace, page, zero, zeroFlags))
+            return false;
+
+        process->MinorFaults++;
+        return true;
+    }
+
+    uint32_t frame = pmm_alloc_frame();
+    if (frame == 0) {
+        log_err(MODULE, "Out of memory loading 0x%x for pid %d", page, process->Pid);
+        return false;
+    }
+    memset((void*)frame, 0, VMM_PAGE_SIZE);
+
+    if (offset < region->FileSize) {
+        uint32_t count = min(VMM_PAGE_SIZE, region->FileSize - offset);
+        if (vfs_file_pread(process->File, (void*)frame, count, region->FileOffset + offset) != (int32_t)count) {
+            log_err(MODULE, "Can't read 0x%x of pid %d", page, process->Pid);
+            pmm_free_frame(frame);
+            return false;
+        }
+        process->MajorFaults++;
+    } else {
+        process->MinorFaults++;
+    }
+
+    uint32_t flags = (region->Flags & PROCESS_REGION_WRITE) ? VMM_PAGE_WRITE : 0;
+    if (!vmm_map_user_page(process->AddressSpace, page, frame, flags)) {
+        pmm_free_frame(frame);
+        return false;
+    }
+
+    return true;
+}
+
+static void process_set_name(Process* process, const char* path)
+{
+    const char* name = path;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/')
+            name = c + 1;
+    }
+
+    uint32_t i = 0;
+    for (; name[i] && i < PROCESS_NAME_MAX - 1; i++)
+        process->Name[i] = name[i];
+    process->Name[i] = '\0';
+}
+
+// Everything but the table entry, which stays until the parent waits
+static void process_release(Process* process, int exitCode)
+{
+    process->State = PROCESS_ZOMBIE;
+    process->ExitCode = exitCode;
+
+    // Whatever it left open, and the executable
+    vfs_context_release(&process->Files);
+    if (process->File != NULL)
+        vfs_put_file(process->File);
+    process->File = NULL;
+
+    if (process->AddressSpace != 0)
+        vmm_destroy_address_space(process->AddressSpace);
+    process->AddressSpace = 0;
+
+    // Nobody is left to wait for its children
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        if (g_Processes[i].State == PROCESS_ZOMBIE && g_Processes[i].ParentPid == process->Pid)
+            process_free(&g_Processes[i]);
+    }
+}
+
+void process_init(void)
+{
+    memset(g_Processes, 0, sizeof(g_Processes));
+    vmm_set_fault_handler(process_fault);
+}
+
+// Runs the process until it exits, from its entry point or from frame, and returns its pid
+static int process_run(Process* process, const Registers* frame)
+{
+    Process* parent = cpu_current()->Process;
+    process->ParentPid = parent != NULL ? parent->Pid : PROCESS_KERNEL_PID;
+    process->State = PROCESS_RUNNING;
+    if (parent != NULL)
+        parent->State = PROCESS_WAITING;
+
+    cpu_current()->Process = process;
+    VfsContext* parentFiles = vfs_set_context(&process->Files);
+    int exitCode = frame != NULL ? usermode_resume(process->AddressSpace, frame)
+                                 : usermode_run(process->AddressSpace, process->Entry, PROCESS_STACK_TOP);
+    vfs_set_context(parentFiles);
+    cpu_current()->Process = parent;
+
+    log_info(MODULE, "Pid %d exited with %d, %u minor and %u major faults",
+             process->Pid, exitCode, process->MinorFaults, process->MajorFaults);
+    process_release(process, exitCode);
+
+    if (parent != NULL) {
+        parent->State = PROCESS_RUNNING;
+        if (parent->Killed)
+            usermode_exit(PROCESS_KILLED_EXIT);
+    }
+    return process->Pid;
+}
+
+int process_exec(const char* path)
+{
+    Process* process = process_alloc();
+    if (process == NULL)
+        return SYSCALL_BUSY;
+
+    // Starts out with the caller's descriptors and directory
+    vfs_context_init(&process->Files);
+    int result = vfs_open_file(path, OPEN_READ, &process->File);
+    if (result == SYSCALL_OK)
+        result = process_load_elf(process);
+    if (result == SYSCALL_OK)
+        result = process_add_region(process, PROCESS_STACK_TOP - PROCESS_STACK_SIZE, PROCESS_STACK_TOP,
+                                    PROCESS_REGION_WRITE, 0, 0);
+    if (result == SYSCALL_OK) {
+        process->AddressSpace = vmm_create_address_space();
+        if (process->AddressSpace == 0)
+            result = SYSCALL_OUT_OF_MEMORY;
+    }
+    if (result != SYSCALL_OK) {
+        process_release(process, result);
+        process_free(process);
+        return result;
+    }
+
+    process_set_name(process, path);
+    log_info(MODULE, "Starting %s as pid %d, entry 0x%x", path, process->Pid, process->Entry);
+    return process_run(process, NULL);
+}
+
+int process_fork(const Registers* frame)
+{
+    Process* parent = cpu_current()->Process;
+    if (parent == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    Process* child = process_alloc();
+    if (child == NULL)
+        return SYSCALL_BUSY;
+
+    // Same descriptors sharing the same positions, and the same executable
+    vfs_context_init(&child->Files);
+    vfs_get_file_ref(parent->File);
+    child->File = parent->File;
+
+    memcpy(child->Name, parent->Name, sizeof(child->Name));
+    memcpy(child->Regions, parent->Regions, sizeof(child->Regions));
+    child->RegionCount = parent->RegionCount;
+    child->Break = parent->Break;
+    child->Entry = parent->Entry;
+
+    // Nothing is copied here, both sides share every frame until one writes to it
+    child->AddressSpace = vmm_clone_address_space(parent->AddressSpace);
+    if (child->AddressSpace == 0) {
+        process_release(child, SYSCALL_OUT_OF_MEMORY);
+        process_free(child);
+        return SYSCALL_OUT_OF_MEMORY;
+    }
+
+    // The child returns 0 from the same fork call
+    Registers childFrame = *frame;
+    childFrame.eax = 0;
+
+    log_info(MODULE, "Forked pid %d from %d", child->Pid, parent->Pid);
+    return process_run(child, &childFrame);
+}
+
+int process_wait(int pid, int* exitCode)
+{
+    // A child always finishes before process_exec returns, so there is nothing to block on
+    int parentPid = process_get_pid();
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        Process* process = &g_Processes[i];
+        if (process->State != PROCESS_ZOMBIE || process->ParentPid != parentPid)
+            continue;
+        if (pid != -1 && process->Pid != pid)
+            continue;
+
+        int found = process->Pid;
+        if (exitCode != NULL)
+            *exitCode = process->ExitCode;
+        process_free(process);
+        return found;
+    }
+    return SYSCALL_NOT_FOUND;
+}
+
+int process_kill(int pid)
+{
+    if (pid == PROCESS_KERNEL_PID)
+        return SYSCALL_PERMISSION_DENIED;
+
+    Process* process = process_find(pid);
+    if (process == NULL || process->State == PROCESS_ZOMBIE)
+        return SYSCALL_NOT_FOUND;
+
+    if (process == cpu_current()->Process)
+        usermode_exit(PROCESS_KILLED_EXIT);
+
+    // Waiting on a child, it goes once that one is done
+    process->Killed = true;
+    return SYSCALL_OK;
+}
+
+int process_sbrk(int32_t increment, uint32_t* address)
+{
+    Process* process = cpu_current()->Process;
+    ProcessRegion* heap = process != NULL ? process_find_flags(process, PROCESS_REGION_HEAP) : NULL;
+    if (heap == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    uint32_t old = process->Break;
+    uint32_t next = old + (uint32_t)increment;
+    if ((increment > 0 && next < old) || (increment < 0 && (next > old || next < heap->Start)))
+        return SYSCALL_INVALID_PARAMS;
+
+    // Only the range is reserved, pages come in as they are touched
+    uint32_t end = (next + VMM_PAGE_SIZE - 1) & ~(VMM_PAGE_SIZE - 1);
+    if (end > heap->End) {
+        for (uint32_t i = 0; i < process->RegionCount; i++) {
+            ProcessRegion* region = &process->Regions[i];
+            if (region != heap && heap->End < region->End && region->Start < end)
+                return SYSCALL_OUT_OF_MEMORY;
+        }
+        if (end > PROCESS_MMAP_TOP)
+            return SYSCALL_OUT_OF_MEMORY;
+    } else {
+        vmm_unmap_user_range(process->AddressSpace, end, heap->End);
+    }
+
+    heap->End = end;
+    process->Break = next;
+    *address = old;
+    return SYSCALL_OK;
+}
+
+int process_mmap(uint32_t length, uint32_t flags, uint32_t* address)
+{
+    Process* process = cpu_current()->Process;
+    if (process == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+    if (length == 0 || length > PROCESS_MMAP_TOP - VMM_USER_BASE || (flags & MMAP_SHARED))
+        return SYSCALL_INVALID_PARAMS;
+
+    // Highest gap that fits, below the stack and above the heap
+    uint32_t size = (length + VMM_PAGE_SIZE - 1) & ~(VMM_PAGE_SIZE - 1);
+    uint32_t end = PROCESS_MMAP_TOP;
+    for (uint32_t i = 0; i < process->RegionCount; ) {
+        ProcessRegion* region = &process->Regions[i];
+        if (end - size < region->End && region->Start < end && region->Start < region->End) {
+            end = region->Start;
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    // Never below the heap, which grows up into the same space
+    ProcessRegion* heap = process_find_flags(process, PROCESS_REGION_HEAP);
+    if (end < size || end - size < VMM_USER_BASE || (heap != NULL && end - size < heap->End))
+        return SYSCALL_OUT_OF_MEMORY;
+
+    uint32_t regionFlags = PROCESS_REGION_ANON | ((flags & MMAP_WRITE) ? PROCESS_REGION_WRITE : 0);
+    int result = process_add_region(process, end - size, end, regionFlags, 0, 0);
+    if (result != SYSCALL_OK)
+        return result;
+
+    *address = end - size;
+    return SYSCALL_OK;
+}
+
+int process_munmap(uint32_t address)
+{
+    Process* process = cpu_current()->Process;
+    if (process == NULL)
+        return SYSCALL_PERMISSION_DENIED;
+
+    ProcessRegion* region = process_find_region(process, address);
+    if (region == NULL || region->Start != address || !(region->Flags & PROCESS_REGION_ANON))
+        return SYSCALL_INVALID_PARAMS;
+
+    process_remove_region(process, region);
+    return SYSCALL_OK;
+}
+
+int process_get_pid(void)
+{
+    Process* process = cpu_current()->Process;     // NULL while the kernel runs
+    return process != NULL ? process->Pid : PROCESS_KERNEL_PID;
+}
+
+Process* process_current(void)
+{
+    return cpu_current()->Process;
+}
+
+const Process* process_get_by_pid(int pid)
+{
+    return process_find(pid);
+}
+
+const Process* process_get(int index)
+{
+    if (index < 0 || index >= PROCESS_MAX)
+        return NULL;
+    return &g_Processes[index];
+}
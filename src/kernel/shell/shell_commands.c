@@ -9,6 +9,21 @@
 #include <keyboard.h>
 #include <io.h>
 #include <x86.h>
+#include <ata.h>
+#include <pmm.h>
+#include <time.h>
+#include <bcache.h>
+#include <blkq.h>
+#include <process.h>
+#include <tmpfs.h>
+#include <vfs.h>
+#include <vmm.h>
+#include <sysenter.h>
+#include <irq.h>
+#include <softirq.h>
+#include <smp.h>
+#include <sync.h>
+#include <boot/bootprofile.h>
 
 //
 // UTILITY FUNCTIONS - MUST BE FIRST
@@ -167,6 +182,7 @@ extern char* shell_strncpy(char* dest, const char* src, int n);
 // Functions from syscall_test.c
 extern void syscall_run_all_tests(void);
 extern void syscall_test_heap_integrity(void);
+extern void syscall_test_usermode(void);
 
 // Functions from time subsystem
 extern uint32_t sys_time(void);
@@ -176,228 +192,74 @@ extern void display_kernel_messages(void);
 extern void dmesg_clear(void);
 extern void dmesg_stats(void);
 extern void kernel_add_message(char level, const char* component, const char* message);
+extern void kernel_get_boot_time(uint64_t* loaderToShellUs, uint64_t* kernelToShellUs);
 
 //
-// RAM-BASED FILE SYSTEM IMPLEMENTATION
+// FILE SYSTEM HELPERS (VFS)
 //
 
-#define MAX_FILES 64
-#define MAX_FILENAME_LEN 32
-#define MAX_FILE_SIZE 4096
-#define MAX_PATH_DEPTH 8
+#define MAX_EDIT_SIZE 4096
+#define FIND_MAX_DEPTH 8
 
-typedef struct ram_file {
-    char name[MAX_FILENAME_LEN];
-    char* data;
-    uint32_t size;
-    uint32_t capacity;
-    uint32_t is_directory;
-    uint32_t parent_index;
-    uint32_t in_use;
-    uint32_t created_time;
-} ram_file_t;
-
-typedef struct ram_fs {
-    ram_file_t files[MAX_FILES];
-    uint32_t file_count;
-    uint32_t current_dir;
-    uint32_t initialized;
-} ram_fs_t;
-
-static ram_fs_t g_ramfs;
-
-// Initialize the RAM file system
-void ramfs_init(void) {
-    if (g_ramfs.initialized) return;
-    
-    shell_memset(&g_ramfs, 0, sizeof(ram_fs_t));
-    
-    // Create root directory
-    g_ramfs.files[0].name[0] = '/';
-    g_ramfs.files[0].name[1] = '\0';
-    g_ramfs.files[0].is_directory = 1;
-    g_ramfs.files[0].parent_index = 0; // Root points to itself
-    g_ramfs.files[0].in_use = 1;
-    g_ramfs.files[0].created_time = sys_time();
-    
-    g_ramfs.file_count = 1;
-    g_ramfs.current_dir = 0;
-    g_ramfs.initialized = 1;
-    
-    printf("RAM File System initialized\n");
-}
-
-// Find file by name in current directory
-int ramfs_find_file(const char* name, uint32_t parent_dir) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (g_ramfs.files[i].in_use && 
-            g_ramfs.files[i].parent_index == parent_dir &&
-            shell_strcmp(g_ramfs.files[i].name, name) == 0) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// Find free file slot
-int ramfs_find_free_slot(void) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!g_ramfs.files[i].in_use) {
-            return i;
-        }
+// Open a regular file for reading, relative to the current directory unless it starts with '/'
+static fd_t fs_open_file(const char* name) {
+    fd_t fd = vfs_open(name, OPEN_READ);
+    if (fd < 0) return fd;
+    
+    VfsStat stat;
+    if (vfs_fstat(fd, &stat) == SYSCALL_OK && stat.IsDirectory) {
+        vfs_close(fd);
+        return SYSCALL_IS_DIRECTORY;
     }
-    return -1;
+    return fd;
 }
 
-// Create a new file or directory
-int ramfs_create(const char* name, uint32_t is_directory) {
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    // Check if file already exists
-    if (ramfs_find_file(name, g_ramfs.current_dir) >= 0) {
-        return -1; // File exists
-    }
+// Map a whole regular file read only, data is NULL for an empty file.
+// The text tools scan the mapping in place instead of copying it through a buffer.
+static int fs_map_file(const char* name, const char** data, uint32_t* size) {
+    fd_t fd = fs_open_file(name);
+    if (fd < 0) return fd;
     
-    // Find free slot
-    int slot = ramfs_find_free_slot();
-    if (slot < 0) {
-        return -2; // No free slots
+    VfsStat stat;
+    int result = vfs_fstat(fd, &stat);
+    *data = NULL;
+    *size = stat.Size;
+    if (result == SYSCALL_OK && stat.Size > 0) {
+        result = vfs_mmap(fd, stat.Size, 0, MMAP_READ, (void**)data);
     }
     
-    // Create the file
-    ram_file_t* file = &g_ramfs.files[slot];
-    shell_strncpy(file->name, name, MAX_FILENAME_LEN - 1);
-    file->name[MAX_FILENAME_LEN - 1] = '\0';
-    
-    if (!is_directory) {
-        file->data = (char*)sys_malloc(256); // Initial size
-        if (!file->data) return -3; // Out of memory
-        file->capacity = 256;
-        file->size = 0;
-        file->data[0] = '\0';
-    } else {
-        file->data = NULL;
-        file->capacity = 0;
-        file->size = 0;
-    }
-    
-    file->is_directory = is_directory;
-    file->parent_index = g_ramfs.current_dir;
-    file->in_use = 1;
-    file->created_time = sys_time();
-    
-    g_ramfs.file_count++;
-    return slot;
+    // The mapping holds its own reference to the file
+    vfs_close(fd);
+    return result;
 }
 
-// Delete a file
-int ramfs_delete(const char* name) {
-    int file_index = ramfs_find_file(name, g_ramfs.current_dir);
-    if (file_index < 0) return -1; // Not found
-    
-    ram_file_t* file = &g_ramfs.files[file_index];
-    
-    // Check if directory is empty
-    if (file->is_directory) {
-        for (int i = 0; i < MAX_FILES; i++) {
-            if (g_ramfs.files[i].in_use && g_ramfs.files[i].parent_index == file_index) {
-                return -2; // Directory not empty
-            }
-        }
-    }
-    
-    // Free memory if it's a file
-    if (file->data) {
-        sys_free(file->data);
-    }
-    
-    // Mark as free
-    shell_memset(file, 0, sizeof(ram_file_t));
-    g_ramfs.file_count--;
-    
-    return 0;
+static void fs_unmap_file(const char* data) {
+    if (data) vfs_munmap((void*)data);
 }
 
-// Write data to file
-int ramfs_write_file(const char* name, const char* data, uint32_t size) {
-    int file_index = ramfs_find_file(name, g_ramfs.current_dir);
-    if (file_index < 0) {
-        // Create new file
-        file_index = ramfs_create(name, 0);
-        if (file_index < 0) return file_index;
-    }
-    
-    ram_file_t* file = &g_ramfs.files[file_index];
-    if (file->is_directory) return -1; // Can't write to directory
-    
-    // Expand buffer if needed
-    if (size > file->capacity) {
-        uint32_t new_capacity = ((size + 255) / 256) * 256; // Round up to 256 bytes
-        char* new_data = (char*)sys_malloc(new_capacity);
-        if (!new_data) return -3; // Out of memory
-        
-        if (file->data) {
-            shell_memcpy(new_data, file->data, file->size);
-            sys_free(file->data);
-        }
-        
-        file->data = new_data;
-        file->capacity = new_capacity;
-    }
+// Replace the contents of a file, creating it if needed
+int fs_write_file(const char* name, const char* data, uint32_t size) {
+    fd_t fd = vfs_open(name, OPEN_WRITE | OPEN_CREATE | OPEN_TRUNCATE);
+    if (fd < 0) return fd;
     
-    // Write data
-    shell_memcpy(file->data, data, size);
-    file->size = size;
-    if (size > 0) {
-        file->data[size] = '\0'; // Null terminate for text files
-    }
-    
-    return size;
+    int result = size > 0 ? vfs_write(fd, data, size) : 0;
+    vfs_close(fd);
+    return result;
 }
 
-// Read data from file
-int ramfs_read_file(const char* name, char* buffer, uint32_t buffer_size) {
-    int file_index = ramfs_find_file(name, g_ramfs.current_dir);
-    if (file_index < 0) return -1; // Not found
-    
-    ram_file_t* file = &g_ramfs.files[file_index];
-    if (file->is_directory) return -2; // Can't read directory as file
-    
-    uint32_t to_read = file->size < buffer_size ? file->size : buffer_size;
-    shell_memcpy(buffer, file->data, to_read);
+// Read the start of a file
+int fs_read_file(const char* name, char* buffer, uint32_t buffer_size) {
+    fd_t fd = fs_open_file(name);
+    if (fd < 0) return fd;
     
-    return to_read;
+    int result = vfs_read(fd, buffer, buffer_size);
+    vfs_close(fd);
+    return result;
 }
 
 // Get current directory path
-void ramfs_get_current_path(char* buffer, uint32_t buffer_size) {
-    if (g_ramfs.current_dir == 0) {
-        shell_strncpy(buffer, "/", buffer_size);
-        return;
-    }
-    
-    // Build path backwards
-    char temp_path[256];
-    int pos = 255;
-    temp_path[pos] = '\0';
-    
-    uint32_t dir_index = g_ramfs.current_dir;
-    while (dir_index != 0) {
-        ram_file_t* dir = &g_ramfs.files[dir_index];
-        int name_len = shell_strlen(dir->name);
-        
-        pos -= name_len;
-        if (pos < 0) break;
-        shell_memcpy(&temp_path[pos], dir->name, name_len);
-        
-        pos--;
-        if (pos < 0) break;
-        temp_path[pos] = '/';
-        
-        dir_index = dir->parent_index;
-    }
-    
-    shell_strncpy(buffer, &temp_path[pos], buffer_size);
+void fs_get_current_path(char* buffer, uint32_t buffer_size) {
+    shell_strncpy(buffer, vfs_getcwd(), buffer_size);
 }
 
 //
@@ -413,7 +275,9 @@ const char* get_command_category(const char* name) {
     // System Information
     else if (shell_strcmp(name, "memory") == 0 || shell_strcmp(name, "uptime") == 0 ||
              shell_strcmp(name, "cpuinfo") == 0 || shell_strcmp(name, "cpuid") == 0 ||
-             shell_strcmp(name, "dmesg") == 0) {
+             shell_strcmp(name, "dmesg") == 0 || shell_strcmp(name, "bcache") == 0 ||
+             shell_strcmp(name, "iostat") == 0 || shell_strcmp(name, "irqstat") == 0 ||
+             shell_strcmp(name, "cpus") == 0 || shell_strcmp(name, "lockstat") == 0) {
         return "System Information";
     }
     // File System
@@ -422,20 +286,22 @@ const char* get_command_category(const char* name) {
              shell_strcmp(name, "rm") == 0 || shell_strcmp(name, "cat") == 0 ||
              shell_strcmp(name, "edit") == 0 || shell_strcmp(name, "touch") == 0 ||
              shell_strcmp(name, "find") == 0 || shell_strcmp(name, "grep") == 0 ||
-             shell_strcmp(name, "wc") == 0) {
+             shell_strcmp(name, "wc") == 0 || shell_strcmp(name, "mount") == 0 ||
+             shell_strcmp(name, "umount") == 0 || shell_strcmp(name, "df") == 0) {
         return "File System";
     }
     // Hardware & Debug
     else if (shell_strcmp(name, "memtest") == 0 || shell_strcmp(name, "ports") == 0 ||
              shell_strcmp(name, "interrupt") == 0 || shell_strcmp(name, "hexdump") == 0 ||
              shell_strcmp(name, "keytest") == 0 || shell_strcmp(name, "benchmark") == 0 ||
-             shell_strcmp(name, "registers") == 0) {
+             shell_strcmp(name, "registers") == 0 || shell_strcmp(name, "ata") == 0) {
         return "Hardware & Debug";
     }
     // System Calls
     else if (shell_strcmp(name, "syscall_test") == 0 || shell_strcmp(name, "malloc_test") == 0 ||
              shell_strcmp(name, "heap_info") == 0 || shell_strcmp(name, "syscall_info") == 0 ||
-             shell_strcmp(name, "sleep") == 0) {
+             shell_strcmp(name, "sleep") == 0 || shell_strcmp(name, "exec") == 0 ||
+             shell_strcmp(name, "ps") == 0 || shell_strcmp(name, "kill") == 0) {
         return "System Calls";
     }
     // System Control
@@ -606,6 +472,11 @@ int cmd_uptime(int argc, char* argv[]) {
     
     printf("System has been up for: %u:%u:%u\n", hours, minutes, seconds);
 
+    uint64_t loader_us, kernel_us;
+    kernel_get_boot_time(&loader_us, &kernel_us);
+    printf("Boot to shell: %u ms (kernel %u ms, %s profile)\n",
+           (uint32_t)(loader_us / 1000), (uint32_t)(kernel_us / 1000), BOOT_PROFILE);
+
     return 0;
 }
 
@@ -715,26 +586,256 @@ int cmd_dmesg(int argc, char* argv[]) {
 // FUNCTIONAL FILE SYSTEM COMMANDS
 //
 
+// Integer percentage with one decimal, printf has no floating point support
+static void print_percent(uint32_t part, uint32_t total) {
+    uint32_t permille = total ? (uint32_t)((uint64_t)part * 1000 / total) : 0;
+    printf("%u.%u%%", permille / 10, permille % 10);
+}
+
+int cmd_bcache(int argc, char* argv[]) {
+    if (argc > 1) {
+        if (shell_strcmp(argv[1], "flush") == 0) {
+            printf(bcache_sync(NULL) ? "Buffer cache flushed\n" : "bcache: Flush failed\n");
+            return 0;
+        }
+        if (shell_strcmp(argv[1], "reset") == 0) {
+            bcache_reset_stats();
+            printf("Buffer cache statistics reset\n");
+            return 0;
+        }
+
+        printf("Usage: bcache [flush|reset]\n");
+        return 1;
+    }
+
+    BCacheStats stats;
+    bcache_get_stats(&stats);
+
+    printf("Buffer cache: %u of %u blocks cached, %u dirty\n",
+           stats.CachedBlocks, BCACHE_BUFFER_COUNT, stats.DirtyBlocks);
+    printf("  Lookups:     %u\n", stats.Lookups);
+    printf("  Hits:        %u (", stats.Hits);
+    print_percent(stats.Hits, stats.Lookups);
+    printf(")\n");
+    printf("  Misses:      %u\n", stats.Misses);
+    printf("  Evictions:   %u (%u dirty)\n", stats.Evictions, stats.DirtyEvictions);
+    printf("  Flushes:     %u (%u blocks written)\n", stats.Flushes, stats.BlocksWritten);
+    printf("  Read-ahead:  %u blocks, %u used (", stats.ReadAheadBlocks, stats.ReadAheadHits);
+    print_percent(stats.ReadAheadHits, stats.ReadAheadBlocks);
+    printf(")\n");
+    return 0;
+}
+
+int cmd_iostat(int argc, char* argv[]) {
+    bool reset = argc > 1 && shell_strcmp(argv[1], "reset") == 0;
+    if (argc > 1 && !reset) {
+        printf("Usage: iostat [reset]\n");
+        return 1;
+    }
+
+    if (blockdev_get_count() == 0) {
+        printf("No block devices\n");
+        return 0;
+    }
+
+    for (int i = 0; i < blockdev_get_count(); i++) {
+        BlockDev* dev = blockdev_get(i);
+        BlockQueueStats stats;
+
+        if (reset) {
+            blkq_reset_stats(dev);
+            continue;
+        }
+        if (!blkq_get_stats(dev, &stats))
+            continue;
+
+        uint32_t merged = stats.BackMerges + stats.FrontMerges;
+        printf("%s:\n", dev->Name);
+        printf("  Requests:    %u submitted, %u merged (", stats.Submitted, merged);
+        print_percent(merged, stats.Submitted);
+        printf(", %u back %u front)\n", stats.BackMerges, stats.FrontMerges);
+        printf("  Commands:    %u dispatched, %u completed, %u errors\n",
+               stats.Dispatched, stats.Completed, stats.Errors);
+        printf("  Deadline:    %u dispatched out of order\n", stats.Expired);
+        printf("  Queue depth: %u now, %u max, avg %u\n", stats.Depth, stats.MaxDepth,
+               stats.Submitted ? (uint32_t)(stats.DepthSum / stats.Submitted) : 0);
+    }
+
+    if (reset)
+        printf("I/O statistics reset\n");
+    return 0;
+}
+
+#define IRQSTAT_BAR_WIDTH   32
+
+static void print_irq_histogram(const char* title, const IrqHistogram* histogram) {
+    printf("%s: %u samples, max %u cycles (%u us)\n", title, histogram->Count,
+           histogram->MaxCycles, (uint32_t)time_tsc_to_us(histogram->MaxCycles));
+
+    uint32_t largest = 0;
+    for (int i = 0; i < SOFTIRQ_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->Buckets[i] > largest) largest = histogram->Buckets[i];
+    }
+
+    for (int i = 0; i < SOFTIRQ_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->Buckets[i] == 0) continue;
+
+        printf("  < %u\t", i < 31 ? 2u << i : UINT32_MAX);
+        uint32_t bar = (uint32_t)((uint64_t)histogram->Buckets[i] * IRQSTAT_BAR_WIDTH / largest);
+        for (uint32_t j = 0; j < IRQSTAT_BAR_WIDTH; j++) putc(j < bar || j == 0 ? '#' : ' ');
+        printf(" %u\n", histogram->Buckets[i]);
+    }
+}
+
+int cmd_irqstat(int argc, char* argv[]) {
+    bool reset = argc > 1 && shell_strcmp(argv[1], "reset") == 0;
+    if (argc > 1 && !reset) {
+        printf("Usage: irqstat [reset]\n");
+        return 1;
+    }
+
+    if (reset) {
+        softirq_reset_stats();
+        printf("IRQ statistics reset\n");
+        return 0;
+    }
+
+    const IrqStats* stats = softirq_get_stats();
+    printf("IRQ counts:");
+    for (int i = 0; i < 16; i++) {
+        if (stats->IrqCount[i] != 0) printf(" %d:%u", i, stats->IrqCount[i]);
+    }
+    printf("\n\nCycles per interrupt, grouped by power of two\n");
+    print_irq_histogram("Interrupts off (entry to EOI)", &stats->IrqOff);
+    print_irq_histogram("Softirqs (interrupts on)", &stats->Softirq);
+    return 0;
+}
+
+int cmd_cpus(int argc, char* argv[]) {
+    uint32_t count = smp_cpu_count();
+    uint64_t now = x86_ReadTsc();
+    printf("%u CPUs online, this is CPU %u\n", count, cpu_current()->Index);
+    printf("CPU\tAPIC\tBUSY\tWORK\tSTOLEN\tQUEUED\tIPIS\n");
+
+    // Busy is the share of time spent on queued work since the CPU came up
+    for (uint32_t i = 0; i < count; i++) {
+        Cpu* cpu = smp_get_cpu(i);
+        uint64_t elapsed = now - cpu->OnlineTsc;
+        uint32_t busy = elapsed != 0 ? (uint32_t)(cpu->BusyCycles * 1000 / elapsed) : 0;
+        printf("%u\t%u\t%u.%u%%\t%u\t%u\t%u\t%u\n", cpu->Index, cpu->ApicId, busy / 10, busy % 10,
+               cpu->WorkDone, cpu->WorkStolen, cpu->QueueLength, cpu->IpisReceived);
+    }
+    return 0;
+}
+
+int cmd_lockstat(int argc, char* argv[]) {
+    bool reset = argc > 1 && shell_strcmp(argv[1], "reset") == 0;
+    if (argc > 1 && !reset) {
+        printf("Usage: lockstat [reset]\n");
+        return 1;
+    }
+
+    if (reset) {
+        lockstat_reset();
+        printf("Lock statistics reset\n");
+        return 0;
+    }
+
+    static const char* types[] = { "spin", "mutex", "rw", "seq" };
+    printf("Wait times in cycles, over contended acquisitions only\n");
+    printf("NAME\t\tTYPE\tTAKEN\tWAITED\tAVG\tMAX\n");
+    for (LockStats* stats = lockstat_first(); stats != NULL; stats = stats->Next) {
+        uint32_t average = stats->Contended ? (uint32_t)(stats->WaitCycles / stats->Contended) : 0;
+        printf("%s\t%s%s\t%u\t%u\t%u\t%u\n", stats->Name, shell_strlen(stats->Name) < 8 ? "\t" : "",
+               types[stats->Type], stats->Acquired, stats->Contended, average, stats->MaxWaitCycles);
+    }
+    return 0;
+}
+
+int cmd_mount(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("Usage: mount <device> <path>\n");
+        printf("Example: mount ata0 /disk\n");
+        return 1;
+    }
+
+    int32_t result = sys_mount(argv[1], argv[2]);
+    if (result != SYSCALL_OK) {
+        printf("mount: Cannot mount %s on %s (error %d)\n", argv[1], argv[2], result);
+        return 1;
+    }
+
+    printf("Mounted %s on %s\n", argv[1], argv[2]);
+    return 0;
+}
+
+int cmd_umount(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: umount <path>\n");
+        return 1;
+    }
+
+    int32_t result = sys_umount(argv[1]);
+    if (result == SYSCALL_BUSY) {
+        printf("umount: %s has open files\n", argv[1]);
+        return 1;
+    }
+    if (result != SYSCALL_OK) {
+        printf("umount: %s is not mounted\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
+
+int cmd_df(int argc, char* argv[]) {
+    TmpfsStats stats;
+    tmpfs_get_stats(&stats);
+
+    uint32_t pages = stats.DataPages + stats.IndexPages + stats.SlabPages;
+    printf("tmpfs: %u KB in use, %u KB free\n", pages * 4, pmm_get_free_frames() * 4);
+    printf("  Nodes:       %u (%u directories)\n", stats.Nodes, stats.Directories);
+    printf("  Data:        %u pages\n", stats.DataPages);
+    printf("  Index:       %u pages\n", stats.IndexPages);
+    printf("  Node slabs:  %u pages\n", stats.SlabPages);
+    return 0;
+}
+
 int cmd_ls(int argc, char* argv[]) {
-    if (!g_ramfs.initialized) ramfs_init();
+    const char* target = argc > 1 ? argv[1] : ".";
+    char path[VFS_MAX_PATH];
+    if (vfs_resolve_path(target, path, sizeof(path)) != SYSCALL_OK) {
+        printf("ls: Invalid path '%s'\n", target);
+        return 1;
+    }
     
-    char current_path[64];
-    ramfs_get_current_path(current_path, sizeof(current_path));
+    fd_t dir = vfs_open(path, OPEN_READ);
+    if (dir < 0) {
+        printf("ls: Cannot open '%s' (error %d)\n", target, dir);
+        return 1;
+    }
 
-    printf("Directory listing for %s:\n", current_path);
+    printf("Directory listing for %s:\n", path);
     printf("%s %s\n", "Type      ", "Name      ");
     printf("------------------------------------------------------------\n");
 
+    // Entries are streamed, one at a time, from whichever file system holds the directory
+    VfsDirEntry entry;
     int count = 0;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (g_ramfs.files[i].in_use && g_ramfs.files[i].parent_index == g_ramfs.current_dir) {
-            ram_file_t* file = &g_ramfs.files[i];
-            
-            printf("%s %s\n",
-                   file->is_directory ? "DIR       " : "FILE      ",
-                   file->name);
-            count++;
+    int result;
+    while ((result = vfs_readdir(dir, &entry)) == 1) {
+        if (entry.IsDirectory) {
+            printf("%s %s\n", "DIR       ", entry.Name);
+        } else {
+            printf("%s %s (%u bytes)\n", "FILE      ", entry.Name, entry.Size);
         }
+        count++;
+    }
+    vfs_close(dir);
+    
+    if (result == SYSCALL_NOT_DIRECTORY) {
+        printf("ls: '%s' is not a directory\n", target);
+        return 1;
     }
     
     if (count == 0) {
@@ -745,53 +846,31 @@ int cmd_ls(int argc, char* argv[]) {
 }
 
 int cmd_cd(int argc, char* argv[]) {
-    if (!g_ramfs.initialized) ramfs_init();
-    
     if (argc < 2) {
         // Show current directory
-        char current_path[64];
-        ramfs_get_current_path(current_path, sizeof(current_path));
-        printf("Current directory: %s\n", current_path);
+        printf("Current directory: %s\n", vfs_getcwd());
         return 0;
     }
     
     const char* target = argv[1];
     
-    // Handle special cases
-    if (shell_strcmp(target, "..") == 0) {
-        // Go to parent directory
-        if (g_ramfs.current_dir != 0) {
-            g_ramfs.current_dir = g_ramfs.files[g_ramfs.current_dir].parent_index;
-        }
-        return 0;
-    } else if (shell_strcmp(target, "/") == 0) {
-        // Go to root
-        g_ramfs.current_dir = 0;
-        return 0;
-    }
-    
-    // Find directory
-    int dir_index = ramfs_find_file(target, g_ramfs.current_dir);
-    if (dir_index < 0) {
-        printf("cd: Directory '%s' not found\n", target);
+    // Paths may be absolute and contain "." and ".."
+    int result = vfs_chdir(target);
+    if (result == SYSCALL_NOT_DIRECTORY) {
+        printf("cd: '%s' is not a directory\n", target);
         return 1;
     }
     
-    if (!g_ramfs.files[dir_index].is_directory) {
-        printf("cd: '%s' is not a directory\n", target);
+    if (result != SYSCALL_OK) {
+        printf("cd: Directory '%s' not found\n", target);
         return 1;
     }
     
-    g_ramfs.current_dir = dir_index;
     return 0;
 }
 
 int cmd_pwd(int argc, char* argv[]) {
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    char current_path[64];
-    ramfs_get_current_path(current_path, sizeof(current_path));
-    printf("%s\n", current_path);
+    printf("%s\n", vfs_getcwd());
     
     return 0;
 }
@@ -802,28 +881,30 @@ int cmd_mkdir(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    int result = ramfs_create(argv[1], 1); // 1 = directory
+    int result = vfs_mkdir(argv[1]);
     
     switch (result) {
-        case -1:
+        case SYSCALL_OK:
+            printf("Directory '%s' created successfully\n", argv[1]);
+            return 0;
+        case SYSCALL_EXISTS:
             printf("mkdir: Directory '%s' already exists\n", argv[1]);
             return 1;
-        case -2:
-            printf("mkdir: No free slots available\n");
+        case SYSCALL_INVALID_PARAMS:
+            printf("mkdir: Invalid name '%s'\n", argv[1]);
+            return 1;
+        case SYSCALL_NOT_FOUND:
+            printf("mkdir: Parent of '%s' not found\n", argv[1]);
             return 1;
-        case -3:
+        case SYSCALL_PERMISSION_DENIED:
+            printf("mkdir: File system does not support directories here\n");
+            return 1;
+        case SYSCALL_OUT_OF_MEMORY:
             printf("mkdir: Out of memory\n");
             return 1;
         default:
-            if (result >= 0) {
-                printf("Directory '%s' created successfully\n", argv[1]);
-                return 0;
-            } else {
-                printf("mkdir: Unknown error (%d)\n", result);
-                return 1;
-            }
+            printf("mkdir: Unknown error (%d)\n", result);
+            return 1;
     }
 }
 
@@ -833,20 +914,21 @@ int cmd_rm(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    int result = ramfs_delete(argv[1]);
+    int result = vfs_unlink(argv[1]);
     
     switch (result) {
-        case 0:
+        case SYSCALL_OK:
             printf("'%s' deleted successfully\n", argv[1]);
             return 0;
-        case -1:
+        case SYSCALL_NOT_FOUND:
             printf("rm: '%s' not found\n", argv[1]);
             return 1;
-        case -2:
+        case SYSCALL_NOT_EMPTY:
             printf("rm: Directory '%s' is not empty\n", argv[1]);
             return 1;
+        case SYSCALL_BUSY:
+            printf("rm: '%s' is in use\n", argv[1]);
+            return 1;
         default:
             printf("rm: Unknown error (%d)\n", result);
             return 1;
@@ -859,43 +941,69 @@ int cmd_cat(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    char buffer[MAX_FILE_SIZE];
-    int bytes_read = ramfs_read_file(argv[1], buffer, sizeof(buffer) - 1);
-    
-    if (bytes_read < 0) {
-        printf("cat: Cannot read '%s' (error %d)\n", argv[1], bytes_read);
+    const char* data;
+    uint32_t size;
+    int result = fs_map_file(argv[1], &data, &size);
+    if (result != SYSCALL_OK) {
+        printf("cat: Cannot read '%s' (error %d)\n", argv[1], result);
         return 1;
     }
     
-    buffer[bytes_read] = '\0';
-    printf("%s", buffer);
+    // Written straight from the file's pages
+    if (data) vfs_write(VFS_FD_STDOUT, data, size);
     
+    fs_unmap_file(data);
     return 0;
 }
 
+// Shared by every level of the search so deep trees don't eat the kernel stack
+static char g_find_path[VFS_MAX_PATH];
+static VfsDirEntry g_find_entry;
+
+// Search the directory at g_find_path, which is length characters long
+static bool find_in_directory(const char* pattern, uint32_t length, int depth) {
+    fd_t dir = vfs_open(g_find_path, OPEN_READ);
+    if (dir < 0) return false;
+    
+    bool found = false;
+    while (vfs_readdir(dir, &g_find_entry) == 1) {
+        uint32_t name_len = shell_strlen(g_find_entry.Name);
+        uint32_t child = length;
+        if (child > 1) g_find_path[child++] = '/';
+        if (child + name_len >= sizeof(g_find_path)) {
+            g_find_path[length] = '\0';
+            continue;
+        }
+        shell_memcpy(g_find_path + child, g_find_entry.Name, name_len);
+        g_find_path[child + name_len] = '\0';
+        
+        bool is_directory = g_find_entry.IsDirectory;
+        if (shell_strstr(g_find_entry.Name, pattern) != NULL) {
+            printf("%s %s\n", is_directory ? "[DIR] " : "[FILE] ", g_find_path);
+            found = true;
+        }
+        
+        if (is_directory && depth < FIND_MAX_DEPTH && find_in_directory(pattern, child + name_len, depth + 1)) {
+            found = true;
+        }
+        g_find_path[length] = '\0';
+    }
+    
+    vfs_close(dir);
+    return found;
+}
+
 int cmd_find(int argc, char* argv[]) {
     if (argc < 2) {
         printf("Usage: find <pattern>\n");
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
     printf("Searching for files matching '%s':\n", argv[1]);
     
-    bool found = false;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (g_ramfs.files[i].in_use) {
-            if (shell_strstr(g_ramfs.files[i].name, argv[1]) != NULL) {
-                printf("%s %s\n", 
-                       g_ramfs.files[i].is_directory ? "[DIR] " : "[FILE] ",
-                       g_ramfs.files[i].name);
-                found = true;
-            }
-        }
-    }
+    // Depth first from the root, mounted volumes included
+    shell_strncpy(g_find_path, "/", sizeof(g_find_path));
+    bool found = find_in_directory(argv[1], 1, 0);
     
     if (!found) {
         printf("No files found matching '%s'\n", argv[1]);
@@ -904,47 +1012,52 @@ int cmd_find(int argc, char* argv[]) {
     return 0;
 }
 
+// Bounded substring search, lines in a mapped file are not NUL terminated
+static bool line_contains(const char* line, uint32_t length, const char* pattern) {
+    uint32_t pattern_len = shell_strlen(pattern);
+    if (pattern_len > length) return false;
+    
+    for (uint32_t i = 0; i + pattern_len <= length; i++) {
+        uint32_t j = 0;
+        while (j < pattern_len && line[i + j] == pattern[j]) j++;
+        if (j == pattern_len) return true;
+    }
+    return false;
+}
+
 int cmd_grep(int argc, char* argv[]) {
     if (argc < 3) {
         printf("Usage: grep <pattern> <filename>\n");
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    char buffer[MAX_FILE_SIZE];
-    int bytes_read = ramfs_read_file(argv[2], buffer, sizeof(buffer) - 1);
-    
-    if (bytes_read < 0) {
+    const char* data;
+    uint32_t size;
+    if (fs_map_file(argv[2], &data, &size) != SYSCALL_OK) {
         printf("grep: Cannot read '%s'\n", argv[2]);
         return 1;
     }
     
-    buffer[bytes_read] = '\0';
-    
-    // Search line by line
-    char* line_start = buffer;
+    // Search line by line in place, lines of any length
     int line_num = 1;
     bool found = false;
+    uint32_t start = 0;
     
-    while (*line_start) {
-        char* line_end = shell_strchr(line_start, '\n');
+    while (start < size) {
+        uint32_t end = start;
+        while (end < size && data[end] != '\n') end++;
         
-        if (line_end) {
-            *line_end = '\0';
-        }
-        
-        if (shell_strstr(line_start, argv[1]) != NULL) {
-            printf("%d: %s\n", line_num, line_start);
+        if (line_contains(data + start, end - start, argv[1])) {
+            printf("%d: ", line_num);
+            vfs_write(VFS_FD_STDOUT, data + start, end - start);
+            printf("\n");
             found = true;
         }
         
-        if (!line_end) break;
-        
-        *line_end = '\n';
-        line_start = line_end + 1;
         line_num++;
+        start = end + 1;
     }
+    fs_unmap_file(data);
     
     if (!found) {
         printf("Pattern '%s' not found in '%s'\n", argv[1], argv[2]);
@@ -959,27 +1072,22 @@ int cmd_wc(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
-    char buffer[MAX_FILE_SIZE];
-    int bytes_read = ramfs_read_file(argv[1], buffer, sizeof(buffer) - 1);
-    
-    if (bytes_read < 0) {
+    const char* data;
+    uint32_t size;
+    if (fs_map_file(argv[1], &data, &size) != SYSCALL_OK) {
         printf("wc: Cannot read '%s'\n", argv[1]);
         return 1;
     }
     
-    buffer[bytes_read] = '\0';
-    
-    int lines = 0, words = 0, chars = bytes_read;
+    int lines = 0, words = 0, chars = size;
     bool in_word = false;
     
-    for (int i = 0; i < bytes_read; i++) {
-        if (buffer[i] == '\n') {
+    for (uint32_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
             lines++;
         }
         
-        if (buffer[i] == ' ' || buffer[i] == '\t' || buffer[i] == '\n') {
+        if (data[i] == ' ' || data[i] == '\t' || data[i] == '\n') {
             if (in_word) {
                 words++;
                 in_word = false;
@@ -988,6 +1096,7 @@ int cmd_wc(int argc, char* argv[]) {
             in_word = true;
         }
     }
+    fs_unmap_file(data);
     
     // Count last word if file doesn't end with whitespace
     if (in_word) {
@@ -1005,17 +1114,17 @@ int cmd_touch(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
     // Check if file exists
-    if (ramfs_find_file(argv[1], g_ramfs.current_dir) >= 0) {
+    VfsStat stat;
+    if (vfs_stat(argv[1], &stat) == SYSCALL_OK) {
         printf("File '%s' already exists\n", argv[1]);
         return 0;
     }
     
     // Create empty file
-    int result = ramfs_write_file(argv[1], "", 0);
-    if (result >= 0) {
+    fd_t file = vfs_open(argv[1], OPEN_WRITE | OPEN_CREATE);
+    int result = file < 0 ? file : vfs_close(file);
+    if (result == SYSCALL_OK) {
         printf("Empty file '%s' created\n", argv[1]);
         return 0;
     } else {
@@ -1030,13 +1139,18 @@ int cmd_edit(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
     char* filename = argv[1];
     
+    // The editor works on one buffer, larger files would be cut short on save
+    VfsStat existing;
+    if (vfs_stat(filename, &existing) == SYSCALL_OK && !existing.IsDirectory && existing.Size >= MAX_EDIT_SIZE) {
+        printf("edit: '%s' is too large to edit (%u bytes)\n", filename, existing.Size);
+        return 1;
+    }
+    
     // Try to read existing file
-    char buffer[MAX_FILE_SIZE];
-    int bytes_read = ramfs_read_file(filename, buffer, sizeof(buffer) - 1);
+    char buffer[MAX_EDIT_SIZE];
+    int bytes_read = fs_read_file(filename, buffer, sizeof(buffer) - 1);
     
     if (bytes_read >= 0) {
         buffer[bytes_read] = '\0';
@@ -1050,7 +1164,7 @@ int cmd_edit(int argc, char* argv[]) {
     printf("\n=== Simple Editor ===\n");
     printf("Enter text (type 'SAVE' on new line to save, 'QUIT' to exit):\n\n");
     
-    char edit_buffer[MAX_FILE_SIZE];
+    char edit_buffer[MAX_EDIT_SIZE];
     int content_length = 0;
     char line_buffer[256];
     
@@ -1104,7 +1218,7 @@ int cmd_edit(int argc, char* argv[]) {
         line_buffer[i] = '\0';
         
         if (shell_strcmp(line_buffer, "SAVE") == 0) {
-            int result = ramfs_write_file(filename, edit_buffer, content_length);
+            int result = fs_write_file(filename, edit_buffer, content_length);
             if (result >= 0) {
                 printf("File '%s' saved (%d bytes)\n", filename, result);
             } else {
@@ -1118,13 +1232,13 @@ int cmd_edit(int argc, char* argv[]) {
         
         // Add line to buffer
         int line_len = shell_strlen(line_buffer);
-        if (content_length + line_len + 2 < MAX_FILE_SIZE) {
+        if (content_length + line_len + 2 < MAX_EDIT_SIZE) {
             shell_memcpy(edit_buffer + content_length, line_buffer, line_len);
             content_length += line_len;
             edit_buffer[content_length++] = '\n';
             edit_buffer[content_length] = '\0';
         } else {
-            printf("Error: File size limit reached (%d bytes)\n", MAX_FILE_SIZE);
+            printf("Error: File size limit reached (%d bytes)\n", MAX_EDIT_SIZE);
             break;
         }
     }
@@ -1204,8 +1318,6 @@ int cmd_hexdump(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!g_ramfs.initialized) ramfs_init();
-    
     // Check if it's a memory address (starts with 0x) or filename
     if (argv[1][0] == '0' && argv[1][1] == 'x') {
         // Memory dump
@@ -1221,6 +1333,12 @@ int cmd_hexdump(int argc, char* argv[]) {
             length = 4096;
         }
         
+        // Reading outside the page tables would fault
+        if (!vmm_is_mapped(address) || (length > 0 && !vmm_is_mapped(address + length - 1))) {
+            printf("hexdump: 0x%X is not mapped\n", address);
+            return 1;
+        }
+        
         printf("Hexdump of memory at 0x%X (%d bytes):\n\n", address, length);
         
         uint8_t* memory = (uint8_t*)address;
@@ -1250,41 +1368,40 @@ int cmd_hexdump(int argc, char* argv[]) {
             offset += 16;
         }
     } else {
-        // File dump
-        char buffer[MAX_FILE_SIZE];
-        int bytes_read = ramfs_read_file(argv[1], buffer, sizeof(buffer));
-        
-        if (bytes_read < 0) {
+        // File dump, a row at a time straight from the mapped file
+        const uint8_t* data;
+        uint32_t size;
+        if (fs_map_file(argv[1], (const char**)&data, &size) != SYSCALL_OK) {
             printf("hexdump: Cannot read '%s'\n", argv[1]);
             return 1;
         }
         
-        printf("Hexdump of file '%s' (%d bytes):\n\n", argv[1], bytes_read);
+        printf("Hexdump of file '%s' (%d bytes):\n\n", argv[1], size);
         
-        uint32_t offset = 0;
-        while (offset < bytes_read) {
+        for (uint32_t offset = 0; offset < size; offset += 16) {
+            const uint8_t* row = data + offset;
+            uint32_t row_len = size - offset < 16 ? size - offset : 16;
             printf("%x  ", offset);
             
-            for (int i = 0; i < 16 && offset + i < bytes_read; i++) {
-                printf("%x ", (uint8_t)buffer[offset + i]);
+            for (uint32_t i = 0; i < row_len; i++) {
+                printf("%x ", row[i]);
                 if (i == 7) printf(" ");
             }
             
-            for (int i = offset + 16 > bytes_read ? bytes_read - offset : 16; i < 16; i++) {
+            for (uint32_t i = row_len; i < 16; i++) {
                 printf("   ");
                 if (i == 7) printf(" ");
             }
             
             printf(" |");
             
-            for (int i = 0; i < 16 && offset + i < bytes_read; i++) {
-                uint8_t byte = (uint8_t)buffer[offset + i];
-                printf("%c", (byte >= 32 && byte <= 126) ? byte : '.');
+            for (uint32_t i = 0; i < row_len; i++) {
+                printf("%c", (row[i] >= 32 && row[i] <= 126) ? row[i] : '.');
             }
             
             printf("|\n");
-            offset += 16;
         }
+        fs_unmap_file((const char*)data);
     }
     
     return 0;
@@ -1329,6 +1446,184 @@ int cmd_keytest(int argc, char* argv[]) {
     return 0;
 }
 
+#define BENCH_SYSCALL_CALLS 100000
+#define BENCH_DISK_SECTORS  8192        // 4MB per run
+#define BENCH_DISK_CHUNK    ATA_DMA_MAX_SECTORS
+#define BENCH_PROGRAM_DIR   "/disk/bin"
+#define BENCH_INTERRUPTS    100000
+#define BENCH_ISR_VECTOR    0x81        // unused, goes through isr_common
+#define BENCH_SMP_CHUNKS    64
+#define BENCH_SMP_ROUNDS    200000
+#define BENCH_MUTEX_ROUNDS  2000
+#define BENCH_MUTEX_HOLD    50          // delay loop iterations with the mutex held
+
+// Average round trip of getpid in nanoseconds, through SYSENTER or int 0x80
+static uint32_t benchmark_syscall(bool fast) {
+    uint64_t start = x86_ReadTsc();
+    for (uint32_t i = 0; i < BENCH_SYSCALL_CALLS; i++) {
+        if (fast) sys_fast_syscall(SYSCALL_GETPID, 0, 0, 0, 0);
+        else SYSCALL0(SYSCALL_GETPID);
+    }
+    uint64_t us = time_tsc_to_us(x86_ReadTsc() - start);
+    return (uint32_t)(us * 1000 / BENCH_SYSCALL_CALLS);
+}
+
+static void benchmark_interrupt_handler(Registers* regs) {
+}
+
+// Cycles per software interrupt and return with an empty handler, through the
+// IRQ entry stub (on its test vector, so no EOI goes out and no IRQ line is
+// counted) or through the generic ISR path
+static uint32_t benchmark_interrupt(bool irq) {
+    uint64_t start = x86_ReadTsc();
+    for (uint32_t i = 0; i < BENCH_INTERRUPTS; i++) {
+        if (irq) __asm__ volatile("int %0" : : "i"(IRQ_TEST_VECTOR) : "memory");
+        else __asm__ volatile("int $0x81" ::: "memory");
+    }
+    return (uint32_t)((x86_ReadTsc() - start) / BENCH_INTERRUPTS);
+}
+
+typedef struct {
+    uint32_t Seed;
+    uint32_t Result;
+} BenchSmpChunk;
+
+static void benchmark_smp_chunk(void* data) {
+    BenchSmpChunk* chunk = (BenchSmpChunk*)data;
+    uint32_t x = chunk->Seed;
+    for (uint32_t i = 0; i < BENCH_SMP_ROUNDS; i++) {
+        x = x * 1103515245 + 12345;
+        x ^= x >> 7;
+    }
+    chunk->Result = x;
+}
+
+// Microseconds for every chunk, run one after another here or queued on all CPUs
+static uint32_t benchmark_smp(bool parallel) {
+    static BenchSmpChunk chunks[BENCH_SMP_CHUNKS];
+    static SmpWork work[BENCH_SMP_CHUNKS];
+
+    uint64_t start = x86_ReadTsc();
+    for (uint32_t i = 0; i < BENCH_SMP_CHUNKS; i++) {
+        chunks[i].Seed = i;
+        if (parallel) {
+            work[i].Function = benchmark_smp_chunk;
+            work[i].Data = &chunks[i];
+            smp_submit(&work[i]);
+        } else {
+            benchmark_smp_chunk(&chunks[i]);
+        }
+    }
+    if (parallel) {
+        for (uint32_t i = 0; i < BENCH_SMP_CHUNKS; i++) smp_wait(&work[i]);
+    }
+    return (uint32_t)time_tsc_to_us(x86_ReadTsc() - start);
+}
+
+static Mutex g_BenchMutex = MUTEX_INIT("benchmark");
+static volatile uint32_t g_BenchMutexCount = 0;
+
+// Read, wait and write back under the mutex, so a second owner would lose updates.
+// Holding it a while makes the other CPUs find it taken and halt until handed over.
+static void benchmark_mutex_chunk(void* data) {
+    for (uint32_t i = 0; i < BENCH_MUTEX_ROUNDS; i++) {
+        mutex_lock(&g_BenchMutex);
+        uint32_t count = g_BenchMutexCount;
+        for (volatile uint32_t j = 0; j < BENCH_MUTEX_HOLD; j++) ;
+        g_BenchMutexCount = count + 1;
+        mutex_unlock(&g_BenchMutex);
+    }
+}
+
+// Every chunk on all CPUs, returns the microseconds and whether no update was lost
+static uint32_t benchmark_mutex(bool* exact) {
+    static SmpWork work[BENCH_SMP_CHUNKS];
+
+    g_BenchMutexCount = 0;
+    uint64_t start = x86_ReadTsc();
+    for (uint32_t i = 0; i < BENCH_SMP_CHUNKS; i++) {
+        work[i].Function = benchmark_mutex_chunk;
+        work[i].Data = NULL;
+        smp_submit(&work[i]);
+    }
+    for (uint32_t i = 0; i < BENCH_SMP_CHUNKS; i++) smp_wait(&work[i]);
+    *exact = g_BenchMutexCount == BENCH_SMP_CHUNKS * BENCH_MUTEX_ROUNDS;
+    return (uint32_t)time_tsc_to_us(x86_ReadTsc() - start);
+}
+
+// Reads the start of the drive in the given mode and returns the throughput in KB/s, 0 on failure
+static uint32_t benchmark_disk_read(ATADrive* drive, bool dma, void* buffer, uint32_t sectors) {
+    bool oldMode = drive->UseDma;
+    drive->UseDma = dma;
+
+    uint64_t start = x86_ReadTsc();
+    bool ok = true;
+    for (uint32_t lba = 0; lba < sectors && ok; lba += BENCH_DISK_CHUNK) {
+        uint32_t count = sectors - lba < BENCH_DISK_CHUNK ? sectors - lba : BENCH_DISK_CHUNK;
+        ok = ata_read_sectors(drive, lba, count, buffer);
+    }
+    uint64_t us = time_tsc_to_us(x86_ReadTsc() - start);
+
+    drive->UseDma = oldMode;
+    if (!ok || us == 0) return 0;
+    return (uint32_t)((uint64_t)sectors * ATA_SECTOR_SIZE * 1000000 / 1024 / us);
+}
+
+// Runs forktest.elf, which times fork and fork+exec itself, and reports the
+// pages fork shared against the ones that had to be copied. Drives that can
+// are switched to DMA and the cache is dropped, so its pages come in through
+// DMA while the page faults run with interrupts off.
+static void benchmark_fork(const char* dir) {
+    char cwd[VFS_MAX_PATH];
+    strcpy(cwd, vfs_getcwd());
+    if (vfs_chdir(dir) != SYSCALL_OK) {
+        printf("SKIPPED (no %s, mount the boot disk first)\n", dir);
+        return;
+    }
+    
+    bool oldMode[ATA_MAX_DRIVES];
+    bool dma = false;
+    for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+        ATADrive* drive = ata_get_drive(i);
+        if (drive == NULL) continue;
+        oldMode[i] = drive->UseDma;
+        drive->UseDma = drive->DmaCapable;
+        dma |= drive->DmaCapable;
+    }
+    bcache_sync(NULL);
+    for (int i = 0; i < blockdev_get_count(); i++) bcache_invalidate(blockdev_get(i));
+    printf("forktest.elf from %s, disk in %s mode\n", dir, dma ? "DMA" : "PIO");
+    
+    VmmCowStats before, after;
+    vmm_get_cow_stats(&before);
+    uint32_t freeBefore = pmm_get_free_frames();
+    uint64_t start = x86_ReadTsc();
+    
+    int32_t status = 0;
+    int pid = process_exec("forktest.elf");
+    uint64_t us = time_tsc_to_us(x86_ReadTsc() - start);
+    if (pid >= 0) process_wait(pid, (int*)&status);
+    
+    vmm_get_cow_stats(&after);
+    vfs_chdir(cwd);
+    for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+        ATADrive* drive = ata_get_drive(i);
+        if (drive != NULL) drive->UseDma = oldMode[i];
+    }
+    
+    if (pid < 0 || status != 0) {
+        printf("   FAILED (error %d, exit code %d)\n", pid, status);
+        return;
+    }
+    
+    uint32_t shared = after.SharedPages - before.SharedPages;
+    uint32_t copied = after.CopiedPages - before.CopiedPages;
+    printf("   Total: %u us\n", (uint32_t)us);
+    printf("   Pages shared: %u, copied: %u, reclaimed: %u (%u KB not copied)\n",
+           shared, copied, after.ReclaimedPages - before.ReclaimedPages, (shared - copied) * 4);
+    printf("   Frames not returned: %d\n", (int)(freeBefore - pmm_get_free_frames()));
+}
+
 int cmd_benchmark(int argc, char* argv[]) {
     printf("Running CPU benchmark suite...\n\n");
     
@@ -1342,12 +1637,18 @@ int cmd_benchmark(int argc, char* argv[]) {
     
     // Memory Test
     printf("2. Memory access test: ");
-    volatile uint8_t* mem = (volatile uint8_t*)0x200000;
-    for (uint32_t i = 0; i < 100000; i++) {
-        mem[i % 1024] = (uint8_t)(i & 0xFF);
-        result += mem[i % 1024];
+    uint32_t frame = pmm_alloc_frame();
+    if (frame != 0) {
+        volatile uint8_t* mem = (volatile uint8_t*)frame;
+        for (uint32_t i = 0; i < 100000; i++) {
+            mem[i % 1024] = (uint8_t)(i & 0xFF);
+            result += mem[i % 1024];
+        }
+        pmm_free_frame(frame);
+        printf("DONE\n");
+    } else {
+        printf("SKIPPED (out of memory)\n");
     }
-    printf("DONE\n");
     
     // Function Call Testing
     printf("3. Function call test: ");
@@ -1365,10 +1666,152 @@ int cmd_benchmark(int argc, char* argv[]) {
     }
     printf("DONE\n");
     
+    // Syscall Round Trip Test
+    printf("5. Syscall round trip test: %u calls\n", BENCH_SYSCALL_CALLS);
+    uint32_t trap = benchmark_syscall(false);
+    printf("   int 0x80: %u ns\n", trap);
+    if (i686_Sysenter_Available()) {
+        uint32_t fast = benchmark_syscall(true);
+        printf("   SYSENTER: %u ns", fast);
+        if (fast != 0) printf(" (%u.%u x faster)", trap / fast, (trap * 10 / fast) % 10);
+        printf("\n");
+    } else {
+        printf("   SYSENTER: not available\n");
+    }
+    
+    // Disk Throughput Test
+    printf("6. Disk throughput test: ");
+    ATADrive* drive = NULL;
+    for (int i = 0; i < ATA_MAX_DRIVES && drive == NULL; i++) {
+        drive = ata_get_drive(i);
+    }
+    
+    uint32_t bufferFrames = BENCH_DISK_CHUNK * ATA_SECTOR_SIZE / PMM_FRAME_SIZE;
+    uint32_t buffer = drive != NULL ? pmm_alloc_frames(bufferFrames) : 0;
+    if (drive == NULL) {
+        printf("SKIPPED (no ATA drive)\n");
+    } else if (buffer == 0) {
+        printf("SKIPPED (out of memory)\n");
+    } else {
+        uint32_t sectors = drive->SectorCount < BENCH_DISK_SECTORS ? (uint32_t)drive->SectorCount : BENCH_DISK_SECTORS;
+        printf("%u KB from %s\n", sectors / 2, drive->Model);
+        
+        uint32_t pio = benchmark_disk_read(drive, false, (void*)buffer, sectors);
+        printf("   PIO: %u KB/s\n", pio);
+        
+        if (drive->DmaCapable) {
+            uint32_t dma = benchmark_disk_read(drive, true, (void*)buffer, sectors);
+            printf("   DMA: %u KB/s", dma);
+            if (pio != 0) printf(" (%u.%u x PIO)", dma / pio, (dma * 10 / pio) % 10);
+            printf("\n");
+        } else {
+            printf("   DMA: not available\n");
+        }
+        
+        pmm_free_frames(buffer, bufferFrames);
+    }
+    
+    // Process Creation Test
+    printf("7. Fork and exec test: ");
+    benchmark_fork(argc > 1 ? argv[1] : BENCH_PROGRAM_DIR);
+    
+    // Interrupt Entry/Exit Test
+    printf("8. Interrupt entry/exit test: %u interrupts\n", BENCH_INTERRUPTS);
+    i686_ISR_RegisterHandler(BENCH_ISR_VECTOR, benchmark_interrupt_handler);
+    i686_IRQ_RegisterTestHandler(benchmark_interrupt_handler);
+    uint32_t generic = benchmark_interrupt(false);
+    uint32_t stub = benchmark_interrupt(true);
+    i686_IRQ_RegisterTestHandler(NULL);
+    i686_ISR_RegisterHandler(BENCH_ISR_VECTOR, NULL);
+    printf("   ISR path: %u cycles\n", generic);
+    printf("   IRQ stub: %u cycles", stub);
+    if (stub != 0) printf(" (%u.%u x faster)", generic / stub, (generic * 10 / stub) % 10);
+    printf("\n");
+    
+    // Multiprocessor Scaling Test
+    printf("9. SMP scaling test: %u chunks on %u CPUs\n", BENCH_SMP_CHUNKS, smp_cpu_count());
+    uint32_t serial = benchmark_smp(false);
+    uint32_t parallel = benchmark_smp(true);
+    printf("   One CPU: %u us\n", serial);
+    printf("   All CPUs: %u us", parallel);
+    if (parallel != 0) printf(" (%u.%u x faster)", serial / parallel, (serial * 10 / parallel) % 10);
+    printf("\n");
+    
+    // Mutex Contention Test
+    printf("10. Mutex contention test: %u locks on %u CPUs\n", BENCH_SMP_CHUNKS * BENCH_MUTEX_ROUNDS, smp_cpu_count());
+    LockStats before = g_BenchMutex.Stats;
+    bool exact;
+    uint32_t mutexUs = benchmark_mutex(&exact);
+    uint32_t contended = g_BenchMutex.Stats.Contended - before.Contended;
+    uint64_t waited = g_BenchMutex.Stats.WaitCycles - before.WaitCycles;
+    printf("   Total: %u us, %u waited for it (%u cycles on average)\n", mutexUs, contended,
+           contended ? (uint32_t)(waited / contended) : 0);
+    if (!exact) printf("   FAILED (count %u, updates were lost)\n", g_BenchMutexCount);
+    
     printf("\nBenchmark completed successfully\n");
     return 0;
 }
 
+int cmd_ata(int argc, char* argv[]) {
+    if (argc < 2) {
+        if (ata_get_drive_count() == 0) {
+            printf("No ATA drives found\n");
+            return 0;
+        }
+
+        for (int i = 0; i < ATA_MAX_DRIVES; i++) {
+            ATADrive* drive = ata_get_drive(i);
+            if (drive == NULL) continue;
+
+            printf("ata%d: %s\n", i, drive->Model);
+            printf("  %llu sectors (%u MB), LBA%d, %u sectors per block, %s\n", drive->SectorCount,
+                   (uint32_t)(drive->SectorCount / 2048), drive->Lba48 ? 48 : 28, drive->MultipleSectors,
+                   drive->UseDma ? "DMA" : "PIO");
+        }
+        return 0;
+    }
+
+    if (argc < 4 || shell_strcmp(argv[1], "read") != 0) {
+        printf("Usage: ata [read <drive> <lba>]\n");
+        printf("Examples:\n");
+        printf("  ata               - List detected drives\n");
+        printf("  ata read 0 0      - Dump the first sector of ata0\n");
+        return 1;
+    }
+
+    ATADrive* drive = ata_get_drive(dec_str_to_int(argv[2]));
+    if (drive == NULL) {
+        printf("ata: No drive %s\n", argv[2]);
+        return 1;
+    }
+
+    uint32_t lba = dec_str_to_int(argv[3]);
+    uint8_t sector[ATA_SECTOR_SIZE];
+    if (!ata_read_sectors(drive, lba, 1, sector)) {
+        printf("ata: Read of LBA %u failed\n", lba);
+        return 1;
+    }
+
+    printf("ata%s LBA %u:\n\n", argv[2], lba);
+    for (uint32_t offset = 0; offset < ATA_SECTOR_SIZE; offset += 16) {
+        printf("%x  ", offset);
+
+        for (int i = 0; i < 16; i++) {
+            printf("%x ", sector[offset + i]);
+            if (i == 7) printf(" ");
+        }
+
+        printf(" |");
+        for (int i = 0; i < 16; i++) {
+            uint8_t byte = sector[offset + i];
+            printf("%c", (byte >= 32 && byte <= 126) ? byte : '.');
+        }
+        printf("|\n");
+    }
+
+    return 0;
+}
+
 int cmd_registers(int argc, char* argv[]) {
     uint32_t eax, ebx, ecx, edx, esp, ebp, esi, edi, eflags;
     
@@ -1427,6 +1870,7 @@ int cmd_syscall_test(int argc, char* argv[]) {
         printf("  memory    - Test malloc/free operations\n");
         printf("  heap      - Test heap integrity\n");
         printf("  stress    - Run stress tests\n");
+        printf("  user      - Run programs in ring 3\n");
         return 1;
     }
     
@@ -1471,6 +1915,9 @@ int cmd_syscall_test(int argc, char* argv[]) {
     } else if (shell_strcmp(argv[1], "heap") == 0) {
         syscall_test_heap_integrity();
         
+    } else if (shell_strcmp(argv[1], "user") == 0) {
+        syscall_test_usermode();
+        
     } else if (shell_strcmp(argv[1], "stress") == 0) {
         printf("=== Stress Test ===\n\n");
         
@@ -1591,12 +2038,69 @@ int cmd_sleep_test(int argc, char* argv[]) {
     return 0;
 }
 
+int cmd_exec(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: exec <program>\n");
+        printf("Example: exec /disk/bin/hello.elf\n");
+        return -1;
+    }
+    
+    int pid = sys_exec(argv[1]);
+    if (pid < 0) {
+        printf("exec: cannot run '%s' (error %d)\n", argv[1], pid);
+        return -1;
+    }
+    
+    // Still a zombie until the wait below
+    const Process* process = process_get_by_pid(pid);
+    uint32_t minor = process != NULL ? process->MinorFaults : 0;
+    uint32_t major = process != NULL ? process->MajorFaults : 0;
+    
+    int32_t status = 0;
+    sys_wait(pid, &status);
+    printf("[pid %d exited with %d, %u minor and %u major faults]\n", pid, status, minor, major);
+    return 0;
+}
+
+int cmd_ps(int argc, char* argv[]) {
+    static const char* states[] = { "free", "running", "waiting", "zombie" };
+    
+    printf("PID\tPPID\tSTATE\tMINFLT\tMAJFLT\tNAME\n");
+    printf("%d\t%d\t%s\t%u\t%u\t%s\n", PROCESS_KERNEL_PID, 0, "running", 0, 0, "kernel");
+    
+    for (int i = 0; i < PROCESS_MAX; i++) {
+        const Process* process = process_get(i);
+        if (process->State == PROCESS_FREE) continue;
+        
+        printf("%d\t%d\t%s\t%u\t%u\t%s\n", process->Pid, process->ParentPid,
+               states[process->State], process->MinorFaults, process->MajorFaults, process->Name);
+    }
+    return 0;
+}
+
+int cmd_kill(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: kill <pid>\n");
+        return -1;
+    }
+    
+    int pid = dec_str_to_int(argv[1]);
+    int result = sys_kill(pid);
+    if (result != SYSCALL_OK) {
+        printf("kill: cannot kill pid %d (error %d)\n", pid, result);
+        return -1;
+    }
+    return 0;
+}
+
 //
 // System Control Commands
 //
 
 int cmd_reboot(int argc, char* argv[]) {
     printf("Rebooting system...\n");
+    vfs_sync();
+    bcache_sync(NULL);
     printf("Goodbye!\n");
     
     // Use the keyboard port for reboot
@@ -1652,8 +2156,13 @@ const ShellCommandEntry shell_commands[] = {
     {"cpuinfo",         "Show CPU information",                             cmd_cpuinfo},
     {"cpuid",           "Show detailed CPU information via CPUID",          cmd_cpuid},
     {"dmesg",           "Show kernel messages",                             cmd_dmesg},
+    {"bcache",          "Show buffer cache statistics",                     cmd_bcache},
+    {"iostat",          "Show block request queue statistics",              cmd_iostat},
+    {"irqstat",         "Show interrupt counts and latency histograms",     cmd_irqstat},
+    {"cpus",            "Show online CPUs and their utilization",           cmd_cpus},
+    {"lockstat",        "Show kernel lock contention",                      cmd_lockstat},
     
-    // File System (RAM-based)
+    // File System (tmpfs)
     {"ls",              "List directory contents",                          cmd_ls},
     {"cd",              "Change directory",                                 cmd_cd},
     {"pwd",             "Print working directory",                          cmd_pwd},
@@ -1665,20 +2174,27 @@ const ShellCommandEntry shell_commands[] = {
     {"find",            "Find files by name pattern",                       cmd_find},
     {"grep",            "Search text in files",                             cmd_grep},
     {"wc",              "Count lines, words and characters",                cmd_wc},
+    {"mount",           "Mount a FAT disk into the file system",            cmd_mount},
+    {"umount",          "Unmount a disk",                                   cmd_umount},
+    {"df",              "Show RAM file system usage",                       cmd_df},
     
     // Hardware & Debug
     {"memtest",         "Run basic memory test",                            cmd_memtest},
     {"interrupt",       "Control interrupt state",                          cmd_interrupt},
     {"hexdump",         "Display file/memory in hexadecimal",               cmd_hexdump},
     {"keytest",         "Test keyboard input (shows scancodes)",            cmd_keytest},
-    {"benchmark",       "Run CPU benchmark",                                cmd_benchmark},
+    {"benchmark",       "Run CPU, memory and disk benchmarks",              cmd_benchmark},
     {"registers",       "Show CPU register values",                         cmd_registers},
+    {"ata",             "List ATA drives or dump a sector",                 cmd_ata},
     
     // System Calls
     {"syscall_test",    "Test system call functionality",                   cmd_syscall_test},
     {"malloc_test",     "Test memory allocation via syscall",               cmd_malloc_test},
     {"heap_info",       "Show heap information and test",                   cmd_heap_info},
     {"sleep",           "Test sleep syscall",                               cmd_sleep_test},
+    {"exec",            "Run an ELF program from disk",                     cmd_exec},
+    {"ps",              "List processes",                                   cmd_ps},
+    {"kill",            "Terminate a process",                              cmd_kill},
     
     // System Control
     {"reboot",          "Restart the system",                               cmd_reboot},
@@ -1710,6 +2226,8 @@ const ShellCommandEntry* find_shell_command(const char* name) {
 
 int cmd_exit(int argc, char* argv[]) {
     printf("Shutting down...\n");
+    vfs_sync();
+    bcache_sync(NULL);
 
     i686_outb(0x604, 0x00);
     i686_outb(0x605, 0x20);
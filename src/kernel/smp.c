@@ -0,0 +1,274 @@
+#include <smp.h>
+#include <apic.h>
+#include <gdt.h>
+#include <idt.h>
+#include <isr.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <time.h>
+#include <memory.h>
+#include <debug.h>
+
+#define MODULE "SMP"
+
+// INIT, then up to two startup IPIs, as the MP specification has it
+#define SMP_INIT_DELAY_US       10000
+#define SMP_STARTUP_DELAY_US    200
+#define SMP_ONLINE_TIMEOUT_US   100000
+
+// Laid out like i686_SmpTrampolineParams in smp_trampoline.asm
+typedef struct {
+    uint32_t Cr0;
+    uint32_t Cr3;
+    uint32_t Cr4;
+    uint32_t Stack;
+    Cpu* Cpu;
+    uint32_t Entry;
+} __attribute__((packed)) SmpTrampolineParams;
+
+// Only their addresses matter
+void i686_SmpTrampoline(void);
+void i686_SmpTrampolineParams(void);
+void i686_SmpTrampolineEnd(void);
+
+// The boot CPU's entry is set up statically, the GDT loads gs with it before anything else runs
+static Cpu g_Cpus[SMP_MAX_CPUS] = {
+    [0] = { .Self = &g_Cpus[0], .Index = 0, .Online = true, .QueueLock = SPINLOCK_INIT("run queue") },
+};
+static uint32_t g_CpuCount = 1;
+static uint32_t g_SubmitNext = 0;      // where the search for the shortest queue starts
+
+static void smp_delay_us(uint32_t us)
+{
+    uint64_t end = x86_ReadTsc() + (uint64_t)time_get_tsc_khz() * us / 1000;
+    while (x86_ReadTsc() < end)
+        __asm__ volatile ("pause");
+}
+
+static void smp_push(Cpu* cpu, SmpWork* work)
+{
+    work->Next = NULL;
+    work->Done = false;
+
+    // With interrupts off, an interrupted holder would keep the other CPUs spinning
+    uint32_t flags = spin_lock_irqsave(&cpu->QueueLock);
+    if (cpu->QueueTail != NULL)
+        cpu->QueueTail->Next = work;
+    else
+        cpu->QueueHead = work;
+    cpu->QueueTail = work;
+    cpu->QueueLength++;
+    spin_unlock_irqrestore(&cpu->QueueLock, flags);
+}
+
+static SmpWork* smp_pop(Cpu* cpu)
+{
+    // Unlocked look first, so idle CPUs don't fight over empty queues
+    if (cpu->QueueLength == 0)
+        return NULL;
+
+    uint32_t flags = spin_lock_irqsave(&cpu->QueueLock);
+    SmpWork* work = cpu->QueueHead;
+    if (work != NULL) {
+        cpu->QueueHead = work->Next;
+        if (cpu->QueueHead == NULL)
+            cpu->QueueTail = NULL;
+        cpu->QueueLength--;
+    }
+    spin_unlock_irqrestore(&cpu->QueueLock, flags);
+    return work;
+}
+
+// The CPU's own queue first, then the oldest work of the longest other one
+static SmpWork* smp_take(Cpu* cpu)
+{
+    SmpWork* work = smp_pop(cpu);
+    if (work != NULL)
+        return work;
+
+    Cpu* victim = NULL;
+    for (uint32_t i = 0; i < g_CpuCount; i++) {
+        Cpu* other = &g_Cpus[i];
+        if (other != cpu && other->QueueLength > (victim != NULL ? victim->QueueLength : 0))
+            victim = other;
+    }
+    if (victim == NULL)
+        return NULL;
+
+    work = smp_pop(victim);
+    if (work != NULL)
+        cpu->WorkStolen++;
+    return work;
+}
+
+static void smp_run(Cpu* cpu, SmpWork* work)
+{
+    uint64_t start = x86_ReadTsc();
+    work->Function(work->Data);
+    cpu->BusyCycles += x86_ReadTsc() - start;
+    cpu->WorkDone++;
+
+    // The waiter may reuse work as soon as it sees Done
+    __sync_synchronize();
+    work->Done = true;
+}
+
+static void smp_ipi_wake(Registers* regs)
+{
+    cpu_current()->IpisReceived++;
+    apic_EndOfInterrupt();
+}
+
+static void smp_idle(Cpu* cpu)
+{
+    for (;;) {
+        SmpWork* work = smp_take(cpu);
+        if (work != NULL) {
+            smp_run(cpu, work);
+            continue;
+        }
+
+        // Work queued after the check sends an IPI, which sti lets in only once hlt waits
+        __asm__ volatile ("cli");
+        if (cpu->QueueLength == 0)
+            __asm__ volatile ("sti\n\thlt" : : : "memory");
+        else
+            __asm__ volatile ("sti");
+    }
+}
+
+// Called by the trampoline on the AP's own stack, with paging on
+void __attribute__((cdecl)) smp_ap_main(Cpu* cpu)
+{
+    i686_GDT_InitializeCpu(cpu->Index, cpu);
+    i686_IDT_Initialize();
+    apic_InitializeCpu();
+
+    cpu->OnlineTsc = x86_ReadTsc();
+    __sync_synchronize();
+    cpu->Online = true;
+
+    smp_idle(cpu);
+}
+
+static bool smp_start_cpu(Cpu* cpu, SmpTrampolineParams* params)
+{
+    uint32_t stack = pmm_alloc_frames(SMP_AP_STACK_FRAMES);
+    if (stack == 0) {
+        log_warn(MODULE, "No memory for the stack of CPU %u", cpu->Index);
+        return false;
+    }
+
+    uint32_t cr0, cr4;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    params->Cr0 = cr0;
+    params->Cr3 = vmm_get_kernel_address_space();
+    params->Cr4 = cr4;
+    params->Stack = stack + SMP_AP_STACK_FRAMES * PMM_FRAME_SIZE;
+    params->Cpu = cpu;
+    params->Entry = (uint32_t)smp_ap_main;
+
+    apic_SendInit(cpu->ApicId);
+    smp_delay_us(SMP_INIT_DELAY_US);
+    for (int attempt = 0; attempt < 2 && !cpu->Online; attempt++) {
+        apic_SendStartup(cpu->ApicId, SMP_TRAMPOLINE_BASE);
+        smp_delay_us(SMP_STARTUP_DELAY_US);
+    }
+
+    uint64_t deadline = x86_ReadTsc() + (uint64_t)time_get_tsc_khz() * SMP_ONLINE_TIMEOUT_US / 1000;
+    while (!cpu->Online && x86_ReadTsc() < deadline)
+        __asm__ volatile ("pause");
+
+    // The stack stays allocated, a late start would still use it
+    return cpu->Online;
+}
+
+void smp_init(void)
+{
+    Cpu* boot = &g_Cpus[0];
+    boot->OnlineTsc = x86_ReadTsc();
+    i686_ISR_RegisterHandler(SMP_IPI_WAKE, smp_ipi_wake);
+
+    const AcpiMadt* madt = acpi_get_madt();
+    if (!apic_IsActive() || madt == NULL) {
+        log_info(MODULE, "No local APIC, running on one CPU");
+        return;
+    }
+    boot->ApicId = apic_GetLocalId();
+
+    uint32_t size = (uint32_t)i686_SmpTrampolineEnd - (uint32_t)i686_SmpTrampoline;
+    memcpy((void*)SMP_TRAMPOLINE_BASE, (const void*)i686_SmpTrampoline, size);
+    SmpTrampolineParams* params = (SmpTrampolineParams*)(SMP_TRAMPOLINE_BASE +
+        ((uint32_t)i686_SmpTrampolineParams - (uint32_t)i686_SmpTrampoline));
+
+    for (uint32_t i = 0; i < madt->CpuCount && g_CpuCount < SMP_MAX_CPUS; i++) {
+        if (madt->CpuApicIds[i] == boot->ApicId)
+            continue;
+
+        Cpu* cpu = &g_Cpus[g_CpuCount];
+        memset(cpu, 0, sizeof(Cpu));
+        cpu->Self = cpu;
+        cpu->Index = g_CpuCount;
+        spinlock_init(&cpu->QueueLock, "run queue");
+        cpu->ApicId = madt->CpuApicIds[i];
+
+        // One that doesn't answer might still run the trampoline later, so stop there
+        if (!smp_start_cpu(cpu, params)) {
+            log_warn(MODULE, "CPU with APIC id %u did not start", cpu->ApicId);
+            break;
+        }
+        g_CpuCount++;
+    }
+
+    log_info(MODULE, "%u of %u CPUs online", g_CpuCount, madt->CpuCount);
+}
+
+Cpu* smp_get_cpu(uint32_t index)
+{
+    return index < SMP_MAX_CPUS ? &g_Cpus[index] : NULL;
+}
+
+uint32_t smp_cpu_count(void)
+{
+    return g_CpuCount;
+}
+
+void smp_send_ipi(uint32_t cpu, uint8_t vector)
+{
+    if (cpu < g_CpuCount && apic_IsActive())
+        apic_SendIpi(g_Cpus[cpu].ApicId, vector);
+}
+
+void smp_submit_to(SmpWork* work, uint32_t index)
+{
+    Cpu* cpu = &g_Cpus[index < g_CpuCount ? index : 0];
+    smp_push(cpu, work);
+    if (cpu != cpu_current())
+        smp_send_ipi(cpu->Index, SMP_IPI_WAKE);
+}
+
+void smp_submit(SmpWork* work)
+{
+    // Starting after the last pick spreads work over CPUs with equal queues
+    uint32_t best = g_SubmitNext % g_CpuCount;
+    for (uint32_t i = 1; i < g_CpuCount; i++) {
+        uint32_t index = (g_SubmitNext + i) % g_CpuCount;
+        if (g_Cpus[index].QueueLength < g_Cpus[best].QueueLength)
+            best = index;
+    }
+    g_SubmitNext = best + 1;
+    smp_submit_to(work, best);
+}
+
+void smp_wait(SmpWork* work)
+{
+    Cpu* cpu = cpu_current();
+    while (!work->Done) {
+        SmpWork* other = smp_take(cpu);
+        if (other != NULL)
+            smp_run(cpu, other);
+        else
+            __asm__ volatile ("pause");
+    }
+}
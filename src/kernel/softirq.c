@@ -0,0 +1,145 @@
+#include <softirq.h>
+#include <time.h>
+#include <memory.h>
+#include <debug.h>
+
+#define MODULE "Softirq"
+
+#define EFLAGS_IF                   0x200
+#define SOFTIRQ_MAX_PASSES          8       // then the rest waits for the next IRQ
+
+static SoftirqHandler g_Handlers[SOFTIRQ_COUNT];
+static volatile uint32_t g_Pending = 0;
+static volatile bool g_Running = false;
+
+static Tasklet* g_TaskletHead = NULL;
+static Tasklet* g_TaskletTail = NULL;
+
+static IrqStats g_Stats;
+
+static inline uint32_t softirq_save_flags(void)
+{
+    uint32_t flags;
+    __asm__ volatile ("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void softirq_restore_flags(uint32_t flags)
+{
+    if (flags & EFLAGS_IF)
+        __asm__ volatile ("sti" : : : "memory");
+}
+
+static void softirq_record(IrqHistogram* histogram, uint64_t cycles)
+{
+    uint32_t value = cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles;
+    uint32_t bucket = value == 0 ? 0 : 31 - __builtin_clz(value);
+
+    histogram->Buckets[bucket]++;
+    histogram->Count++;
+    if (value > histogram->MaxCycles)
+        histogram->MaxCycles = value;
+}
+
+static void softirq_run_tasklets(void)
+{
+    // Take the whole list, tasklets scheduled meanwhile go on a fresh one
+    uint32_t flags = softirq_save_flags();
+    Tasklet* tasklet = g_TaskletHead;
+    g_TaskletHead = g_TaskletTail = NULL;
+    softirq_restore_flags(flags);
+
+    while (tasklet != NULL) {
+        Tasklet* next = tasklet->Next;
+        tasklet->Next = NULL;
+        tasklet->Scheduled = false;
+        tasklet->Function(tasklet->Data);
+        tasklet = next;
+    }
+}
+
+void softirq_register(SoftirqVector vector, SoftirqHandler handler)
+{
+    if (vector < SOFTIRQ_COUNT)
+        g_Handlers[vector] = handler;
+}
+
+void softirq_raise(SoftirqVector vector)
+{
+    __asm__ volatile ("lock orl %1, %0" : "+m"(g_Pending) : "r"(1u << vector) : "memory");
+}
+
+void softirq_run(void)
+{
+    uint32_t flags = softirq_save_flags();
+    if (g_Running || g_Pending == 0) {
+        softirq_restore_flags(flags);
+        return;
+    }
+    g_Running = true;
+
+    // IRQs that come in meanwhile only raise more work, this loop picks it up
+    for (int pass = 0; pass < SOFTIRQ_MAX_PASSES && g_Pending != 0; pass++) {
+        uint32_t pending = g_Pending;
+        g_Pending = 0;
+        __asm__ volatile ("sti" : : : "memory");
+
+        uint64_t start = x86_ReadTsc();
+        for (uint32_t vector = 0; vector < SOFTIRQ_COUNT; vector++) {
+            if (!(pending & (1u << vector)))
+                continue;
+
+            if (vector == SOFTIRQ_TASKLET)
+                softirq_run_tasklets();
+            else if (g_Handlers[vector] != NULL)
+                g_Handlers[vector]();
+        }
+        uint64_t cycles = x86_ReadTsc() - start;
+
+        __asm__ volatile ("cli" : : : "memory");
+        softirq_record(&g_Stats.Softirq, cycles);
+    }
+
+    g_Running = false;
+    softirq_restore_flags(flags);
+}
+
+void tasklet_schedule(Tasklet* tasklet)
+{
+    uint32_t flags = softirq_save_flags();
+    if (!tasklet->Scheduled) {
+        tasklet->Scheduled = true;
+        tasklet->Next = NULL;
+        if (g_TaskletTail != NULL)
+            g_TaskletTail->Next = tasklet;
+        else
+            g_TaskletHead = tasklet;
+        g_TaskletTail = tasklet;
+        g_Pending |= 1u << SOFTIRQ_TASKLET;
+    }
+    softirq_restore_flags(flags);
+}
+
+void __attribute__((cdecl)) softirq_irq_exit(Registers* regs, uint32_t irq, uint64_t entry)
+{
+    softirq_record(&g_Stats.IrqOff, x86_ReadTsc() - entry);
+    if (irq < 16)
+        g_Stats.IrqCount[irq]++;
+
+    // Not when the interrupted code had interrupts off (a software int), it
+    // would find them enabled behind its back
+    if (g_Pending != 0 && (regs->eflags & EFLAGS_IF))
+        softirq_run();
+}
+
+const IrqStats* softirq_get_stats(void)
+{
+    return &g_Stats;
+}
+
+void softirq_reset_stats(void)
+{
+    uint32_t flags = softirq_save_flags();
+    memset(&g_Stats, 0, sizeof(g_Stats));
+    softirq_restore_flags(flags);
+}
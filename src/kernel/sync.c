@@ -0,0 +1,316 @@
+#include <sync.h>
+#include <smp.h>
+#include <time.h>
+#include <stdio.h>
+#include <debug.h>
+#include <io.h>
+
+#define MODULE "Sync"
+
+#define EFLAGS_IF               0x200
+
+static LockStats* volatile g_Locks = NULL;
+
+static inline void sync_pause(void)
+{
+    __asm__ volatile ("pause" : : : "memory");
+}
+
+static inline void sync_barrier(void)
+{
+    __asm__ volatile ("" : : : "memory");
+}
+
+static inline uint32_t sync_irq_save(void)
+{
+    uint32_t flags;
+    __asm__ volatile ("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void sync_irq_restore(uint32_t flags)
+{
+    if (flags & EFLAGS_IF)
+        __asm__ volatile ("sti" : : : "memory");
+}
+
+static void lockstat_register(LockStats* stats)
+{
+    if (stats->Name == NULL || !__sync_bool_compare_and_swap(&stats->Registered, 0, 1))
+        return;
+
+    LockStats* head;
+    do {
+        head = g_Locks;
+        stats->Next = head;
+    } while (!__sync_bool_compare_and_swap(&g_Locks, head, stats));
+}
+
+// Called while holding the lock, so the counters need no atomics
+static inline void lockstat_acquired(LockStats* stats, uint64_t waited)
+{
+    if (!stats->Registered)
+        lockstat_register(stats);
+
+    stats->Acquired++;
+    if (waited != 0) {
+        stats->Contended++;
+        stats->WaitCycles += waited;
+        if (waited > stats->MaxWaitCycles)
+            stats->MaxWaitCycles = waited > UINT32_MAX ? UINT32_MAX : (uint32_t)waited;
+    }
+}
+
+LockStats* lockstat_first(void)
+{
+    return g_Locks;
+}
+
+void lockstat_reset(void)
+{
+    for (LockStats* stats = g_Locks; stats != NULL; stats = stats->Next) {
+        stats->Acquired = 0;
+        stats->Contended = 0;
+        stats->WaitCycles = 0;
+        stats->MaxWaitCycles = 0;
+    }
+}
+
+//
+// Spinlocks
+//
+
+void spinlock_init(Spinlock* lock, const char* name)
+{
+    lock->Next = 0;
+    lock->Owner = 0;
+    lock->Stats = (LockStats){ .Name = name, .Type = LOCK_SPIN };
+}
+
+void spin_lock(Spinlock* lock)
+{
+    uint16_t ticket = __sync_fetch_and_add(&lock->Next, 1);
+    uint64_t waited = 0;
+    if (lock->Owner != ticket) {
+        uint64_t start = x86_ReadTsc();
+        while (lock->Owner != ticket)
+            sync_pause();
+        waited = x86_ReadTsc() - start;
+    }
+    sync_barrier();
+    lockstat_acquired(&lock->Stats, waited);
+}
+
+void spin_unlock(Spinlock* lock)
+{
+    sync_barrier();
+    lock->Owner++;
+}
+
+bool spin_trylock(Spinlock* lock)
+{
+    // Free only when nobody holds a ticket, then the next one is served right away
+    uint16_t owner = lock->Owner;
+    if (!__sync_bool_compare_and_swap(&lock->Next, owner, (uint16_t)(owner + 1)))
+        return false;
+
+    sync_barrier();
+    lockstat_acquired(&lock->Stats, 0);
+    return true;
+}
+
+uint32_t spin_lock_irqsave(Spinlock* lock)
+{
+    uint32_t flags = sync_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(Spinlock* lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    sync_irq_restore(flags);
+}
+
+//
+// Mutexes
+//
+
+void mutex_init(Mutex* mutex, const char* name)
+{
+    mutex->Locked = false;
+    mutex->Owner = NULL;
+    spinlock_init(&mutex->Waiters.Lock, NULL);
+    mutex->Waiters.Head = NULL;
+    mutex->Waiters.Tail = NULL;
+    mutex->Stats = (LockStats){ .Name = name, .Type = LOCK_MUTEX };
+}
+
+void mutex_lock(Mutex* mutex)
+{
+    Cpu* cpu = cpu_current();
+    uint32_t flags = spin_lock_irqsave(&mutex->Waiters.Lock);
+    if (!mutex->Locked) {
+        mutex->Locked = true;
+        mutex->Owner = cpu;
+        lockstat_acquired(&mutex->Stats, 0);
+        spin_unlock_irqrestore(&mutex->Waiters.Lock, flags);
+        return;
+    }
+
+    // Nothing else runs on this CPU that could ever release it
+    if (mutex->Owner == cpu) {
+        spin_unlock_irqrestore(&mutex->Waiters.Lock, flags);
+        log_crit(MODULE, "Mutex %s taken twice on CPU %u", mutex->Stats.Name != NULL ? mutex->Stats.Name : "?", cpu->Index);
+        printf("KERNEL PANIC!");
+        i686_Panic();
+    }
+
+    WaitQueueEntry entry = { .Cpu = cpu, .Woken = false, .Next = NULL };
+    if (mutex->Waiters.Tail != NULL)
+        mutex->Waiters.Tail->Next = &entry;
+    else
+        mutex->Waiters.Head = &entry;
+    mutex->Waiters.Tail = &entry;
+    spin_unlock(&mutex->Waiters.Lock);
+
+    // Still with interrupts off, the wake IPI can only come in once hlt waits for it.
+    // A caller that had them off can't be woken that way and spins instead.
+    uint64_t start = x86_ReadTsc();
+    while (!entry.Woken) {
+        if (flags & EFLAGS_IF)
+            __asm__ volatile ("sti\n\thlt\n\tcli" : : : "memory");
+        else
+            sync_pause();
+    }
+    sync_barrier();
+
+    // mutex_unlock handed it over with Locked still set
+    lockstat_acquired(&mutex->Stats, x86_ReadTsc() - start);
+    sync_irq_restore(flags);
+}
+
+bool mutex_trylock(Mutex* mutex)
+{
+    uint32_t flags = spin_lock_irqsave(&mutex->Waiters.Lock);
+    bool taken = !mutex->Locked;
+    if (taken) {
+        mutex->Locked = true;
+        mutex->Owner = cpu_current();
+        lockstat_acquired(&mutex->Stats, 0);
+    }
+    spin_unlock_irqrestore(&mutex->Waiters.Lock, flags);
+    return taken;
+}
+
+void mutex_unlock(Mutex* mutex)
+{
+    uint32_t flags = spin_lock_irqsave(&mutex->Waiters.Lock);
+    WaitQueueEntry* next = mutex->Waiters.Head;
+    if (next == NULL) {
+        mutex->Locked = false;
+        mutex->Owner = NULL;
+        spin_unlock_irqrestore(&mutex->Waiters.Lock, flags);
+        return;
+    }
+
+    // Straight to the first waiter, so a CPU taking it again right away can't overtake
+    mutex->Waiters.Head = next->Next;
+    if (mutex->Waiters.Head == NULL)
+        mutex->Waiters.Tail = NULL;
+    mutex->Owner = next->Cpu;
+
+    // The entry lives on the waiter's stack, only its CPU is needed after this
+    Cpu* waiter = next->Cpu;
+    sync_barrier();
+    next->Woken = true;
+    spin_unlock_irqrestore(&mutex->Waiters.Lock, flags);
+
+    if (waiter != cpu_current())
+        smp_send_ipi(waiter->Index, SMP_IPI_WAKE);
+}
+
+//
+// Reader-writer locks
+//
+
+void rwlock_init(RwLock* lock, const char* name)
+{
+    lock->Count = 0;
+    lock->WritersWaiting = 0;
+    lock->Stats = (LockStats){ .Name = name, .Type = LOCK_RW };
+}
+
+void rwlock_read_lock(RwLock* lock)
+{
+    uint64_t start = 0;
+    for (;;) {
+        int32_t count = lock->Count;
+        if (count >= 0 && lock->WritersWaiting == 0 && __sync_bool_compare_and_swap(&lock->Count, count, count + 1))
+            break;
+        if (start == 0)
+            start = x86_ReadTsc();
+        sync_pause();
+    }
+
+    // Other readers may be in here too
+    LockStats* stats = &lock->Stats;
+    if (!stats->Registered)
+        lockstat_register(stats);
+    __sync_fetch_and_add(&stats->Acquired, 1);
+    if (start != 0) {
+        uint64_t waited = x86_ReadTsc() - start;
+        __sync_fetch_and_add(&stats->Contended, 1);
+        stats->WaitCycles += waited;
+    }
+}
+
+void rwlock_read_unlock(RwLock* lock)
+{
+    __sync_fetch_and_sub(&lock->Count, 1);
+}
+
+void rwlock_write_lock(RwLock* lock)
+{
+    __sync_fetch_and_add(&lock->WritersWaiting, 1);
+    uint64_t waited = 0;
+    if (!__sync_bool_compare_and_swap(&lock->Count, 0, -1)) {
+        uint64_t start = x86_ReadTsc();
+        while (!__sync_bool_compare_and_swap(&lock->Count, 0, -1))
+            sync_pause();
+        waited = x86_ReadTsc() - start;
+    }
+    __sync_fetch_and_sub(&lock->WritersWaiting, 1);
+    lockstat_acquired(&lock->Stats, waited);
+}
+
+void rwlock_write_unlock(RwLock* lock)
+{
+    sync_barrier();
+    lock->Count = 0;
+}
+
+//
+// Sequence locks
+//
+
+void seqlock_init(SeqLock* lock, const char* name)
+{
+    lock->Sequence = 0;
+    spinlock_init(&lock->Lock, name);
+    lock->Lock.Stats.Type = LOCK_SEQ;
+}
+
+void seqlock_write_begin(SeqLock* lock)
+{
+    spin_lock(&lock->Lock);
+    lock->Sequence++;
+    sync_barrier();
+}
+
+void seqlock_write_end(SeqLock* lock)
+{
+    sync_barrier();
+    lock->Sequence++;
+    spin_unlock(&lock->Lock);
+}
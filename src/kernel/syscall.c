@@ -8,12 +8,22 @@
 #include <vga_text.h>
 #include <io.h>
 #include <time.h>
+#include <memdefs.h>
+#include <blockdev.h>
+#include <vfs.h>
+#include <sysenter.h>
+#include <usermode.h>
+#include <process.h>
+#include <sync.h>
 
 // Syscall handler table
 static syscall_handler_t syscall_handlers[SYSCALL_COUNT];
 
-#define HEAP_START      0x400000    // 4MB
-#define HEAP_SIZE       0x100000    // 1MB
+// Registers of the int 0x80 being handled, for fork
+static Registers* current_frame = NULL;
+
+#define HEAP_START      MEMORY_KERNEL_HEAP_ADDR     // 4MB
+#define HEAP_SIZE       MEMORY_KERNEL_HEAP_SIZE     // 1MB
 #define BLOCK_SIZE      32          // Minimum block size
 
 typedef struct heap_block {
@@ -24,6 +34,7 @@ typedef struct heap_block {
 
 static heap_block_t* heap_start = NULL;
 static uint32_t heap_initialized = 0;
+static Spinlock heap_lock = SPINLOCK_INIT("kernel heap");     // the block list
 
 // Initialize the simple heap
 static void heap_init(void) {
@@ -38,54 +49,15 @@ static void heap_init(void) {
     log_info("Syscall", "Heap initialized at 0x%X, size: %d bytes", HEAP_START, HEAP_SIZE);
 }
 
-// Simple virtual file system (for file syscalls)
-#define MAX_OPEN_FILES  32
-#define MAX_FILENAME    64
+#define PRINT_CHUNK     128
 
-typedef struct {
-    char name[MAX_FILENAME];
-    char* data;
-    uint32_t size;
-    uint32_t capacity;
-    uint32_t is_directory;
-    uint32_t in_use;
-} vfile_t;
-
-typedef struct {
-    vfile_t* file;
-    uint32_t position;
-    uint32_t flags;
-    uint32_t in_use;
-} file_descriptor_t;
-
-static vfile_t virtual_files[MAX_OPEN_FILES];
-static file_descriptor_t file_descriptors[MAX_OPEN_FILES];
-static uint32_t fs_initialized = 0;
-
-// Initialize the virtual file system
-static void vfs_init(void) {
-    if (fs_initialized) return;
-    
-    memset(virtual_files, 0, sizeof(virtual_files));
-    memset(file_descriptors, 0, sizeof(file_descriptors));
-    
-    // Create some default files
-    strcpy(virtual_files[0].name, "welcome.txt");
-    virtual_files[0].data = "Welcome to MiqOSoft!\nThis is a virtual file system.\n";
-    virtual_files[0].size = strlen(virtual_files[0].data);
-    virtual_files[0].capacity = virtual_files[0].size;
-    virtual_files[0].is_directory = 0;
-    virtual_files[0].in_use = 1;
-    
-    strcpy(virtual_files[1].name, "info.txt");
-    virtual_files[1].data = "System calls are working!\nYou can use the syscall interface.\n";
-    virtual_files[1].size = strlen(virtual_files[1].data);
-    virtual_files[1].capacity = virtual_files[1].size;
-    virtual_files[1].is_directory = 0;
-    virtual_files[1].in_use = 1;
-    
-    fs_initialized = 1;
-    log_info("Syscall", "Virtual file system initialized");
+// Copies a path argument in, so later checks and the VFS see one stable string
+static int syscall_get_path(char* path, uint32_t path_ptr) {
+    if (!path_ptr) return SYSCALL_INVALID_PARAMS;
+    
+    int32_t length = strncpy_from_user(path, (const char*)path_ptr, VFS_MAX_PATH);
+    if (length < 0 || length >= VFS_MAX_PATH) return SYSCALL_INVALID_PARAMS;
+    return SYSCALL_OK;
 }
 
 //
@@ -95,6 +67,9 @@ static void vfs_init(void) {
 static int32_t sys_handler_exit(uint32_t code, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
     log_info("Syscall", "Process exit with code: %d", code);
     printf("Process exited with code: %d\n", code);
+    
+    // Back to whoever started the ring 3 program, does not return
+    usermode_exit((int)code);
     return SYSCALL_OK;
 }
 
@@ -102,33 +77,31 @@ static int32_t sys_handler_print(uint32_t msg_ptr, uint32_t arg2, uint32_t arg3,
     const char* msg = (const char*)msg_ptr;
     if (!msg) return SYSCALL_INVALID_PARAMS;
     
-    printf("%s", msg);
-    return strlen(msg);
+    // In chunks, the string can be any length
+    char chunk[PRINT_CHUNK];
+    int32_t total = 0;
+    while (1) {
+        int32_t length = strncpy_from_user(chunk, msg + total, sizeof(chunk) - 1);
+        if (length < 0) return length;
+        
+        chunk[length] = '\0';
+        printf("%s", chunk);
+        total += length;
+        if (length < (int32_t)sizeof(chunk) - 1) break;
+    }
+    return total;
 }
 
 static int32_t sys_handler_read(uint32_t fd, uint32_t buffer_ptr, uint32_t count, uint32_t arg4) {
-    if (fd >= MAX_OPEN_FILES || !file_descriptors[fd].in_use) {
-        return SYSCALL_INVALID_PARAMS;
-    }
-    
-    file_descriptor_t* desc = &file_descriptors[fd];
-    vfile_t* file = desc->file;
-    char* buffer = (char*)buffer_ptr;
+    void* buffer = (void*)buffer_ptr;
+    if (!buffer || !user_buffer_ok(buffer, count, true)) return SYSCALL_INVALID_PARAMS;
     
-    if (!buffer || !file) return SYSCALL_INVALID_PARAMS;
-    
-    uint32_t to_read = count;
-    if (desc->position + to_read > file->size) {
-        to_read = file->size - desc->position;
-    }
-    
-    memcpy(buffer, file->data + desc->position, to_read);
-    desc->position += to_read;
-    
-    return to_read;
+    return vfs_read((fd_t)fd, buffer, count);
 }
 
 static int32_t sys_handler_malloc(uint32_t size, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    // The heap is kernel memory, out of reach of ring 3
+    if (usermode_active()) return SYSCALL_PERMISSION_DENIED;
     if (!heap_initialized) heap_init();
     
     if (size == 0) return (int32_t)NULL;
@@ -136,6 +109,7 @@ static int32_t sys_handler_malloc(uint32_t size, uint32_t arg2, uint32_t arg3, u
     // Align to block size
     size = (size + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
     
+    spin_lock(&heap_lock);
     heap_block_t* current = heap_start;
     while (current) {
         if (current->is_free && current->size >= size) {
@@ -152,18 +126,22 @@ static int32_t sys_handler_malloc(uint32_t size, uint32_t arg2, uint32_t arg3, u
                 current->size = size;
             }
             
+            spin_unlock(&heap_lock);
             return (int32_t)((uint8_t*)current + sizeof(heap_block_t));
         }
         current = current->next;
     }
     
+    spin_unlock(&heap_lock);
     return (int32_t)NULL; // No memory available
 }
 
 static int32_t sys_handler_free(uint32_t ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    if (usermode_active()) return SYSCALL_PERMISSION_DENIED;
     if (!ptr || !heap_initialized) return SYSCALL_INVALID_PARAMS;
     
     heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - sizeof(heap_block_t));
+    spin_lock(&heap_lock);
     block->is_free = 1;
     
     // Attempt to merge with free adjacent blocks
@@ -176,127 +154,233 @@ static int32_t sys_handler_free(uint32_t ptr, uint32_t arg2, uint32_t arg3, uint
             current = current->next;
         }
     }
+    spin_unlock(&heap_lock);
     
     return SYSCALL_OK;
 }
 
 static int32_t sys_handler_open(uint32_t path_ptr, uint32_t flags, uint32_t arg3, uint32_t arg4) {
-    const char* path = (const char*)path_ptr;
-    if (!path) return SYSCALL_INVALID_PARAMS;
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
     
-    vfs_init();
+    return vfs_open(path, flags);
+}
+
+static int32_t sys_handler_close(uint32_t fd, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    // The console descriptors stay open
+    if (fd <= VFS_FD_DEBUG) return SYSCALL_INVALID_PARAMS;
     
-    // Find the file
-    vfile_t* file = NULL;
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (virtual_files[i].in_use && strcmp(virtual_files[i].name, path) == 0) {
-            file = &virtual_files[i];
-            break;
-        }
-    }
+    return vfs_close((fd_t)fd);
+}
+
+static int32_t sys_handler_write(uint32_t fd, uint32_t buffer_ptr, uint32_t count, uint32_t arg4) {
+    const void* buffer = (const void*)buffer_ptr;
+    if (!buffer || count == 0 || !user_buffer_ok(buffer, count, false)) return SYSCALL_INVALID_PARAMS;
     
-    // If it does not exist and we have CREATE flag, create it
-    if (!file && (flags & OPEN_CREATE)) {
-        for (int i = 0; i < MAX_OPEN_FILES; i++) {
-            if (!virtual_files[i].in_use) {
-                file = &virtual_files[i];
-                strcpy(file->name, path);
-                file->data = (char*)sys_handler_malloc(256, 0, 0, 0); // Initial buffer of 256 bytes
-                if (!file->data) return SYSCALL_OUT_OF_MEMORY;
-                file->size = 0;
-                file->capacity = 256;
-                file->is_directory = 0;
-                file->in_use = 1;
-                break;
-            }
-        }
-    }
+    return vfs_write((fd_t)fd, buffer, count);
+}
+
+// Copies the vector in and checks every buffer it points to
+static int syscall_get_iovec(VfsIoVec* iov, uint32_t iov_ptr, uint32_t count, bool write) {
+    if (!iov_ptr || count == 0 || count > IOV_MAX) return SYSCALL_INVALID_PARAMS;
     
-    if (!file) return SYSCALL_NOT_FOUND;
+    int result = copy_from_user(iov, (const void*)iov_ptr, count * sizeof(iovec_t));
+    if (result != SYSCALL_OK) return result;
     
-    // Search for free descriptor
-    for (int i = 3; i < MAX_OPEN_FILES; i++) { // 0,1,2 reserved for stdin,stdout,stderr
-        if (!file_descriptors[i].in_use) {
-            file_descriptors[i].file = file;
-            file_descriptors[i].position = (flags & OPEN_APPEND) ? file->size : 0;
-            file_descriptors[i].flags = flags;
-            file_descriptors[i].in_use = 1;
-            
-            if (flags & OPEN_TRUNCATE) {
-                file->size = 0;
-                file_descriptors[i].position = 0;
-            }
-            
-            return i;
-        }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!user_buffer_ok(iov[i].Base, iov[i].Length, write)) return SYSCALL_INVALID_PARAMS;
     }
+    return SYSCALL_OK;
+}
+
+static int32_t sys_handler_readv(uint32_t fd, uint32_t iov_ptr, uint32_t count, uint32_t arg4) {
+    VfsIoVec iov[IOV_MAX];
+    int result = syscall_get_iovec(iov, iov_ptr, count, true);
+    if (result != SYSCALL_OK) return result;
     
-    return SYSCALL_OUT_OF_MEMORY;
+    return vfs_readv((fd_t)fd, iov, count);
 }
 
-static int32_t sys_handler_close(uint32_t fd, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
-    if (fd >= MAX_OPEN_FILES || !file_descriptors[fd].in_use) {
-        return SYSCALL_INVALID_PARAMS;
-    }
+static int32_t sys_handler_writev(uint32_t fd, uint32_t iov_ptr, uint32_t count, uint32_t arg4) {
+    VfsIoVec iov[IOV_MAX];
+    int result = syscall_get_iovec(iov, iov_ptr, count, false);
+    if (result != SYSCALL_OK) return result;
     
-    file_descriptors[fd].in_use = 0;
-    file_descriptors[fd].file = NULL;
-    file_descriptors[fd].position = 0;
-    file_descriptors[fd].flags = 0;
+    return vfs_writev((fd_t)fd, iov, count);
+}
+
+static int32_t sys_handler_seek(uint32_t fd, uint32_t offset, uint32_t whence, uint32_t arg4) {
+    return vfs_seek((fd_t)fd, (int32_t)offset, (int)whence);
+}
+
+static int32_t sys_handler_pread(uint32_t fd, uint32_t buffer_ptr, uint32_t count, uint32_t offset) {
+    void* buffer = (void*)buffer_ptr;
+    if (!buffer || !user_buffer_ok(buffer, count, true)) return SYSCALL_INVALID_PARAMS;
     
-    return SYSCALL_OK;
+    return vfs_pread((fd_t)fd, buffer, count, offset);
 }
 
-static int32_t sys_handler_write(uint32_t fd, uint32_t buffer_ptr, uint32_t count, uint32_t arg4) {
-    if (fd >= MAX_OPEN_FILES || !buffer_ptr || count == 0) {
+static int32_t sys_handler_pwrite(uint32_t fd, uint32_t buffer_ptr, uint32_t count, uint32_t offset) {
+    const void* buffer = (const void*)buffer_ptr;
+    if (!buffer || count == 0 || !user_buffer_ok(buffer, count, false)) return SYSCALL_INVALID_PARAMS;
+    
+    return vfs_pwrite((fd_t)fd, buffer, count, offset);
+}
+
+static int32_t sys_handler_stat(uint32_t path_ptr, uint32_t info_ptr, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
+    if (!info_ptr) return SYSCALL_INVALID_PARAMS;
+    
+    VfsStat stat;
+    result = vfs_stat(path, &stat);
+    if (result != SYSCALL_OK) return result;
+    
+    // No file system tracks modification times or permissions yet
+    stat_info_t info;
+    info.size = stat.Size;
+    info.type = stat.IsDirectory ? 1 : 0;
+    info.mode = 0;
+    info.created_time = stat.Created;
+    info.modified_time = stat.Created;
+    return copy_to_user((void*)info_ptr, &info, sizeof(info));
+}
+
+static int32_t sys_handler_unlink(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
+    
+    return vfs_unlink(path);
+}
+
+static int32_t sys_handler_mount(uint32_t device_ptr, uint32_t path_ptr, uint32_t arg3, uint32_t arg4) {
+    char device_name[VFS_MAX_NAME + 1];
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
+    
+    int32_t length = device_ptr ? strncpy_from_user(device_name, (const char*)device_ptr, sizeof(device_name)) : -1;
+    if (length < 0 || length >= (int32_t)sizeof(device_name) || path[0] != '/') {
         return SYSCALL_INVALID_PARAMS;
     }
     
-    const char* buffer = (const char*)buffer_ptr;
+    BlockDev* device = blockdev_find(device_name);
+    if (!device) return SYSCALL_NOT_FOUND;
     
-    // Special cases for stdout/stderr
-    if (fd == 1 || fd == 2) {
-        for (uint32_t i = 0; i < count; i++) {
-            putc(buffer[i]);
-        }
-        return count;
-    }
+    return vfs_mount(path, "fat", device);
+}
+
+static int32_t sys_handler_umount(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
     
-    if (!file_descriptors[fd].in_use) {
-        return SYSCALL_INVALID_PARAMS;
-    }
+    return vfs_umount(path);
+}
+
+static int32_t sys_handler_chdir(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
     
-    file_descriptor_t* desc = &file_descriptors[fd];
-    vfile_t* file = desc->file;
+    return vfs_chdir(path);
+}
+
+static int32_t sys_handler_getcwd(uint32_t buffer_ptr, uint32_t size, uint32_t arg3, uint32_t arg4) {
+    char* buffer = (char*)buffer_ptr;
+    const char* cwd = vfs_getcwd();
+    uint32_t length = strlen(cwd);
+    if (!buffer || size <= length) return SYSCALL_INVALID_PARAMS;
     
-    if (!file || !(desc->flags & OPEN_WRITE)) {
-        return SYSCALL_PERMISSION_DENIED;
-    }
+    int result = copy_to_user(buffer, cwd, length + 1);
+    if (result != SYSCALL_OK) return result;
+    return length;
+}
+
+static int32_t sys_handler_mkdir(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
+    
+    return vfs_mkdir(path);
+}
+
+static int32_t sys_handler_rmdir(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
     
-    // Check if we need to expand the buffer
-    uint32_t needed_size = desc->position + count;
-    if (needed_size > file->capacity) {
-        uint32_t new_capacity = (needed_size + 255) & ~255; // Round to a multiple of 256
-        char* new_data = (char*)sys_handler_malloc(new_capacity, 0, 0, 0);
-        if (!new_data) return SYSCALL_OUT_OF_MEMORY;
+    return vfs_rmdir(path);
+}
+
+// Maps a file read only. Mappings live in the window above physical memory, so
+// addresses are positive and tell themselves apart from error codes.
+static int32_t sys_handler_mmap(uint32_t fd, uint32_t length, uint32_t offset, uint32_t flags) {
+    // Programs get zero filled memory in their own address space, backed as it is touched
+    if (usermode_active()) {
+        if (!(flags & MMAP_ANONYMOUS)) return SYSCALL_PERMISSION_DENIED;
         
-        memcpy(new_data, file->data, file->size);
-        sys_handler_free((uint32_t)file->data, 0, 0, 0);
-        file->data = new_data;
-        file->capacity = new_capacity;
+        uint32_t mapping;
+        int result = process_mmap(length, flags, &mapping);
+        return result == SYSCALL_OK ? (int32_t)mapping : result;
     }
     
-    memcpy(file->data + desc->position, buffer, count);
-    desc->position += count;
-    if (desc->position > file->size) {
-        file->size = desc->position;
-    }
+    // The window is kernel memory, out of reach of ring 3
+    void* address;
+    int result = vfs_mmap((fd_t)fd, length, offset, flags, &address);
+    if (result != SYSCALL_OK) return result;
     
-    return count;
+    return (int32_t)address;
+}
+
+static int32_t sys_handler_munmap(uint32_t address, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    if (usermode_active()) return process_munmap(address);
+    return vfs_munmap((void*)address);
+}
+
+static int32_t sys_handler_sbrk(uint32_t increment, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    uint32_t old_break;
+    int result = process_sbrk((int32_t)increment, &old_break);
+    return result == SYSCALL_OK ? (int32_t)old_break : result;
 }
 
 static int32_t sys_handler_getpid(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
-    return 1;
+    return process_get_pid();
+}
+
+// Only through int 0x80, SYSENTER leaves no register frame for the child to start from
+static int32_t sys_handler_fork(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    Registers* frame = usermode_get_trap_frame();
+    if (frame == NULL || frame != current_frame || frame->eax != SYSCALL_FORK) {
+        return SYSCALL_INVALID_SYSCALL;
+    }
+    
+    return process_fork(frame);
+}
+
+// Runs the program to completion and returns its pid for sys_wait
+static int32_t sys_handler_exec(uint32_t path_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    char path[VFS_MAX_PATH];
+    int result = syscall_get_path(path, path_ptr);
+    if (result != SYSCALL_OK) return result;
+    
+    return process_exec(path);
+}
+
+static int32_t sys_handler_wait(uint32_t pid, uint32_t status_ptr, uint32_t arg3, uint32_t arg4) {
+    int exit_code;
+    int result = process_wait((int)pid, &exit_code);
+    if (result < 0 || !status_ptr) return result;
+    
+    int copied = copy_to_user((void*)status_ptr, &exit_code, sizeof(exit_code));
+    return copied == SYSCALL_OK ? result : copied;
+}
+
+static int32_t sys_handler_kill(uint32_t pid, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    return process_kill((int)pid);
 }
 
 static int32_t sys_handler_time(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
@@ -372,7 +456,10 @@ static void syscall_handler(Registers* regs) {
     uint32_t arg3 = regs->edx;
     uint32_t arg4 = regs->esi;
     
+    Registers* outer = current_frame;
+    current_frame = regs;
     int32_t result = syscall_dispatch(syscall_num, arg1, arg2, arg3, arg4);
+    current_frame = outer;
     
     // Return result in EAX
     regs->eax = result;
@@ -389,9 +476,6 @@ int32_t syscall_dispatch(uint32_t syscall_num, uint32_t arg1, uint32_t arg2, uin
         return SYSCALL_INVALID_SYSCALL;
     }
     
-    log_debug("Syscall", "Calling syscall %d with args: %x, %x, %x, %x", 
-              syscall_num, arg1, arg2, arg3, arg4);
-    
     return syscall_handlers[syscall_num](arg1, arg2, arg3, arg4);
 }
 
@@ -421,16 +505,37 @@ void syscall_initialize(void) {
     syscall_register_handler(SYSCALL_CLOSE, sys_handler_close);
     syscall_register_handler(SYSCALL_WRITE, sys_handler_write);
     syscall_register_handler(SYSCALL_GETPID, sys_handler_getpid);
+    syscall_register_handler(SYSCALL_FORK, sys_handler_fork);
+    syscall_register_handler(SYSCALL_EXEC, sys_handler_exec);
+    syscall_register_handler(SYSCALL_WAIT, sys_handler_wait);
+    syscall_register_handler(SYSCALL_KILL, sys_handler_kill);
     syscall_register_handler(SYSCALL_TIME, sys_handler_time);
     syscall_register_handler(SYSCALL_SLEEP, sys_handler_sleep);
     syscall_register_handler(SYSCALL_YIELD, sys_handler_yield);
+    syscall_register_handler(SYSCALL_UNLINK, sys_handler_unlink);
+    syscall_register_handler(SYSCALL_MOUNT, sys_handler_mount);
+    syscall_register_handler(SYSCALL_UMOUNT, sys_handler_umount);
+    syscall_register_handler(SYSCALL_CHDIR, sys_handler_chdir);
+    syscall_register_handler(SYSCALL_GETCWD, sys_handler_getcwd);
+    syscall_register_handler(SYSCALL_MKDIR, sys_handler_mkdir);
+    syscall_register_handler(SYSCALL_RMDIR, sys_handler_rmdir);
+    syscall_register_handler(SYSCALL_MMAP, sys_handler_mmap);
+    syscall_register_handler(SYSCALL_SEEK, sys_handler_seek);
+    syscall_register_handler(SYSCALL_STAT, sys_handler_stat);
+    syscall_register_handler(SYSCALL_PREAD, sys_handler_pread);
+    syscall_register_handler(SYSCALL_PWRITE, sys_handler_pwrite);
+    syscall_register_handler(SYSCALL_READV, sys_handler_readv);
+    syscall_register_handler(SYSCALL_WRITEV, sys_handler_writev);
+    syscall_register_handler(SYSCALL_MUNMAP, sys_handler_munmap);
+    syscall_register_handler(SYSCALL_SBRK, sys_handler_sbrk);
+    syscall_ring_initialize();
     
     // Install interrupt handler for syscalls
     i686_ISR_RegisterHandler(SYSCALL_INTERRUPT, syscall_handler);
+    i686_Sysenter_Initialize();
     
     // Initialize subsystems
     heap_init();
-    vfs_init();
     
     log_info("Syscall", "System call interface initialized successfully");
     log_info("Syscall", "Registered %d system calls", SYSCALL_COUNT);
@@ -0,0 +1,117 @@
+#include <syscall.h>
+#include <pmm.h>
+#include <memory.h>
+#include <debug.h>
+#include <usermode.h>
+
+#define MAX_RINGS       8
+
+// Every ring the kernel handed out, the handlers only trust pointers found here
+static syscall_ring_t* rings[MAX_RINGS];
+
+static inline bool ring_is_ring_syscall(uint32_t opcode) {
+    return opcode == SYSCALL_RING_SETUP || opcode == SYSCALL_RING_ENTER || opcode == SYSCALL_RING_DESTROY;
+}
+
+static uint32_t ring_frames(uint32_t entries) {
+    uint32_t size = sizeof(syscall_ring_t) + entries * (sizeof(sq_entry_t) + sizeof(cq_entry_t));
+    return (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+}
+
+static int ring_find(syscall_ring_t* ring) {
+    for (int i = 0; i < MAX_RINGS; i++) {
+        if (ring != NULL && rings[i] == ring) return i;
+    }
+    return -1;
+}
+
+// Runs queued entries until sq is empty or cq is full, returns how many completed.
+// A full cq leaves the rest queued rather than dropping results.
+static int32_t ring_drain(syscall_ring_t* ring) {
+    uint32_t mask = ring->entries - 1;
+    int32_t completed = 0;
+
+    while (ring->sq_head != ring->sq_tail && ring->cq_tail - ring->cq_head < ring->entries) {
+        __asm__ volatile("" ::: "memory");
+        sq_entry_t entry = ring->sq[ring->sq_head & mask];
+        ring->sq_head++;
+
+        // Same table as int 0x80, so every registered syscall can be queued
+        int32_t result;
+        if (ring_is_ring_syscall(entry.opcode)) {
+            result = SYSCALL_INVALID_SYSCALL;
+        } else {
+            result = syscall_dispatch(entry.opcode, entry.args[0], entry.args[1], entry.args[2], entry.args[3]);
+        }
+
+        cq_entry_t* completion = &ring->cq[ring->cq_tail & mask];
+        completion->result = result;
+        completion->user_data = entry.user_data;
+        __asm__ volatile("" ::: "memory");
+        ring->cq_tail++;
+        completed++;
+    }
+
+    return completed;
+}
+
+static int32_t sys_handler_ring_setup(uint32_t entries, uint32_t flags, uint32_t arg3, uint32_t arg4) {
+    // The rings are kernel memory, out of reach of ring 3
+    if (usermode_active()) return SYSCALL_PERMISSION_DENIED;
+    if (entries == 0 || entries > SYSCALL_RING_MAX_ENTRIES || (entries & (entries - 1)) != 0) {
+        return SYSCALL_INVALID_PARAMS;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < MAX_RINGS && slot < 0; i++) {
+        if (!rings[i]) slot = i;
+    }
+    if (slot < 0) return SYSCALL_BUSY;
+
+    uint32_t frames = ring_frames(entries);
+    syscall_ring_t* ring = (syscall_ring_t*)pmm_alloc_frames(frames);
+    if (ring == NULL) return SYSCALL_OUT_OF_MEMORY;
+
+    memset(ring, 0, frames * PMM_FRAME_SIZE);
+    ring->entries = entries;
+    ring->flags = flags & SYSCALL_RING_POLL;
+    ring->sq = (sq_entry_t*)(ring + 1);
+    ring->cq = (cq_entry_t*)(ring->sq + entries);
+    rings[slot] = ring;
+
+    log_info("Syscall", "Ring of %u entries at 0x%X", entries, (uint32_t)ring);
+    return (int32_t)ring;
+}
+
+static int32_t sys_handler_ring_enter(uint32_t ring_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    syscall_ring_t* ring = (syscall_ring_t*)ring_ptr;
+    if (ring_find(ring) < 0) return SYSCALL_INVALID_PARAMS;
+
+    return ring_drain(ring);
+}
+
+static int32_t sys_handler_ring_destroy(uint32_t ring_ptr, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    syscall_ring_t* ring = (syscall_ring_t*)ring_ptr;
+    int slot = ring_find(ring);
+    if (slot < 0) return SYSCALL_INVALID_PARAMS;
+
+    rings[slot] = NULL;
+    pmm_free_frames((uint32_t)ring, ring_frames(ring->entries));
+    return SYSCALL_OK;
+}
+
+void syscall_ring_poll(void) {
+    for (int i = 0; i < MAX_RINGS; i++) {
+        if (rings[i] && (rings[i]->flags & SYSCALL_RING_POLL)) {
+            ring_drain(rings[i]);
+        }
+    }
+}
+
+void syscall_ring_initialize(void) {
+    memset(rings, 0, sizeof(rings));
+
+    syscall_register_handler(SYSCALL_RING_SETUP, sys_handler_ring_setup);
+    syscall_register_handler(SYSCALL_RING_ENTER, sys_handler_ring_enter);
+    syscall_register_handler(SYSCALL_RING_DESTROY, sys_handler_ring_destroy);
+}
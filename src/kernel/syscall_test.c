@@ -3,6 +3,9 @@
 #include <memory.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <usermode.h>
 
 // Tests for syscalls
 void syscall_test_basic(void) {
@@ -115,6 +118,46 @@ void syscall_test_files(void) {
             printf("   Read back %d bytes:\n%s", read_bytes, read_buffer);
             sys_close(fd3);
         }
+        
+        // Test SYSCALL_STAT
+        printf("\n7. Testing sys_stat():\n");
+        stat_info_t info;
+        int32_t stat_result = sys_stat("test_file.txt", &info);
+        printf("   Stat result: %d, size: %u, type: %u\n", stat_result, info.size, info.type);
+        
+        // Test SYSCALL_SEEK, SYSCALL_PREAD and SYSCALL_PWRITE
+        printf("\n8. Testing sys_seek() and positional I/O:\n");
+        int32_t fd4 = sys_open("test_file.txt", OPEN_READ | OPEN_WRITE);
+        if (fd4 >= 0) {
+            printf("   Seek to end: %d\n", sys_seek(fd4, 0, SEEK_END));
+            printf("   Seek to 8: %d\n", sys_seek(fd4, 8, SEEK_SET));
+            
+            int32_t written = sys_pwrite(fd4, "TEST", 4, 10);
+            char chunk[16];
+            memset(chunk, 0, sizeof(chunk));
+            int32_t got = sys_pread(fd4, chunk, 9, 10);
+            printf("   pwrite: %d, pread: %d '%s'\n", written, got, chunk);
+            printf("   Position still at: %d\n", sys_seek(fd4, 0, SEEK_CUR));
+            sys_close(fd4);
+        }
+        
+        // Test SYSCALL_WRITEV and SYSCALL_READV
+        printf("\n9. Testing sys_writev() and sys_readv():\n");
+        char header[] = "   [header] ";
+        char payload[] = "payload in the same trap\n";
+        iovec_t out[2] = { { header, sizeof(header) - 1 }, { payload, sizeof(payload) - 1 } };
+        int32_t total = sys_writev(1, out, 2);
+        printf("   writev to stdout: %d bytes\n", total);
+        
+        int32_t fd5 = sys_open("test_file.txt", OPEN_READ);
+        if (fd5 >= 0) {
+            char first[5], second[9];
+            memset(first, 0, sizeof(first));
+            memset(second, 0, sizeof(second));
+            iovec_t in[2] = { { first, sizeof(first) - 1 }, { second, sizeof(second) - 1 } };
+            printf("   readv: %d bytes '%s' + '%s'\n", sys_readv(fd5, in, 2), first, second);
+            sys_close(fd5);
+        }
     }
     
     printf("\n");
@@ -212,6 +255,126 @@ void syscall_stress_test(void) {
     printf("   Successful file operations: %d\n", file_success);
     printf("   Failed file operations: %d\n", file_fail);
     
+    printf("\n3. Batched ring stress test:\n");
+    int32_t ring_result = sys_ring_setup(64, 0);
+    if (ring_result < 0) {
+        printf("   Ring setup failed: %d\n", ring_result);
+        printf("\n");
+        return;
+    }
+    syscall_ring_t* ring = (syscall_ring_t*)ring_result;
+    
+    // The same 50 allocations as test 1, queued and run with one trap
+    for (int i = 0; i < 50; i++) {
+        syscall_ring_push(ring, SYSCALL_MALLOC, 128, 0, 0, 0, i);
+    }
+    int32_t completed = sys_ring_enter(ring);
+    printf("   Allocations completed by one enter: %d\n", completed);
+    
+    cq_entry_t completion;
+    int batch_success = 0;
+    while (syscall_ring_pop(ring, &completion)) {
+        if (completion.result != 0) {
+            batch_success++;
+            memset((void*)completion.result, 0xAA, 128);
+            syscall_ring_push(ring, SYSCALL_FREE, (uint32_t)completion.result, 0, 0, 0, completion.user_data);
+        }
+    }
+    syscall_ring_push(ring, SYSCALL_TIME, 0, 0, 0, 0, 0xFFFF);
+    completed = sys_ring_enter(ring);
+    
+    int batch_errors = 0;
+    while (syscall_ring_pop(ring, &completion)) {
+        if (completion.result < 0) batch_errors++;
+    }
+    
+    printf("   Successful allocations: %d\n", batch_success);
+    printf("   Frees and time completed: %d, errors: %d\n", completed, batch_errors);
+    sys_ring_destroy(ring);
+    
+    printf("\n");
+}
+
+#define USER_TEST_CODE      VMM_USER_BASE
+#define USER_TEST_STACK     (VMM_USER_TOP - VMM_PAGE_SIZE)
+#define USER_TEST_MESSAGE   0x40            // offset in the code page
+
+// Prints, then passes a kernel address to print and exits with what it got back
+static const uint8_t g_user_print_program[] = {
+    0xB8, 0x01, 0x00, 0x00, 0x00,           // mov eax, SYSCALL_PRINT
+    0xBB, 0x40, 0x00, 0x00, 0x80,           // mov ebx, USER_TEST_CODE + USER_TEST_MESSAGE
+    0xCD, 0x80,                             // int 0x80
+    0xB8, 0x01, 0x00, 0x00, 0x00,           // mov eax, SYSCALL_PRINT
+    0xBB, 0x00, 0x00, 0x10, 0x00,           // mov ebx, 0x100000
+    0xCD, 0x80,                             // int 0x80
+    0x89, 0xC3,                             // mov ebx, eax
+    0xB8, 0x00, 0x00, 0x00, 0x00,           // mov eax, SYSCALL_EXIT
+    0xCD, 0x80,                             // int 0x80
+    0xEB, 0xFE,                             // jmp $
+};
+
+// Asks getcwd to write above the user range, where the local APIC is mapped, and exits with the result
+static const uint8_t g_user_high_pointer_program[] = {
+    0xB8, 0x15, 0x00, 0x00, 0x00,           // mov eax, SYSCALL_GETCWD
+    0xBB, 0xB0, 0x00, 0xE0, 0xFE,           // mov ebx, 0xFEE000B0 (the local APIC EOI register)
+    0xB9, 0x40, 0x00, 0x00, 0x00,           // mov ecx, 64
+    0xCD, 0x80,                             // int 0x80
+    0x89, 0xC3,                             // mov ebx, eax
+    0xB8, 0x00, 0x00, 0x00, 0x00,           // mov eax, SYSCALL_EXIT
+    0xCD, 0x80,                             // int 0x80
+    0xEB, 0xFE,                             // jmp $
+};
+
+// Writes to kernel memory
+static const uint8_t g_user_fault_program[] = {
+    0xC7, 0x05, 0x00, 0x00, 0x10, 0x00,     // mov dword [0x100000], 0
+    0x00, 0x00, 0x00, 0x00,
+    0xEB, 0xFE,                             // jmp $
+};
+
+// Runs code in a fresh address space with one read only code page and one stack page
+static int syscall_run_user_program(const uint8_t* code, uint32_t size, const char* message) {
+    uint32_t space = vmm_create_address_space();
+    if (!space) return SYSCALL_OUT_OF_MEMORY;
+    
+    uint32_t code_frame = pmm_alloc_frame();
+    uint32_t stack_frame = pmm_alloc_frame();
+    bool mapped = code_frame && stack_frame;
+    if (mapped) {
+        memset((void*)code_frame, 0, PMM_FRAME_SIZE);
+        memcpy((void*)code_frame, code, size);
+        if (message) strcpy((char*)code_frame + USER_TEST_MESSAGE, message);
+        
+        // Once mapped the frames belong to the address space
+        mapped = vmm_map_user_page(space, USER_TEST_CODE, code_frame, 0);
+        if (mapped) code_frame = 0;
+        mapped = mapped && vmm_map_user_page(space, USER_TEST_STACK, stack_frame, VMM_PAGE_WRITE);
+        if (mapped) stack_frame = 0;
+    }
+    
+    int result = mapped ? usermode_run(space, USER_TEST_CODE, USER_TEST_STACK + VMM_PAGE_SIZE) : SYSCALL_OUT_OF_MEMORY;
+    
+    if (code_frame) pmm_free_frame(code_frame);
+    if (stack_frame) pmm_free_frame(stack_frame);
+    vmm_destroy_address_space(space);
+    return result;
+}
+
+void syscall_test_usermode(void) {
+    printf("=== Testing Ring 3 ===\n\n");
+    
+    printf("1. Print and exit:\n");
+    int code = syscall_run_user_program(g_user_print_program, sizeof(g_user_print_program), "   Hello from ring 3\n");
+    printf("   Exit code: %d (kernel pointer rejected with %d)\n", code, SYSCALL_INVALID_PARAMS);
+    
+    printf("\n2. Write to kernel memory:\n   ");
+    code = syscall_run_user_program(g_user_fault_program, sizeof(g_user_fault_program), NULL);
+    printf("   Exit code: %d, the kernel kept running\n", code);
+    
+    printf("\n3. Pointer above the user range:\n");
+    code = syscall_run_user_program(g_user_high_pointer_program, sizeof(g_user_high_pointer_program), NULL);
+    printf("   Exit code: %d (%s)\n", code, code == SYSCALL_INVALID_PARAMS ? "rejected" : "FAILED, it was accepted");
+    
     printf("\n");
 }
 
@@ -225,6 +388,7 @@ void syscall_run_all_tests(void) {
     syscall_test_files();
     syscall_test_advanced();
     syscall_stress_test();
+    syscall_test_usermode();
     
     printf("====================================\n");
     printf("         ALL TESTS COMPLETED\n");
@@ -6,15 +6,29 @@
 #include <isr.h>
 #include <pit.h>
 #include <stdio.h>
+#include <sync.h>
 
 // PIT frequency (Hz). 1000 → one tick = 1ms
 #define HZ 1000
 
+// Number of PIT ticks used to calibrate the TSC
+#define TSC_CALIBRATION_TICKS 10
+
+// Give up on the PIT after this many cycles (a second or more on anything that boots this)
+// and assume a clock instead, so a timer that never fires can't hang the boot
+#define TSC_CALIBRATION_TIMEOUT 0x100000000ULL
+#define TSC_FALLBACK_KHZ 1000000
+
+// 64 bits take two loads here, readers on other CPUs go through the seqlock so they never see half an update
 static volatile uint64_t s_ticks = 0;
+static SeqLock s_clock = SEQLOCK_INIT("clock");
+static uint32_t s_tsc_khz = 0;
 
 static void pit_tick_handler(Registers* regs) {
     (void)regs;
+    seqlock_write_begin(&s_clock);
     s_ticks++;
+    seqlock_write_end(&s_clock);
     
     // Debug: log every 1000 ticks to monitor current timer speed
     // if (s_ticks % 1000 == 0) {
@@ -35,10 +49,52 @@ void time_init(void) {
 }
 
 uint64_t time_get_ticks(void) {
-    return s_ticks;
+    uint32_t sequence;
+    uint64_t ticks;
+    do {
+        sequence = seqlock_read_begin(&s_clock);
+        ticks = s_ticks;
+    } while (seqlock_read_retry(&s_clock, sequence));
+    return ticks;
 }
 
 uint32_t sys_time(void) {
     // With HZ=1000, each tick = 1ms, so ticks == milliseconds
-    return (uint32_t)s_ticks;
+    return (uint32_t)time_get_ticks();
+}
+
+// Measure the TSC frequency over a few PIT ticks. Interrupts must be enabled.
+void time_calibrate_tsc(void) {
+    // Align to a tick edge so the measured window is exact
+    uint64_t deadline = x86_ReadTsc() + TSC_CALIBRATION_TIMEOUT;
+    uint64_t tick = time_get_ticks();
+    while (time_get_ticks() == tick && x86_ReadTsc() < deadline) {
+        __asm__ volatile ("pause");
+    }
+
+    uint64_t start_tsc = x86_ReadTsc();
+    uint64_t target = time_get_ticks() + TSC_CALIBRATION_TICKS;
+    while (time_get_ticks() < target && x86_ReadTsc() < deadline) {
+        __asm__ volatile ("pause");
+    }
+    uint64_t cycles = x86_ReadTsc() - start_tsc;
+
+    if (time_get_ticks() < target) {
+        s_tsc_khz = TSC_FALLBACK_KHZ;
+        log_warn("Time", "PIT is not ticking, assuming a %u kHz TSC", s_tsc_khz);
+        return;
+    }
+
+    // One tick is 1000 / HZ ms
+    s_tsc_khz = (uint32_t)(cycles * HZ / (TSC_CALIBRATION_TICKS * 1000));
+    log_debug("Time", "TSC calibrated at %u kHz", s_tsc_khz);
+}
+
+uint32_t time_get_tsc_khz(void) {
+    return s_tsc_khz;
+}
+
+uint64_t time_tsc_to_us(uint64_t cycles) {
+    if (s_tsc_khz == 0) return 0;
+    return cycles * 1000 / s_tsc_khz;
 }
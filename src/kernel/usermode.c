@@ -0,0 +1,172 @@
+#include <usermode.h>
+#include <syscall.h>
+#include <vmm.h>
+#include <isr.h>
+#include <gdt.h>
+#include <sysenter.h>
+#include <stdio.h>
+#include <memory.h>
+#include <debug.h>
+
+#define MODULE "User"
+
+#define EFLAGS_IF               0x00000200
+#define EFLAGS_IOPL             0x00003000
+
+int __attribute__((cdecl)) i686_EnterUserMode(uint32_t* kernelEsp, const Registers* frame);
+void __attribute__((cdecl)) i686_LeaveUserMode(uint32_t kernelEsp, int code);
+
+uint32_t __attribute__((cdecl)) i686_UserCopy(void* dst, const void* src, uint32_t size);
+int32_t __attribute__((cdecl)) i686_UserStrCopy(char* dst, const char* src, uint32_t size);
+
+// Labels inside the copy routines, only their addresses matter
+void i686_UserCopyFault(void);
+void i686_UserCopyFixup(void);
+void i686_UserStrCopyFault(void);
+void i686_UserStrCopyFixup(void);
+void i686_SysenterArgFault(void);
+void i686_SysenterArgFixup(void);
+
+// Where i686_EnterUserMode saved the kernel for the innermost running program.
+// A program can start another from a syscall, each run keeps its own on the stack.
+static uint32_t* g_KernelEsp = NULL;
+
+static void usermode_exception(Registers* regs)
+{
+    log_err(MODULE, "Exception %u at eip=0x%x, error=0x%x", regs->interrupt, regs->eip, regs->error);
+    usermode_fault(regs);
+}
+
+void usermode_init(void)
+{
+    i686_ISR_RegisterUserFaultHandler(usermode_exception);
+}
+
+// Called by i686_EnterUserMode, 0 once no program runs
+void __attribute__((cdecl)) usermode_set_kernel_stack(uint32_t esp)
+{
+    i686_TSS_SetKernelStack(esp);
+    i686_Sysenter_SetKernelStack(esp);
+}
+
+int usermode_run(uint32_t directory, uint32_t entry, uint32_t stack)
+{
+    Registers frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.eip = entry;
+    frame.esp = stack;
+    frame.eflags = EFLAGS_IF;
+    return usermode_resume(directory, &frame);
+}
+
+int usermode_resume(uint32_t directory, const Registers* frame)
+{
+    // Always ring 3 with interrupts on, whatever the saved flags say
+    Registers user = *frame;
+    user.eflags = (user.eflags & ~EFLAGS_IOPL) | EFLAGS_IF;
+
+    uint32_t saved = 0;
+    uint32_t* outer = g_KernelEsp;
+    uint32_t previous = vmm_get_address_space();
+
+    vmm_switch_address_space(directory);
+    g_KernelEsp = &saved;
+
+    int code = i686_EnterUserMode(&saved, &user);
+
+    g_KernelEsp = outer;
+    usermode_set_kernel_stack(outer != NULL ? *outer : 0);
+    vmm_switch_address_space(previous);
+    return code;
+}
+
+bool usermode_active(void)
+{
+    return g_KernelEsp != NULL;
+}
+
+Registers* usermode_get_trap_frame(void)
+{
+    if (g_KernelEsp == NULL)
+        return NULL;
+    return (Registers*)(*g_KernelEsp - sizeof(Registers));
+}
+
+void usermode_exit(int code)
+{
+    if (g_KernelEsp != NULL)
+        i686_LeaveUserMode(*g_KernelEsp, code);
+}
+
+void usermode_fault(Registers* regs)
+{
+    printf("Program killed by exception %u at 0x%x\n", regs->interrupt, regs->eip);
+    usermode_exit(USERMODE_FAULT_EXIT + (int)regs->interrupt);
+}
+
+bool user_range_ok(const void* ptr, uint32_t size)
+{
+    if (!usermode_active())
+        return true;
+
+    uint32_t start = (uint32_t)ptr;
+    return start >= VMM_USER_BASE && start < VMM_USER_TOP && size <= VMM_USER_TOP - start;
+}
+
+bool user_buffer_ok(const void* ptr, uint32_t size, bool write)
+{
+    if (!usermode_active())
+        return true;
+    if (!user_range_ok(ptr, size))
+        return false;
+    if (size == 0)
+        return true;
+
+    uint32_t required = VMM_PAGE_PRESENT | VMM_PAGE_USER | (write ? VMM_PAGE_WRITE : 0);
+    uint32_t first = (uint32_t)ptr & ~(VMM_PAGE_SIZE - 1);
+    uint32_t last = ((uint32_t)ptr + size - 1) & ~(VMM_PAGE_SIZE - 1);
+    for (uint32_t page = first; ; page += VMM_PAGE_SIZE) {
+        // Pages loaded on demand are brought in now rather than faulting inside a driver
+        if ((vmm_get_flags(page) & required) != required && !vmm_handle_fault(page, write))
+            return false;
+        if (page == last)
+            break;
+    }
+    return true;
+}
+
+int copy_from_user(void* dst, const void* src, uint32_t size)
+{
+    if (!user_range_ok(src, size))
+        return SYSCALL_INVALID_PARAMS;
+    return i686_UserCopy(dst, src, size) == 0 ? SYSCALL_OK : SYSCALL_INVALID_PARAMS;
+}
+
+int copy_to_user(void* dst, const void* src, uint32_t size)
+{
+    if (!user_range_ok(dst, size))
+        return SYSCALL_INVALID_PARAMS;
+    return i686_UserCopy(dst, src, size) == 0 ? SYSCALL_OK : SYSCALL_INVALID_PARAMS;
+}
+
+int32_t strncpy_from_user(char* dst, const char* src, uint32_t size)
+{
+    // The string may end well before size, so only its start is checked here
+    // and a read past the user part faults into the fixup
+    if (!user_range_ok(src, 1))
+        return SYSCALL_INVALID_PARAMS;
+
+    int32_t length = i686_UserStrCopy(dst, src, size);
+    return length < 0 ? SYSCALL_INVALID_PARAMS : length;
+}
+
+uint32_t uaccess_fixup(uint32_t eip)
+{
+    if (eip == (uint32_t)i686_UserCopyFault)
+        return (uint32_t)i686_UserCopyFixup;
+    if (eip == (uint32_t)i686_UserStrCopyFault)
+        return (uint32_t)i686_UserStrCopyFixup;
+    if (eip == (uint32_t)i686_SysenterArgFault)
+        return (uint32_t)i686_SysenterArgFixup;
+    return 0;
+}
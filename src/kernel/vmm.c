@@ -0,0 +1,495 @@
+#include <vmm.h>
+#include <isr.h>
+#include <io.h>
+#include <memory.h>
+#include <stdio.h>
+#include <debug.h>
+#include <usermode.h>
+
+#define MODULE "VMM"
+
+#define VMM_ENTRIES             1024
+#define VMM_LARGE_PAGE_SIZE     0x400000
+#define VMM_ADDRESS_MASK        0xFFFFF000
+#define VMM_WINDOW_PAGES        (VMM_MAP_SIZE / VMM_PAGE_SIZE)
+#define VMM_MAX_DEVICE_PAGES    8
+
+#define CR0_WP                  0x00010000      // read only pages apply to the kernel too
+#define CR0_PG                  0x80000000
+#define CR4_PSE                 0x00000010
+
+#define PF_PRESENT              0x01
+#define PF_WRITE                0x02
+#define PF_USER                 0x04
+
+static uint32_t* g_KernelDirectory = NULL;
+static uint32_t* g_PageDirectory = NULL;                    // current
+static uint32_t g_WindowBitmap[VMM_WINDOW_PAGES / 32];     // set = used
+static uint32_t g_WindowSearch = 0;
+static uint32_t g_ZeroPage = 0;
+static VmmFaultHandler g_FaultHandler = NULL;
+static VmmCowStats g_CowStats;
+static uint32_t g_DevicePages[VMM_MAX_DEVICE_PAGES];       // 4MB page directory indices
+static uint32_t g_DevicePageCount = 0;
+
+static inline void vmm_invalidate(uint32_t virt)
+{
+    __asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+static inline uint32_t vmm_read_cr2(void)
+{
+    uint32_t value;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static void vmm_page_fault(Registers* regs)
+{
+    uint32_t address = vmm_read_cr2();
+
+    // From ring 3 or from the kernel touching user memory in a syscall
+    if (vmm_handle_fault(address, (regs->error & PF_WRITE) != 0))
+        return;
+
+    // A bad pointer handed to copy_from_user or copy_to_user
+    if (!(regs->error & PF_USER)) {
+        uint32_t fixup = uaccess_fixup(regs->eip);
+        if (fixup != 0) {
+            regs->eip = fixup;
+            return;
+        }
+    }
+
+    if (regs->error & PF_USER) {
+        log_err(MODULE, "User page fault at 0x%x (%s, %s), eip=0x%x",
+                address,
+                (regs->error & PF_PRESENT) ? "protection" : "not present",
+                (regs->error & PF_WRITE) ? "write" : "read",
+                regs->eip);
+        usermode_fault(regs);
+    }
+
+    log_crit(MODULE, "Page fault at 0x%x (%s, %s, %s), eip=0x%x",
+             address,
+             (regs->error & PF_PRESENT) ? "protection" : "not present",
+             (regs->error & PF_WRITE) ? "write" : "read",
+             (regs->error & PF_USER) ? "user" : "kernel",
+             regs->eip);
+
+    log_crit(MODULE, "KERNEL PANIC!");
+    printf("KERNEL PANIC!");
+    i686_Panic();
+}
+
+static uint32_t vmm_device_entry(uint32_t index)
+{
+    return (index * VMM_LARGE_PAGE_SIZE) | VMM_PAGE_LARGE | VMM_PAGE_NO_CACHE | VMM_PAGE_WRITE_THROUGH |
+           VMM_PAGE_WRITE | VMM_PAGE_PRESENT;
+}
+
+void vmm_init(void)
+{
+    g_PageDirectory = (uint32_t*)pmm_alloc_frame();
+    if (g_PageDirectory == NULL) {
+        log_crit(MODULE, "No frame for the page directory");
+        return;
+    }
+    memset(g_PageDirectory, 0, VMM_PAGE_SIZE);
+
+    for (uint32_t i = 0; i < PMM_MAX_MEMORY / VMM_LARGE_PAGE_SIZE; i++)
+        g_PageDirectory[i] = (i * VMM_LARGE_PAGE_SIZE) | VMM_PAGE_LARGE | VMM_PAGE_WRITE | VMM_PAGE_PRESENT;
+
+    // Registers found before paging was on (the interrupt controllers)
+    for (uint32_t i = 0; i < g_DevicePageCount; i++)
+        g_PageDirectory[g_DevicePages[i]] = vmm_device_entry(g_DevicePages[i]);
+
+    // Every window page table exists up front, so address spaces copied from
+    // this directory see later kernel mappings too
+    for (uint32_t i = VMM_MAP_BASE >> 22; i < (VMM_MAP_BASE + VMM_MAP_SIZE) >> 22; i++) {
+        uint32_t table = pmm_alloc_frame();
+        if (table == 0) {
+            log_crit(MODULE, "No frame for the mapping window");
+            return;
+        }
+        memset((void*)table, 0, VMM_PAGE_SIZE);
+        g_PageDirectory[i] = table | VMM_PAGE_USER | VMM_PAGE_WRITE | VMM_PAGE_PRESENT;
+    }
+    g_KernelDirectory = g_PageDirectory;
+
+    memset(g_WindowBitmap, 0, sizeof(g_WindowBitmap));
+    i686_ISR_RegisterHandler(14, vmm_page_fault);
+
+    __asm__ volatile (
+        "mov %%cr4, %%eax\n\t"
+        "or %1, %%eax\n\t"
+        "mov %%eax, %%cr4\n\t"
+        "mov %0, %%cr3\n\t"
+        "mov %%cr0, %%eax\n\t"
+        "or %2, %%eax\n\t"
+        "mov %%eax, %%cr0"
+        : : "r"(g_PageDirectory), "i"(CR4_PSE), "i"(CR0_PG | CR0_WP) : "eax", "memory");
+
+    log_info(MODULE, "Paging enabled, %u MB identity mapped", PMM_MAX_MEMORY >> 20);
+}
+
+// Page table entry for virt, creating its page table if asked to
+static uint32_t* vmm_get_entry_in(uint32_t* directory, uint32_t virt, bool create)
+{
+    uint32_t* pde = &directory[virt >> 22];
+    if (*pde & VMM_PAGE_LARGE)
+        return NULL;
+
+    if (!(*pde & VMM_PAGE_PRESENT)) {
+        if (!create)
+            return NULL;
+
+        uint32_t table = pmm_alloc_frame();
+        if (table == 0)
+            return NULL;
+        memset((void*)table, 0, VMM_PAGE_SIZE);
+        *pde = table | VMM_PAGE_USER | VMM_PAGE_WRITE | VMM_PAGE_PRESENT;
+    }
+
+    uint32_t* table = (uint32_t*)(*pde & VMM_ADDRESS_MASK);
+    return &table[(virt >> 12) % VMM_ENTRIES];
+}
+
+static inline uint32_t* vmm_get_entry(uint32_t virt, bool create)
+{
+    return vmm_get_entry_in(g_PageDirectory, virt, create);
+}
+
+bool vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags)
+{
+    uint32_t* pte = vmm_get_entry(virt, true);
+    if (pte == NULL)
+        return false;
+
+    *pte = (phys & VMM_ADDRESS_MASK) | (flags & ~VMM_ADDRESS_MASK) | VMM_PAGE_PRESENT;
+    vmm_invalidate(virt);
+    return true;
+}
+
+void vmm_unmap_page(uint32_t virt)
+{
+    uint32_t* pte = vmm_get_entry(virt, false);
+    if (pte == NULL)
+        return;
+
+    *pte = 0;
+    vmm_invalidate(virt);
+}
+
+uint32_t vmm_get_physical(uint32_t virt)
+{
+    uint32_t pde = g_PageDirectory[virt >> 22];
+    if (pde & VMM_PAGE_LARGE)
+        return (pde & ~(VMM_LARGE_PAGE_SIZE - 1)) | (virt & (VMM_LARGE_PAGE_SIZE - 1));
+
+    uint32_t* pte = vmm_get_entry(virt, false);
+    if (pte == NULL || !(*pte & VMM_PAGE_PRESENT))
+        return 0;
+    return (*pte & VMM_ADDRESS_MASK) | (virt & ~VMM_ADDRESS_MASK);
+}
+
+bool vmm_is_mapped(uint32_t virt)
+{
+    if (g_PageDirectory[virt >> 22] & VMM_PAGE_LARGE)
+        return true;
+
+    uint32_t* pte = vmm_get_entry(virt, false);
+    return pte != NULL && (*pte & VMM_PAGE_PRESENT);
+}
+
+uint32_t vmm_get_flags(uint32_t virt)
+{
+    uint32_t pde = g_PageDirectory[virt >> 22];
+    if (pde & VMM_PAGE_LARGE)
+        return pde & ~VMM_ADDRESS_MASK;
+
+    uint32_t* pte = vmm_get_entry(virt, false);
+    if (pte == NULL || !(*pte & VMM_PAGE_PRESENT))
+        return 0;
+    return *pte & ~VMM_ADDRESS_MASK;
+}
+
+uint32_t vmm_create_address_space(void)
+{
+    uint32_t* directory = (uint32_t*)pmm_alloc_frame();
+    if (directory == NULL)
+        return 0;
+
+    // Kernel page directory entries are shared, the user part starts empty
+    for (uint32_t i = 0; i < VMM_ENTRIES; i++) {
+        bool user = i >= (VMM_USER_BASE >> 22) && i < (VMM_USER_TOP >> 22);
+        directory[i] = user ? 0 : g_KernelDirectory[i];
+    }
+    return (uint32_t)directory;
+}
+
+void vmm_destroy_address_space(uint32_t directory)
+{
+    uint32_t* pd = (uint32_t*)directory;
+    if (pd == NULL || pd == g_KernelDirectory || pd == g_PageDirectory)
+        return;
+
+    for (uint32_t i = VMM_USER_BASE >> 22; i < VMM_USER_TOP >> 22; i++) {
+        if (!(pd[i] & VMM_PAGE_PRESENT))
+            continue;
+
+        uint32_t* table = (uint32_t*)(pd[i] & VMM_ADDRESS_MASK);
+        for (uint32_t j = 0; j < VMM_ENTRIES; j++) {
+            uint32_t frame = table[j] & VMM_ADDRESS_MASK;
+            if ((table[j] & VMM_PAGE_PRESENT) && frame != g_ZeroPage)
+                pmm_unref_frame(frame);
+        }
+        pmm_free_frame((uint32_t)table);
+    }
+    pmm_free_frame(directory);
+}
+
+void vmm_switch_address_space(uint32_t directory)
+{
+    g_PageDirectory = (uint32_t*)directory;
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+uint32_t vmm_get_address_space(void)
+{
+    return (uint32_t)g_PageDirectory;
+}
+
+uint32_t vmm_get_kernel_address_space(void)
+{
+    return (uint32_t)g_KernelDirectory;
+}
+
+bool vmm_map_user_page(uint32_t directory, uint32_t virt, uint32_t phys, uint32_t flags)
+{
+    if (virt < VMM_USER_BASE || virt >= VMM_USER_TOP)
+        return false;
+
+    uint32_t* pte = vmm_get_entry_in((uint32_t*)directory, virt, true);
+    if (pte == NULL)
+        return false;
+
+    *pte = (phys & VMM_ADDRESS_MASK) | (flags & ~VMM_ADDRESS_MASK) | VMM_PAGE_USER | VMM_PAGE_PRESENT;
+    if ((uint32_t*)directory == g_PageDirectory)
+        vmm_invalidate(virt);
+    return true;
+}
+
+void vmm_unmap_user_range(uint32_t directory, uint32_t start, uint32_t end)
+{
+    if (start < VMM_USER_BASE || end > VMM_USER_TOP)
+        return;
+
+    for (uint32_t page = start & VMM_ADDRESS_MASK; page < end; page += VMM_PAGE_SIZE) {
+        uint32_t* pte = vmm_get_entry_in((uint32_t*)directory, page, false);
+        if (pte == NULL) {
+            // No page table, skip to the next one
+            page = (page | (VMM_LARGE_PAGE_SIZE - 1)) + 1 - VMM_PAGE_SIZE;
+            continue;
+        }
+        if (!(*pte & VMM_PAGE_PRESENT))
+            continue;
+
+        uint32_t frame = *pte & VMM_ADDRESS_MASK;
+        *pte = 0;
+        if (frame != g_ZeroPage)
+            pmm_unref_frame(frame);
+        if ((uint32_t*)directory == g_PageDirectory)
+            vmm_invalidate(page);
+    }
+}
+
+uint32_t vmm_clone_address_space(uint32_t directory)
+{
+    uint32_t* source = (uint32_t*)directory;
+    uint32_t* clone = (uint32_t*)vmm_create_address_space();
+    if (clone == NULL)
+        return 0;
+
+    for (uint32_t i = VMM_USER_BASE >> 22; i < VMM_USER_TOP >> 22; i++) {
+        if (!(source[i] & VMM_PAGE_PRESENT))
+            continue;
+
+        uint32_t* table = (uint32_t*)pmm_alloc_frame();
+        if (table == NULL) {
+            vmm_destroy_address_space((uint32_t)clone);
+            return 0;
+        }
+        memset(table, 0, VMM_PAGE_SIZE);
+        clone[i] = (uint32_t)table | (source[i] & ~VMM_ADDRESS_MASK);
+
+        uint32_t* sourceTable = (uint32_t*)(source[i] & VMM_ADDRESS_MASK);
+        for (uint32_t j = 0; j < VMM_ENTRIES; j++) {
+            uint32_t entry = sourceTable[j];
+            uint32_t frame = entry & VMM_ADDRESS_MASK;
+            if (!(entry & VMM_PAGE_PRESENT))
+                continue;
+
+            if (frame == g_ZeroPage || pmm_ref_frame(frame)) {
+                if (entry & (VMM_PAGE_WRITE | VMM_PAGE_COW)) {
+                    entry = (entry & ~VMM_PAGE_WRITE) | VMM_PAGE_COW;
+                    sourceTable[j] = entry;
+                }
+                table[j] = entry;
+                g_CowStats.SharedPages++;
+                continue;
+            }
+
+            // Too many users of the frame already, this one gets a copy now
+            uint32_t copy = pmm_alloc_frame();
+            if (copy == 0) {
+                vmm_destroy_address_space((uint32_t)clone);
+                return 0;
+            }
+            memcpy((void*)copy, (void*)frame, VMM_PAGE_SIZE);
+            table[j] = copy | (entry & ~VMM_ADDRESS_MASK);
+        }
+    }
+
+    // The source lost its write permissions too
+    if (source == g_PageDirectory)
+        vmm_switch_address_space(directory);
+
+    return (uint32_t)clone;
+}
+
+// A write to a copy on write page: the last user takes the frame back, others copy it
+static bool vmm_cow_fault(uint32_t address)
+{
+    uint32_t page = address & VMM_ADDRESS_MASK;
+    uint32_t* pte = vmm_get_entry(page, false);
+    if (pte == NULL || (*pte & (VMM_PAGE_PRESENT | VMM_PAGE_COW)) != (VMM_PAGE_PRESENT | VMM_PAGE_COW))
+        return false;
+
+    uint32_t frame = *pte & VMM_ADDRESS_MASK;
+    uint32_t flags = (*pte & ~(VMM_ADDRESS_MASK | VMM_PAGE_COW)) | VMM_PAGE_WRITE;
+
+    if (frame != g_ZeroPage && pmm_get_frame_refs(frame) == 1) {
+        g_CowStats.ReclaimedPages++;
+        *pte = frame | flags;
+    } else {
+        uint32_t copy = pmm_alloc_frame();
+        if (copy == 0) {
+            log_err(MODULE, "Out of memory copying 0x%x", page);
+            return false;
+        }
+        memcpy((void*)copy, (void*)page, VMM_PAGE_SIZE);
+        if (frame != g_ZeroPage)
+            pmm_unref_frame(frame);
+
+        g_CowStats.CopiedPages++;
+        *pte = copy | flags;
+    }
+
+    vmm_invalidate(page);
+    return true;
+}
+
+void vmm_get_cow_stats(VmmCowStats* stats)
+{
+    *stats = g_CowStats;
+}
+
+bool vmm_map_device(uint32_t phys, uint32_t size)
+{
+    if (size == 0)
+        return false;
+
+    uint32_t first = phys / VMM_LARGE_PAGE_SIZE;
+    uint32_t last = (phys + size - 1) / VMM_LARGE_PAGE_SIZE;
+    if (last < first || first < (VMM_MAP_BASE + VMM_MAP_SIZE) / VMM_LARGE_PAGE_SIZE)
+        return false;
+    if (last >= VMM_USER_BASE / VMM_LARGE_PAGE_SIZE && first < VMM_USER_TOP / VMM_LARGE_PAGE_SIZE)
+        return false;
+
+    for (uint32_t index = first; index <= last; index++) {
+        bool known = false;
+        for (uint32_t i = 0; i < g_DevicePageCount; i++)
+            known |= g_DevicePages[i] == index;
+        if (known)
+            continue;
+        if (g_DevicePageCount == VMM_MAX_DEVICE_PAGES)
+            return false;
+
+        g_DevicePages[g_DevicePageCount++] = index;
+        if (g_KernelDirectory != NULL) {
+            g_KernelDirectory[index] = vmm_device_entry(index);
+            g_PageDirectory[index] = vmm_device_entry(index);
+            vmm_invalidate(index * VMM_LARGE_PAGE_SIZE);
+        }
+    }
+    return true;
+}
+
+static inline bool vmm_window_test(uint32_t page)
+{
+    return g_WindowBitmap[page / 32] & (1u << (page % 32));
+}
+
+uint32_t vmm_alloc_range(uint32_t pages)
+{
+    if (pages == 0 || pages > VMM_WINDOW_PAGES)
+        return 0;
+
+    // First fit, like the frame allocator
+    uint32_t run = 0;
+    for (uint32_t page = g_WindowSearch; page < VMM_WINDOW_PAGES; page++) {
+        if (vmm_window_test(page)) {
+            run = 0;
+            continue;
+        }
+
+        if (++run == pages) {
+            uint32_t first = page + 1 - pages;
+            for (uint32_t i = first; i <= page; i++)
+                g_WindowBitmap[i / 32] |= 1u << (i % 32);
+
+            if (first == g_WindowSearch)
+                g_WindowSearch = page + 1;
+            return VMM_MAP_BASE + first * VMM_PAGE_SIZE;
+        }
+    }
+
+    log_warn(MODULE, "Mapping window full allocating %u pages", pages);
+    return 0;
+}
+
+void vmm_free_range(uint32_t address, uint32_t pages)
+{
+    uint32_t first = (address - VMM_MAP_BASE) / VMM_PAGE_SIZE;
+
+    for (uint32_t i = first; i < first + pages && i < VMM_WINDOW_PAGES; i++)
+        g_WindowBitmap[i / 32] &= ~(1u << (i % 32));
+
+    if (first < g_WindowSearch)
+        g_WindowSearch = first;
+}
+
+void vmm_set_fault_handler(VmmFaultHandler handler)
+{
+    g_FaultHandler = handler;
+}
+
+bool vmm_handle_fault(uint32_t address, bool write)
+{
+    if (address < VMM_USER_BASE || address >= VMM_USER_TOP)
+        return false;
+    if (write && vmm_cow_fault(address))
+        return true;
+    return g_FaultHandler != NULL && g_FaultHandler(address, write);
+}
+
+uint32_t vmm_get_zero_page(void)
+{
+    if (g_ZeroPage == 0) {
+        g_ZeroPage = pmm_alloc_frame();
+        if (g_ZeroPage != 0)
+            memset((void*)g_ZeroPage, 0, VMM_PAGE_SIZE);
+    }
+    return g_ZeroPage;
+}
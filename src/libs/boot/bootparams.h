@@ -16,4 +16,5 @@ typedef struct  {
 typedef struct {
     MemoryInfo Memory;
     uint8_t BootDevice;
+    uint64_t LoaderStartTsc;        // time stamp counter when stage2 started
 } BootParams;
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+// Boot output profile, selected at build time with the bootProfile option.
+// FASTBOOT keeps only errors on the boot path; otherwise every step is traced.
+#ifdef FASTBOOT
+#define BOOT_VERBOSE    0
+#define BOOT_PROFILE    "fast"
+#else
+#define BOOT_VERBOSE    1
+#define BOOT_PROFILE    "verbose"
+#endif
+
+// Diagnostic output that is compiled out in the fast profile
+#define boot_trace(...) do { if (BOOT_VERBOSE) printf(__VA_ARGS__); } while (0)
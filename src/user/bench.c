@@ -0,0 +1,32 @@
+#include "ulib.h"
+#include <syscall.h>
+
+#define ITERATIONS  100000
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// Syscall round trip as seen from user mode, including the privilege switch
+int main(void)
+{
+    uint64_t start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        sys_getpid();
+    uint64_t slow = rdtsc() - start;
+
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++)
+        sys_fast_syscall(SYSCALL_GETPID, 0, 0, 0, 0);
+    uint64_t fast = rdtsc() - start;
+
+    uprint("int 0x80: ");
+    uprint_uint((uint32_t)(slow / ITERATIONS));
+    uprint(" cycles/call\nsysenter: ");
+    uprint_uint((uint32_t)(fast / ITERATIONS));
+    uprint(" cycles/call\n");
+    return 0;
+}
@@ -0,0 +1,18 @@
+bits 32
+
+section .text
+
+extern main
+global _start
+
+; The kernel starts programs at the top of their stack, with no arguments
+_start:
+    call main
+
+    ; exit(main())
+    mov ebx, eax
+    mov eax, 0
+    int 0x80
+
+.hang:
+    jmp .hang
@@ -0,0 +1,58 @@
+#include "ulib.h"
+#include <syscall.h>
+
+#define ITERATIONS  50
+#define DATA_SIZE   0x4000
+
+// Some written data, so the parent has pages for fork to share
+static char g_Data[DATA_SIZE];
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static void report(const char* what, uint64_t cycles)
+{
+    uprint(what);
+    uprint_uint((uint32_t)(cycles / ITERATIONS));
+    uprint(" cycles\n");
+}
+
+// fork followed by wait, and fork followed by exec of true.elf from the current directory
+int main(void)
+{
+    for (int i = 0; i < DATA_SIZE; i += 512)
+        g_Data[i] = (char)i;
+
+    int32_t status;
+    uint64_t start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++) {
+        int32_t pid = sys_fork();
+        if (pid == 0) {
+            g_Data[0]++;            // one page copied
+            sys_exit(0);
+        }
+        sys_wait(pid, &status);
+    }
+    report("fork+wait: ", rdtsc() - start);
+
+    start = rdtsc();
+    for (int i = 0; i < ITERATIONS; i++) {
+        int32_t pid = sys_fork();
+        if (pid == 0) {
+            int32_t child = sys_exec("true.elf");
+            sys_wait(child, &status);
+            sys_exit(child < 0 ? 1 : status);
+        }
+        sys_wait(pid, &status);
+        if (status != 0) {
+            uprint("exec of true.elf failed\n");
+            return 1;
+        }
+    }
+    report("fork+exec+wait: ", rdtsc() - start);
+    return 0;
+}
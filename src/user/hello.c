@@ -0,0 +1,10 @@
+#include "ulib.h"
+#include <syscall.h>
+
+int main(void)
+{
+    uprint("Hello from ring 3, pid ");
+    uprint_uint(sys_getpid());
+    uprint("\n");
+    return 0;
+}
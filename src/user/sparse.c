@@ -0,0 +1,48 @@
+#include "ulib.h"
+#include <syscall.h>
+
+#define TABLE_SIZE      (64 * 1024 * 1024)
+#define TABLE_STRIDE    (1024 * 1024)
+#define HEAP_GROWTH     (1024 * 1024)
+#define PAGE_SIZE       4096
+
+// A large mapping that is mostly never touched: only the written pages should
+// cost memory, the rest reads as zero through a single shared page
+int main(void)
+{
+    int32_t table = sys_mmap(-1, TABLE_SIZE, 0, MMAP_READ | MMAP_WRITE | MMAP_PRIVATE | MMAP_ANONYMOUS);
+    if (SYSCALL_FAILED(table)) {
+        uprint("mmap failed\n");
+        return 1;
+    }
+
+    uint32_t* words = (uint32_t*)table;
+    uint32_t written = 0;
+    for (uint32_t offset = 0; offset < TABLE_SIZE; offset += TABLE_STRIDE) {
+        words[offset / sizeof(uint32_t)] = offset;
+        written++;
+    }
+
+    // Pages in between were never written and must read back as zero
+    uint32_t nonzero = 0;
+    for (uint32_t offset = PAGE_SIZE; offset < TABLE_SIZE; offset += TABLE_STRIDE)
+        nonzero += words[offset / sizeof(uint32_t)] != 0;
+
+    int32_t heap = sys_sbrk(HEAP_GROWTH);
+    if (SYSCALL_FAILED(heap)) {
+        uprint("sbrk failed\n");
+        return 1;
+    }
+    char* bytes = (char*)heap;
+    bytes[0] = 1;
+    bytes[HEAP_GROWTH - 1] = 1;
+
+    uprint("64 MB mapped, ");
+    uprint_uint(written);
+    uprint(" pages written, ");
+    uprint_uint(nonzero);
+    uprint(" untouched pages not zero\n");
+
+    sys_munmap((void*)table);
+    return nonzero != 0;
+}
@@ -0,0 +1,5 @@
+// Does nothing, the smallest program to exec
+int main(void)
+{
+    return 0;
+}
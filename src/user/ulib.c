@@ -0,0 +1,21 @@
+#include "ulib.h"
+#include <syscall.h>
+
+void uprint(const char* str)
+{
+    sys_print(str);
+}
+
+void uprint_uint(uint32_t value)
+{
+    char buffer[11];
+    int i = sizeof(buffer) - 1;
+
+    buffer[i] = '\0';
+    do {
+        buffer[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    sys_print(&buffer[i]);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+// Small helpers shared by the programs, everything goes through the syscalls
+void uprint(const char* str);
+void uprint_uint(uint32_t value);